@@ -0,0 +1,48 @@
+//
+// AstroStdDlls.cpp
+// Loading and freeing the AstroStd DLLs, shared by the app and the tools
+//
+
+#include "AstroStdDlls.h"
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "services/TimeFuncDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/EnvConstDll.h"
+#include "wrappers/AstroFuncDll.h"
+#include "wrappers/TimeFuncDll.h"
+#include "wrappers/TleDll.h"
+#include "wrappers/Sgp4PropDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+// load dlls because AstroSTD is a mess and uses GetFnPtr wrappers
+void LoadAstroStdDlls()
+{
+    LoadDllMainDll();
+    LoadEnvConstDll();
+    LoadTimeFuncDll();
+    LoadAstroFuncDll();
+    LoadTleDll();
+    LoadSgp4PropDll();
+}
+
+// free
+void FreeAstroStdDlls()
+{
+    FreeDllMainDll();
+    FreeEnvConstDll();
+    FreeAstroFuncDll();
+    FreeTimeFuncDll();
+    FreeTleDll();
+    FreeSgp4PropDll();
+}
+
@@ -0,0 +1,13 @@
+//
+// AstroStdDlls.h
+// Loading and freeing the AstroStd DLLs, shared by the app and the tools
+//
+
+#ifndef ASTROSTDDLLS_H
+#define ASTROSTDDLLS_H
+
+// why is sgp4prop so awful
+void LoadAstroStdDlls();
+void FreeAstroStdDlls();
+
+#endif //ASTROSTDDLLS_H
@@ -0,0 +1,272 @@
+//
+// CatalogDiff.cpp
+// Matches two TLE catalogs by satellite number and flags element jumps between them
+//
+
+#include "CatalogDiff.h"
+#include "OrbitMath.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const double XKE = 0.0743669161;        // sqrt(GM) (er^1.5/min), WGS-72 as SGP4 uses it
+
+        double WrapDegrees(double angle)
+        {
+            angle = fmod(angle, 360.0);
+            if (angle > 180.0)
+                angle -= 360.0;
+            else if (angle < -180.0)
+                angle += 360.0;
+            return angle;
+        }
+
+        double Revolutions(double angle)
+        {
+            angle = fmod(angle, 360.0);
+            return angle < 0.0 ? angle + 360.0 : angle;
+        }
+
+        // Semi-major axis (km) of a mean motion (rev/day), Kozai as the TLE states it
+        double SemiMajorAxisKm(double meanMotion)
+        {
+            double n = meanMotion * TWO_PI / 1440.0;
+            return n > 0.0 ? EARTH_RADIUS * pow(XKE / n, 2.0 / 3.0) : 0.0;
+        }
+
+        // The best the catalog number field offers when the lines don't parse
+        int SatNumField(const std::string& line1)
+        {
+            return line1.size() >= 7 ? atoi(line1.substr(2, 5).c_str()) : 0;
+        }
+
+    }
+
+    bool CatalogDiff::ReadCatalog(const std::string& filePath, std::vector<CatalogEntry>& entries, std::string* error)
+    {
+        entries.clear();
+        FILE* fp = fopen(filePath.c_str(), "r");
+        if (!fp)
+        {
+            if (error)
+                *error = "Can't open " + filePath;
+            return false;
+        }
+
+        std::string previous;
+        char line[512];
+        while (fgets(line, sizeof(line), fp))
+        {
+            std::string text(line);
+            while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+                text.pop_back();
+
+            if (text.size() > 1 && text[0] == '2' && text[1] == ' ' && previous.size() > 1 && previous[0] == '1' &&
+                previous[1] == ' ')
+            {
+                CatalogEntry& entry = entries.emplace_back();
+                entry.line1 = std::move(previous);
+                entry.line2 = std::move(text);
+                entry.parsed = ParseTle(entry.line1, entry.line2, entry.elements);
+                if (!entry.parsed)
+                    entry.elements.satNum = SatNumField(entry.line1);
+                previous.clear();
+            }
+            else
+                previous = std::move(text);
+        }
+        fclose(fp);
+        return true;
+    }
+
+    CatalogDiffResult CatalogDiff::Compare(const std::vector<CatalogEntry>& previous,
+                                           const std::vector<CatalogEntry>& current,
+                                           const ManeuverThresholds& thresholds, int numThreads)
+    {
+        auto start = std::chrono::steady_clock::now();
+        CatalogDiffResult result;
+
+        std::unordered_map<int, int> previousBySatNum;
+        previousBySatNum.reserve(previous.size());
+        for (size_t i = 0; i < previous.size(); i++)
+            previousBySatNum.emplace(previous[i].elements.satNum, (int)i);
+
+        std::vector<char> matched(previous.size(), 0);
+        result.carryOver.assign(current.size(), -1);
+        result.changes.resize(current.size());
+        for (size_t i = 0; i < current.size(); i++)
+        {
+            CatalogChangeRecord& record = result.changes[i];
+            record.satNum = current[i].elements.satNum;
+            record.currentIndex = (int)i;
+
+            auto found = previousBySatNum.find(record.satNum);
+            if (found == previousBySatNum.end())
+            {
+                record.change = CHANGE_NEW;
+                continue;
+            }
+            record.previousIndex = found->second;
+            matched[found->second] = 1;
+
+            const CatalogEntry& before = previous[found->second];
+            if (before.line1 == current[i].line1 && before.line2 == current[i].line2)
+            {
+                record.change = CHANGE_UNCHANGED;
+                result.carryOver[i] = found->second;
+            }
+            else
+                record.change = CHANGE_UPDATED;
+        }
+
+        // the predictions are the only real work, even shares of the current catalog
+        auto run = [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                CatalogChangeRecord& record = result.changes[i];
+                if (record.change != CHANGE_UPDATED)
+                    continue;
+                const CatalogEntry& before = previous[record.previousIndex];
+                const CatalogEntry& after = current[i];
+                if (!before.parsed || !after.parsed)
+                    record.residuals.jumps = JUMP_MALFORMED;
+                else
+                    record.residuals = Residuals(before.elements, after.elements, thresholds);
+            }
+        };
+
+        size_t threads = std::min<size_t>(std::max(1, numThreads), current.size());
+        if (threads <= 1)
+            run(0, current.size());
+        else
+        {
+            std::vector<std::thread> workers;
+            size_t chunk = (current.size() + threads - 1) / threads;
+            for (size_t w = 1; w < threads; w++)
+            {
+                size_t begin = std::min(current.size(), w * chunk);
+                workers.emplace_back(run, begin, std::min(current.size(), begin + chunk));
+            }
+            run(0, std::min(current.size(), chunk));
+            for (auto& worker : workers)
+                worker.join();
+        }
+
+        for (size_t i = 0; i < previous.size(); i++)
+        {
+            // a repeated satellite number only ever matches its first entry
+            if (matched[i] || previousBySatNum.at(previous[i].elements.satNum) != (int)i)
+                continue;
+            CatalogChangeRecord& record = result.changes.emplace_back();
+            record.satNum = previous[i].elements.satNum;
+            record.change = CHANGE_REMOVED;
+            record.previousIndex = (int)i;
+        }
+
+        for (const CatalogChangeRecord& record : result.changes)
+        {
+            result.counts[record.change]++;
+            if (record.Flagged())
+                result.flagged++;
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    TleElements CatalogDiff::Predict(const TleElements& elements, double days)
+    {
+        TleElements predicted = elements;
+        TleSecularRates rates = Sgp4SecularRates(elements);
+        double minutes = days * 1440.0;
+
+        // drag as the TLE's derivatives state it: n' t and n'' t^2 / 2, over 2 and 6 already
+        double t2 = days * days;
+        predicted.meanMotion = elements.meanMotion + 2.0 * elements.nDot * days + 3.0 * elements.nDotDot * t2;
+        predicted.meanAnomaly = Revolutions(elements.meanAnomaly + rates.meanAnomaly * minutes * RAD2DEG +
+                                            360.0 * (elements.nDot * t2 + elements.nDotDot * t2 * days));
+        predicted.argPerigee = Revolutions(elements.argPerigee + rates.argPerigee * minutes * RAD2DEG);
+        predicted.raan = Revolutions(elements.raan + rates.raan * minutes * RAD2DEG);
+        predicted.revNum = elements.revNum + (int)floor(elements.meanMotion * days);
+        predicted.epochDay = elements.epochDay + days;
+        return predicted;
+    }
+
+    ElementResiduals CatalogDiff::Residuals(const TleElements& previous, const TleElements& current,
+                                            const ManeuverThresholds& thresholds)
+    {
+        ElementResiduals residuals;
+        residuals.days = TleEpochDs50UTC(current) - TleEpochDs50UTC(previous);
+        TleElements predicted = Predict(previous, residuals.days);
+
+        double sma = SemiMajorAxisKm(current.meanMotion);
+        residuals.smaKm = sma - SemiMajorAxisKm(predicted.meanMotion);
+        residuals.eccentricity = current.eccentricity - predicted.eccentricity;
+        residuals.inclinationDeg = current.inclination - predicted.inclination;
+        residuals.raanDeg = WrapDegrees(current.raan - predicted.raan);
+
+        // argument of latitude, plus the node's share of it, stays defined on circular orbits
+        // where perigee and mean anomaly trade off freely
+        double sinInc = sin(current.inclination * DEG2RAD);
+        double cosInc = cos(current.inclination * DEG2RAD);
+        double latitude = WrapDegrees(current.meanAnomaly + current.argPerigee -
+                                      predicted.meanAnomaly - predicted.argPerigee);
+        residuals.alongTrackKm = sma * (latitude + residuals.raanDeg * cosInc) * DEG2RAD;
+
+        double days = fabs(residuals.days);
+        auto check = [&](double residual, double allowed, unsigned bit)
+        {
+            double ratio = fabs(residual) / std::max(allowed, 1e-12);
+            residuals.score = std::max(residuals.score, ratio);
+            if (ratio > 1.0)
+                residuals.jumps |= bit;
+        };
+        check(residuals.smaKm, thresholds.smaKm + thresholds.smaKmPerDay * days, JUMP_SMA);
+        check(residuals.eccentricity, thresholds.eccentricity + thresholds.eccentricityPerDay * days, JUMP_ECCENTRICITY);
+        check(residuals.inclinationDeg, thresholds.inclinationDeg + thresholds.inclinationDegPerDay * days,
+              JUMP_INCLINATION);
+        check(residuals.raanDeg * sinInc, thresholds.raanDeg + thresholds.raanDegPerDay * days, JUMP_RAAN);
+        check(residuals.alongTrackKm, thresholds.alongTrackKm + thresholds.alongTrackKmPerDay * days +
+              thresholds.alongTrackKmPerDay2 * days * days, JUMP_ALONG_TRACK);
+
+        if (residuals.days < 0.0)
+            residuals.jumps |= JUMP_EPOCH;
+        return residuals;
+    }
+
+    const char* CatalogDiff::ChangeName(CatalogChange change)
+    {
+        switch (change)
+        {
+            case CHANGE_UNCHANGED: return "unchanged";
+            case CHANGE_NEW: return "new";
+            case CHANGE_REMOVED: return "removed";
+            case CHANGE_UPDATED: return "updated";
+            default: return "unknown";
+        }
+    }
+
+    std::string CatalogDiff::JumpNames(unsigned jumps)
+    {
+        static const char* names[] = {"sma", "eccentricity", "inclination", "raan", "along_track", "epoch", "malformed"};
+        std::string text;
+        for (int bit = 0; bit < (int)(sizeof(names) / sizeof(names[0])); bit++)
+        {
+            if (!(jumps & (1u << bit)))
+                continue;
+            if (!text.empty())
+                text += ',';
+            text += names[bit];
+        }
+        return text;
+    }
+
+} // SGP_IMPL
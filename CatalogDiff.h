@@ -0,0 +1,137 @@
+//
+// CatalogDiff.h
+// Matches two TLE catalogs by satellite number and flags element jumps between them
+//
+
+#ifndef CATALOGDIFF_H
+#define CATALOGDIFF_H
+
+#include <string>
+#include <vector>
+#include "TleUtil.h"
+
+namespace SGP_IMPL {
+
+    // One TLE line pair of a catalog file, in file order
+    struct CatalogEntry
+    {
+        std::string line1;
+        std::string line2;
+        TleElements elements;
+        bool parsed = false;            // false when ParseTle rejected the lines
+    };
+
+    enum CatalogChange
+    {
+        CHANGE_UNCHANGED = 0,           // identical lines
+        CHANGE_NEW,                     // only in the current catalog
+        CHANGE_REMOVED,                 // only in the previous catalog
+        CHANGE_UPDATED,                 // a different element set for the same satellite
+        NUM_CATALOG_CHANGES
+    };
+
+    // Why an update was flagged, combined as bits
+    enum ElementJump
+    {
+        JUMP_SMA = 1 << 0,
+        JUMP_ECCENTRICITY = 1 << 1,
+        JUMP_INCLINATION = 1 << 2,
+        JUMP_RAAN = 1 << 3,
+        JUMP_ALONG_TRACK = 1 << 4,
+        JUMP_EPOCH = 1 << 5,            // the update is older than what it replaces
+        JUMP_MALFORMED = 1 << 6,        // either element set doesn't parse
+    };
+
+    // Allowed |update - prediction| is base + perDay * days between the epochs; the along
+    // track allowance also grows with days squared, a drag error integrates twice. Defaults
+    // pass the day to day noise of routine element sets and catch station keeping burns.
+    struct ManeuverThresholds
+    {
+        double smaKm = 0.5;
+        double smaKmPerDay = 0.2;
+        double eccentricity = 2e-4;
+        double eccentricityPerDay = 5e-5;
+        double inclinationDeg = 0.01;
+        double inclinationDegPerDay = 0.003;
+        double raanDeg = 0.02;          // measured as the node shift times sin(inclination)
+        double raanDegPerDay = 0.01;
+        double alongTrackKm = 10.0;
+        double alongTrackKmPerDay = 5.0;
+        double alongTrackKmPerDay2 = 1.0;
+    };
+
+    // Update minus the previous element set carried to the update's epoch
+    struct ElementResiduals
+    {
+        double days = 0.0;              // between the epochs
+        double smaKm = 0.0;
+        double eccentricity = 0.0;
+        double inclinationDeg = 0.0;
+        double raanDeg = 0.0;           // node shift, not scaled
+        double alongTrackKm = 0.0;
+        double score = 0.0;             // largest residual over its allowance, above 1 is flagged
+        unsigned jumps = 0;             // ElementJump bits
+    };
+
+    struct CatalogChangeRecord
+    {
+        int satNum = 0;
+        CatalogChange change = CHANGE_UNCHANGED;
+        int previousIndex = -1;         // into the previous catalog, -1 for new satellites
+        int currentIndex = -1;          // into the current catalog, -1 for removed satellites
+        ElementResiduals residuals;     // updates only
+
+        bool Flagged() const { return residuals.jumps != 0; }
+    };
+
+    struct CatalogDiffResult
+    {
+        // Current catalog order, then the removed satellites in previous catalog order
+        std::vector<CatalogChangeRecord> changes;
+        int counts[NUM_CATALOG_CHANGES] = {};
+        int flagged = 0;
+
+        // Per current entry, the previous entry with the same lines or -1: the satellites
+        // whose earlier results can be carried over instead of propagated again
+        std::vector<int> carryOver;
+        double seconds = 0.0;
+    };
+
+    // New catalogs arrive several times a day and mostly repeat the last one. The diff
+    // matches them by satellite number (the first entry wins when a catalog repeats one),
+    // so only new and updated satellites need propagating, and checks every update against
+    // the previous element set carried forward with SGP4's secular J2/J4 rates and the TLE's
+    // mean motion derivatives. Updates that land farther away than the thresholds allow are
+    // flagged: a maneuver or a bad element set, telling them apart is left to the reader.
+    //
+    // SGP4's periodic terms and bstar drag are left out, the thresholds absorb them; deep
+    // space objects get the same near earth rates, which are fine over days.
+    class CatalogDiff
+    {
+    public:
+        // Every line 1 / line 2 pair of the file, pairs are found as the pipeline finds them
+        static bool ReadCatalog(const std::string& filePath, std::vector<CatalogEntry>& entries,
+                                std::string* error = nullptr);
+
+        // The match runs on one thread, the predictions on numThreads
+        static CatalogDiffResult Compare(const std::vector<CatalogEntry>& previous,
+                                         const std::vector<CatalogEntry>& current,
+                                         const ManeuverThresholds& thresholds = ManeuverThresholds(),
+                                         int numThreads = 1);
+
+        // The element set's mean elements days after its epoch. epochDay moves by the same
+        // amount and can run past the end of the year, TleEpochDs50UTC still reads it right.
+        static TleElements Predict(const TleElements& elements, double days);
+
+        static ElementResiduals Residuals(const TleElements& previous, const TleElements& current,
+                                          const ManeuverThresholds& thresholds);
+
+        static const char* ChangeName(CatalogChange change);
+
+        // Comma separated names of the jump bits, e.g. "sma,along_track"
+        static std::string JumpNames(unsigned jumps);
+    };
+
+} // SGP_IMPL
+
+#endif //CATALOGDIFF_H
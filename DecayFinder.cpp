@@ -0,0 +1,255 @@
+//
+// DecayFinder.cpp
+// First crossing of a reentry altitude by every satellite of a catalog
+//
+
+#include "DecayFinder.h"
+#include "OrbitMath.h"
+#include "RootFinder.h"
+#include "ScratchTable.h"
+#include "WorkScheduler.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "services/TimeFuncDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/Sgp4PropDll.h"
+#include "wrappers/TimeFuncDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const double MIN_PERIOD = 10.0;         // minutes, bounds the step of a collapsing orbit
+        const double UNBOUND_PERIOD = 1440.0;   // minutes, steps hyperbolic states a day apart
+        const double MIN_SECONDS = 1.0;         // time resolution of a minimum
+
+        // Height above the altitude at one time; failures count as the ground
+        struct Point
+        {
+            double t = 0.0;                     // days from the search start
+            double f = 0.0;                     // km
+            bool failed = false;
+        };
+
+        struct Track
+        {
+            __int64 satKey = 0;
+            double start = 0.0;
+            double altitude = 0.0;
+            int evaluations = 0;
+
+            // periodMin and llh are only set for points that propagated
+            Point At(double t, double* periodMin = nullptr, double llh[3] = nullptr)
+            {
+                double mse, pos[3], vel[3], where[3];
+                Point point;
+                point.t = t;
+                evaluations++;
+                if (Sgp4PropDs50UTC(satKey, start + t, &mse, pos, vel, where) != 0)
+                {
+                    point.f = std::min(-altitude, -1.0);
+                    point.failed = true;
+                    return point;
+                }
+                point.f = where[2] - altitude;
+                if (periodMin)
+                {
+                    double r = sqrt(pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2]);
+                    double v2 = vel[0] * vel[0] + vel[1] * vel[1] + vel[2] * vel[2];
+                    double inverseA = 2.0 / r - v2 / MU_EARTH;
+                    *periodMin = inverseA > 0.0 ? TWO_PI * sqrt(1.0 / (MU_EARTH * inverseA * inverseA * inverseA)) / 60.0
+                                                : UNBOUND_PERIOD;
+                }
+                if (llh)
+                    std::copy(where, where + 3, llh);
+                return point;
+            }
+        };
+
+        void Finish(Track& track, Point above, Point below, const DecayOptions& options, DecayPrediction& prediction)
+        {
+            double llh[3] = {};
+            BrentBracket([&](double t) { return track.At(t); }, above, below, options.toleranceSeconds / 86400.0);
+            track.At(above.t, nullptr, llh);
+            prediction.status = below.failed ? DECAY_PROPAGATION_ERROR : DECAY_CROSSING;
+            prediction.ds50UTC = track.start + above.t;
+            prediction.altitudeKm = llh[2];
+            prediction.latitude = llh[0];
+            prediction.longitude = llh[1];
+            if (below.failed)
+                prediction.error = "SGP4 fails from here on";
+        }
+
+    } // namespace
+
+    DecayPrediction DecayFinder::FindOne(__int64 satKey, double startTime, const DecayOptions& options)
+    {
+        DecayPrediction prediction;
+        Track track;
+        track.satKey = satKey;
+        track.start = startTime;
+        track.altitude = options.altitudeKm;
+
+        double period = 0.0;
+        double llh[3] = {};
+        Point previous = track.At(0.0, &period, llh);
+        if (previous.failed || previous.f < 0.0)
+        {
+            prediction.status = previous.failed ? DECAY_PROPAGATION_ERROR : DECAY_BELOW_AT_START;
+            prediction.ds50UTC = startTime;
+            prediction.altitudeKm = llh[2];
+            prediction.latitude = llh[0];
+            prediction.longitude = llh[1];
+            if (previous.failed)
+                prediction.error = "SGP4 fails at the start";
+            prediction.evaluations = track.evaluations;
+            return prediction;
+        }
+
+        prediction.status = DECAY_NONE;
+        prediction.ds50UTC = startTime + options.horizonDays;
+        prediction.altitudeKm = previous.f + options.altitudeKm;
+
+        int stepsPerOrbit = std::max(1, options.stepsPerOrbit);
+        double minTol = MIN_SECONDS / 86400.0;
+        Point beforePrevious;
+        bool haveBefore = false;
+        while (previous.t < options.horizonDays)
+        {
+            double step = std::max(period, MIN_PERIOD) / stepsPerOrbit / 1440.0;
+            Point next = track.At(std::min(previous.t + step, options.horizonDays), &period);
+            if (next.f < 0.0)
+            {
+                Finish(track, previous, next, options, prediction);
+                break;
+            }
+            prediction.altitudeKm = std::min(prediction.altitudeKm, next.f + options.altitudeKm);
+
+            // a sampled perigee close enough that the true one may dip under
+            if (haveBefore && previous.f <= beforePrevious.f && previous.f <= next.f && previous.f < options.marginKm)
+            {
+                Point lowest = BrentMinimum<Point>([&](double t) { return track.At(t); }, beforePrevious.t, next.t,
+                                                   minTol, 0.0);
+                if (lowest.f < 0.0)
+                {
+                    Finish(track, beforePrevious, lowest, options, prediction);
+                    break;
+                }
+                prediction.altitudeKm = std::min(prediction.altitudeKm, lowest.f + options.altitudeKm);
+            }
+            beforePrevious = previous;
+            previous = next;
+            haveBefore = true;
+        }
+        prediction.evaluations = track.evaluations;
+        return prediction;
+    }
+
+    DecayReport DecayFinder::Find(const std::vector<TleElements>& catalog, double startTime, const DecayOptions& options)
+    {
+        auto start = std::chrono::steady_clock::now();
+        DecayReport report;
+        report.predictions.resize(catalog.size());
+
+        ScratchTable table;
+        std::vector<const TleElements*> sets;
+        std::vector<SatelliteCost> costs;
+        for (size_t chunk = 0; chunk < catalog.size(); chunk += ScratchTable::MAX_SETS)
+        {
+            size_t chunkEnd = std::min(catalog.size(), chunk + (size_t)ScratchTable::MAX_SETS);
+            sets.clear();
+            for (size_t i = chunk; i < chunkEnd; i++)
+                sets.push_back(&catalog[i]);
+            table.Fill(sets);
+
+            // decaying satellites end their search early, the cost model knows which
+            costs.assign(chunkEnd - chunk, SatelliteCost());
+            for (size_t i = chunk; i < chunkEnd; i++)
+            {
+                DecayPrediction& prediction = report.predictions[i];
+                prediction.satNum = catalog[i].satNum;
+                if (table.Key(i - chunk) <= 0)
+                {
+                    prediction.error = table.Error(i - chunk);
+                    continue;
+                }
+                double from = startTime > 0.0 ? startTime : TleEpochDs50UTC(catalog[i]);
+                double step = TlePeriodMinutes(catalog[i]) / std::max(1, options.stepsPerOrbit);
+                costs[i - chunk] = CostModel::Estimate(catalog[i], from, from + options.horizonDays, step);
+                costs[i - chunk].cost = std::max(costs[i - chunk].cost, 1.0);
+            }
+
+            WorkScheduler::Run(WorkScheduler::Order(costs), options.numThreads, [&](int index)
+            {
+                size_t i = chunk + index;
+                double from = startTime > 0.0 ? startTime : TleEpochDs50UTC(catalog[i]);
+                int satNum = report.predictions[i].satNum;
+                report.predictions[i] = FindOne(table.Key(index), from, options);
+                report.predictions[i].satNum = satNum;
+            });
+        }
+        table.Clear();
+
+        for (const DecayPrediction& prediction : report.predictions)
+        {
+            report.counts[prediction.status]++;
+            report.evaluations += prediction.evaluations;
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    bool DecayFinder::WriteReport(const std::string& filePath, const DecayReport& report, std::string* error)
+    {
+        FILE* fp = fopen(filePath.c_str(), "w");
+        if (!fp)
+        {
+            if (error)
+                *error = "Can't create " + filePath;
+            return false;
+        }
+        for (const DecayPrediction& prediction : report.predictions)
+        {
+            if (prediction.status == DECAY_INIT_FAILED)
+            {
+                fprintf(fp, "%05d %-17s %s\n", prediction.satNum, StatusName(prediction.status), prediction.error.c_str());
+                continue;
+            }
+            fprintf(fp, "%05d %-17s %17.8f %s %10.3f %9.4f %9.4f\n", prediction.satNum, StatusName(prediction.status),
+                    prediction.ds50UTC, UTCToDtg20Str(prediction.ds50UTC), prediction.altitudeKm,
+                    prediction.latitude, prediction.longitude);
+        }
+        bool written = fclose(fp) == 0;
+        if (!written && error)
+            *error = "Can't write " + filePath;
+        return written;
+    }
+
+    const char* DecayFinder::StatusName(DecayStatus status)
+    {
+        switch (status)
+        {
+        case DECAY_NONE: return "none";
+        case DECAY_CROSSING: return "crossing";
+        case DECAY_BELOW_AT_START: return "below_at_start";
+        case DECAY_PROPAGATION_ERROR: return "propagation_error";
+        case DECAY_INIT_FAILED: return "init_failed";
+        default: return "unknown";
+        }
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,82 @@
+//
+// DecayFinder.h
+// First crossing of a reentry altitude by every satellite of a catalog
+//
+
+#ifndef DECAYFINDER_H
+#define DECAYFINDER_H
+
+#include <string>
+#include <vector>
+#include "TleUtil.h"
+
+namespace SGP_IMPL {
+
+    struct DecayOptions
+    {
+        double altitudeKm = 100.0;      // height above the ellipsoid, as Sgp4PropDs50UTC gives it
+        double horizonDays = 30.0;      // searched from the start time on
+        int stepsPerOrbit = 12;         // coarse samples per osculating period
+        double marginKm = 50.0;         // sampled minima within this of the altitude are refined
+        double toleranceSeconds = 1e-3;
+        int numThreads = 1;
+    };
+
+    enum DecayStatus
+    {
+        DECAY_NONE = 0,                 // stays above the altitude over the horizon
+        DECAY_CROSSING,
+        DECAY_BELOW_AT_START,
+        DECAY_PROPAGATION_ERROR,        // SGP4 gives up before the altitude, the time is where
+        DECAY_INIT_FAILED,
+        NUM_DECAY_STATUSES
+    };
+
+    struct DecayPrediction
+    {
+        int satNum = 0;
+        DecayStatus status = DECAY_INIT_FAILED;
+        double ds50UTC = 0.0;           // crossing, or the end of the horizon
+        double altitudeKm = 0.0;        // at the crossing, or the lowest sampled
+        double latitude = 0.0;          // deg, at the crossing
+        double longitude = 0.0;         // deg
+        int evaluations = 0;            // Sgp4PropDs50UTC calls
+        std::string error;
+    };
+
+    struct DecayReport
+    {
+        std::vector<DecayPrediction> predictions;   // catalog order
+        int counts[NUM_DECAY_STATUSES] = {};
+        long long evaluations = 0;
+        double seconds = 0.0;
+    };
+
+    // Stepping a catalog at a fine step to see when it reenters costs a propagation per
+    // step per satellite. The finder samples each satellite a few times per orbit instead,
+    // the step following its osculating period as the orbit shrinks. A sample below the
+    // altitude brackets the crossing with the one before; a sampled perigee that comes
+    // within marginKm is refined by Brent's minimization first, so a crossing between
+    // samples isn't missed. Brackets are closed by Brent's root finder to toleranceSeconds.
+    // Times SGP4 fails at count as below the altitude, so decay errors bracket like a
+    // crossing and end as DECAY_PROPAGATION_ERROR at the last time it still propagates.
+    class DecayFinder
+    {
+    public:
+        // start in ds50UTC, or 0 for each set's own epoch. The catalog goes in ScratchTable
+        // batches and is searched on numThreads, so this can't run alongside a job.
+        static DecayReport Find(const std::vector<TleElements>& catalog, double startTime = 0.0,
+                                const DecayOptions& options = DecayOptions());
+
+        // One satellite already initialized in SGP4
+        static DecayPrediction FindOne(__int64 satKey, double startTime, const DecayOptions& options = DecayOptions());
+
+        // One line per prediction: number, status, ds50UTC, date, altitude, latitude, longitude
+        static bool WriteReport(const std::string& filePath, const DecayReport& report, std::string* error = nullptr);
+
+        static const char* StatusName(DecayStatus status);
+    };
+
+} // SGP_IMPL
+
+#endif //DECAYFINDER_H
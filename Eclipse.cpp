@@ -0,0 +1,424 @@
+//
+// Eclipse.cpp
+// Earth shadow state of every propagated step, with transition times between steps
+//
+
+#include "Eclipse.h"
+#include "EphemerisQuery.h"
+#include "OrbitMath.h"
+#include "RootFinder.h"
+#include "WorkScheduler.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ECLIPSE_SSE2
+#include <emmintrin.h>
+#endif
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "services/TimeFuncDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/TimeFuncDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const double MIN_SUN_STEP = 1.0;        // minutes between Sun nodes
+        const double MAX_SUN_STEP = 60.0;
+        const double NODE_EPSILON = 1e-6;       // of a node step, times this close are on the node
+
+        enum Column
+        {
+            COL_X = 0, COL_Y, COL_Z,
+            COL_SUN_X, COL_SUN_Y, COL_SUN_Z,
+            COL_PENUMBRA_RADIUS, COL_PENUMBRA_SLOPE, COL_UMBRA_RADIUS, COL_UMBRA_SLOPE,
+            COL_PENUMBRA, COL_UMBRA,
+            NUM_COLUMNS
+        };
+
+        // Distance off the shadow axis against each cone's radius there; only points
+        // behind Earth are measured along the axis, so the values stay continuous
+        inline void ShadowValues(double x, double y, double z, double sunX, double sunY, double sunZ,
+                                 double penumbraRadius, double penumbraSlope, double umbraRadius,
+                                 double umbraSlope, double& penumbra, double& umbra)
+        {
+            double r2 = x * x + y * y + z * z;
+            double behind = std::max(0.0, -(x * sunX + y * sunY + z * sunZ));
+            double offAxis = sqrt(std::max(0.0, r2 - behind * behind));
+            penumbra = offAxis - (penumbraRadius + behind * penumbraSlope);
+            umbra = offAxis - (umbraRadius - behind * umbraSlope);
+        }
+
+        inline ShadowState StateOf(bool inPenumbra, bool inUmbra)
+        {
+            return (ShadowState)((int)inPenumbra + (int)inUmbra);
+        }
+
+        // One shadow function inside a step
+        struct Point
+        {
+            double t = 0.0;                     // days from the start of the step
+            double f = 0.0;                     // km
+        };
+
+        struct Crossing
+        {
+            double t = 0.0;
+            bool umbra = false;                 // which cone
+        };
+
+    } // namespace
+
+    ShadowGeometry ShadowGeometry::At(double ds50UTC, ShadowModel model)
+    {
+        ShadowGeometry geometry;
+        double sun[3];
+        SunPositionKm(ds50UTC, sun);
+        double distance = sqrt(sun[0] * sun[0] + sun[1] * sun[1] + sun[2] * sun[2]);
+        for (int k = 0; k < 3; k++)
+            geometry.sun[k] = sun[k] / distance;
+
+        if (model == SHADOW_CYLINDRICAL)
+        {
+            geometry.penumbraRadius = EARTH_RADIUS;
+            geometry.umbraRadius = EARTH_RADIUS;
+            return geometry;
+        }
+        double sinPenumbra = (SUN_RADIUS + EARTH_RADIUS) / distance;
+        double cosPenumbra = sqrt(1.0 - sinPenumbra * sinPenumbra);
+        double sinUmbra = (SUN_RADIUS - EARTH_RADIUS) / distance;
+        double cosUmbra = sqrt(1.0 - sinUmbra * sinUmbra);
+        geometry.penumbraRadius = EARTH_RADIUS / cosPenumbra;
+        geometry.penumbraSlope = sinPenumbra / cosPenumbra;
+        geometry.umbraRadius = EARTH_RADIUS / cosUmbra;
+        geometry.umbraSlope = sinUmbra / cosUmbra;
+        return geometry;
+    }
+
+    void SolarEphemeris::Build(double first, double last, double stepMinutes, ShadowModel model)
+    {
+        m_first = std::min(first, last);
+        m_step = std::max(fabs(stepMinutes), MIN_SUN_STEP) / 1440.0;
+        m_slack = NODE_EPSILON * m_step;
+        m_size = (size_t)floor(fabs(last - first) / m_step) + 2;
+        m_columns.resize(NUM_FIELDS * m_size);
+        for (size_t i = 0; i < m_size; i++)
+        {
+            ShadowGeometry geometry = ShadowGeometry::At(m_first + i * m_step, model);
+            m_columns[SUN_X * m_size + i] = geometry.sun[0];
+            m_columns[SUN_Y * m_size + i] = geometry.sun[1];
+            m_columns[SUN_Z * m_size + i] = geometry.sun[2];
+            m_columns[PENUMBRA_RADIUS * m_size + i] = geometry.penumbraRadius;
+            m_columns[PENUMBRA_SLOPE * m_size + i] = geometry.penumbraSlope;
+            m_columns[UMBRA_RADIUS * m_size + i] = geometry.umbraRadius;
+            m_columns[UMBRA_SLOPE * m_size + i] = geometry.umbraSlope;
+        }
+    }
+
+    long SolarEphemeris::Node(double ds50UTC) const
+    {
+        if (m_size == 0)
+            return -1;
+        double node = floor((ds50UTC - m_first) / m_step + 0.5);
+        if (node < 0.0 || node >= (double)m_size || !OnNode(ds50UTC, (long)node))
+            return -1;
+        return (long)node;
+    }
+
+    void SolarEphemeris::Geometry(double ds50UTC, ShadowGeometry& geometry) const
+    {
+        if (m_size < 2)
+        {
+            geometry = ShadowGeometry();
+            return;
+        }
+        double u = (ds50UTC - m_first) / m_step;
+        size_t k = u <= 0.0 ? 0 : std::min(m_size - 2, (size_t)u);
+        double f = u - (double)k;
+        auto value = [&](Field field)
+        {
+            const double* column = Column(field);
+            return column[k] + f * (column[k + 1] - column[k]);
+        };
+
+        double norm = 0.0;
+        for (int i = 0; i < 3; i++)
+        {
+            geometry.sun[i] = value((Field)(SUN_X + i));
+            norm += geometry.sun[i] * geometry.sun[i];
+        }
+        norm = sqrt(norm);
+        for (int i = 0; i < 3; i++)
+            geometry.sun[i] /= norm;
+        geometry.penumbraRadius = value(PENUMBRA_RADIUS);
+        geometry.penumbraSlope = value(PENUMBRA_SLOPE);
+        geometry.umbraRadius = value(UMBRA_RADIUS);
+        geometry.umbraSlope = value(UMBRA_SLOPE);
+    }
+
+    void Eclipse::Classify(const double* x, const double* y, const double* z, const double* sunX,
+                           const double* sunY, const double* sunZ, const double* penumbraRadius,
+                           const double* penumbraSlope, const double* umbraRadius, const double* umbraSlope,
+                           size_t count, double* penumbra, double* umbra, uint8_t* states)
+    {
+        size_t i = 0;
+#ifdef ECLIPSE_SSE2
+        const __m128d zero = _mm_setzero_pd();
+        for (; i + 2 <= count; i += 2)
+        {
+            __m128d px = _mm_loadu_pd(x + i);
+            __m128d py = _mm_loadu_pd(y + i);
+            __m128d pz = _mm_loadu_pd(z + i);
+            __m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(px, px), _mm_mul_pd(py, py)), _mm_mul_pd(pz, pz));
+            __m128d dot = _mm_add_pd(_mm_add_pd(_mm_mul_pd(px, _mm_loadu_pd(sunX + i)),
+                                                _mm_mul_pd(py, _mm_loadu_pd(sunY + i))),
+                                     _mm_mul_pd(pz, _mm_loadu_pd(sunZ + i)));
+            __m128d behind = _mm_max_pd(zero, _mm_sub_pd(zero, dot));
+            __m128d offAxis = _mm_sqrt_pd(_mm_max_pd(zero, _mm_sub_pd(r2, _mm_mul_pd(behind, behind))));
+            __m128d pen = _mm_sub_pd(offAxis, _mm_add_pd(_mm_loadu_pd(penumbraRadius + i),
+                                                         _mm_mul_pd(behind, _mm_loadu_pd(penumbraSlope + i))));
+            __m128d umb = _mm_sub_pd(offAxis, _mm_sub_pd(_mm_loadu_pd(umbraRadius + i),
+                                                         _mm_mul_pd(behind, _mm_loadu_pd(umbraSlope + i))));
+            _mm_storeu_pd(penumbra + i, pen);
+            _mm_storeu_pd(umbra + i, umb);
+            if (states)
+            {
+                int inPenumbra = _mm_movemask_pd(_mm_cmplt_pd(pen, zero));
+                int inUmbra = _mm_movemask_pd(_mm_cmplt_pd(umb, zero));
+                states[i] = (uint8_t)((inPenumbra & 1) + (inUmbra & 1));
+                states[i + 1] = (uint8_t)((inPenumbra >> 1) + (inUmbra >> 1));
+            }
+        }
+#endif
+        for (; i < count; i++)
+        {
+            ShadowValues(x[i], y[i], z[i], sunX[i], sunY[i], sunZ[i], penumbraRadius[i], penumbraSlope[i],
+                         umbraRadius[i], umbraSlope[i], penumbra[i], umbra[i]);
+            if (states)
+                states[i] = StateOf(penumbra[i] < 0.0, umbra[i] < 0.0);
+        }
+    }
+
+    EclipseReport Eclipse::Run(const PropagationResults& results, const EclipseOptions& options)
+    {
+        auto start = std::chrono::steady_clock::now();
+        EclipseReport report;
+        size_t numSatellites = results.satellites.size();
+        report.satellites.resize(numSatellites);
+
+        // each satellite's span, and the job's span and step for the Sun table
+        std::vector<size_t> spans(numSatellites, 0);
+        double first = DBL_MAX, last = -DBL_MAX, stepSize = 0.0;
+        for (size_t s = 0; s < numSatellites; s++)
+        {
+            // the error records say where the span ends without touching every step
+            const SatelliteData& satellite = results.satellites[s];
+            const auto& steps = satellite.timeSteps;
+            size_t count = steps.size();
+            for (const StepErrorRecord& record : satellite.errors)
+            {
+                if (record.code == STEP_INIT_FAILED || record.code == STEP_PROPAGATION_ERROR)
+                {
+                    count = std::min(count, (size_t)record.step);
+                    break;
+                }
+            }
+            spans[s] = count;
+            if (count == 0)
+                continue;
+            first = std::min(first, std::min(steps[0].ds50UTC, steps[count - 1].ds50UTC));
+            last = std::max(last, std::max(steps[0].ds50UTC, steps[count - 1].ds50UTC));
+            if (stepSize == 0.0 && count > 1)
+                stepSize = fabs(steps[1].ds50UTC - steps[0].ds50UTC) * 1440.0;
+        }
+        SolarEphemeris sun;
+        if (first <= last)
+            sun.Build(first, last, std::clamp(stepSize > 0.0 ? stepSize : MAX_SUN_STEP, MIN_SUN_STEP, MAX_SUN_STEP),
+                      options.model);
+        double tol = options.toleranceSeconds / 86400.0;
+
+        std::vector<int> order(numSatellites);
+        for (size_t s = 0; s < numSatellites; s++)
+            order[s] = (int)s;
+        WorkScheduler::Run(order, options.numThreads, [&](int s)
+        {
+            SatelliteShadow& shadow = report.satellites[s];
+            const auto& steps = results.satellites[s].timeSteps;
+            size_t count = spans[s];
+            if (options.keepStates)
+                shadow.states.assign(steps.size(), SHADOW_UNKNOWN);
+            if (count == 0)
+                return;
+
+            // steps on consecutive nodes read the table as it is
+            long node = sun.Node(steps[0].ds50UTC);
+            bool onNodes = node >= 0 && node + (long)count <= (long)sun.Size();
+
+            std::vector<double> columns(NUM_COLUMNS * count);
+            double* column[NUM_COLUMNS];
+            for (int c = 0; c < NUM_COLUMNS; c++)
+                column[c] = &columns[c * count];
+            for (size_t i = 0; i < count; i++)
+            {
+                column[COL_X][i] = steps[i].pos[0];
+                column[COL_Y][i] = steps[i].pos[1];
+                column[COL_Z][i] = steps[i].pos[2];
+                onNodes = onNodes && sun.OnNode(steps[i].ds50UTC, node + (long)i);
+            }
+
+            const double* geometry[SolarEphemeris::NUM_FIELDS];
+            for (int f = 0; f < SolarEphemeris::NUM_FIELDS; f++)
+                geometry[f] = onNodes ? sun.Column((SolarEphemeris::Field)f) + node : column[COL_SUN_X + f];
+            ShadowGeometry at;
+            for (size_t i = 0; i < count && !onNodes; i++)
+            {
+                sun.Geometry(steps[i].ds50UTC, at);
+                column[COL_SUN_X][i] = at.sun[0];
+                column[COL_SUN_Y][i] = at.sun[1];
+                column[COL_SUN_Z][i] = at.sun[2];
+                column[COL_PENUMBRA_RADIUS][i] = at.penumbraRadius;
+                column[COL_PENUMBRA_SLOPE][i] = at.penumbraSlope;
+                column[COL_UMBRA_RADIUS][i] = at.umbraRadius;
+                column[COL_UMBRA_SLOPE][i] = at.umbraSlope;
+            }
+            Classify(column[COL_X], column[COL_Y], column[COL_Z], geometry[SolarEphemeris::SUN_X],
+                     geometry[SolarEphemeris::SUN_Y], geometry[SolarEphemeris::SUN_Z],
+                     geometry[SolarEphemeris::PENUMBRA_RADIUS], geometry[SolarEphemeris::PENUMBRA_SLOPE],
+                     geometry[SolarEphemeris::UMBRA_RADIUS], geometry[SolarEphemeris::UMBRA_SLOPE], count,
+                     column[COL_PENUMBRA], column[COL_UMBRA], options.keepStates ? shadow.states.data() : nullptr);
+            const double* penumbra = column[COL_PENUMBRA];
+            const double* umbra = column[COL_UMBRA];
+
+            for (size_t i = 1; i < count; i++)
+            {
+                double stepStart = steps[i - 1].ds50UTC;
+                double span = steps[i].ds50UTC - stepStart;
+                ShadowState state = StateOf(penumbra[i - 1] < 0.0, umbra[i - 1] < 0.0);
+                ShadowState next = StateOf(penumbra[i] < 0.0, umbra[i] < 0.0);
+                bool penumbraFlips = (penumbra[i - 1] < 0.0) != (penumbra[i] < 0.0);
+                bool umbraFlips = (umbra[i - 1] < 0.0) != (umbra[i] < 0.0);
+                if (!options.findTransitions || (!penumbraFlips && !umbraFlips))
+                {
+                    // without a crossing time the step is split evenly
+                    double seconds = fabs(span) * 86400.0;
+                    shadow.seconds[state] += state == next ? seconds : 0.5 * seconds;
+                    shadow.seconds[next] += state == next ? 0.0 : 0.5 * seconds;
+                    continue;
+                }
+
+                Crossing crossings[2];
+                int numCrossings = 0;
+                for (int cone = 0; cone < 2; cone++)
+                {
+                    bool isUmbra = cone == 1;
+                    if (!(isUmbra ? umbraFlips : penumbraFlips))
+                        continue;
+                    auto eval = [&](double t)
+                    {
+                        Point point;
+                        point.t = t;
+                        EphemerisState ephemeris;
+                        double pen, umb;
+                        EphemerisQuery::Between(steps[i - 1], steps[i], stepStart + t, AXIS_DS50UTC, ephemeris);
+                        sun.Geometry(stepStart + t, at);
+                        ShadowValues(ephemeris.pos[0], ephemeris.pos[1], ephemeris.pos[2], at.sun[0], at.sun[1],
+                                     at.sun[2], at.penumbraRadius, at.penumbraSlope, at.umbraRadius, at.umbraSlope,
+                                     pen, umb);
+                        point.f = isUmbra ? umb : pen;
+                        return point;
+                    };
+                    Point before, after;
+                    before.f = isUmbra ? umbra[i - 1] : penumbra[i - 1];
+                    after.t = span;
+                    after.f = isUmbra ? umbra[i] : penumbra[i];
+                    BrentBracket(eval, before, after, tol);
+                    crossings[numCrossings].t = fabs(before.f) <= fabs(after.f) ? before.t : after.t;
+                    crossings[numCrossings].umbra = isUmbra;
+                    numCrossings++;
+                }
+                if (numCrossings == 2 && fabs(crossings[1].t) < fabs(crossings[0].t))
+                    std::swap(crossings[0], crossings[1]);
+
+                bool inPenumbra = penumbra[i - 1] < 0.0;
+                bool inUmbra = umbra[i - 1] < 0.0;
+                double from = 0.0;
+                for (int c = 0; c < numCrossings; c++)
+                {
+                    shadow.seconds[state] += fabs(crossings[c].t - from) * 86400.0;
+                    from = crossings[c].t;
+                    if (crossings[c].umbra)
+                        inUmbra = !inUmbra;
+                    else
+                        inPenumbra = !inPenumbra;
+                    ShadowState after = StateOf(inPenumbra, inUmbra);
+                    if (after != state)
+                        shadow.transitions.push_back({stepStart + crossings[c].t, state, after});
+                    state = after;
+                }
+                shadow.seconds[state] += fabs(span - from) * 86400.0;
+            }
+        });
+
+        for (size_t s = 0; s < numSatellites; s++)
+        {
+            report.steps += spans[s];
+            report.transitions += report.satellites[s].transitions.size();
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    bool Eclipse::WriteTransitions(const std::string& filePath, const PropagationResults& results,
+                                   const EclipseReport& report, std::string* error)
+    {
+        FILE* fp = fopen(filePath.c_str(), "w");
+        if (!fp)
+        {
+            if (error)
+                *error = "Can't create " + filePath;
+            return false;
+        }
+        for (size_t s = 0; s < report.satellites.size() && s < results.satellites.size(); s++)
+        {
+            std::string satNum = results.satellites[s].line1.size() >= 7 ? results.satellites[s].line1.substr(2, 5)
+                                                                          : std::to_string(s);
+            for (const ShadowTransition& transition : report.satellites[s].transitions)
+            {
+                fprintf(fp, "%s %17.8f %s %-8s %s\n", satNum.c_str(), transition.ds50UTC,
+                        UTCToDtg20Str(transition.ds50UTC), StateName(transition.from), StateName(transition.to));
+            }
+        }
+        bool written = fclose(fp) == 0;
+        if (!written && error)
+            *error = "Can't write " + filePath;
+        return written;
+    }
+
+    const char* Eclipse::StateName(ShadowState state)
+    {
+        switch (state)
+        {
+        case SHADOW_SUNLIT: return "sunlit";
+        case SHADOW_PENUMBRA: return "penumbra";
+        case SHADOW_UMBRA: return "umbra";
+        case SHADOW_UNKNOWN: return "unknown";
+        default: return "unknown";
+        }
+    }
+
+} // SGP_IMPL
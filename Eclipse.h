@@ -0,0 +1,155 @@
+//
+// Eclipse.h
+// Earth shadow state of every propagated step, with transition times between steps
+//
+
+#ifndef ECLIPSE_H
+#define ECLIPSE_H
+
+#include <math.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PropResults.h"
+
+namespace SGP_IMPL {
+
+    enum ShadowState : uint8_t
+    {
+        SHADOW_SUNLIT = 0,
+        SHADOW_PENUMBRA,
+        SHADOW_UMBRA,
+        SHADOW_UNKNOWN,                 // past the satellite's span
+        NUM_SHADOW_STATES
+    };
+
+    enum ShadowModel
+    {
+        SHADOW_CONICAL = 0,             // umbra and penumbra cones of a Sun of finite size
+        SHADOW_CYLINDRICAL,             // Earth's radius along the anti-Sun axis, no penumbra
+    };
+
+    // The shadow cones at one time. Seen down the anti-Sun axis, a point s km behind Earth's
+    // centre is in the penumbra within penumbraRadius + s * penumbraSlope of the axis and
+    // in the umbra within umbraRadius - s * umbraSlope.
+    struct ShadowGeometry
+    {
+        double sun[3] = {};             // unit vector to the Sun
+        double penumbraRadius = 0.0;    // km
+        double penumbraSlope = 0.0;
+        double umbraRadius = 0.0;       // km
+        double umbraSlope = 0.0;
+
+        static ShadowGeometry At(double ds50UTC, ShadowModel model);
+    };
+
+    // Shadow geometry tabulated once over a span and shared by every satellite, kept as
+    // columns so satellites stepping on the nodes read it in place. Times between nodes
+    // are interpolated linearly, good to 1e-7 rad of Sun direction at hourly nodes.
+    class SolarEphemeris
+    {
+    public:
+        enum Field
+        {
+            SUN_X = 0,
+            SUN_Y,
+            SUN_Z,
+            PENUMBRA_RADIUS,
+            PENUMBRA_SLOPE,
+            UMBRA_RADIUS,
+            UMBRA_SLOPE,
+            NUM_FIELDS
+        };
+
+        // nodes stepMinutes apart from first to past last
+        void Build(double first, double last, double stepMinutes, ShadowModel model);
+
+        size_t Size() const { return m_size; }
+        const double* Column(Field field) const { return &m_columns[field * m_size]; }
+
+        // Index of the node at the time, -1 between nodes or outside the table
+        long Node(double ds50UTC) const;
+
+        // Whether the time is on the given node
+        bool OnNode(double ds50UTC, long node) const
+        {
+            return fabs(ds50UTC - (m_first + node * m_step)) <= m_slack;
+        }
+
+        // Outside the span the nearest nodes are extrapolated
+        void Geometry(double ds50UTC, ShadowGeometry& geometry) const;
+
+    private:
+        std::vector<double> m_columns;
+        size_t m_size = 0;
+        double m_first = 0.0;
+        double m_step = 0.0;            // days
+        double m_slack = 0.0;           // days off a node that still count as on it
+    };
+
+    struct EclipseOptions
+    {
+        ShadowModel model = SHADOW_CONICAL;
+        bool keepStates = true;         // the state of every step
+        bool findTransitions = true;    // times between steps where the state changes
+        double toleranceSeconds = 1e-3;
+        int numThreads = 1;
+    };
+
+    struct ShadowTransition
+    {
+        double ds50UTC = 0.0;
+        ShadowState from = SHADOW_SUNLIT;
+        ShadowState to = SHADOW_SUNLIT;
+    };
+
+    struct SatelliteShadow
+    {
+        std::vector<uint8_t> states;    // ShadowState per step, keepStates only
+        std::vector<ShadowTransition> transitions;  // in step order
+        double seconds[SHADOW_UNKNOWN] = {};        // spent in each state over the span,
+                                                    // split at transitions when found
+    };
+
+    struct EclipseReport
+    {
+        std::vector<SatelliteShadow> satellites;    // results order
+        long long steps = 0;            // classified
+        long long transitions = 0;
+        double seconds = 0.0;
+    };
+
+    // Shadow state needs the Sun at every step; instead of the Sun per point, the Sun is
+    // tabulated once over the job's span at its step and every satellite reads the table,
+    // in place when its steps fall on the nodes. Each satellite's positions are copied
+    // into columns and classified two at a time with SSE2 where the compiler targets it.
+    // Where either cone's side changes between two steps, Brent's method finds the
+    // crossing on the Hermite interpolated ephemeris (see EphemerisQuery), so transitions
+    // need neither smaller steps nor more propagation. A shadow entered and left within
+    // one step is missed.
+    //
+    // The span of a satellite ends at its first init or propagation failure, as the
+    // query's does. Satellites run in parallel on numThreads.
+    class Eclipse
+    {
+    public:
+        static EclipseReport Run(const PropagationResults& results, const EclipseOptions& options = EclipseOptions());
+
+        // Penumbra and umbra functions of count positions given as columns, each with the
+        // geometry of its own time as columns: negative inside the cone. The state is
+        // written too when states isn't null.
+        static void Classify(const double* x, const double* y, const double* z, const double* sunX,
+                             const double* sunY, const double* sunZ, const double* penumbraRadius,
+                             const double* penumbraSlope, const double* umbraRadius, const double* umbraSlope,
+                             size_t count, double* penumbra, double* umbra, uint8_t* states);
+
+        // One line per transition: number, time, date, from, to
+        static bool WriteTransitions(const std::string& filePath, const PropagationResults& results,
+                                     const EclipseReport& report, std::string* error = nullptr);
+
+        static const char* StateName(ShadowState state);
+    };
+
+} // SGP_IMPL
+
+#endif //ECLIPSE_H
@@ -0,0 +1,253 @@
+//
+// Ensemble.cpp
+// Monte Carlo samples of one element set, propagated as one batch with running statistics
+//
+
+#include "Ensemble.h"
+#include "Propagator.h"
+#include "ScratchTable.h"
+#include "WorkScheduler.h"
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/Sgp4PropDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const int N = NUM_ENSEMBLE_ELEMENTS;
+        const int MAX_GROUPS = 256;
+        const int MIN_GROUP_SAMPLES = 16;
+
+        // Welford running sums of one group at one step
+        struct Accumulator
+        {
+            double count = 0.0;
+            double mean[6] = {};            // position, velocity
+            double m2[6] = {};              // position, packed as EnsembleStep::covariance
+        };
+
+        const int PAIR_A[6] = {0, 0, 0, 1, 1, 2};
+        const int PAIR_B[6] = {0, 1, 2, 1, 2, 2};
+
+        void Add(Accumulator& acc, const double state[6])
+        {
+            double before[3];
+            for (int k = 0; k < 3; k++)
+                before[k] = state[k] - acc.mean[k];
+            acc.count += 1.0;
+            for (int k = 0; k < 6; k++)
+                acc.mean[k] += (state[k] - acc.mean[k]) / acc.count;
+            for (int p = 0; p < 6; p++)
+                acc.m2[p] += before[PAIR_A[p]] * (state[PAIR_B[p]] - acc.mean[PAIR_B[p]]);
+        }
+
+        // Chan's pairwise combination of two groups' sums
+        void Merge(Accumulator& acc, const Accumulator& other)
+        {
+            if (other.count == 0.0)
+                return;
+            double count = acc.count + other.count;
+            double delta[6];
+            for (int k = 0; k < 6; k++)
+                delta[k] = other.mean[k] - acc.mean[k];
+            double weight = acc.count * other.count / count;
+            for (int p = 0; p < 6; p++)
+                acc.m2[p] += other.m2[p] + delta[PAIR_A[p]] * delta[PAIR_B[p]] * weight;
+            for (int k = 0; k < 6; k++)
+                acc.mean[k] += delta[k] * other.count / count;
+            acc.count = count;
+        }
+
+        double Revolutions(double angle)
+        {
+            angle = fmod(angle, 360.0);
+            return angle < 0.0 ? angle + 360.0 : angle;
+        }
+
+        // Lower triangle L with L L^T = covariance, false when it isn't positive definite
+        bool Cholesky(const std::vector<double>& covariance, double l[N * N])
+        {
+            std::fill(l, l + N * N, 0.0);
+            for (int j = 0; j < N; j++)
+            {
+                double sum = covariance[j * N + j];
+                for (int k = 0; k < j; k++)
+                    sum -= l[j * N + k] * l[j * N + k];
+                if (sum <= 0.0)
+                    return false;
+                l[j * N + j] = sqrt(sum);
+                for (int i = j + 1; i < N; i++)
+                {
+                    double value = covariance[i * N + j];
+                    for (int k = 0; k < j; k++)
+                        value -= l[i * N + k] * l[j * N + k];
+                    l[i * N + j] = value / l[j * N + j];
+                }
+            }
+            return true;
+        }
+
+    } // namespace
+
+    double EnsembleStep::Spread() const
+    {
+        return sqrt(std::max(0.0, covariance[0] + covariance[3] + covariance[5]));
+    }
+
+    bool Ensemble::Sample(const TleElements& elements, const EnsembleSpread& spread, int count, uint64_t seed,
+                          std::vector<TleElements>& samples, std::string* error)
+    {
+        samples.clear();
+        double l[N * N] = {};
+        if (!spread.covariance.empty())
+        {
+            if (spread.covariance.size() != (size_t)(N * N) || !Cholesky(spread.covariance, l))
+            {
+                if (error)
+                    *error = "Covariance isn't a positive definite 7 x 7 matrix";
+                return false;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < N; i++)
+                l[i * N + i] = fabs(spread.sigma[i]);
+        }
+
+        std::mt19937_64 random(seed);
+        std::normal_distribution<double> normal;
+        samples.reserve(std::max(0, count));
+        double z[N], d[N];
+        for (int s = 0; s < count; s++)
+        {
+            for (int i = 0; i < N; i++)
+                z[i] = normal(random);
+            for (int i = 0; i < N; i++)
+            {
+                d[i] = 0.0;
+                for (int k = 0; k <= i; k++)
+                    d[i] += l[i * N + k] * z[k];
+            }
+
+            TleElements& sample = samples.emplace_back(elements);
+            sample.meanMotion = std::max(0.05, elements.meanMotion + d[ENS_MEAN_MOTION]);
+            sample.eccentricity = std::min(0.99, fabs(elements.eccentricity + d[ENS_ECCENTRICITY]));
+            double inclination = fabs(fmod(elements.inclination + d[ENS_INCLINATION], 360.0));
+            sample.inclination = inclination > 180.0 ? 360.0 - inclination : inclination;
+            sample.raan = Revolutions(elements.raan + d[ENS_RAAN]);
+            sample.argPerigee = Revolutions(elements.argPerigee + d[ENS_ARG_PERIGEE]);
+            sample.meanAnomaly = Revolutions(elements.meanAnomaly + d[ENS_MEAN_ANOMALY]);
+            sample.bstar = elements.bstar + d[ENS_BSTAR];
+        }
+        return true;
+    }
+
+    EnsembleResult Ensemble::Run(const TleElements& elements, const EnsembleSpread& spread, double startTime,
+                                 double stopTime, double stepSize, const EnsembleOptions& options)
+    {
+        auto start = std::chrono::steady_clock::now();
+        EnsembleResult result;
+        if (!Sample(elements, spread, options.samples, options.seed, result.samples, &result.error))
+            return result;
+
+        std::vector<double> times = Propagator::StepTimes(startTime, stopTime, stepSize);
+        size_t numTimes = times.size();
+        size_t numSamples = result.samples.size();
+        if (options.keepSamples)
+        {
+            result.states.assign(numTimes * numSamples * 6, 0.0);
+            result.failed.assign(numTimes * numSamples, 1);
+        }
+
+        // groups depend on the sample count alone, so the merge order does too
+        size_t groupSize = std::max<size_t>(MIN_GROUP_SAMPLES, (numSamples + MAX_GROUPS - 1) / MAX_GROUPS);
+        size_t numGroups = (numSamples + groupSize - 1) / groupSize;
+        std::vector<Accumulator> sums(numGroups * numTimes);
+
+        ScratchTable table;
+        std::vector<const TleElements*> sets;
+        std::vector<int> order;
+        int initialized = 0;
+        std::string initError;
+        for (size_t chunk = 0; chunk < numSamples; chunk += ScratchTable::MAX_SETS)
+        {
+            size_t chunkEnd = std::min(numSamples, chunk + ScratchTable::MAX_SETS);
+            sets.clear();
+            for (size_t s = chunk; s < chunkEnd; s++)
+                sets.push_back(&result.samples[s]);
+            int filled = table.Fill(sets);
+            initialized += filled;
+            result.initFailures += (int)sets.size() - filled;
+            if (filled == 0 && initError.empty())
+                initError = table.Error(0);
+
+            // a group's samples in this chunk, in sample order on one thread
+            order.clear();
+            for (size_t g = chunk / groupSize; g < numGroups && g * groupSize < chunkEnd; g++)
+                order.push_back((int)g);
+            WorkScheduler::Run(order, options.numThreads, [&](int g)
+            {
+                size_t first = std::max(chunk, g * groupSize);
+                size_t last = std::min(chunkEnd, (g + 1) * groupSize);
+                double state[6], mse, llh[3];
+                for (size_t s = first; s < last; s++)
+                {
+                    __int64 satKey = table.Key(s - chunk);
+                    if (satKey <= 0)
+                        continue;
+                    for (size_t t = 0; t < numTimes; t++)
+                    {
+                        if (Sgp4PropDs50UTC(satKey, times[t], &mse, state, state + 3, llh) != 0)
+                            break;
+                        Add(sums[g * numTimes + t], state);
+                        if (options.keepSamples)
+                        {
+                            std::copy(state, state + 6, &result.states[(t * numSamples + s) * 6]);
+                            result.failed[t * numSamples + s] = 0;
+                        }
+                    }
+                }
+            });
+        }
+        table.Clear();
+
+        result.steps.resize(numTimes);
+        for (size_t t = 0; t < numTimes; t++)
+        {
+            Accumulator total;
+            for (size_t g = 0; g < numGroups; g++)
+                Merge(total, sums[g * numTimes + t]);
+
+            EnsembleStep& step = result.steps[t];
+            step.ds50UTC = times[t];
+            step.count = (int)total.count;
+            std::copy(total.mean, total.mean + 3, step.meanPos);
+            std::copy(total.mean + 3, total.mean + 6, step.meanVel);
+            for (int p = 0; p < 6 && total.count > 1.0; p++)
+                step.covariance[p] = total.m2[p] / (total.count - 1.0);
+        }
+
+        result.success = initialized > 0;
+        if (!result.success && result.error.empty())
+            result.error = numSamples > 0 ? "No sample initialized: " + initError : "No samples";
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,98 @@
+//
+// Ensemble.h
+// Monte Carlo samples of one element set, propagated as one batch with running statistics
+//
+
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TleUtil.h"
+
+namespace SGP_IMPL {
+
+    // Elements the spread is over, in the units of the TLE fields
+    enum EnsembleElement
+    {
+        ENS_MEAN_MOTION = 0,            // rev/day
+        ENS_ECCENTRICITY,
+        ENS_INCLINATION,                // deg
+        ENS_RAAN,                       // deg
+        ENS_ARG_PERIGEE,                // deg
+        ENS_MEAN_ANOMALY,               // deg
+        ENS_BSTAR,                      // 1/earth radii
+        NUM_ENSEMBLE_ELEMENTS
+    };
+
+    // Independent sigmas per element, or a full covariance over them when one is given
+    struct EnsembleSpread
+    {
+        double sigma[NUM_ENSEMBLE_ELEMENTS] = {};
+        std::vector<double> covariance;     // row major, NUM_ENSEMBLE_ELEMENTS squared
+    };
+
+    struct EnsembleOptions
+    {
+        int samples = 500;
+        uint64_t seed = 1;
+        bool keepSamples = false;       // every sample's state at every step
+        int numThreads = 1;
+    };
+
+    // Statistics over the samples that propagated to one time
+    struct EnsembleStep
+    {
+        double ds50UTC = 0.0;
+        int count = 0;
+        double meanPos[3] = {};         // km
+        double meanVel[3] = {};         // km/s
+        double covariance[6] = {};      // position, km^2: xx xy xz yy yz zz
+
+        // Square root of the covariance's trace (km)
+        double Spread() const;
+    };
+
+    struct EnsembleResult
+    {
+        std::vector<EnsembleStep> steps;
+        std::vector<TleElements> samples;
+
+        // keepSamples only: sample s at step t at (t * samples + s) * 6, position then
+        // velocity, and a 1 at t * samples + s where the sample didn't get there
+        std::vector<double> states;
+        std::vector<char> failed;
+
+        int initFailures = 0;           // samples AstroStd refused
+        bool success = false;           // any sample propagated
+        std::string error;
+        double seconds = 0.0;
+    };
+
+    // Risk assessments perturb a TLE into hundreds of samples. Rather than a job per
+    // sample, Run draws them all up front, puts them in one ScratchTable and propagates
+    // them over the shared time grid on numThreads. Samples are split into at most 256
+    // fixed groups that keep Welford running means and covariances per step, merged in
+    // group order at the end, so the statistics take no memory per sample and come out
+    // the same on any number of threads.
+    //
+    // Samples are drawn in element space: eccentricity reflects at 0, inclination at 0
+    // and 180. A sample that fails to propagate leaves the statistics from that step on.
+    // Fills the AstroStd tables, see ScratchTable, so it can't run alongside a job.
+    class Ensemble
+    {
+    public:
+        // start and stop in ds50UTC, step in minutes; the last step lands on stop
+        static EnsembleResult Run(const TleElements& elements, const EnsembleSpread& spread, double startTime,
+                                  double stopTime, double stepSize, const EnsembleOptions& options = EnsembleOptions());
+
+        // The sets Run propagates for the same spread, count and seed. False when the
+        // covariance isn't positive definite.
+        static bool Sample(const TleElements& elements, const EnsembleSpread& spread, int count, uint64_t seed,
+                           std::vector<TleElements>& samples, std::string* error = nullptr);
+    };
+
+} // SGP_IMPL
+
+#endif //ENSEMBLE_H
@@ -0,0 +1,252 @@
+//
+// EphemerisQuery.cpp
+// State of any satellite at any time within its propagated span, by Hermite interpolation
+//
+
+#include "EphemerisQuery.h"
+#include "OrbitMath.h"
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        // relative spacing error still treated as a uniform grid
+        const double UNIFORM_TOLERANCE = 1e-6;
+
+        bool UsableStep(const TimeStepData& step)
+        {
+            return step.error != STEP_INIT_FAILED && step.error != STEP_PROPAGATION_ERROR;
+        }
+
+        void TwoBodyAcceleration(const double pos[3], double acc[3])
+        {
+            double r2 = pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2];
+            double scale = r2 > 1.0 ? -MU_EARTH / (r2 * sqrt(r2)) : 0.0;
+            for (int j = 0; j < 3; j++)
+                acc[j] = scale * pos[j];
+        }
+
+        double Distance(const double a[3], const double b[3])
+        {
+            double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+            return sqrt(dx * dx + dy * dy + dz * dz);
+        }
+
+        // s in [0, 1] across the interval, h its length in seconds
+        void Interpolate(const TimeStepData& s0, const TimeStepData& s1, double s, double h, EphemerisState& state)
+        {
+            double a0[3], a1[3];
+            TwoBodyAcceleration(s0.pos, a0);
+            TwoBodyAcceleration(s1.pos, a1);
+
+            double s2 = s * s, s3 = s2 * s, s4 = s3 * s, s5 = s4 * s;
+
+            // quintic Hermite basis and its derivative
+            double q0 = 1.0 - 10.0 * s3 + 15.0 * s4 - 6.0 * s5;
+            double q1 = s - 6.0 * s3 + 8.0 * s4 - 3.0 * s5;
+            double q2 = 0.5 * (s2 - 3.0 * s3 + 3.0 * s4 - s5);
+            double q3 = 0.5 * (s3 - 2.0 * s4 + s5);
+            double q4 = -4.0 * s3 + 7.0 * s4 - 3.0 * s5;
+            double q5 = 10.0 * s3 - 15.0 * s4 + 6.0 * s5;
+            double dq0 = -30.0 * s2 + 60.0 * s3 - 30.0 * s4;
+            double dq1 = 1.0 - 18.0 * s2 + 32.0 * s3 - 15.0 * s4;
+            double dq2 = 0.5 * (2.0 * s - 9.0 * s2 + 12.0 * s3 - 5.0 * s4);
+            double dq3 = 0.5 * (3.0 * s2 - 8.0 * s3 + 5.0 * s4);
+            double dq4 = -12.0 * s2 + 28.0 * s3 - 15.0 * s4;
+            double dq5 = 30.0 * s2 - 60.0 * s3 + 30.0 * s4;
+
+            // cubic Hermite, for the error estimate
+            double c0 = 2.0 * s3 - 3.0 * s2 + 1.0;
+            double c1 = s3 - 2.0 * s2 + s;
+            double c2 = -2.0 * s3 + 3.0 * s2;
+            double c3 = s3 - s2;
+            double dc0 = 6.0 * s2 - 6.0 * s;
+            double dc1 = 3.0 * s2 - 4.0 * s + 1.0;
+            double dc2 = -6.0 * s2 + 6.0 * s;
+            double dc3 = 3.0 * s2 - 2.0 * s;
+
+            double h2 = h * h;
+            double cubicPos[3], cubicVel[3];
+            for (int j = 0; j < 3; j++)
+            {
+                state.pos[j] = q0 * s0.pos[j] + q1 * h * s0.vel[j] + q2 * h2 * a0[j] + q3 * h2 * a1[j] +
+                               q4 * h * s1.vel[j] + q5 * s1.pos[j];
+                state.vel[j] = (dq0 * s0.pos[j] + dq1 * h * s0.vel[j] + dq2 * h2 * a0[j] + dq3 * h2 * a1[j] +
+                                dq4 * h * s1.vel[j] + dq5 * s1.pos[j]) / h;
+                cubicPos[j] = c0 * s0.pos[j] + c1 * h * s0.vel[j] + c2 * s1.pos[j] + c3 * h * s1.vel[j];
+                cubicVel[j] = (dc0 * s0.pos[j] + dc1 * h * s0.vel[j] + dc2 * s1.pos[j] + dc3 * h * s1.vel[j]) / h;
+            }
+            state.positionError = Distance(state.pos, cubicPos);
+            state.velocityError = Distance(state.vel, cubicVel);
+        }
+
+    }
+
+    void TimeGrid::Assign(std::vector<double> times)
+    {
+        m_times = std::move(times);
+        m_step = m_times.size() >= 2 ? m_times[1] - m_times[0] : 0.0;
+        m_uniform = m_step > 0.0;
+        for (size_t i = 1; m_uniform && i < m_times.size(); i++)
+        {
+            double expected = m_times[0] + (double)i * m_step;
+            double slack = UNIFORM_TOLERANCE * m_step;
+            // the last step may stop short at the end of the span
+            if (i + 1 == m_times.size())
+                m_uniform = m_times[i] > m_times[i - 1] && m_times[i] <= expected + slack;
+            else
+                m_uniform = fabs(m_times[i] - expected) <= slack;
+        }
+    }
+
+    void TimeGrid::Clear()
+    {
+        m_times.clear();
+        m_uniform = false;
+        m_step = 0.0;
+    }
+
+    int TimeGrid::Locate(double time) const
+    {
+        size_t count = m_times.size();
+        if (count == 0 || !(time >= m_times.front() && time <= m_times.back()))
+            return -1;
+        if (count == 1)
+            return 0;
+
+        int last = (int)count - 2;
+        if (m_uniform)
+        {
+            // the guess is off by one at most, from rounding or the short last step
+            int index = std::clamp((int)((time - m_times[0]) / m_step), 0, last);
+            while (index > 0 && m_times[index] > time)
+                index--;
+            while (index < last && m_times[index + 1] <= time)
+                index++;
+            return index;
+        }
+
+        auto upper = std::upper_bound(m_times.begin(), m_times.end(), time);
+        return std::min((int)(upper - m_times.begin()) - 1, last);
+    }
+
+    EphemerisQuery::EphemerisQuery(const PropagationResults& results, QueryAxis axis)
+    {
+        Build(results, axis);
+    }
+
+    void EphemerisQuery::Build(const PropagationResults& results, QueryAxis axis)
+    {
+        m_results = &results;
+        m_axis = axis;
+        m_grids.assign(results.satellites.size(), TimeGrid());
+        for (size_t s = 0; s < results.satellites.size(); s++)
+        {
+            std::vector<double> times;
+            times.reserve(results.satellites[s].timeSteps.size());
+            for (const TimeStepData& step : results.satellites[s].timeSteps)
+            {
+                if (!UsableStep(step))
+                    break;
+                times.push_back(axis == AXIS_MSE ? step.mse : step.ds50UTC);
+            }
+            m_grids[s].Assign(std::move(times));
+        }
+    }
+
+    void EphemerisQuery::Clear()
+    {
+        m_results = nullptr;
+        m_grids.clear();
+    }
+
+    bool EphemerisQuery::Span(int satellite, double* first, double* last) const
+    {
+        if (satellite < 0 || satellite >= SatelliteCount() || m_grids[satellite].Empty())
+            return false;
+        if (first)
+            *first = m_grids[satellite].First();
+        if (last)
+            *last = m_grids[satellite].Last();
+        return true;
+    }
+
+    bool EphemerisQuery::StateAt(int satellite, double time, EphemerisState& state) const
+    {
+        state = EphemerisState();
+        if (satellite < 0 || satellite >= SatelliteCount())
+            return false;
+
+        const TimeGrid& grid = m_grids[satellite];
+        int index = grid.Locate(time);
+        if (index < 0)
+            return false;
+
+        const auto& steps = m_results->satellites[satellite].timeSteps;
+        double t0 = grid.Time(index);
+        if (time == t0 || grid.Size() == 1 || time == grid.Time(index + 1))
+        {
+            int exact = time == t0 || grid.Size() == 1 ? index : index + 1;
+            const TimeStepData& step = steps[exact];
+            std::copy(step.pos, step.pos + 3, state.pos);
+            std::copy(step.vel, step.vel + 3, state.vel);
+            state.step = exact;
+            state.valid = true;
+            return true;
+        }
+
+        double t1 = grid.Time(index + 1);
+        double seconds = m_axis == AXIS_MSE ? 60.0 : 86400.0;
+        Interpolate(steps[index], steps[index + 1], (time - t0) / (t1 - t0), (t1 - t0) * seconds, state);
+        state.step = index;
+        state.valid = true;
+        return true;
+    }
+
+    void EphemerisQuery::Between(const TimeStepData& before, const TimeStepData& after, double time, QueryAxis axis,
+                                 EphemerisState& state)
+    {
+        double t0 = axis == AXIS_MSE ? before.mse : before.ds50UTC;
+        double t1 = axis == AXIS_MSE ? after.mse : after.ds50UTC;
+        double seconds = axis == AXIS_MSE ? 60.0 : 86400.0;
+        state = EphemerisState();
+        Interpolate(before, after, (time - t0) / (t1 - t0), (t1 - t0) * seconds, state);
+        state.valid = true;
+    }
+
+    void EphemerisQuery::StatesAt(const std::vector<int>& satellites, const std::vector<double>& times,
+                                  std::vector<EphemerisState>& states, int numThreads) const
+    {
+        size_t columns = times.size();
+        states.assign(satellites.size() * columns, EphemerisState());
+
+        auto run = [&](size_t begin, size_t end)
+        {
+            for (size_t s = begin; s < end; s++)
+                for (size_t t = 0; t < columns; t++)
+                    StateAt(satellites[s], times[t], states[s * columns + t]);
+        };
+
+        size_t threads = std::min<size_t>(std::max(1, numThreads), satellites.size());
+        if (threads <= 1)
+        {
+            run(0, satellites.size());
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        size_t chunk = (satellites.size() + threads - 1) / threads;
+        for (size_t w = 1; w < threads; w++)
+        {
+            size_t begin = std::min(satellites.size(), w * chunk);
+            workers.emplace_back(run, begin, std::min(satellites.size(), begin + chunk));
+        }
+        run(0, std::min(satellites.size(), chunk));
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,103 @@
+//
+// EphemerisQuery.h
+// State of any satellite at any time within its propagated span, by Hermite interpolation
+//
+
+#ifndef EPHEMERISQUERY_H
+#define EPHEMERISQUERY_H
+
+#include <cstddef>
+#include <vector>
+#include "PropResults.h"
+
+namespace SGP_IMPL {
+
+    // Sorted step times with interval lookup. Uniform grids (a shorter last step allowed)
+    // are located by division, anything else by binary search.
+    class TimeGrid
+    {
+    public:
+        void Assign(std::vector<double> times);
+        void Clear();
+
+        size_t Size() const { return m_times.size(); }
+        bool Empty() const { return m_times.empty(); }
+        bool IsUniform() const { return m_uniform; }
+        double Time(size_t index) const { return m_times[index]; }
+        double First() const { return m_times.front(); }
+        double Last() const { return m_times.back(); }
+
+        // Index i of the interval [Time(i), Time(i + 1)] holding time, the last interval
+        // includes its end. A single step grid gives 0 for exactly its time, -1 outside.
+        int Locate(double time) const;
+
+    private:
+        std::vector<double> m_times;
+        bool m_uniform = false;
+        double m_step = 0.0;
+    };
+
+    enum QueryAxis
+    {
+        AXIS_DS50UTC = 0,       // days since 1950 UTC, shared by every satellite of a job
+        AXIS_MSE,               // minutes since each satellite's epoch
+    };
+
+    struct EphemerisState
+    {
+        double pos[3] = {};             // km
+        double vel[3] = {};             // km/s
+        double positionError = 0.0;     // km, estimated
+        double velocityError = 0.0;     // km/s, estimated
+        int step = -1;                  // stored step at or before the time
+        bool valid = false;             // false outside the satellite's span
+    };
+
+    // Interpolates between the two stored steps around the time with a quintic Hermite
+    // polynomial: positions, velocities and two-body accelerations at both ends. The error
+    // estimate is its distance from the cubic Hermite through positions and velocities only,
+    // which grows with step size the same way the true error does. At stored times the
+    // stored state comes back exactly with no error.
+    //
+    // Good to metres for LEO at 1 to 5 minute steps. Hourly LEO steps are far too coarse
+    // for any polynomial, the estimate says so, and the map's animator flies the
+    // osculating orbit instead.
+    //
+    // The span of a satellite ends at its first init or propagation failure. Keeps a
+    // pointer to the results, which have to outlive the query or be rebuilt against.
+    class EphemerisQuery
+    {
+    public:
+        EphemerisQuery() = default;
+        explicit EphemerisQuery(const PropagationResults& results, QueryAxis axis = AXIS_DS50UTC);
+
+        void Build(const PropagationResults& results, QueryAxis axis = AXIS_DS50UTC);
+        void Clear();
+
+        QueryAxis GetAxis() const { return m_axis; }
+        int SatelliteCount() const { return (int)m_grids.size(); }
+        const TimeGrid& Grid(int satellite) const { return m_grids[satellite]; }
+
+        // False when the satellite has no usable step
+        bool Span(int satellite, double* first, double* last) const;
+
+        bool StateAt(int satellite, double time, EphemerisState& state) const;
+
+        // Every satellite at every time, states[s * times.size() + t], split over numThreads
+        void StatesAt(const std::vector<int>& satellites, const std::vector<double>& times,
+                      std::vector<EphemerisState>& states, int numThreads = 1) const;
+
+        // The interpolation StateAt does between two consecutive steps, for callers that walk
+        // the steps themselves; step is left at -1
+        static void Between(const TimeStepData& before, const TimeStepData& after, double time, QueryAxis axis,
+                            EphemerisState& state);
+
+    private:
+        const PropagationResults* m_results = nullptr;
+        QueryAxis m_axis = AXIS_DS50UTC;
+        std::vector<TimeGrid> m_grids;
+    };
+
+} // SGP_IMPL
+
+#endif //EPHEMERISQUERY_H
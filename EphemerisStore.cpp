@@ -0,0 +1,397 @@
+//
+// EphemerisStore.cpp
+// Compact in-memory storage of propagated steps: float32, fixed-point and delta encoded
+//
+
+#include "EphemerisStore.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        struct FieldInfo
+        {
+            const char* name;
+            size_t offset;      // into TimeStepData
+            double quantum;
+        };
+
+        const double TIME_QUANTUM = 1e-4;       // min
+        const double KM_QUANTUM = 1e-3;         // km
+        const double VEL_QUANTUM = 1e-6;        // km/s
+        const double ANGLE_QUANTUM = 1e-6;      // deg
+
+        #define STEP_FIELD(member, i) (offsetof(TimeStepData, member) + (i) * sizeof(double))
+
+        const FieldInfo FIELDS[NUM_FIELDS] = {
+            {"mse", STEP_FIELD(mse, 0), TIME_QUANTUM},
+            {"ds50UTC", STEP_FIELD(ds50UTC, 0), TIME_QUANTUM},
+            {"posX", STEP_FIELD(pos, 0), KM_QUANTUM},
+            {"posY", STEP_FIELD(pos, 1), KM_QUANTUM},
+            {"posZ", STEP_FIELD(pos, 2), KM_QUANTUM},
+            {"velX", STEP_FIELD(vel, 0), VEL_QUANTUM},
+            {"velY", STEP_FIELD(vel, 1), VEL_QUANTUM},
+            {"velZ", STEP_FIELD(vel, 2), VEL_QUANTUM},
+            {"lat", STEP_FIELD(llh, 0), ANGLE_QUANTUM},
+            {"lon", STEP_FIELD(llh, 1), ANGLE_QUANTUM},
+            {"height", STEP_FIELD(llh, 2), KM_QUANTUM},
+            {"meanA", STEP_FIELD(meanKep, 0), KM_QUANTUM},
+            {"meanE", STEP_FIELD(meanKep, 1), 1e-9},
+            {"meanIncl", STEP_FIELD(meanKep, 2), ANGLE_QUANTUM},
+            {"meanKep3", STEP_FIELD(meanKep, 3), ANGLE_QUANTUM},
+            {"meanKep4", STEP_FIELD(meanKep, 4), ANGLE_QUANTUM},
+            {"meanKep5", STEP_FIELD(meanKep, 5), ANGLE_QUANTUM},
+            {"oscA", STEP_FIELD(oscKep, 0), KM_QUANTUM},
+            {"oscE", STEP_FIELD(oscKep, 1), 1e-9},
+            {"oscIncl", STEP_FIELD(oscKep, 2), ANGLE_QUANTUM},
+            {"oscKep3", STEP_FIELD(oscKep, 3), ANGLE_QUANTUM},
+            {"oscKep4", STEP_FIELD(oscKep, 4), ANGLE_QUANTUM},
+            {"oscKep5", STEP_FIELD(oscKep, 5), ANGLE_QUANTUM},
+            {"nodalPeriod", STEP_FIELD(nodalApPer, 0), 1e-6},
+            {"apogee", STEP_FIELD(nodalApPer, 1), KM_QUANTUM},
+            {"perigee", STEP_FIELD(nodalApPer, 2), KM_QUANTUM},
+            {"meanMotion", STEP_FIELD(meanMotion, 0), 1e-8},
+        };
+
+        #undef STEP_FIELD
+
+        inline double& FieldRef(TimeStepData& step, int field)
+        {
+            return *(double*)((char*)&step + FIELDS[field].offset);
+        }
+
+        inline double FieldValue(const TimeStepData& step, int field)
+        {
+            return *(const double*)((const char*)&step + FIELDS[field].offset);
+        }
+
+        inline int64_t Quantize(double value, int field)
+        {
+            // NaN or a wild value from a failed step stores as zero rather than overflowing
+            double quanta = value / FIELDS[field].quantum;
+            return fabs(quanta) < 1e18 ? llround(quanta) : 0;
+        }
+
+        inline void PutVarint(std::vector<uint8_t>& out, int64_t value)
+        {
+            // zigzag so small negative residuals stay short
+            uint64_t bits = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+            while (bits >= 0x80)
+            {
+                out.push_back((uint8_t)(bits | 0x80));
+                bits >>= 7;
+            }
+            out.push_back((uint8_t)bits);
+        }
+
+        inline int64_t GetVarint(const uint8_t* data, size_t& offset)
+        {
+            uint64_t bits = 0;
+            int shift = 0;
+            uint8_t byte;
+            do
+            {
+                byte = data[offset++];
+                bits |= (uint64_t)(byte & 0x7F) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            return (int64_t)(bits >> 1) ^ -(int64_t)(bits & 1);
+        }
+
+    } // namespace
+
+    EphemerisStore::EphemerisStore(StorageMode mode)
+        : m_mode(mode)
+    {
+    }
+
+    void EphemerisStore::Clear()
+    {
+        m_satellites.clear();
+        m_errors.clear();
+        m_doubles.clear();
+        m_floats.clear();
+        m_fixed.clear();
+        m_bytes.clear();
+        m_keyframes.clear();
+    }
+
+    void EphemerisStore::Build(const PropagationResults& results)
+    {
+        Clear();
+
+        size_t totalSteps = 0;
+        for (const auto& sat : results.satellites)
+            totalSteps += sat.timeSteps.size();
+
+        m_satellites.reserve(results.satellites.size());
+        m_errors.reserve(totalSteps);
+        switch (m_mode)
+        {
+            case STORAGE_DOUBLE: m_doubles.reserve(totalSteps * NUM_FIELDS); break;
+            case STORAGE_FLOAT32: m_floats.reserve(totalSteps * NUM_FIELDS); break;
+            case STORAGE_FIXED: m_fixed.reserve(totalSteps * NUM_FIELDS); break;
+            default: break;
+        }
+
+        for (const auto& sat : results.satellites)
+            AddSatellite(sat);
+    }
+
+    int EphemerisStore::AddSatellite(const SatelliteData& satellite)
+    {
+        SatelliteIndex index;
+        index.firstStep = m_errors.size();
+        index.steps = (int)satellite.timeSteps.size();
+        index.firstKeyframe = m_keyframes.size();
+        if (!satellite.timeSteps.empty())
+        {
+            index.baseMse = satellite.timeSteps[0].mse;
+            index.baseDs50 = satellite.timeSteps[0].ds50UTC;
+        }
+
+        int64_t prev[NUM_FIELDS] = {};
+        int64_t prevPrev[NUM_FIELDS] = {};
+        for (int s = 0; s < index.steps; s++)
+        {
+            const TimeStepData& step = satellite.timeSteps[s];
+            m_errors.push_back((uint8_t)step.error);
+
+            for (int f = 0; f < NUM_FIELDS; f++)
+            {
+                double stored = ToStored(index, step, f);
+                switch (m_mode)
+                {
+                    case STORAGE_DOUBLE:
+                        m_doubles.push_back(FieldValue(step, f));
+                        break;
+                    case STORAGE_FLOAT32:
+                        m_floats.push_back((float)stored);
+                        break;
+                    case STORAGE_FIXED:
+                        m_fixed.push_back((int32_t)std::clamp<int64_t>(Quantize(stored, f), INT32_MIN, INT32_MAX));
+                        break;
+                    default:
+                    {
+                        int row = s % DELTA_KEYFRAME_INTERVAL;
+                        if (row == 0 && f == 0)
+                            m_keyframes.push_back(m_bytes.size());
+
+                        // keyframe, then first difference, then second differences, which
+                        // are near zero for anything that moves smoothly
+                        int64_t value = Quantize(stored, f);
+                        int64_t residual = row == 0 ? value
+                                         : row == 1 ? value - prev[f]
+                                         : value - 2 * prev[f] + prevPrev[f];
+                        PutVarint(m_bytes, residual);
+                        prevPrev[f] = prev[f];
+                        prev[f] = value;
+                        break;
+                    }
+                }
+            }
+        }
+
+        m_satellites.push_back(index);
+        return (int)m_satellites.size() - 1;
+    }
+
+    StepError EphemerisStore::GetError(int satellite, int step) const
+    {
+        return (StepError)m_errors[m_satellites[satellite].firstStep + step];
+    }
+
+    TimeStepData EphemerisStore::GetStep(int satellite, int step) const
+    {
+        const SatelliteIndex& index = m_satellites[satellite];
+        double values[NUM_FIELDS];
+        DecodeRow(index, step, values);
+        return MakeStep(index, step, values);
+    }
+
+    double EphemerisStore::GetField(int satellite, int step, EphemerisField field) const
+    {
+        const SatelliteIndex& index = m_satellites[satellite];
+        size_t row = (index.firstStep + step) * NUM_FIELDS + field;
+        switch (m_mode)
+        {
+            case STORAGE_DOUBLE: return m_doubles[row];
+            case STORAGE_FLOAT32: return FromStored(index, m_floats[row], field);
+            case STORAGE_FIXED: return FromStored(index, m_fixed[row] * FIELDS[field].quantum, field);
+            default:
+            {
+                double values[NUM_FIELDS];
+                DecodeRow(index, step, values);
+                return values[field];
+            }
+        }
+    }
+
+    void EphemerisStore::DecodeSatellite(int satellite, std::vector<TimeStepData>& steps) const
+    {
+        const SatelliteIndex& index = m_satellites[satellite];
+        steps.clear();
+        steps.reserve(index.steps);
+
+        if (m_mode != STORAGE_DELTA)
+        {
+            double values[NUM_FIELDS];
+            for (int s = 0; s < index.steps; s++)
+            {
+                DecodeRow(index, s, values);
+                steps.push_back(MakeStep(index, s, values));
+            }
+            return;
+        }
+
+        int64_t prev[NUM_FIELDS] = {};
+        int64_t prevPrev[NUM_FIELDS] = {};
+        int64_t quantized[NUM_FIELDS];
+        double values[NUM_FIELDS];
+        size_t offset = index.steps > 0 ? m_keyframes[index.firstKeyframe] : 0;
+        for (int s = 0; s < index.steps; s++)
+        {
+            offset = DecodeDeltaRow(offset, s % DELTA_KEYFRAME_INTERVAL, prev, prevPrev, quantized);
+            for (int f = 0; f < NUM_FIELDS; f++)
+                values[f] = FromStored(index, quantized[f] * FIELDS[f].quantum, f);
+            steps.push_back(MakeStep(index, s, values));
+        }
+    }
+
+    size_t EphemerisStore::MemoryBytes() const
+    {
+        return m_satellites.capacity() * sizeof(SatelliteIndex) +
+               m_errors.capacity() +
+               m_doubles.capacity() * sizeof(double) +
+               m_floats.capacity() * sizeof(float) +
+               m_fixed.capacity() * sizeof(int32_t) +
+               m_bytes.capacity() +
+               m_keyframes.capacity() * sizeof(uint64_t);
+    }
+
+    const char* EphemerisStore::ModeName(StorageMode mode)
+    {
+        switch (mode)
+        {
+            case STORAGE_DOUBLE: return "double";
+            case STORAGE_FLOAT32: return "float32";
+            case STORAGE_FIXED: return "fixed";
+            case STORAGE_DELTA: return "delta";
+            default: return "unknown";
+        }
+    }
+
+    const char* EphemerisStore::FieldName(EphemerisField field)
+    {
+        return field >= 0 && field < NUM_FIELDS ? FIELDS[field].name : "unknown";
+    }
+
+    double EphemerisStore::FieldQuantum(EphemerisField field)
+    {
+        return FIELDS[field].quantum;
+    }
+
+    double EphemerisStore::ReadField(const TimeStepData& step, EphemerisField field)
+    {
+        return FieldValue(step, field);
+    }
+
+    void EphemerisStore::WriteField(TimeStepData& step, EphemerisField field, double value)
+    {
+        FieldRef(step, field) = value;
+    }
+
+    double EphemerisStore::ErrorBound(StorageMode mode, EphemerisField field, double magnitude)
+    {
+        switch (mode)
+        {
+            case STORAGE_DOUBLE: return 0.0;
+            case STORAGE_FLOAT32: return fabs(magnitude) * ldexp(1.0, -24);
+            default: return FIELDS[field].quantum / 2.0;
+        }
+    }
+
+    double EphemerisStore::ToStored(const SatelliteIndex& index, const TimeStepData& step, int field)
+    {
+        switch (field)
+        {
+            case FIELD_MSE: return step.mse - index.baseMse;
+            case FIELD_DS50: return (step.ds50UTC - index.baseDs50) * 1440.0;
+            default: return FieldValue(step, field);
+        }
+    }
+
+    double EphemerisStore::FromStored(const SatelliteIndex& index, double stored, int field)
+    {
+        switch (field)
+        {
+            case FIELD_MSE: return index.baseMse + stored;
+            case FIELD_DS50: return index.baseDs50 + stored / 1440.0;
+            default: return stored;
+        }
+    }
+
+    void EphemerisStore::DecodeRow(const SatelliteIndex& index, int step, double values[NUM_FIELDS]) const
+    {
+        size_t row = (index.firstStep + step) * NUM_FIELDS;
+        switch (m_mode)
+        {
+            case STORAGE_DOUBLE:
+                memcpy(values, &m_doubles[row], NUM_FIELDS * sizeof(double));
+                break;
+            case STORAGE_FLOAT32:
+                for (int f = 0; f < NUM_FIELDS; f++)
+                    values[f] = FromStored(index, m_floats[row + f], f);
+                break;
+            case STORAGE_FIXED:
+                for (int f = 0; f < NUM_FIELDS; f++)
+                    values[f] = FromStored(index, m_fixed[row + f] * FIELDS[f].quantum, f);
+                break;
+            default:
+            {
+                // walk forward from the keyframe at or before the step
+                int keyframe = step / DELTA_KEYFRAME_INTERVAL;
+                size_t offset = m_keyframes[index.firstKeyframe + keyframe];
+                int64_t prev[NUM_FIELDS] = {};
+                int64_t prevPrev[NUM_FIELDS] = {};
+                int64_t quantized[NUM_FIELDS];
+                for (int row = 0; row <= step % DELTA_KEYFRAME_INTERVAL; row++)
+                    offset = DecodeDeltaRow(offset, row, prev, prevPrev, quantized);
+                for (int f = 0; f < NUM_FIELDS; f++)
+                    values[f] = FromStored(index, quantized[f] * FIELDS[f].quantum, f);
+                break;
+            }
+        }
+    }
+
+    size_t EphemerisStore::DecodeDeltaRow(size_t offset, int row, int64_t prev[NUM_FIELDS], int64_t prevPrev[NUM_FIELDS],
+                                          int64_t out[NUM_FIELDS]) const
+    {
+        const uint8_t* data = m_bytes.data();
+        for (int f = 0; f < NUM_FIELDS; f++)
+        {
+            int64_t residual = GetVarint(data, offset);
+            int64_t value = row == 0 ? residual
+                          : row == 1 ? residual + prev[f]
+                          : residual + 2 * prev[f] - prevPrev[f];
+            prevPrev[f] = prev[f];
+            prev[f] = value;
+            out[f] = value;
+        }
+        return offset;
+    }
+
+    TimeStepData EphemerisStore::MakeStep(const SatelliteIndex& index, int step, const double values[NUM_FIELDS]) const
+    {
+        TimeStepData decoded = {};
+        for (int f = 0; f < NUM_FIELDS; f++)
+            FieldRef(decoded, f) = values[f];
+        decoded.error = (StepError)m_errors[index.firstStep + step];
+        return decoded;
+    }
+
+} // SGP_IMPL
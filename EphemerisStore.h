@@ -0,0 +1,127 @@
+//
+// EphemerisStore.h
+// Compact in-memory storage of propagated steps: float32, fixed-point and delta encoded
+//
+
+#ifndef EPHEMERISSTORE_H
+#define EPHEMERISSTORE_H
+
+#include <cstdint>
+#include <vector>
+#include "PropResults.h"
+
+namespace SGP_IMPL {
+
+    // How the numeric fields of every step are kept
+    enum StorageMode
+    {
+        STORAGE_DOUBLE = 0,     // as propagated, 216 bytes per step
+        STORAGE_FLOAT32,        // 108 bytes per step, relative error 2^-24
+        STORAGE_FIXED,          // int32 multiples of a per field quantum, 108 bytes per step
+        STORAGE_DELTA,          // fixed point, second differences as varints, ~70 bytes at 1 min LEO steps
+        NUM_STORAGE_MODES
+    };
+
+    // The 27 numeric fields of TimeStepData, in declaration order
+    enum EphemerisField
+    {
+        FIELD_MSE = 0,
+        FIELD_DS50 = 1,
+        FIELD_POS = 2,              // x, y, z
+        FIELD_VEL = 5,              // x, y, z
+        FIELD_LLH = 8,              // lat, lon, height
+        FIELD_MEAN_KEP = 11,        // six elements
+        FIELD_OSC_KEP = 17,         // six elements
+        FIELD_NODAL_AP_PER = 23,    // period, apogee, perigee
+        FIELD_MEAN_MOTION = 26,
+        NUM_FIELDS = 27
+    };
+
+    // Keeps the steps of a whole catalog in one set of contiguous buffers. Errors keep their
+    // StepError code exactly; the error records and messages stay with the PropagationResults.
+    //
+    // Error bounds, for the decoded value against the propagated one:
+    //  - STORAGE_FLOAT32: |value| * 2^-24. Times are stored as minutes from the satellite's
+    //    first step, so a week of one minute steps is good to 0.04 s.
+    //  - STORAGE_FIXED and STORAGE_DELTA: half the field's quantum, see FieldQuantum().
+    //    1 m position, 1 mm/s velocity, 1e-6 deg angles, 6 ms time. The fixed mode clamps
+    //    values past 2^31 quanta (e.g. offsets beyond 149 days from the first step).
+    // ErrorBound() gives the figure for a given field and magnitude.
+    //
+    // Delta encoding restarts every DELTA_KEYFRAME_INTERVAL steps, so random access decodes
+    // at most that many rows.
+    class EphemerisStore
+    {
+    public:
+        explicit EphemerisStore(StorageMode mode = STORAGE_FIXED);
+
+        void Clear();
+
+        // Encodes every satellite of the results, in order
+        void Build(const PropagationResults& results);
+
+        // Encodes one more satellite, returns its index
+        int AddSatellite(const SatelliteData& satellite);
+
+        StorageMode GetMode() const { return m_mode; }
+        int SatelliteCount() const { return (int)m_satellites.size(); }
+        int StepCount(int satellite) const { return m_satellites[satellite].steps; }
+        StepError GetError(int satellite, int step) const;
+
+        // Decoded copies, identical to the input in STORAGE_DOUBLE mode
+        TimeStepData GetStep(int satellite, int step) const;
+        double GetField(int satellite, int step, EphemerisField field) const;
+
+        // All steps of one satellite, sequential decoding is the fast way through delta storage
+        void DecodeSatellite(int satellite, std::vector<TimeStepData>& steps) const;
+
+        // Heap bytes held by the store
+        size_t MemoryBytes() const;
+
+        static const char* ModeName(StorageMode mode);
+        static const char* FieldName(EphemerisField field);
+
+        // Step of the fixed point modes, in the field's units
+        static double FieldQuantum(EphemerisField field);
+
+        // Field access by index, in the units TimeStepData uses
+        static double ReadField(const TimeStepData& step, EphemerisField field);
+        static void WriteField(TimeStepData& step, EphemerisField field, double value);
+
+        // Largest decode error for a value of the given magnitude
+        static double ErrorBound(StorageMode mode, EphemerisField field, double magnitude);
+
+        static constexpr int DELTA_KEYFRAME_INTERVAL = 32;
+
+    private:
+        struct SatelliteIndex
+        {
+            size_t firstStep = 0;       // into the per step columns
+            int steps = 0;
+            double baseMse = 0.0;       // time fields are stored relative to these
+            double baseDs50 = 0.0;
+            size_t firstKeyframe = 0;   // into m_keyframes, delta mode only
+        };
+
+        // Field value as stored: time fields become minutes from the first step
+        static double ToStored(const SatelliteIndex& index, const TimeStepData& step, int field);
+        static double FromStored(const SatelliteIndex& index, double stored, int field);
+
+        void DecodeRow(const SatelliteIndex& index, int step, double values[NUM_FIELDS]) const;
+        size_t DecodeDeltaRow(size_t offset, int row, int64_t prev[NUM_FIELDS], int64_t prevPrev[NUM_FIELDS],
+                              int64_t out[NUM_FIELDS]) const;
+        TimeStepData MakeStep(const SatelliteIndex& index, int step, const double values[NUM_FIELDS]) const;
+
+        StorageMode m_mode;
+        std::vector<SatelliteIndex> m_satellites;
+        std::vector<uint8_t> m_errors;          // StepError per step
+        std::vector<double> m_doubles;          // STORAGE_DOUBLE, NUM_FIELDS per step
+        std::vector<float> m_floats;            // STORAGE_FLOAT32
+        std::vector<int32_t> m_fixed;           // STORAGE_FIXED
+        std::vector<uint8_t> m_bytes;           // STORAGE_DELTA varint stream
+        std::vector<uint64_t> m_keyframes;      // STORAGE_DELTA, stream offset of every keyframe row
+    };
+
+} // SGP_IMPL
+
+#endif //EPHEMERISSTORE_H
@@ -0,0 +1,229 @@
+//
+// EventDetector.cpp
+// Zero crossings of user event functions along SGP4 trajectories, refined between steps
+//
+
+#include "EventDetector.h"
+#include "Propagator.h"
+#include "RootFinder.h"
+#include "ScratchTable.h"
+#include "WorkScheduler.h"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "services/TimeFuncDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/Sgp4PropDll.h"
+#include "wrappers/TimeFuncDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        // One function's value at a time inside a step
+        struct Point
+        {
+            double t = 0.0;                     // days from the start of the step
+            double f = 0.0;
+            bool failed = false;
+            EventState state;
+        };
+
+        bool Propagate(__int64 satKey, double ds50UTC, EventState& state, int& evaluations)
+        {
+            evaluations++;
+            state.ds50UTC = ds50UTC;
+            return Sgp4PropDs50UTC(satKey, ds50UTC, &state.mse, state.pos, state.vel, state.llh) == 0;
+        }
+
+    } // namespace
+
+    namespace EventFunctions {
+
+        EventFunction Nodes(EventDirection direction)
+        {
+            return {"node", [](const EventState& state) { return state.pos[2]; }, direction};
+        }
+
+        EventFunction Apsides(EventDirection direction)
+        {
+            return {"apsis", [](const EventState& state)
+            {
+                return state.pos[0] * state.vel[0] + state.pos[1] * state.vel[1] + state.pos[2] * state.vel[2];
+            }, direction};
+        }
+
+        EventFunction LatitudeBand(double minLatitude, double maxLatitude, EventDirection direction)
+        {
+            return {"latitude_band", [=](const EventState& state)
+            {
+                return std::min(state.llh[0] - minLatitude, maxLatitude - state.llh[0]);
+            }, direction};
+        }
+
+        EventFunction Altitude(double altitudeKm, EventDirection direction)
+        {
+            return {"altitude", [=](const EventState& state) { return state.llh[2] - altitudeKm; }, direction};
+        }
+
+    } // EventFunctions
+
+    SatelliteEvents EventDetector::RunOne(__int64 satKey, const std::vector<EventFunction>& functions,
+                                          const std::vector<double>& times, const EventOptions& options)
+    {
+        SatelliteEvents result;
+        result.initialized = true;
+        size_t numFunctions = functions.size();
+        double tol = options.toleranceSeconds / 86400.0;
+
+        EventState previous, current;
+        std::vector<double> previousG(numFunctions), currentG(numFunctions);
+        for (size_t k = 0; k < times.size(); k++)
+        {
+            if (!Propagate(satKey, times[k], current, result.evaluations))
+            {
+                char message[64];
+                snprintf(message, sizeof(message), "SGP4 fails at %.8f", times[k]);
+                result.error = message;
+                break;
+            }
+            result.steps++;
+            for (size_t f = 0; f < numFunctions; f++)
+                currentG[f] = functions[f].g(current);
+
+            for (size_t f = 0; f < numFunctions && k > 0; f++)
+            {
+                bool increasing = currentG[f] >= 0.0;
+                if ((previousG[f] >= 0.0) == increasing || !(functions[f].direction & (increasing ? EVENT_INCREASING
+                                                                                                    : EVENT_DECREASING)))
+                    continue;
+
+                // a failure inside the step moves the bracket towards its end
+                double stepStart = previous.ds50UTC;
+                double beforeG = previousG[f];
+                auto eval = [&](double t)
+                {
+                    Point point;
+                    point.t = t;
+                    point.failed = !Propagate(satKey, stepStart + t, point.state, result.evaluations);
+                    point.f = point.failed ? beforeG : functions[f].g(point.state);
+                    return point;
+                };
+                Point before, after;
+                before.f = previousG[f];
+                before.state = previous;
+                after.t = current.ds50UTC - stepStart;
+                after.f = currentG[f];
+                after.state = current;
+                BrentBracket(eval, before, after, tol);
+
+                const Point& closest = fabs(before.f) <= fabs(after.f) && !before.failed ? before : after;
+                OrbitEvent& event = result.events.emplace_back();
+                event.function = (int)f;
+                event.increasing = increasing;
+                event.state = closest.state;
+            }
+            previous = current;
+            std::swap(previousG, currentG);
+        }
+
+        std::stable_sort(result.events.begin(), result.events.end(), [](const OrbitEvent& a, const OrbitEvent& b)
+        {
+            return a.state.ds50UTC < b.state.ds50UTC;
+        });
+        return result;
+    }
+
+    EventReport EventDetector::Run(const std::vector<TleElements>& catalog, const std::vector<EventFunction>& functions,
+                                   double startTime, double stopTime, double stepSize, const EventOptions& options)
+    {
+        auto start = std::chrono::steady_clock::now();
+        EventReport report;
+        report.satellites.resize(catalog.size());
+        std::vector<double> times = Propagator::StepTimes(startTime, stopTime, stepSize);
+
+        ScratchTable table;
+        std::vector<const TleElements*> sets;
+        std::vector<SatelliteCost> costs;
+        for (size_t chunk = 0; chunk < catalog.size(); chunk += ScratchTable::MAX_SETS)
+        {
+            size_t chunkEnd = std::min(catalog.size(), chunk + (size_t)ScratchTable::MAX_SETS);
+            sets.clear();
+            for (size_t i = chunk; i < chunkEnd; i++)
+                sets.push_back(&catalog[i]);
+            table.Fill(sets);
+
+            costs.assign(chunkEnd - chunk, SatelliteCost());
+            for (size_t i = chunk; i < chunkEnd; i++)
+            {
+                SatelliteEvents& satellite = report.satellites[i];
+                satellite.satNum = catalog[i].satNum;
+                if (table.Key(i - chunk) <= 0)
+                {
+                    satellite.error = table.Error(i - chunk);
+                    continue;
+                }
+                costs[i - chunk] = CostModel::Estimate(catalog[i], startTime, stopTime, stepSize);
+                costs[i - chunk].cost = std::max(costs[i - chunk].cost, 1.0);
+            }
+
+            WorkScheduler::Run(WorkScheduler::Order(costs), options.numThreads, [&](int index)
+            {
+                size_t i = chunk + index;
+                report.satellites[i] = RunOne(table.Key(index), functions, times, options);
+                report.satellites[i].satNum = catalog[i].satNum;
+            });
+        }
+        table.Clear();
+
+        for (const SatelliteEvents& satellite : report.satellites)
+        {
+            report.events += satellite.events.size();
+            report.evaluations += satellite.evaluations;
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    bool EventDetector::WriteEvents(const std::string& filePath, const EventReport& report,
+                                    const std::vector<EventFunction>& functions, std::string* error)
+    {
+        FILE* fp = fopen(filePath.c_str(), "w");
+        if (!fp)
+        {
+            if (error)
+                *error = "Can't create " + filePath;
+            return false;
+        }
+        for (const SatelliteEvents& satellite : report.satellites)
+        {
+            for (const OrbitEvent& event : satellite.events)
+            {
+                const EventState& s = event.state;
+                fprintf(fp, "%05d %17.8f %s %-14s %-10s %14.6f %14.6f %14.6f %9.4f %9.4f %10.3f\n", satellite.satNum,
+                        s.ds50UTC, UTCToDtg20Str(s.ds50UTC), functions[event.function].name.c_str(),
+                        event.increasing ? "increasing" : "decreasing", s.pos[0], s.pos[1], s.pos[2],
+                        s.llh[0], s.llh[1], s.llh[2]);
+            }
+            if (!satellite.error.empty())
+                fprintf(fp, "%05d error %s\n", satellite.satNum, satellite.error.c_str());
+        }
+        bool written = fclose(fp) == 0;
+        if (!written && error)
+            *error = "Can't write " + filePath;
+        return written;
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,121 @@
+//
+// EventDetector.h
+// Zero crossings of user event functions along SGP4 trajectories, refined between steps
+//
+
+#ifndef EVENTDETECTOR_H
+#define EVENTDETECTOR_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "TleUtil.h"
+
+namespace SGP_IMPL {
+
+    // What an event function sees at one time, as Sgp4PropDs50UTC gives it
+    struct EventState
+    {
+        double ds50UTC = 0.0;
+        double mse = 0.0;               // minutes since epoch
+        double pos[3] = {};             // km, TEME
+        double vel[3] = {};             // km/s
+        double llh[3] = {};             // deg, deg, km
+    };
+
+    enum EventDirection
+    {
+        EVENT_INCREASING = 1,           // g goes from negative to positive
+        EVENT_DECREASING = 2,
+        EVENT_ANY = EVENT_INCREASING | EVENT_DECREASING
+    };
+
+    // A scalar g(t) whose zeros are the events. It has to be continuous: a jump in sign is
+    // found like a root, at the jump.
+    struct EventFunction
+    {
+        std::string name;
+        std::function<double(const EventState&)> g;
+        EventDirection direction = EVENT_ANY;
+    };
+
+    // Common event functions; names are what EventDetector::WriteEvents prints
+    namespace EventFunctions {
+
+        // Equator crossings, g = z. Ascending ones increase.
+        EventFunction Nodes(EventDirection direction = EVENT_ANY);
+
+        // Apsis passages, g = r . v: perigee where it increases, apogee where it decreases
+        EventFunction Apsides(EventDirection direction = EVENT_ANY);
+
+        // Inside a band of geodetic latitude (deg) g is positive: entries increase, exits decrease
+        EventFunction LatitudeBand(double minLatitude, double maxLatitude, EventDirection direction = EVENT_ANY);
+
+        // Height above the ellipsoid (km): climbs through it increase
+        EventFunction Altitude(double altitudeKm, EventDirection direction = EVENT_ANY);
+
+    } // EventFunctions
+
+    struct EventOptions
+    {
+        double toleranceSeconds = 1e-3;
+        int numThreads = 1;
+    };
+
+    struct OrbitEvent
+    {
+        int function = 0;               // index into the functions searched
+        bool increasing = false;        // the direction g crossed in
+        EventState state;               // at the event
+    };
+
+    struct SatelliteEvents
+    {
+        int satNum = 0;
+        bool initialized = false;
+        std::vector<OrbitEvent> events; // in time order
+        int steps = 0;                  // grid times propagated
+        int evaluations = 0;            // Sgp4PropDs50UTC calls, the grid included
+        std::string error;              // failed to initialize, or where SGP4 stopped
+    };
+
+    struct EventReport
+    {
+        std::vector<SatelliteEvents> satellites;    // catalog order
+        long long events = 0;
+        long long evaluations = 0;
+        double seconds = 0.0;
+    };
+
+    // Instead of stepping finely and post-processing the output, the detector propagates
+    // each satellite over the job's grid once, evaluates every function at every step and
+    // only spends extra propagations inside steps where a function changes sign, where
+    // Brent's method finds the crossing to toleranceSeconds. Events of one satellite come
+    // out merged across functions in time order.
+    //
+    // A function that crosses zero twice within one step shows no sign change and both
+    // events are missed, so the step has to be shorter than the events are apart: a tenth of
+    // a period catches apsides and nodes. A satellite stops at the first step SGP4 fails on,
+    // as in a job. Satellites go in ScratchTable batches and are searched on numThreads, so
+    // this can't run alongside a job.
+    class EventDetector
+    {
+    public:
+        // start and stop in ds50UTC, step in minutes, laid out as Propagator::StepTimes
+        static EventReport Run(const std::vector<TleElements>& catalog, const std::vector<EventFunction>& functions,
+                               double startTime, double stopTime, double stepSize,
+                               const EventOptions& options = EventOptions());
+
+        // One satellite already initialized in SGP4, over the given times
+        static SatelliteEvents RunOne(__int64 satKey, const std::vector<EventFunction>& functions,
+                                      const std::vector<double>& times, const EventOptions& options = EventOptions());
+
+        // One line per event: number, time, date, function, direction, position, latitude,
+        // longitude, height
+        static bool WriteEvents(const std::string& filePath, const EventReport& report,
+                                const std::vector<EventFunction>& functions, std::string* error = nullptr);
+    };
+
+} // SGP_IMPL
+
+#endif //EVENTDETECTOR_H
@@ -0,0 +1,144 @@
+//
+// FrameScheduler.cpp
+// Decides when the main loop draws a frame, so an idle UI costs next to nothing
+//
+
+#include "FrameScheduler.h"
+#include "extern/imgui/imgui.h"
+#define GLFW_INCLUDE_NONE
+#include "extern/GLFW/glfw3.h"
+
+// GLFW callbacks carry no user data we can safely claim (the ImGui backend may use the
+// window user pointer), and the app has a single window, so the attached scheduler is global
+static FrameScheduler* s_attached = nullptr;
+
+void FrameScheduler::Attach(GLFWwindow* window)
+{
+    m_window = window;
+    s_attached = this;
+
+    m_prevCursorPos = glfwSetCursorPosCallback(window, OnCursorPos);
+    m_prevMouseButton = glfwSetMouseButtonCallback(window, OnMouseButton);
+    m_prevScroll = glfwSetScrollCallback(window, OnScroll);
+    m_prevKey = glfwSetKeyCallback(window, OnKey);
+    m_prevChar = glfwSetCharCallback(window, OnChar);
+    m_prevCursorEnter = glfwSetCursorEnterCallback(window, OnCursorEnter);
+    m_prevWindowFocus = glfwSetWindowFocusCallback(window, OnWindowFocus);
+    m_prevWindowSize = glfwSetWindowSizeCallback(window, OnWindowSize);
+    m_prevWindowRefresh = glfwSetWindowRefreshCallback(window, OnWindowRefresh);
+
+    m_lastFrame = glfwGetTime();
+}
+
+bool FrameScheduler::WaitForNextFrame(bool animating)
+{
+    if (m_window && glfwGetWindowAttrib(m_window, GLFW_ICONIFIED))
+    {
+        // nothing to show, just keep the event queue moving
+        glfwWaitEventsTimeout(IDLE_TIMEOUT);
+        return false;
+    }
+
+    if (animating || m_pendingFrames.load() > 0)
+    {
+        double now = glfwGetTime();
+        double due = m_maxFps > 0 ? m_lastFrame + 1.0 / m_maxFps : now;
+        if (due > now)
+            glfwWaitEventsTimeout(due - now); // input still wakes us straight away
+        else
+            glfwPollEvents();
+    }
+    else
+    {
+        // sleep until input, a Wake() or the idle timeout
+        double timeout = IDLE_TIMEOUT;
+        if (ImGui::GetCurrentContext() && ImGui::GetIO().WantTextInput && timeout > TEXT_INPUT_REFRESH)
+            timeout = TEXT_INPUT_REFRESH;
+        glfwWaitEventsTimeout(timeout);
+    }
+
+    // this frame uses up one of the requested ones
+    int pending = m_pendingFrames.load();
+    while (pending > 0 && !m_pendingFrames.compare_exchange_weak(pending, pending - 1))
+    {
+    }
+
+    m_lastFrame = glfwGetTime();
+    return true;
+}
+
+void FrameScheduler::RequestFrames(int frames)
+{
+    int pending = m_pendingFrames.load();
+    while (pending < frames && !m_pendingFrames.compare_exchange_weak(pending, frames))
+    {
+    }
+}
+
+void FrameScheduler::Wake()
+{
+    glfwPostEmptyEvent();
+}
+
+void FrameScheduler::OnCursorPos(GLFWwindow* window, double x, double y)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevCursorPos) self->m_prevCursorPos(window, x, y);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
+
+void FrameScheduler::OnMouseButton(GLFWwindow* window, int button, int action, int mods)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevMouseButton) self->m_prevMouseButton(window, button, action, mods);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
+
+void FrameScheduler::OnScroll(GLFWwindow* window, double xOffset, double yOffset)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevScroll) self->m_prevScroll(window, xOffset, yOffset);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
+
+void FrameScheduler::OnKey(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevKey) self->m_prevKey(window, key, scancode, action, mods);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
+
+void FrameScheduler::OnChar(GLFWwindow* window, unsigned int codepoint)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevChar) self->m_prevChar(window, codepoint);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
+
+void FrameScheduler::OnCursorEnter(GLFWwindow* window, int entered)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevCursorEnter) self->m_prevCursorEnter(window, entered);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
+
+void FrameScheduler::OnWindowFocus(GLFWwindow* window, int focused)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevWindowFocus) self->m_prevWindowFocus(window, focused);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
+
+void FrameScheduler::OnWindowSize(GLFWwindow* window, int width, int height)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevWindowSize) self->m_prevWindowSize(window, width, height);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
+
+void FrameScheduler::OnWindowRefresh(GLFWwindow* window)
+{
+    FrameScheduler* self = s_attached;
+    if (self->m_prevWindowRefresh) self->m_prevWindowRefresh(window);
+    self->RequestFrames(FRAMES_AFTER_INPUT);
+}
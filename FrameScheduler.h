@@ -0,0 +1,75 @@
+//
+// FrameScheduler.h
+// Decides when the main loop draws a frame, so an idle UI costs next to nothing
+//
+
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <atomic>
+
+struct GLFWwindow;
+
+// The main loop asks WaitForNextFrame() before every frame:
+//  - while something is moving (animation, processing, live catalog, imagery streaming)
+//    frames run at full rate, optionally capped by the max frame rate
+//  - otherwise the thread sleeps in glfwWaitEventsTimeout until input arrives or background
+//    work calls Wake(), so idle CPU drops to near zero and both are shown straight away
+//  - every input event buys a few extra frames, ImGui needs them to settle hover states,
+//    popups and layout changes
+class FrameScheduler
+{
+public:
+    // Hooks the window's input callbacks, chaining to the ones already installed (ImGui)
+    void Attach(GLFWwindow* window);
+
+    // Blocks until the next frame is due and processes pending events. Returns false
+    // when there is nothing to draw (minimized window)
+    bool WaitForNextFrame(bool animating);
+
+    // Wakes the main loop from any thread for one frame, background work calls it when it
+    // has something new to show
+    static void Wake();
+
+    // 0 leaves the rate to vsync
+    void SetMaxFps(int fps) { m_maxFps = fps < 0 ? 0 : fps; }
+    int GetMaxFps() const { return m_maxFps; }
+
+private:
+    void RequestFrames(int frames);
+
+    static void OnCursorPos(GLFWwindow* window, double x, double y);
+    static void OnMouseButton(GLFWwindow* window, int button, int action, int mods);
+    static void OnScroll(GLFWwindow* window, double xOffset, double yOffset);
+    static void OnKey(GLFWwindow* window, int key, int scancode, int action, int mods);
+    static void OnChar(GLFWwindow* window, unsigned int codepoint);
+    static void OnCursorEnter(GLFWwindow* window, int entered);
+    static void OnWindowFocus(GLFWwindow* window, int focused);
+    static void OnWindowSize(GLFWwindow* window, int width, int height);
+    static void OnWindowRefresh(GLFWwindow* window);
+
+    // ImGui needs a couple of frames after an event before the UI is stable again
+    static constexpr int FRAMES_AFTER_INPUT = 3;
+    // Text cursor blink while an input field is active
+    static constexpr double TEXT_INPUT_REFRESH = 0.5;
+    // Longest sleep while idle, keeps clocks in the UI roughly current
+    static constexpr double IDLE_TIMEOUT = 1.0;
+
+    GLFWwindow* m_window = nullptr;
+    std::atomic<int> m_pendingFrames{FRAMES_AFTER_INPUT};
+    int m_maxFps = 0;
+    double m_lastFrame = 0.0;
+
+    // Callbacks that were installed before Attach(), called first
+    void (*m_prevCursorPos)(GLFWwindow*, double, double) = nullptr;
+    void (*m_prevMouseButton)(GLFWwindow*, int, int, int) = nullptr;
+    void (*m_prevScroll)(GLFWwindow*, double, double) = nullptr;
+    void (*m_prevKey)(GLFWwindow*, int, int, int, int) = nullptr;
+    void (*m_prevChar)(GLFWwindow*, unsigned int) = nullptr;
+    void (*m_prevCursorEnter)(GLFWwindow*, int) = nullptr;
+    void (*m_prevWindowFocus)(GLFWwindow*, int) = nullptr;
+    void (*m_prevWindowSize)(GLFWwindow*, int, int) = nullptr;
+    void (*m_prevWindowRefresh)(GLFWwindow*) = nullptr;
+};
+
+#endif //FRAMESCHEDULER_H
@@ -0,0 +1,293 @@
+//
+// Instrumentation.cpp
+// Low overhead phase timers, counters and Chrome trace export for propagation jobs
+//
+
+#include "Instrumentation.h"
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        struct TraceEvent
+        {
+            int64_t startNs;
+            int64_t durationNs;
+            Phase phase;
+        };
+
+        // Written only by the owning thread. The fields are atomics so a summary taken from the
+        // GUI thread never reads torn values, but updates are plain load/store pairs rather
+        // than locked read-modify-writes, since there is a single writer.
+        struct ThreadData
+        {
+            int id = 0;
+            std::atomic<uint64_t> count[NUM_PHASES] = {};
+            std::atomic<uint64_t> totalNs[NUM_PHASES] = {};
+            std::atomic<uint64_t> minNs[NUM_PHASES] = {};
+            std::atomic<uint64_t> maxNs[NUM_PHASES] = {};
+            std::atomic<uint64_t> counters[NUM_COUNTERS] = {};
+            std::atomic<uint64_t> histogram[HISTOGRAM_BUCKETS] = {};
+
+            // reserved once and never grown, so readers can walk it up to eventCount
+            std::vector<TraceEvent> events;
+            std::atomic<size_t> eventCount{0};
+            std::atomic<uint64_t> dropped{0};
+
+            // the owning thread has ended, Reset drops the data
+            std::atomic<bool> exited{false};
+        };
+
+        // Marks the thread's data as done when the thread ends
+        struct LocalHandle
+        {
+            std::shared_ptr<ThreadData> data;
+
+            ~LocalHandle()
+            {
+                if (data)
+                    data->exited.store(true);
+            }
+        };
+
+        inline void Add(std::atomic<uint64_t>& value, uint64_t delta)
+        {
+            value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        }
+
+        std::mutex s_registryMutex;
+        std::vector<std::shared_ptr<ThreadData>> s_threads;
+        int s_nextId = 0;
+        std::atomic<size_t> s_traceCapacity{1u << 16};
+
+        ThreadData& LocalData()
+        {
+            // shared with the registry so a worker's data outlives the worker until the
+            // next Reset; jobs start new workers every time
+            thread_local LocalHandle local;
+            if (!local.data)
+            {
+                local.data = std::make_shared<ThreadData>();
+                local.data->events.reserve(s_traceCapacity.load());
+
+                std::lock_guard<std::mutex> lock(s_registryMutex);
+                local.data->id = s_nextId++;
+                s_threads.push_back(local.data);
+            }
+            return *local.data;
+        }
+
+        int HistogramBucket(int64_t durationNs)
+        {
+            uint64_t us = durationNs > 0 ? (uint64_t)durationNs / 1000 : 0;
+            int bucket = 0;
+            while (us > 1 && bucket < HISTOGRAM_BUCKETS - 1)
+            {
+                us >>= 1;
+                bucket++;
+            }
+            return bucket;
+        }
+
+    } // namespace
+
+    std::atomic<bool> Instrumentation::s_enabled{false};
+    const std::chrono::steady_clock::time_point Instrumentation::s_epoch = std::chrono::steady_clock::now();
+
+    void Instrumentation::SetTraceCapacity(size_t events)
+    {
+        s_traceCapacity.store(events);
+    }
+
+    void Instrumentation::Reset()
+    {
+        std::lock_guard<std::mutex> lock(s_registryMutex);
+        s_threads.erase(std::remove_if(s_threads.begin(), s_threads.end(), [](const std::shared_ptr<ThreadData>& thread)
+        {
+            return thread->exited.load();
+        }), s_threads.end());
+        for (const auto& thread : s_threads)
+        {
+            for (int p = 0; p < NUM_PHASES; p++)
+            {
+                thread->count[p] = 0;
+                thread->totalNs[p] = 0;
+                thread->minNs[p] = 0;
+                thread->maxNs[p] = 0;
+            }
+            for (auto& counter : thread->counters)
+                counter = 0;
+            for (auto& bucket : thread->histogram)
+                bucket = 0;
+            thread->eventCount = 0;
+            thread->dropped = 0;
+        }
+    }
+
+    void Instrumentation::Record(Phase phase, int64_t startNs, int64_t durationNs)
+    {
+        ThreadData& data = LocalData();
+        uint64_t duration = durationNs > 0 ? (uint64_t)durationNs : 0;
+
+        uint64_t count = data.count[phase].load(std::memory_order_relaxed);
+        if (count == 0 || duration < data.minNs[phase].load(std::memory_order_relaxed))
+            data.minNs[phase].store(duration, std::memory_order_relaxed);
+        if (duration > data.maxNs[phase].load(std::memory_order_relaxed))
+            data.maxNs[phase].store(duration, std::memory_order_relaxed);
+        data.count[phase].store(count + 1, std::memory_order_relaxed);
+        Add(data.totalNs[phase], duration);
+
+        if (phase == PHASE_SATELLITE)
+            Add(data.histogram[HistogramBucket(durationNs)], 1);
+
+        size_t index = data.eventCount.load(std::memory_order_relaxed);
+        if (index < data.events.capacity())
+        {
+            if (index < data.events.size())
+                data.events[index] = {startNs, durationNs, phase};
+            else
+                data.events.push_back({startNs, durationNs, phase});
+            data.eventCount.store(index + 1, std::memory_order_release);
+        }
+        else
+        {
+            Add(data.dropped, 1);
+        }
+    }
+
+    void Instrumentation::Count(Counter counter, uint64_t value)
+    {
+        Add(LocalData().counters[counter], value);
+    }
+
+    InstrumentationSummary Instrumentation::Summarize()
+    {
+        InstrumentationSummary summary;
+
+        std::lock_guard<std::mutex> lock(s_registryMutex);
+        for (const auto& thread : s_threads)
+        {
+            // threads still alive from earlier jobs stay registered without recording
+            bool recorded = false;
+            for (int p = 0; p < NUM_PHASES; p++)
+            {
+                uint64_t count = thread->count[p].load(std::memory_order_relaxed);
+                if (count == 0)
+                    continue;
+                recorded = true;
+
+                PhaseStats& stats = summary.phases[p];
+                uint64_t minNs = thread->minNs[p].load(std::memory_order_relaxed);
+                stats.minNs = stats.count == 0 ? minNs : std::min(stats.minNs, minNs);
+                stats.maxNs = std::max(stats.maxNs, thread->maxNs[p].load(std::memory_order_relaxed));
+                stats.count += count;
+                stats.totalNs += thread->totalNs[p].load(std::memory_order_relaxed);
+            }
+            for (int c = 0; c < NUM_COUNTERS; c++)
+                summary.counters[c] += thread->counters[c].load(std::memory_order_relaxed);
+            for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+                summary.histogram[b] += thread->histogram[b].load(std::memory_order_relaxed);
+            summary.traceEvents += thread->eventCount.load(std::memory_order_acquire);
+            summary.droppedEvents += thread->dropped.load(std::memory_order_relaxed);
+            summary.threads += recorded ? 1 : 0;
+        }
+        return summary;
+    }
+
+    bool Instrumentation::WriteChromeTrace(const std::string& filePath)
+    {
+        FILE* fp = fopen(filePath.c_str(), "w");
+        if (!fp)
+            return false;
+
+        std::lock_guard<std::mutex> lock(s_registryMutex);
+        fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+        bool first = true;
+        for (const auto& thread : s_threads)
+        {
+            size_t count = thread->eventCount.load(std::memory_order_acquire);
+            if (count == 0)
+                continue;
+            fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                    first ? "" : ",\n", thread->id, thread->id);
+            first = false;
+
+            for (size_t i = 0; i < count; i++)
+            {
+                const TraceEvent& event = thread->events[i];
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"propagation\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        PhaseName(event.phase), thread->id, event.startNs / 1000.0, event.durationNs / 1000.0);
+            }
+        }
+
+        fprintf(fp, "\n]}\n");
+        bool ok = ferror(fp) == 0;
+        fclose(fp);
+        return ok;
+    }
+
+    void Instrumentation::LogSummary(spdlog::logger& logger)
+    {
+        InstrumentationSummary summary = Summarize();
+
+        logger.info("Propagation profile: {} thread(s), {} trace events ({} dropped)",
+                    summary.threads, summary.traceEvents, summary.droppedEvents);
+        for (int p = 0; p < NUM_PHASES; p++)
+        {
+            const PhaseStats& stats = summary.phases[p];
+            if (stats.count == 0)
+                continue;
+            logger.info("  {:<16} {:>10} calls {:>12.3f} ms total {:>10.3f} us avg {:>10.3f} us min {:>10.3f} us max",
+                        PhaseName((Phase)p), stats.count, stats.totalNs / 1e6,
+                        stats.totalNs / 1e3 / stats.count, stats.minNs / 1e3, stats.maxNs / 1e3);
+        }
+        for (int c = 0; c < NUM_COUNTERS; c++)
+            logger.info("  {:<16} {:>10}", CounterName((Counter)c), summary.counters[c]);
+
+        logger.info("  Time per satellite:");
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            if (summary.histogram[b] == 0)
+                continue;
+            logger.info("    {:>10} - {:>10} us {:>10}", b == 0 ? 0ull : 1ull << b, 1ull << (b + 1), summary.histogram[b]);
+        }
+    }
+
+    const char* Instrumentation::PhaseName(Phase phase)
+    {
+        switch (phase)
+        {
+            case PHASE_JOB: return "Job";
+            case PHASE_LOAD_FILE: return "LoadFile";
+            case PHASE_SATELLITE: return "Satellite";
+            case PHASE_INIT_SAT: return "InitSat";
+            case PHASE_PROPAGATE: return "Propagate";
+            case PHASE_OSC_KEP: return "OscKep";
+            case PHASE_MEAN_KEP: return "MeanKep";
+            case PHASE_NODAL_AP_PER: return "NodalApPer";
+            case PHASE_ASSEMBLE_STEP: return "AssembleStep";
+            case PHASE_STORE_SATELLITE: return "StoreSatellite";
+            case PHASE_WORKER: return "Worker";
+            default: return "Unknown";
+        }
+    }
+
+    const char* Instrumentation::CounterName(Counter counter)
+    {
+        switch (counter)
+        {
+            case COUNTER_STEPS: return "Steps";
+            case COUNTER_ERRORS: return "Errors";
+            case COUNTER_BYTES: return "Result bytes";
+            default: return "Unknown";
+        }
+    }
+
+} // SGP_IMPL
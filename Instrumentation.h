@@ -0,0 +1,146 @@
+//
+// Instrumentation.h
+// Low overhead phase timers, counters and Chrome trace export for propagation jobs
+//
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace spdlog { class logger; }
+
+namespace SGP_IMPL {
+
+    // Phases of a propagation job that get their own timer
+    enum Phase
+    {
+        PHASE_JOB = 0,          // RunOneSgp4Job or a pipeline run as a whole
+        PHASE_LOAD_FILE,        // Sgp4LoadFileAll, or the pipeline's parse stage
+        PHASE_SATELLITE,        // one satellite, init to stored results (feeds the histogram)
+        PHASE_INIT_SAT,         // Sgp4InitSat
+        PHASE_PROPAGATE,        // Sgp4PropDs50UTC
+        PHASE_OSC_KEP,          // Sgp4GetPropOut(XF_SGP4OUT_OSC_KEP)
+        PHASE_MEAN_KEP,         // Sgp4GetPropOut(XF_SGP4OUT_MEAN_KEP)
+        PHASE_NODAL_AP_PER,     // Sgp4GetPropOut(XF_SGP4OUT_NODAL_AP_PER)
+        PHASE_ASSEMBLE_STEP,    // TimeStepData fill and push_back
+        PHASE_STORE_SATELLITE,  // results.satellites.push_back
+        PHASE_WORKER,           // one propagation thread, first satellite to last (load balance)
+        NUM_PHASES
+    };
+
+    enum Counter
+    {
+        COUNTER_STEPS = 0,      // time steps produced
+        COUNTER_ERRORS,         // steps or satellites that ended in an error
+        COUNTER_BYTES,          // result bytes produced (steps plus error records)
+        NUM_COUNTERS
+    };
+
+    // Per satellite time histogram, bucket b holds times in [2^b, 2^(b+1)) microseconds
+    constexpr int HISTOGRAM_BUCKETS = 32;
+
+    struct PhaseStats
+    {
+        uint64_t count = 0;
+        uint64_t totalNs = 0;
+        uint64_t minNs = 0;
+        uint64_t maxNs = 0;
+    };
+
+    struct InstrumentationSummary
+    {
+        PhaseStats phases[NUM_PHASES];
+        uint64_t counters[NUM_COUNTERS] = {};
+        uint64_t histogram[HISTOGRAM_BUCKETS] = {};
+        uint64_t traceEvents = 0;
+        uint64_t droppedEvents = 0;   // past the per thread trace capacity, still in the totals
+        int threads = 0;
+    };
+
+    // Every thread records into its own buffers, so timers never contend. Totals and the
+    // histogram are always kept, trace events only up to a per thread capacity, which keeps
+    // memory bounded on 50k satellite jobs while the totals stay exact.
+    //
+    // Recording is compiled in with SATPROP_INSTRUMENTATION and switched on at runtime with
+    // SetEnabled(); while off, a timer costs one relaxed atomic load.
+    class Instrumentation
+    {
+    public:
+        static void SetEnabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+        static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+        // Trace events kept per thread, applies to threads that start recording afterwards
+        static void SetTraceCapacity(size_t events);
+
+        // Clears everything recorded so far, call between jobs
+        static void Reset();
+
+        static void Record(Phase phase, int64_t startNs, int64_t durationNs);
+        static void Count(Counter counter, uint64_t value);
+
+        static InstrumentationSummary Summarize();
+
+        // chrome://tracing / Perfetto compatible JSON, returns false when the file can't be written
+        static bool WriteChromeTrace(const std::string& filePath);
+
+        static void LogSummary(spdlog::logger& logger);
+
+        static const char* PhaseName(Phase phase);
+        static const char* CounterName(Counter counter);
+
+        // Nanoseconds since the process started recording
+        static int64_t NowNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - s_epoch).count();
+        }
+
+    private:
+        static std::atomic<bool> s_enabled;
+        static const std::chrono::steady_clock::time_point s_epoch;
+    };
+
+    // Times the enclosing scope into one phase
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Phase phase)
+            : m_phase(phase), m_active(Instrumentation::IsEnabled())
+        {
+            if (m_active)
+                m_start = Instrumentation::NowNs();
+        }
+
+        ~ScopedTimer()
+        {
+            if (m_active)
+                Instrumentation::Record(m_phase, m_start, Instrumentation::NowNs() - m_start);
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Phase m_phase;
+        bool m_active;
+        int64_t m_start = 0;
+    };
+
+} // SGP_IMPL
+
+#ifdef SATPROP_INSTRUMENTATION
+#define SATPROP_CONCAT_INNER(a, b) a##b
+#define SATPROP_CONCAT(a, b) SATPROP_CONCAT_INNER(a, b)
+#define SATPROP_SCOPE(phase) SGP_IMPL::ScopedTimer SATPROP_CONCAT(satpropTimer, __LINE__)(phase)
+#define SATPROP_COUNT(counter, value) \
+    do { if (SGP_IMPL::Instrumentation::IsEnabled()) SGP_IMPL::Instrumentation::Count(counter, value); } while (0)
+#else
+#define SATPROP_SCOPE(phase) ((void)0)
+#define SATPROP_COUNT(counter, value) ((void)0)
+#endif
+
+#endif //INSTRUMENTATION_H
@@ -0,0 +1,111 @@
+//
+// OrbitMath.h
+// Small two-body and Earth rotation helpers shared by the map and analysis code
+//
+
+#ifndef ORBITMATH_H
+#define ORBITMATH_H
+
+#include <math.h>
+
+namespace SGP_IMPL {
+
+    const double PI = 3.14159265358979323846;
+    const double TWO_PI = 2.0 * PI;
+    const double DEG2RAD = PI / 180.0;
+    const double RAD2DEG = 180.0 / PI;
+
+    const double MU_EARTH = 398600.4418;   // Earth gravitational parameter (km^3/s^2)
+    const double EARTH_RADIUS = 6378.135;  // WGS-72 equatorial radius (km), same as SGP4
+    const double DS50_TO_JD = 2433281.5;   // Julian date of days since 1950 = 0
+    const double AU_KM = 149597870.7;      // astronomical unit (km)
+    const double SUN_RADIUS = 696000.0;    // km
+
+    // Greenwich mean sidereal time (rad) for a days-since-1950 UTC time, IAU-82 model.
+    // UT1-UTC is ignored, which is well below anything we display or search for.
+    inline double GmstRad(double ds50UTC)
+    {
+        double t = (ds50UTC + DS50_TO_JD - 2451545.0) / 36525.0;
+        double gmstSec = 67310.54841 + (876600.0 * 3600.0 + 8640184.812866) * t
+                         + 0.093104 * t * t - 6.2e-6 * t * t * t;
+        double gmst = fmod(gmstSec * TWO_PI / 86400.0, TWO_PI);
+        if (gmst < 0)
+            gmst += TWO_PI;
+        return gmst;
+    }
+
+    // Solve Kepler's equation M = E - e sin(E) for the eccentric anomaly (rad)
+    inline double SolveKepler(double meanAnomaly, double ecc)
+    {
+        double E = ecc < 0.8 ? meanAnomaly + ecc * sin(meanAnomaly) : PI;
+        for (int i = 0; i < 12; i++)
+        {
+            double f = E - ecc * sin(E) - meanAnomaly;
+            double dE = f / (1.0 - ecc * cos(E));
+            E -= dE;
+            if (fabs(dE) < 1e-12)
+                break;
+        }
+        return E;
+    }
+
+    // Two-body position (km) from AstroStd ordered Keplerian elements
+    // (a km, e, incl deg, mean anomaly deg, node deg, arg of perigee deg),
+    // advanced by dtMin minutes along the unperturbed orbit.
+    inline void KepToPos(const double kep[6], double dtMin, double pos[3])
+    {
+        double a = kep[0];
+        double e = kep[1];
+        double incl = kep[2] * DEG2RAD;
+        double node = kep[4] * DEG2RAD;
+        double argp = kep[5] * DEG2RAD;
+
+        double n = sqrt(MU_EARTH / (a * a * a)); // rad/s
+        double M = fmod(kep[3] * DEG2RAD + n * dtMin * 60.0, TWO_PI);
+        double E = SolveKepler(M, e);
+
+        // perifocal coordinates
+        double xp = a * (cos(E) - e);
+        double yp = a * sqrt(1.0 - e * e) * sin(E);
+
+        double cO = cos(node), sO = sin(node);
+        double cw = cos(argp), sw = sin(argp);
+        double ci = cos(incl), si = sin(incl);
+
+        pos[0] = (cO * cw - sO * sw * ci) * xp + (-cO * sw - sO * cw * ci) * yp;
+        pos[1] = (sO * cw + cO * sw * ci) * xp + (-sO * sw + cO * cw * ci) * yp;
+        pos[2] = (sw * si) * xp + (cw * si) * yp;
+    }
+
+    // Sub-satellite point (geocentric latitude, longitude in deg) of an inertial (TEME) position
+    inline void TemeToLatLon(const double pos[3], double ds50UTC, double* lat, double* lon)
+    {
+        double gmst = GmstRad(ds50UTC);
+        double c = cos(gmst), s = sin(gmst);
+        double x = c * pos[0] + s * pos[1];
+        double y = -s * pos[0] + c * pos[1];
+
+        *lat = atan2(pos[2], sqrt(x * x + y * y)) * RAD2DEG;
+        *lon = atan2(y, x) * RAD2DEG;
+    }
+
+    // Geocentric Sun position (km) in the mean equator and equinox of date, the Astronomical
+    // Almanac's low precision series: 0.01 deg over 1950-2050. TEME differs from it by less,
+    // and UTC stands in for UT1.
+    inline void SunPositionKm(double ds50UTC, double sun[3])
+    {
+        double t = (ds50UTC + DS50_TO_JD - 2451545.0) / 36525.0;
+        double meanLongitude = (280.460 + 36000.771 * t) * DEG2RAD;
+        double meanAnomaly = (357.5291092 + 35999.05034 * t) * DEG2RAD;
+        double longitude = meanLongitude + (1.914666471 * sin(meanAnomaly) + 0.019994643 * sin(2.0 * meanAnomaly)) * DEG2RAD;
+        double distance = (1.000140612 - 0.016708617 * cos(meanAnomaly) - 0.000139589 * cos(2.0 * meanAnomaly)) * AU_KM;
+        double obliquity = (23.439291 - 0.0130042 * t) * DEG2RAD;
+
+        sun[0] = distance * cos(longitude);
+        sun[1] = distance * cos(obliquity) * sin(longitude);
+        sun[2] = distance * sin(obliquity) * sin(longitude);
+    }
+
+} // SGP_IMPL
+
+#endif //ORBITMATH_H
@@ -3,14 +3,68 @@
 //
 #include <stdio.h>
 #include <math.h>    // Without this the fabs returns wrong results
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #ifndef PROPRESULTS_H
 #define PROPRESULTS_H
 
+// Why a step failed, the details are kept per satellite in SatelliteData::errors
+enum StepError : uint8_t {
+    STEP_OK = 0,
+    STEP_INIT_FAILED,           // Sgp4InitSat failed, message from AstroStd
+    STEP_PROPAGATION_ERROR,     // Sgp4PropDs50UTC failed, message from AstroStd
+    STEP_DECAY,                 // below the geoid, value is the height (km)
+    STEP_LOW_ALTITUDE,          // below 100 km, value is the height (km)
+    NUM_STEP_ERRORS
+};
+
+struct StepErrorRecord {
+    int step;                   // index into timeSteps
+    StepError code;
+    uint32_t message;           // AstroStd text in PropagationResults::messages, 0 for none
+    double value;               // numeric payload, see StepError
+};
+
+// Interned error texts of one job. AstroStd reports the same few messages over and over, so
+// each distinct text is stored once. Not locked, the propagator interns under its error lock.
+class ErrorMessageTable {
+public:
+    ErrorMessageTable() : m_texts(1) {}
+
+    uint32_t Intern(const char* text)
+    {
+        auto found = m_ids.find(text);
+        if (found != m_ids.end())
+            return found->second;
+
+        uint32_t id = (uint32_t)m_texts.size();
+        m_texts.emplace_back(text);
+        m_ids.emplace(m_texts.back(), id);
+        return id;
+    }
+
+    const std::string& Get(uint32_t id) const
+    {
+        return id < m_texts.size() ? m_texts[id] : m_texts[0];
+    }
+
+    size_t Size() const { return m_texts.size() - 1; }
+
+private:
+    std::vector<std::string> m_texts;   // [0] is the empty text
+    std::unordered_map<std::string, uint32_t> m_ids;
+};
+
 struct TimeStepData {
     double mse;                 // Mean solar ecliptic time
+    double ds50UTC;             // Time of this step (days since 1950 UTC)
     double pos[3];             // Position (km)
     double vel[3];             // Velocity (km/s)
     double llh[3];             // Latitude(deg), Longitude(deg), Height above Geoid (km)
@@ -18,23 +72,108 @@ struct TimeStepData {
     double oscKep[6];          // Osculating Keplerian elements
     double nodalApPer[3];      // Nodal period, apogee, perigee
     double meanMotion;         // Mean motion
-    std::string errorMsg;      // Error message if any
-    bool hasError;             // Flag indicating if this timestep has an error
+    StepError error;           // STEP_OK unless this timestep has an error
+
+    bool hasError() const { return error != STEP_OK; }
+};
+
+// Owns the step storage of one propagation job, released in one go with the last results
+// that share it. The propagator reserves every satellite's exact step count up front, so the
+// arena is normally hit once per satellite on the init thread; the lock only matters if a
+// satellite outgrows its reservation on a worker thread.
+class ResultArena : public std::pmr::memory_resource {
+public:
+    explicit ResultArena(size_t initialBytes)
+        : m_buffer(std::max<size_t>(initialBytes, 4096)) {}
+
+    size_t BytesAllocated() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bytes;
+    }
+
+    size_t Allocations() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_allocations;
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bytes += bytes;
+        m_allocations++;
+        return m_buffer.allocate(bytes, alignment);
+    }
+
+    // memory comes back when the arena goes
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    mutable std::mutex m_mutex;
+    std::pmr::monotonic_buffer_resource m_buffer;
+    size_t m_bytes = 0;
+    size_t m_allocations = 0;
 };
 
 struct SatelliteData {
+    SatelliteData() = default;
+    // Steps are allocated from the given resource. Copies go to the default heap, so a copy
+    // of the results never depends on the original job's arena.
+    explicit SatelliteData(std::pmr::memory_resource* resource) : timeSteps(resource) {}
+
     std::string line1;                    // TLE line 1
     std::string line2;                    // TLE line 2
     __int64 satKey;                       // Satellite key
-    std::vector<TimeStepData> timeSteps;  // All timestep data for this satellite
+    std::pmr::vector<TimeStepData> timeSteps;  // All timestep data for this satellite
+    std::vector<StepErrorRecord> errors;  // Only the steps that failed, in step order
     bool propagationSuccess;              // Overall success flag for this satellite
+
+    const StepErrorRecord* FindError(int step) const
+    {
+        for (const auto& record : errors)
+            if (record.step == step)
+                return &record;
+        return nullptr;
+    }
 };
 
 struct PropagationResults {
+    std::shared_ptr<ResultArena> arena;   // declared first so the steps go before it does
     std::vector<SatelliteData> satellites;
     int totalSatellites;
     bool overallSuccess;
     std::string generalError;
+    ErrorMessageTable messages;
+
+    // Display text for a failed step, empty when the step is fine
+    std::string ErrorText(const SatelliteData& sat, int step) const
+    {
+        const StepErrorRecord* record = sat.FindError(step);
+        return record ? ErrorText(*record) : std::string();
+    }
+
+    // Same text for a record already in hand, without searching the satellite's errors
+    std::string ErrorText(const StepErrorRecord& record) const
+    {
+        char text[128];
+        switch (record.code)
+        {
+            case STEP_DECAY:
+                snprintf(text, sizeof(text), "Warning: Decay condition. Distance from the Geoid (Km) = %f", record.value);
+                return text;
+            case STEP_LOW_ALTITUDE:
+                snprintf(text, sizeof(text), "Warning: Height is low. HT (Km) = %f", record.value);
+                return text;
+            default:
+                return messages.Get(record.message);
+        }
+    }
 };
 
 #endif //PROPRESULTS_H
@@ -0,0 +1,863 @@
+//
+// PropagationPipeline.cpp
+// Streams a job through parse, init, propagate, format and write stages with bounded queues
+//
+
+#include "PropagationPipeline.h"
+#include "Instrumentation.h"
+#include "Propagator.h"
+#include "ResultCache.h"
+#include "WorkScheduler.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/TleDll.h"
+#include "wrappers/Sgp4PropDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        typedef std::chrono::steady_clock Clock;
+
+        double Since(Clock::time_point start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        // FIFO between two stages, or with a Before ordering a heap that hands out the item no
+        // other is Before first. Close() once the last producer is done, Pop() then drains what
+        // is left and returns false.
+        template <typename T, typename Before = void>
+        class BoundedQueue
+        {
+        public:
+            explicit BoundedQueue(size_t capacity, int producers = 1)
+                : m_capacity(std::max<size_t>(1, capacity)), m_producers(producers) {}
+
+            void Push(T item, double& waited)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_items.size() >= m_capacity)
+                {
+                    auto start = Clock::now();
+                    m_notFull.wait(lock, [&]() { return m_items.size() < m_capacity; });
+                    waited += Since(start);
+                }
+                m_items.push_back(std::move(item));
+                if constexpr (!std::is_void_v<Before>)
+                    std::push_heap(m_items.begin(), m_items.end(), Before());
+                m_pushes++;
+                m_depthSum += m_items.size();
+                m_maxDepth = std::max(m_maxDepth, m_items.size());
+                m_notEmpty.notify_one();
+            }
+
+            bool Pop(T& item, double& waited)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_items.empty() && m_producers > 0)
+                {
+                    auto start = Clock::now();
+                    m_notEmpty.wait(lock, [&]() { return !m_items.empty() || m_producers == 0; });
+                    waited += Since(start);
+                }
+                if (m_items.empty())
+                    return false;
+                Take(item);
+                return true;
+            }
+
+            bool TryPop(T& item)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_items.empty())
+                    return false;
+                Take(item);
+                return true;
+            }
+
+            // One producer is done
+            void Close()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_producers <= 0)
+                    m_notEmpty.notify_all();
+            }
+
+            QueueStats Stats() const
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                QueueStats stats;
+                stats.capacity = m_capacity;
+                stats.maxDepth = m_maxDepth;
+                stats.meanDepth = m_pushes ? (double)m_depthSum / m_pushes : 0.0;
+                return stats;
+            }
+
+        private:
+            // under the lock, the queue not empty
+            void Take(T& item)
+            {
+                if constexpr (!std::is_void_v<Before>)
+                {
+                    std::pop_heap(m_items.begin(), m_items.end(), Before());
+                    item = std::move(m_items.back());
+                    m_items.pop_back();
+                }
+                else
+                {
+                    item = std::move(m_items.front());
+                    m_items.pop_front();
+                }
+                m_notFull.notify_one();
+            }
+
+            mutable std::mutex m_mutex;
+            std::condition_variable m_notFull;
+            std::condition_variable m_notEmpty;
+            std::deque<T> m_items;
+            size_t m_capacity;
+            int m_producers;
+            uint64_t m_pushes = 0;
+            uint64_t m_depthSum = 0;
+            size_t m_maxDepth = 0;
+        };
+
+        // Readers and writer of AstroStd's satellite tables. A waiting writer holds new readers
+        // back, otherwise a busy propagation stage would never let the init stage in.
+        class TableGate
+        {
+        public:
+            void LockShared()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [&]() { return !m_writer && m_writersWaiting == 0; });
+                m_readers++;
+            }
+
+            void UnlockShared()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_readers == 0)
+                    m_changed.notify_all();
+            }
+
+            void Lock()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_writersWaiting++;
+                m_changed.wait(lock, [&]() { return !m_writer && m_readers == 0; });
+                m_writersWaiting--;
+                m_writer = true;
+            }
+
+            void Unlock()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_writer = false;
+                m_changed.notify_all();
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_changed;
+            int m_readers = 0;
+            int m_writersWaiting = 0;
+            bool m_writer = false;
+        };
+
+        struct TleRecord
+        {
+            size_t seq = 0;
+            std::string line1;
+            std::string line2;
+        };
+
+        // Passed between stages by pointer: moving a SatelliteData into a default constructed
+        // one would copy its steps off the arena
+        struct SatelliteItem
+        {
+            SatelliteItem(size_t seq, std::pmr::memory_resource* resource) : seq(seq), satellite(resource) {}
+
+            size_t seq;
+            SatelliteData satellite;
+            bool initialized = false;
+            // CostModel's estimate, satellites with nothing to propagate go first
+            double cost = std::numeric_limits<double>::infinity();
+            std::string text;           // formatted rows
+        };
+        typedef std::unique_ptr<SatelliteItem> SatelliteItemPtr;
+
+        // Propagation takes the costliest satellite in flight first, as WorkScheduler orders
+        // the batch job; ties in catalog order
+        struct CheaperItem
+        {
+            bool operator()(const SatelliteItemPtr& a, const SatelliteItemPtr& b) const
+            {
+                return a->cost != b->cost ? a->cost < b->cost : a->seq > b->seq;
+            }
+        };
+
+        // Every TLE takes at least two 69 character lines and their line ends
+        const size_t MIN_TLE_BYTES = 2 * 70;
+
+        const char* OSC_STATE_HEADER =
+            "     TSINCE (MIN)           X (KM)           Y (KM)           Z (KM)      XDOT (KM/S)       YDOT(KM/S)    ZDOT (KM/SEC)\n";
+
+    } // namespace
+
+    // Friend of Propagator, runs its per satellite pieces on the pipeline's threads
+    class PipelineRun
+    {
+    public:
+        PipelineRun(const char* inFile, double startTime, double stopTime, double stepSize, const std::string& outFile,
+                    const PipelineOptions& options)
+            : m_inFile(inFile), m_outFile(outFile), m_options(options),
+              m_parsed(options.parseQueue),
+              m_initialized(options.inFlight),
+              m_propagated(options.inFlight, std::max(1, options.propagateThreads))
+        {
+            Propagator::CalcStartStopTimeFromParams(0.0, &m_window.startTime, &m_window.stopTime, &m_window.stepSize,
+                                                    startTime, stopTime, stepSize);
+            m_window.initialized = true;
+
+            m_results.overallSuccess = true;
+            m_results.totalSatellites = 0;
+
+            // the satellite count isn't known before parsing, the file size bounds it
+            size_t satellites = 0;
+            if (options.keepResults)
+            {
+                std::error_code error;
+                uintmax_t bytes = std::filesystem::file_size(inFile, error);
+                satellites = error ? 0 : (size_t)(bytes / MIN_TLE_BYTES);
+                m_results.satellites.reserve(satellites);
+            }
+            m_results.arena = std::make_shared<ResultArena>(satellites * Propagator::CountSteps(m_window) *
+                                                            sizeof(TimeStepData));
+        }
+
+        PropagationResults Run(PipelineStats* stats)
+        {
+            SATPROP_SCOPE(PHASE_JOB);
+            auto start = Clock::now();
+
+            // rows end in \n on every platform, the writer is binary
+            AsyncFileWriter writer;
+            AsyncFileWriter* out = nullptr;
+            if (!m_outFile.empty())
+            {
+                if (!writer.Open(m_outFile, m_options.output))
+                {
+                    m_results.overallSuccess = false;
+                    m_results.generalError = "Can't open output file " + m_outFile;
+                    return std::move(m_results);
+                }
+                out = &writer;
+            }
+
+            int propagateThreads = std::max(1, m_options.propagateThreads);
+            int formatThreads = std::max(1, m_options.formatThreads);
+
+            std::vector<std::thread> threads;
+            threads.emplace_back(&PipelineRun::Parse, this);
+            threads.emplace_back(&PipelineRun::Init, this);
+            for (int t = 0; t < propagateThreads; t++)
+                threads.emplace_back(&PipelineRun::Propagate, this);
+            m_formatting = formatThreads;
+            for (int t = 0; t < formatThreads; t++)
+                threads.emplace_back(&PipelineRun::Format, this, out != nullptr);
+            threads.emplace_back(&PipelineRun::Write, this, out);
+            for (auto& thread : threads)
+                thread.join();
+
+            if (out && !writer.Close() && m_results.overallSuccess)
+            {
+                m_results.overallSuccess = false;
+                m_results.generalError = writer.GetError();
+            }
+
+            // whatever the init stage didn't get to remove
+            TleRemoveAllSats();
+            Sgp4RemoveAllSats();
+
+            if (m_results.overallSuccess && m_results.totalSatellites == 0)
+            {
+                m_results.overallSuccess = false;
+                m_results.generalError = "No TLEs were found in the input file";
+            }
+
+            if (stats)
+            {
+                for (int s = 0; s < NUM_PIPELINE_STAGES; s++)
+                    stats->stages[s] = m_stages[s];
+                stats->stages[STAGE_PARSE].workers = 1;
+                stats->stages[STAGE_INIT].workers = 1;
+                stats->stages[STAGE_PROPAGATE].workers = propagateThreads;
+                stats->stages[STAGE_FORMAT].workers = formatThreads;
+                stats->stages[STAGE_WRITE].workers = 1;
+                stats->queues[STAGE_INIT] = m_parsed.Stats();
+                stats->queues[STAGE_PROPAGATE] = m_initialized.Stats();
+                stats->queues[STAGE_FORMAT] = m_propagated.Stats();
+                stats->queues[STAGE_WRITE].capacity = m_options.inFlight;
+                stats->queues[STAGE_WRITE].maxDepth = m_reorderMax;
+                stats->queues[STAGE_WRITE].meanDepth = m_reorderPuts ? (double)m_reorderSum / m_reorderPuts : 0.0;
+                stats->wallSeconds = Since(start);
+                stats->carriedOver = m_carriedOver;
+                stats->cacheHits = m_cacheHits;
+            }
+            return std::move(m_results);
+        }
+
+    private:
+        void AddStats(PipelineStage stage, const StageStats& local)
+        {
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            m_stages[stage].items += local.items;
+            m_stages[stage].busySeconds += local.busySeconds;
+            m_stages[stage].waitInputSeconds += local.waitInputSeconds;
+            m_stages[stage].waitOutputSeconds += local.waitOutputSeconds;
+        }
+
+        void Fail(const std::string& error)
+        {
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            if (m_results.overallSuccess)
+            {
+                m_results.overallSuccess = false;
+                m_results.generalError = error;
+            }
+        }
+
+        void Parse()
+        {
+            SATPROP_SCOPE(PHASE_LOAD_FILE);
+            StageStats local;
+            FILE* fp = fopen(m_inFile, "r");
+            if (!fp)
+                Fail(std::string("Can't open ") + m_inFile);
+
+            char line[INPUTCARDLEN];
+            std::string previous;
+            size_t seq = 0;
+            auto busy = Clock::now();
+            while (fp && fgets(line, sizeof(line), fp))
+            {
+                std::string text(line);
+                while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+                    text.pop_back();
+
+                if (text.size() > 1 && text[0] == '2' && text[1] == ' ' && previous.size() > 1 && previous[0] == '1' &&
+                    previous[1] == ' ')
+                {
+                    TleRecord record;
+                    record.seq = seq++;
+                    record.line1 = std::move(previous);
+                    record.line2 = std::move(text);
+                    previous.clear();
+
+                    local.busySeconds += Since(busy);
+                    m_parsed.Push(std::move(record), local.waitOutputSeconds);
+                    busy = Clock::now();
+                    local.items++;
+                }
+                else
+                    previous = std::move(text);
+            }
+            local.busySeconds += Since(busy);
+            if (fp)
+                fclose(fp);
+
+            m_parsed.Close();
+            AddStats(STAGE_PARSE, local);
+        }
+
+        // Waits until the satellite fits in the in flight window
+        void Admit(size_t seq, double& waited)
+        {
+            std::unique_lock<std::mutex> lock(m_writtenMutex);
+            if (seq >= m_written + m_options.inFlight)
+            {
+                auto start = Clock::now();
+                m_writtenChanged.wait(lock, [&]() { return seq < m_written + m_options.inFlight; });
+                waited += Since(start);
+            }
+        }
+
+        bool Admissible(size_t seq)
+        {
+            std::lock_guard<std::mutex> lock(m_writtenMutex);
+            return seq < m_written + m_options.inFlight;
+        }
+
+        void Init()
+        {
+            StageStats local;
+            size_t batchSize = (size_t)std::max(1, m_options.initBatch);
+            std::vector<TleRecord> batch;
+            std::vector<SatelliteItemPtr> ready;
+            std::vector<__int64> retired;
+            TleRecord carried;
+            bool haveCarried = false;
+            char errMsg[LOGMSGLEN];
+            char line1[INPUTCARDLEN];
+            char line2[INPUTCARDLEN];
+
+            while (true)
+            {
+                // the first satellite of a batch waits for room, the rest only join if they
+                // fit right away, the batch must never sit on satellites the writer needs
+                batch.clear();
+                TleRecord record;
+                if (haveCarried)
+                {
+                    record = std::move(carried);
+                    haveCarried = false;
+                }
+                else if (!m_parsed.Pop(record, local.waitInputSeconds))
+                    break;
+                Admit(record.seq, local.waitOutputSeconds);
+                batch.push_back(std::move(record));
+                while (batch.size() < batchSize && m_parsed.TryPop(record))
+                {
+                    if (!Admissible(record.seq))
+                    {
+                        carried = std::move(record);
+                        haveCarried = true;
+                        break;
+                    }
+                    batch.push_back(std::move(record));
+                }
+
+                // carried over satellites never touch AstroStd, only the rest wait for the tables
+                size_t batchItems = batch.size();
+                std::erase_if(batch, [&](const TleRecord& tle)
+                {
+                    SatelliteItemPtr item = CarryOver(tle);
+                    if (!item)
+                        item = FromCache(tle);
+                    if (!item)
+                        return false;
+                    ready.push_back(std::move(item));
+                    return true;
+                });
+
+                {
+                    std::lock_guard<std::mutex> lock(m_retiredMutex);
+                    retired.swap(m_retired);
+                }
+
+                // waiting for the satellites in propagation counts as held back
+                auto gateWait = Clock::now();
+                m_gate.Lock();
+                local.waitOutputSeconds += Since(gateWait);
+
+                auto busy = Clock::now();
+                for (__int64 satKey : retired)
+                {
+                    Sgp4RemoveSat(satKey);
+                    TleRemoveSat(satKey);
+                }
+                retired.clear();
+
+                for (TleRecord& tle : batch)
+                {
+                    SatelliteItem& item = *ready.emplace_back(std::make_unique<SatelliteItem>(
+                        tle.seq, m_options.keepResults ? m_results.arena.get() : std::pmr::get_default_resource()));
+                    SatelliteData& satData = item.satellite;
+                    satData.line1 = tle.line1;
+                    satData.line2 = tle.line2;
+                    satData.propagationSuccess = true;
+
+                    snprintf(line1, sizeof(line1), "%s", tle.line1.c_str());
+                    snprintf(line2, sizeof(line2), "%s", tle.line2.c_str());
+                    satData.satKey = TleAddSatFrLines(line1, line2);
+                    int initErr = 1;
+                    if (satData.satKey > 0)
+                    {
+                        SATPROP_SCOPE(PHASE_INIT_SAT);
+                        initErr = Sgp4InitSat(satData.satKey);
+                    }
+                    if (initErr != 0)
+                    {
+                        satData.propagationSuccess = false;
+                        GetLastErrMsg(errMsg);
+                        errMsg[LOGMSGLEN - 1] = 0;
+
+                        TimeStepData errorStep = {};
+                        errorStep.error = STEP_INIT_FAILED;
+                        satData.timeSteps.push_back(errorStep);
+                        std::lock_guard<std::mutex> lock(Propagator::s_errorMutex);
+                        satData.errors.push_back({0, STEP_INIT_FAILED, m_results.messages.Intern(errMsg), 0.0});
+                        SATPROP_COUNT(COUNTER_ERRORS, 1);
+                        SATPROP_COUNT(COUNTER_BYTES, sizeof(TimeStepData) + sizeof(StepErrorRecord));
+                        continue;
+                    }
+                    item.initialized = true;
+                    satData.timeSteps.reserve(Propagator::CountSteps(m_window));
+                }
+                m_gate.Unlock();
+
+                // AstroStd's tables aren't needed to rank the satellites
+                for (SatelliteItemPtr& item : ready)
+                {
+                    if (!item->initialized)
+                        continue;
+                    TleElements elements;
+                    const SatelliteData& satData = item->satellite;
+                    if (ParseTle(satData.line1, satData.line2, elements))
+                        item->cost = CostModel::Estimate(elements, m_window.startTime, m_window.stopTime,
+                                                         m_window.stepSize).cost;
+                    else
+                        item->cost = Propagator::CountSteps(m_window);
+                }
+                local.busySeconds += Since(busy);
+                local.items += batchItems;
+
+                for (SatelliteItemPtr& item : ready)
+                    m_initialized.Push(std::move(item), local.waitOutputSeconds);
+                ready.clear();
+            }
+
+            m_initialized.Close();
+            AddStats(STAGE_INIT, local);
+        }
+
+        // A copy of the earlier job's satellite when the input's TLE is the same one
+        SatelliteItemPtr CarryOver(const TleRecord& tle)
+        {
+            const PropagationResults* previous = m_options.previous;
+            if (!previous || !m_options.carryOver || tle.seq >= m_options.carryOver->size())
+                return nullptr;
+            int index = (*m_options.carryOver)[tle.seq];
+            if (index < 0 || index >= (int)previous->satellites.size())
+                return nullptr;
+            const SatelliteData& before = previous->satellites[index];
+            if (before.line1 != tle.line1 || before.line2 != tle.line2)
+                return nullptr;
+
+            auto item = std::make_unique<SatelliteItem>(
+                tle.seq, m_options.keepResults ? m_results.arena.get() : std::pmr::get_default_resource());
+            SatelliteData& satData = item->satellite;
+            satData.line1 = tle.line1;
+            satData.line2 = tle.line2;
+            satData.satKey = before.satKey;     // the earlier job's, not loaded in AstroStd
+            satData.propagationSuccess = before.propagationSuccess;
+            satData.timeSteps.assign(before.timeSteps.begin(), before.timeSteps.end());
+            satData.errors = before.errors;
+
+            // message ids belong to the job that interned them
+            if (!satData.errors.empty())
+            {
+                std::lock_guard<std::mutex> lock(Propagator::s_errorMutex);
+                for (StepErrorRecord& record : satData.errors)
+                    if (record.message)
+                        record.message = m_results.messages.Intern(previous->messages.Get(record.message).c_str());
+            }
+            m_carriedOver++;
+            return item;
+        }
+
+        SatelliteItemPtr FromCache(const TleRecord& tle)
+        {
+            ResultCache* cache = m_options.cache;
+            if (!cache)
+                return nullptr;
+
+            auto item = std::make_unique<SatelliteItem>(
+                tle.seq, m_options.keepResults ? m_results.arena.get() : std::pmr::get_default_resource());
+            SatelliteData& satData = item->satellite;
+            ResultCacheKey key = ResultCacheKey::Make(tle.line1, tle.line2, m_window.startTime, m_window.stopTime,
+                                                      m_window.stepSize, cache->Fields());
+            if (!cache->Lookup(key, satData, m_cacheTexts))
+                return nullptr;
+
+            satData.line1 = tle.line1;
+            satData.line2 = tle.line2;
+            satData.satKey = 0;
+            if (!satData.errors.empty())
+            {
+                std::lock_guard<std::mutex> lock(Propagator::s_errorMutex);
+                for (size_t e = 0; e < satData.errors.size(); e++)
+                    satData.errors[e].message = m_cacheTexts[e].empty() ? 0 : m_results.messages.Intern(m_cacheTexts[e].c_str());
+            }
+            m_cacheHits++;
+            return item;
+        }
+
+        void Propagate()
+        {
+            SATPROP_SCOPE(PHASE_WORKER);
+            StageStats local;
+            SatelliteItemPtr item;
+            while (m_initialized.Pop(item, local.waitInputSeconds))
+            {
+                auto busy = Clock::now();
+                if (item->initialized)
+                {
+                    m_gate.LockShared();
+                    Propagator::PropagateSatellite(item->satellite, m_window);
+                    m_gate.UnlockShared();
+
+                    // the failure's text is read again with every other propagation held off
+                    const std::vector<StepErrorRecord>& errors = item->satellite.errors;
+                    if (!errors.empty() && errors.back().code == STEP_PROPAGATION_ERROR)
+                    {
+                        m_gate.Lock();
+                        Propagator::ReadFailureTexts(item->satellite, m_results.messages);
+                        m_gate.Unlock();
+                    }
+                }
+                local.busySeconds += Since(busy);
+                local.items++;
+                m_propagated.Push(std::move(item), local.waitOutputSeconds);
+            }
+
+            m_propagated.Close();
+            AddStats(STAGE_PROPAGATE, local);
+        }
+
+        void Format(bool formatting)
+        {
+            StageStats local;
+            SatelliteItemPtr item;
+            char row[160];
+            std::vector<std::pair<int, std::string>> errorTexts;
+            while (m_propagated.Pop(item, local.waitInputSeconds))
+            {
+                auto busy = Clock::now();
+                if (formatting)
+                {
+                    const SatelliteData& sat = item->satellite;
+
+                    // the message table grows under the error lock while other satellites run
+                    errorTexts.clear();
+                    if (!sat.errors.empty())
+                    {
+                        std::lock_guard<std::mutex> lock(Propagator::s_errorMutex);
+                        for (const auto& record : sat.errors)
+                            errorTexts.emplace_back(record.step, m_results.ErrorText(record));
+                    }
+
+                    std::string& text = item->text;
+                    text.reserve(sat.timeSteps.size() * 120 + 400);
+                    text += sat.line1;
+                    text += '\n';
+                    text += sat.line2;
+                    text += '\n';
+                    text += OSC_STATE_HEADER;
+
+                    size_t nextError = 0;
+                    for (int s = 0; s < (int)sat.timeSteps.size(); s++)
+                    {
+                        const TimeStepData& step = sat.timeSteps[s];
+                        if (step.hasError())
+                        {
+                            while (nextError < errorTexts.size() && errorTexts[nextError].first < s)
+                                nextError++;
+                            if (nextError < errorTexts.size() && errorTexts[nextError].first == s)
+                            {
+                                text += errorTexts[nextError].second;
+                                text += '\n';
+                            }
+                            continue;
+                        }
+                        int length = snprintf(row, sizeof(row), " %17.7f%17.7f%17.7f%17.7f%17.7f%17.7f%17.7f\n",
+                                              step.mse, step.pos[0], step.pos[1], step.pos[2],
+                                              step.vel[0], step.vel[1], step.vel[2]);
+                        text.append(row, std::min<size_t>(length, sizeof(row) - 1));
+                    }
+                    text += '\n';
+                }
+                if (m_options.cache && item->initialized)
+                    Cache(item->satellite);
+                local.busySeconds += Since(busy);
+                local.items++;
+
+                std::lock_guard<std::mutex> lock(m_reorderMutex);
+                size_t seq = item->seq;
+                m_reorder.emplace(seq, std::move(item));
+                m_reorderPuts++;
+                m_reorderSum += m_reorder.size();
+                m_reorderMax = std::max(m_reorderMax, m_reorder.size());
+                if (seq == m_nextToWrite)
+                    m_reorderChanged.notify_all();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_reorderMutex);
+                m_formatting--;
+                m_reorderChanged.notify_all();
+            }
+            AddStats(STAGE_FORMAT, local);
+        }
+
+        // Propagated satellites go into the cache from the format threads, with their raw
+        // AstroStd texts
+        void Cache(const SatelliteData& sat)
+        {
+            std::vector<std::string> texts;
+            if (!sat.errors.empty())
+            {
+                std::lock_guard<std::mutex> lock(Propagator::s_errorMutex);
+                for (const StepErrorRecord& record : sat.errors)
+                    texts.push_back(m_results.messages.Get(record.message));
+            }
+            ResultCacheKey key = ResultCacheKey::Make(sat.line1, sat.line2, m_window.startTime, m_window.stopTime,
+                                                      m_window.stepSize, m_options.cache->Fields());
+            m_options.cache->Insert(key, sat, texts);
+        }
+
+        void Write(AsyncFileWriter* out)
+        {
+            StageStats local;
+            while (true)
+            {
+                SatelliteItemPtr item;
+                {
+                    std::unique_lock<std::mutex> lock(m_reorderMutex);
+                    auto ready = [&]() { return m_reorder.count(m_nextToWrite) != 0 || m_formatting == 0; };
+                    if (!ready())
+                    {
+                        auto start = Clock::now();
+                        m_reorderChanged.wait(lock, ready);
+                        local.waitInputSeconds += Since(start);
+                    }
+                    auto found = m_reorder.find(m_nextToWrite);
+                    if (found == m_reorder.end())
+                        break;
+                    item = std::move(found->second);
+                    m_reorder.erase(found);
+                    m_nextToWrite++;
+                }
+
+                auto busy = Clock::now();
+                if (out && !item->text.empty() && !out->Write(item->text.data(), item->text.size()))
+                    Fail(out->GetError());
+
+                __int64 satKey = item->initialized ? item->satellite.satKey : 0;
+                m_results.totalSatellites++;
+                if (m_options.keepResults)
+                {
+                    SATPROP_SCOPE(PHASE_STORE_SATELLITE);
+                    m_results.satellites.push_back(std::move(item->satellite));
+                }
+                local.busySeconds += Since(busy);
+                local.items++;
+
+                if (satKey > 0)
+                {
+                    std::lock_guard<std::mutex> lock(m_retiredMutex);
+                    m_retired.push_back(satKey);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(m_writtenMutex);
+                    m_written++;
+                }
+                m_writtenChanged.notify_all();
+            }
+            AddStats(STAGE_WRITE, local);
+        }
+
+        const char* m_inFile;
+        std::string m_outFile;
+        PipelineOptions m_options;
+        Propagator::PropWindow m_window;
+        PropagationResults m_results;
+
+        BoundedQueue<TleRecord> m_parsed;
+        BoundedQueue<SatelliteItemPtr, CheaperItem> m_initialized;
+        BoundedQueue<SatelliteItemPtr> m_propagated;
+        TableGate m_gate;
+
+        // format -> write, by catalog position
+        std::mutex m_reorderMutex;
+        std::condition_variable m_reorderChanged;
+        std::map<size_t, SatelliteItemPtr> m_reorder;
+        size_t m_nextToWrite = 0;
+        int m_formatting = 0;
+        uint64_t m_reorderPuts = 0;
+        uint64_t m_reorderSum = 0;
+        size_t m_reorderMax = 0;
+
+        // write -> init, the window and the satellites to drop from AstroStd
+        std::mutex m_writtenMutex;
+        std::condition_variable m_writtenChanged;
+        size_t m_written = 0;
+        std::mutex m_retiredMutex;
+        std::vector<__int64> m_retired;
+
+        std::mutex m_statsMutex;
+        StageStats m_stages[NUM_PIPELINE_STAGES];
+        uint64_t m_carriedOver = 0;         // init thread only
+        uint64_t m_cacheHits = 0;
+        std::vector<std::string> m_cacheTexts;
+    };
+
+    PropagationResults PropagationPipeline::Run(const char* inFile, double startTime, double stopTime, double stepSize,
+                                                const std::string& outFile, const PipelineOptions& options,
+                                                PipelineStats* stats)
+    {
+        PipelineRun run(inFile, startTime, stopTime, stepSize, outFile, options);
+        return run.Run(stats);
+    }
+
+    const char* PropagationPipeline::StageName(PipelineStage stage)
+    {
+        switch (stage)
+        {
+            case STAGE_PARSE: return "Parse";
+            case STAGE_INIT: return "Init";
+            case STAGE_PROPAGATE: return "Propagate";
+            case STAGE_FORMAT: return "Format";
+            case STAGE_WRITE: return "Write";
+            default: return "Unknown";
+        }
+    }
+
+    PipelineStage PipelineStats::Bottleneck() const
+    {
+        int slowest = 0;
+        for (int s = 1; s < NUM_PIPELINE_STAGES; s++)
+        {
+            double perWorker = stages[s].workers ? stages[s].busySeconds / stages[s].workers : 0.0;
+            double best = stages[slowest].workers ? stages[slowest].busySeconds / stages[slowest].workers : 0.0;
+            if (perWorker > best)
+                slowest = s;
+        }
+        return (PipelineStage)slowest;
+    }
+
+    double PipelineStats::BottleneckSeconds() const
+    {
+        const StageStats& stage = stages[Bottleneck()];
+        return stage.workers ? stage.busySeconds / stage.workers : 0.0;
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,112 @@
+//
+// PropagationPipeline.h
+// Streams a job through parse, init, propagate, format and write stages with bounded queues
+//
+
+#ifndef PROPAGATIONPIPELINE_H
+#define PROPAGATIONPIPELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PropResults.h"
+#include "io/AsyncFileWriter.h"
+
+namespace SGP_IMPL {
+
+    class ResultCache;
+
+    enum PipelineStage
+    {
+        STAGE_PARSE = 0,        // TLE line pairs from the input file
+        STAGE_INIT,             // TleAddSatFrLines + Sgp4InitSat, and Sgp4RemoveSat once written
+        STAGE_PROPAGATE,        // PropagateSatellite
+        STAGE_FORMAT,           // text rows of the output file
+        STAGE_WRITE,            // output buffers in catalog order, and the in-memory results
+        NUM_PIPELINE_STAGES
+    };
+
+    struct StageStats
+    {
+        int workers = 0;
+        uint64_t items = 0;
+        double busySeconds = 0.0;           // summed over the stage's threads
+        double waitInputSeconds = 0.0;      // starved, nothing queued in front
+        double waitOutputSeconds = 0.0;     // held back, the stages behind are full
+
+        // Fraction of the stage's thread time spent working
+        double Occupancy(double wallSeconds) const
+        {
+            return workers > 0 && wallSeconds > 0.0 ? busySeconds / (workers * wallSeconds) : 0.0;
+        }
+    };
+
+    // Queue in front of a stage, depth sampled at every push
+    struct QueueStats
+    {
+        size_t capacity = 0;
+        size_t maxDepth = 0;
+        double meanDepth = 0.0;
+    };
+
+    struct PipelineStats
+    {
+        StageStats stages[NUM_PIPELINE_STAGES];
+        QueueStats queues[NUM_PIPELINE_STAGES];     // [STAGE_PARSE] is unused
+        double wallSeconds = 0.0;
+        uint64_t carriedOver = 0;           // satellites taken from PipelineOptions::previous
+        uint64_t cacheHits = 0;             // and from PipelineOptions::cache
+
+        // Busy time of the slowest stage per worker, the floor for the wall time
+        double BottleneckSeconds() const;
+        PipelineStage Bottleneck() const;
+    };
+
+    struct PipelineOptions
+    {
+        int propagateThreads = 1;
+        int formatThreads = 1;
+        size_t parseQueue = 1024;           // TLEs read ahead of initialization
+        size_t inFlight = 512;              // satellites between init and write
+        int initBatch = 64;                 // satellites initialized per hold of AstroStd's tables
+        bool keepResults = true;            // false drops satellites once written, memory stays flat
+        AsyncWriteOptions output;           // the write stage only copies, the disk runs behind it
+
+        // Results of an earlier job over the same times and carryOver[i], the satellite in them
+        // for the i-th TLE of the input or -1 (see CatalogDiff). Those are copied instead of
+        // propagated, unless their lines turn out to differ from the input's after all.
+        const PropagationResults* previous = nullptr;
+        const std::vector<int>* carryOver = nullptr;
+
+        // Satellites not carried over are looked up here before initialization, and the
+        // ones propagated are inserted by the format stage
+        ResultCache* cache = nullptr;
+    };
+
+    // The batch job runs load, init, propagation and output one after another, so the disk
+    // waits on the CPU and the other way round. Here every stage has its own threads and
+    // satellites flow through bounded queues, so reading, propagating, formatting and
+    // writing overlap and the wall time approaches the slowest stage.
+    //
+    // AstroStd's satellite tables can't change under a running propagation, so the init
+    // stage takes them exclusively for a batch of adds and removes while propagation holds
+    // them shared per satellite. inFlight caps the satellites between init and write, which
+    // also bounds the reorder window that keeps the output in catalog order. Within it the
+    // propagate stage takes the costliest initialized satellite first, as the batch job does.
+    //
+    // Only the TLE line pairs of the input are read, times come from the arguments as for
+    // RunOneSgp4Job. With an empty outFile nothing is formatted or written.
+    class PropagationPipeline
+    {
+    public:
+        static PropagationResults Run(const char* inFile, double startTime, double stopTime, double stepSize,
+                                      const std::string& outFile, const PipelineOptions& options,
+                                      PipelineStats* stats = nullptr);
+
+        static const char* StageName(PipelineStage stage);
+    };
+
+} // SGP_IMPL
+
+#endif //PROPAGATIONPIPELINE_H
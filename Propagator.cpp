@@ -3,8 +3,15 @@
 //
 #include <stdio.h>
 #include <math.h>    // Without this the fabs returns wrong results
+#include <algorithm>
+#include <mutex>
+#include <vector>
 #include "Propagator.h"
 #include "PropResults.h"
+#include "Instrumentation.h"
+#include "ResultCache.h"
+#include "TleUtil.h"
+#include "WorkScheduler.h"
 
 // C interface wrapper
 #ifdef __cplusplus
@@ -27,13 +34,16 @@ extern "C"
 
 
 namespace SGP_IMPL {
+    std::mutex Propagator::s_errorMutex;
+
     Propagator::Propagator() = default;
     Propagator::~Propagator() = default;
-    PropagationResults Propagator::RunOneSgp4Job(char* inFile, double startTime, double stopTime, double stepSize)
+    PropagationResults Propagator::RunOneSgp4Job(char* inFile, double startTime, double stopTime, double stepSize, int numThreads,
+                                                 ResultCache* cache)
 {
+        SATPROP_SCOPE(PHASE_JOB);
         //debug log in doubles
         printf("Start Time: %.2f, Stop Time: %.2f, Step Size: %.2f\n", startTime, stopTime, stepSize);
-    const double EPSI = 0.00050;	/*	TIME TOLERANCE IN SEC.	*/
 
     PropagationResults results;
     results.overallSuccess = true;
@@ -45,28 +55,19 @@ namespace SGP_IMPL {
     char  line1[INPUTCARDLEN];
     char  line2[INPUTCARDLEN];
 
-    int   errCode;
     int   numSats;
     int   i;
-    int   step;
     int   order = 2;   // Get the satKeys in the order they were read
 
-    double mse, ds50UTC, epochDs50UTC;
-    double meanMotion;
+    double epochDs50UTC;
 
     __int64* pSatKeys;
 
-    // propagator output data
-    double
-        pos[3],           //Position (km)
-        vel[3],           //Velocity (km/s)
-        llh[3],           // Latitude(deg), Longitude(deg), Height above Geoid (km)
-        meanKep[6],       //Mean Keplerian elements
-        oscKep[6],        //Osculating Keplerian elements
-        nodalApPer[3];    //Nodal period, apogee, perigee
-
     // Load all SGP4-related data in one call
-    Sgp4LoadFileAll(inFile);
+    {
+        SATPROP_SCOPE(PHASE_LOAD_FILE);
+        Sgp4LoadFileAll(inFile);
+    }
 
     // number of satellites currently loaded in memory
     numSats = TleGetCount();
@@ -91,13 +92,25 @@ namespace SGP_IMPL {
     // get all the satellites ids from memory and store them in the local array
     TleGetLoaded(order, pSatKeys);
 
-        //reserving space for the satellites in results
-    results.satellites.reserve(numSats);
-
-    // tle loop
+    // One arena holds every satellite's steps. The window only depends on the job inputs,
+    // so the first buffer is sized for the whole job and the arena grows if that changes.
+    PropWindow jobWindow;
+    CalcStartStopTimeFromParams(0.0, &jobWindow.startTime, &jobWindow.stopTime, &jobWindow.stepSize,
+                                startTime, stopTime, stepSize);
+    results.arena = std::make_shared<ResultArena>((size_t)numSats * CountSteps(jobWindow) * sizeof(TimeStepData));
+
+    // per satellite work, filled in place so the output order matches the input file
+    std::vector<SatelliteData> satellites;
+    satellites.reserve(numSats);
+    std::vector<PropWindow> windows(numSats);
+    std::vector<SatelliteCost> costs(numSats);     // zero for satellites that failed to init
+    std::vector<ResultCacheKey> cacheKeys(cache ? numSats : 0);
+    std::vector<std::string> errorTexts;
+
+    // tle loop, initialization changes AstroStd's shared tables so it stays on this thread
     for (i = 0; i < numSats; i++)
     {
-        SatelliteData satData;
+        SatelliteData& satData = satellites.emplace_back(results.arena.get());
         satData.satKey = pSatKeys[i];
         satData.propagationSuccess = true;
 
@@ -109,19 +122,37 @@ namespace SGP_IMPL {
         satData.line1 = std::string(line1);
         satData.line2 = std::string(line2);
 
+        // propagated before over the same times, neither init nor propagation needed
+        if (cache)
+        {
+            cacheKeys[i] = ResultCacheKey::Make(satData.line1, satData.line2, jobWindow.startTime, jobWindow.stopTime,
+                                                jobWindow.stepSize, cache->Fields());
+            if (cache->Lookup(cacheKeys[i], satData, errorTexts))
+            {
+                for (size_t e = 0; e < satData.errors.size(); e++)
+                    satData.errors[e].message = errorTexts[e].empty() ? 0 : results.messages.Intern(errorTexts[e].c_str());
+                continue;
+            }
+        }
+
         // init sat
-        if (Sgp4InitSat(pSatKeys[i]) != 0)
+        int initErr;
+        {
+            SATPROP_SCOPE(PHASE_INIT_SAT);
+            initErr = Sgp4InitSat(pSatKeys[i]);
+        }
+        if (initErr != 0)
         {
             satData.propagationSuccess = false;
             GetLastErrMsg(errMsg);
             errMsg[LOGMSGLEN - 1] = 0;
 
-            TimeStepData errorStep;
-            errorStep.hasError = true;
-            errorStep.errorMsg = std::string(errMsg);
+            TimeStepData errorStep = {};
+            errorStep.error = STEP_INIT_FAILED;
             satData.timeSteps.push_back(errorStep);
-
-            results.satellites.push_back(satData);
+            satData.errors.push_back({0, STEP_INIT_FAILED, results.messages.Intern(errMsg), 0.0});
+            SATPROP_COUNT(COUNTER_ERRORS, 1);
+            SATPROP_COUNT(COUNTER_BYTES, sizeof(TimeStepData) + sizeof(StepErrorRecord));
             continue;
         }
 
@@ -131,8 +162,97 @@ namespace SGP_IMPL {
 
         // compute start/stop times and step size from the input 6P card
         //CalcStartStopTime(epochDs50UTC, &startTime, &stopTime, &stepSize);
-        CalcStartStopTimeFromParams(epochDs50UTC, &startTime, &stopTime, &stepSize,
+        PropWindow& window = windows[i];
+        CalcStartStopTimeFromParams(epochDs50UTC, &window.startTime, &window.stopTime, &window.stepSize,
                                     startTime, stopTime, stepSize);
+        window.initialized = true;
+
+        // exact, so propagation never reallocates
+        satData.timeSteps.reserve(CountSteps(window));
+
+        TleElements elements;
+        if (ParseTle(satData.line1, satData.line2, elements))
+            costs[i] = CostModel::Estimate(elements, window.startTime, window.stopTime, window.stepSize);
+        else
+            costs[i].cost = CountSteps(window);
+    }
+
+    // Propagating only touches each satellite's own state. Per satellite cost varies by
+    // orders of magnitude (deep space, decay, window), so threads take satellites longest
+    // first instead of fixed chunks; results still land in input order.
+    std::vector<int> schedule = WorkScheduler::Order(costs);
+    WorkScheduler::Run(schedule, numThreads, [&](int sat)
+    {
+        PropagateSatellite(satellites[sat], windows[sat]);
+    });
+
+    // the propagation threads are done, so the failures' texts are their own
+    for (i = 0; i < numSats; i++)
+    {
+        if (windows[i].initialized)
+            ReadFailureTexts(satellites[i], results.messages);
+    }
+
+    if (cache)
+    {
+        WorkScheduler::Run(schedule, numThreads, [&](int sat)
+        {
+            std::vector<std::string> texts;
+            for (const StepErrorRecord& record : satellites[sat].errors)
+                texts.push_back(results.messages.Get(record.message));
+            cache->Insert(cacheKeys[sat], satellites[sat], texts);
+        });
+    }
+
+    results.satellites.reserve(numSats);
+    for (i = 0; i < numSats; i++)
+    {
+        // Add this satellite's data to results
+        {
+            SATPROP_SCOPE(PHASE_STORE_SATELLITE);
+            results.satellites.push_back(std::move(satellites[i]));
+        }
+
+        // Remove this satellite if no longer needed
+        if (windows[i].initialized && Sgp4RemoveSat(pSatKeys[i]) != 0)
+        {
+            results.overallSuccess = false;
+            results.generalError = "Failed to remove satellite from memory";
+            break;
+        }
+    }
+
+    // Clean up memory
+    free(pSatKeys);
+
+    // Clean up after each job
+    TleRemoveAllSats();
+    Sgp4RemoveAllSats();
+
+    return results;
+}
+
+    void Propagator::PropagateSatellite(SatelliteData& satData, const PropWindow& window)
+{
+    SATPROP_SCOPE(PHASE_SATELLITE);
+    const double EPSI = 0.00050;	/*	TIME TOLERANCE IN SEC.	*/
+
+    int   errCode;
+    int   step;
+    double mse, ds50UTC;
+
+    double startTime = window.startTime;
+    double stopTime = window.stopTime;
+    double stepSize = window.stepSize;
+
+    // propagator output data
+    double
+        pos[3],           //Position (km)
+        vel[3],           //Velocity (km/s)
+        llh[3],           // Latitude(deg), Longitude(deg), Height above Geoid (km)
+        meanKep[6],       //Mean Keplerian elements
+        oscKep[6],        //Osculating Keplerian elements
+        nodalApPer[3];    //Nodal period, apogee, perigee
 
         step = 0;
         ds50UTC = startTime;
@@ -152,11 +272,16 @@ namespace SGP_IMPL {
                 ds50UTC = stopTime;
 
             // propagate satellite to the current time step
-            errCode = Sgp4PropDs50UTC(pSatKeys[i], ds50UTC, &mse, pos, vel, llh);
+            {
+                SATPROP_SCOPE(PHASE_PROPAGATE);
+                errCode = Sgp4PropDs50UTC(satData.satKey, ds50UTC, &mse, pos, vel, llh);
+            }
 
-            TimeStepData stepData;
+            // zeroed so a failed step carries no leftover values
+            TimeStepData stepData = {};
             stepData.mse = mse;
-            stepData.hasError = false;
+            stepData.ds50UTC = ds50UTC;
+            stepData.error = STEP_OK;
 
             // copy stepdata
             for (int j = 0; j < 3; j++)
@@ -169,21 +294,31 @@ namespace SGP_IMPL {
             // Error or decay condition
             if (errCode != 0)
             {
-                GetLastErrMsg(errMsg);
-                errMsg[LOGMSGLEN - 1] = 0;
-
-                stepData.hasError = true;
-                stepData.errorMsg = std::string(errMsg);
+                stepData.error = STEP_PROPAGATION_ERROR;
+                satData.errors.push_back({(int)satData.timeSteps.size(), STEP_PROPAGATION_ERROR, 0, 0.0});
                 satData.timeSteps.push_back(stepData);
                 satData.propagationSuccess = false;
+                SATPROP_COUNT(COUNTER_ERRORS, 1);
+                SATPROP_COUNT(COUNTER_BYTES, sizeof(TimeStepData) + sizeof(StepErrorRecord));
                 break; // Move to the next satellite
             }
 
             //Compute/Retrieve other propagator output data
             //----------------------------------------------------------------
-            Sgp4GetPropOut(pSatKeys[i], XF_SGP4OUT_OSC_KEP, oscKep);
-            Sgp4GetPropOut(pSatKeys[i], XF_SGP4OUT_MEAN_KEP, meanKep);
-            Sgp4GetPropOut(pSatKeys[i], XF_SGP4OUT_NODAL_AP_PER, nodalApPer);
+            {
+                SATPROP_SCOPE(PHASE_OSC_KEP);
+                Sgp4GetPropOut(satData.satKey, XF_SGP4OUT_OSC_KEP, oscKep);
+            }
+            {
+                SATPROP_SCOPE(PHASE_MEAN_KEP);
+                Sgp4GetPropOut(satData.satKey, XF_SGP4OUT_MEAN_KEP, meanKep);
+            }
+            {
+                SATPROP_SCOPE(PHASE_NODAL_AP_PER);
+                Sgp4GetPropOut(satData.satKey, XF_SGP4OUT_NODAL_AP_PER, nodalApPer);
+            }
+
+            SATPROP_SCOPE(PHASE_ASSEMBLE_STEP);
 
             // Copy Keplerian elements and nodal data
             for (int j = 0; j < 6; j++)
@@ -203,44 +338,77 @@ namespace SGP_IMPL {
             // Height is below 100km - Skip the satellite
             if (llh[2] < 100.0)
             {
-                stepData.hasError = true;
-                if (llh[2] < 0)
-                    stepData.errorMsg = "Warning: Decay condition. Distance from the Geoid (Km) = " +
-                                       std::to_string(llh[2]);
-                else
-                    stepData.errorMsg = "Warning: Height is low. HT (Km) = " + std::to_string(llh[2]);
-
+                // the text is built from the height only when someone looks at it
+                stepData.error = llh[2] < 0 ? STEP_DECAY : STEP_LOW_ALTITUDE;
+                satData.errors.push_back({(int)satData.timeSteps.size(), stepData.error, 0, llh[2]});
                 satData.timeSteps.push_back(stepData);
                 satData.propagationSuccess = false;
+                SATPROP_COUNT(COUNTER_ERRORS, 1);
+                SATPROP_COUNT(COUNTER_BYTES, sizeof(TimeStepData) + sizeof(StepErrorRecord));
                 break; // Move to the next satellite
             }
 
             // Add this successful timestep to the satellite data
             satData.timeSteps.push_back(stepData);
+            SATPROP_COUNT(COUNTER_STEPS, 1);
+            SATPROP_COUNT(COUNTER_BYTES, sizeof(TimeStepData));
             step++;
         }
+}
 
-        // Add this satellite's data to results
-        results.satellites.push_back(satData);
-
-        // Remove this satellite if no longer needed
-        if (Sgp4RemoveSat(pSatKeys[i]) != 0)
+    void Propagator::ReadFailureTexts(SatelliteData& satData, ErrorMessageTable& messages)
+    {
+        char errMsg[LOGMSGLEN];
+        double mse, pos[3], vel[3], llh[3];
+        for (StepErrorRecord& record : satData.errors)
         {
-            results.overallSuccess = false;
-            results.generalError = "Failed to remove satellite from memory";
-            break;
+            if (record.code != STEP_PROPAGATION_ERROR || record.message != 0 || record.step < 0 ||
+                record.step >= (int)satData.timeSteps.size())
+                continue;
+
+            // the same satellite at the same time fails the same way
+            Sgp4PropDs50UTC(satData.satKey, satData.timeSteps[record.step].ds50UTC, &mse, pos, vel, llh);
+            GetLastErrMsg(errMsg);
+            errMsg[LOGMSGLEN - 1] = 0;
+
+            // format threads may be reading the table
+            std::lock_guard<std::mutex> lock(s_errorMutex);
+            record.message = messages.Intern(errMsg);
         }
     }
 
-    // Clean up memory
-    free(pSatKeys);
-
-    // Clean up after each job
-    TleRemoveAllSats();
-    Sgp4RemoveAllSats();
+    int Propagator::CountSteps(const PropWindow& window)
+    {
+        // mirrors the loop in PropagateSatellite: a step every stepSize minutes from the start,
+        // the last one pulled onto the stop time when it lands within the tolerance
+        const double EPSI = 0.00050;
+        double span = fabs(window.stopTime - window.startTime) * 1440.0;
+        double step = fabs(window.stepSize);
+        if (span <= 0.0)
+            return 0;
+        if (step <= 0.0)
+            return 1;
+        return (int)floor((span - EPSI / 60.0) / step) + 2;
+    }
 
-    return results;
-}
+    std::vector<double> Propagator::StepTimes(double startTime, double stopTime, double stepSize)
+    {
+        PropWindow window;
+        window.startTime = startTime;
+        window.stopTime = stopTime;
+        window.stepSize = stopTime >= startTime ? fabs(stepSize) : -fabs(stepSize);
+        int count = CountSteps(window);
+        std::vector<double> times;
+        if (count <= 1)
+        {
+            times.push_back(startTime);
+            return times;
+        }
+        for (int t = 0; t < count - 1; t++)
+            times.push_back(startTime + t * window.stepSize / 1440.0);
+        times.push_back(stopTime);
+        return times;
+    }
 
    void PrintHeader(FILE* fp, int fileType) // output file header print
     {
@@ -6,10 +6,14 @@
 #define PROPAGATOR_H
 
 #include <stdio.h>
+#include <mutex>
+#include <vector>
 #include "PropResults.h"
 
 namespace SGP_IMPL {
 
+    class ResultCache;
+
     // File type constants for PrintHeader function
     const int FT_OSC_STATE = 0;
     const int FT_OSC_ELEM = 1;
@@ -25,13 +29,47 @@ namespace SGP_IMPL {
         // Destructor
         ~Propagator();
 
-        // Main SGP4 propagation function
-        static PropagationResults RunOneSgp4Job(char* inFile, double startTime, double stopTime, double stepSize);
+        // Main SGP4 propagation function. Satellites are initialized on the calling thread and
+        // propagated on numThreads threads, most expensive first (see WorkScheduler); results
+        // keep the input file order either way. Satellites found in the cache skip both, the
+        // others are inserted once propagated.
+        static PropagationResults RunOneSgp4Job(char* inFile, double startTime, double stopTime, double stepSize,
+                                                int numThreads = 1, ResultCache* cache = nullptr);
+
+        // Times a satellite steps through from start to stop (ds50UTC), stepSize minutes
+        // apart with the last pulled onto stop, as a job lays them out
+        static std::vector<double> StepTimes(double startTime, double stopTime, double stepSize);
 
         // Print header function
         static void PrintHeader(FILE* fp, int fileType);
 
     private:
+        // runs PropagateSatellite per satellite as its own stage
+        friend class PipelineRun;
+
+        // Time span of one initialized satellite
+        struct PropWindow {
+            double startTime = 0.0;
+            double stopTime = 0.0;
+            double stepSize = 0.0;
+            bool initialized = false;
+        };
+
+        // Steps one initialized satellite through its window, safe to run per satellite in
+        // parallel. A propagation failure is recorded without its text, see ReadFailureTexts.
+        static void PropagateSatellite(SatelliteData& satData, const PropWindow& window);
+
+        // AstroStd keeps one last error text for the whole process, which another thread's
+        // failure can replace before it is read. This repeats the failed step of a satellite
+        // that is still loaded and interns its text, so it may only run while no other thread
+        // is in AstroStd.
+        static void ReadFailureTexts(SatelliteData& satData, ErrorMessageTable& messages);
+
+        // Steps PropagateSatellite produces for the window when nothing fails
+        static int CountSteps(const PropWindow& window);
+
+        static std::mutex s_errorMutex;
+
         // Helper functions that you'll likely need based on the implementation
         static void CalcStartStopTime(double epochDs50UTC, double* startTime,
                               double* stopTime, double* stepSize);
@@ -0,0 +1,486 @@
+//
+// RelativeMotion.cpp
+// Deputy states in the chief's radial/in-track/cross-track frame and proximity of satellite pairs
+//
+
+#include "RelativeMotion.h"
+#include "EphemerisQuery.h"
+#include "RootFinder.h"
+#include "WorkScheduler.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RELATIVEMOTION_SSE2
+#include <emmintrin.h>
+#endif
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "services/TimeFuncDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/TimeFuncDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const double MAX_RELATIVE_ACCEL = 0.02;     // km/s^2, two satellites pulled apart at the surface
+        const double GRID_EPSILON = 1e-6;           // of a step, times this close are the same time
+
+        enum Column
+        {
+            COL_CHIEF = 0,                          // x, y, z, vx, vy, vz
+            COL_DEPUTY = 6,
+            COL_OUT = 12,                           // NUM_RELATIVE_FIELDS of them
+            COL_KEEP_OUT = COL_OUT + NUM_RELATIVE_FIELDS,
+            NUM_COLUMNS
+        };
+
+        // One function of the pair inside a bracket
+        struct Point
+        {
+            double t = 0.0;                         // days from the pair's first step
+            double f = 0.0;
+            RelativeState state;
+        };
+
+        inline void RicState(const double c[6], const double d[6], double out[NUM_RELATIVE_FIELDS])
+        {
+            double r2 = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+            double r = sqrt(r2);
+            double hx = c[1] * c[5] - c[2] * c[4];
+            double hy = c[2] * c[3] - c[0] * c[5];
+            double hz = c[0] * c[4] - c[1] * c[3];
+            double h = std::max(sqrt(hx * hx + hy * hy + hz * hz), DBL_MIN);
+            double rx = c[0] / r, ry = c[1] / r, rz = c[2] / r;
+            double cx = hx / h, cy = hy / h, cz = hz / h;
+            double ix = cy * rz - cz * ry, iy = cz * rx - cx * rz, iz = cx * ry - cy * rx;
+
+            double px = d[0] - c[0], py = d[1] - c[1], pz = d[2] - c[2];
+            double vx = d[3] - c[3], vy = d[4] - c[4], vz = d[5] - c[5];
+            double wx = hx / r2, wy = hy / r2, wz = hz / r2;
+            double ux = vx - (wy * pz - wz * py);
+            double uy = vy - (wz * px - wx * pz);
+            double uz = vz - (wx * py - wy * px);
+
+            out[REL_R] = px * rx + py * ry + pz * rz;
+            out[REL_I] = px * ix + py * iy + pz * iz;
+            out[REL_C] = px * cx + py * cy + pz * cz;
+            out[REL_VR] = ux * rx + uy * ry + uz * rz;
+            out[REL_VI] = ux * ix + uy * iy + uz * iz;
+            out[REL_VC] = ux * cx + uy * cy + uz * cz;
+            out[REL_RANGE] = sqrt(px * px + py * py + pz * pz);
+            out[REL_RANGE_RATE] = (px * vx + py * vy + pz * vz) / std::max(out[REL_RANGE], DBL_MIN);
+            out[REL_SPEED] = sqrt(vx * vx + vy * vy + vz * vz);
+        }
+
+        // Ellipsoid function, negative inside
+        inline double KeepOut(const double ric[3], const double axes[3])
+        {
+            double r = ric[0] / axes[0], i = ric[1] / axes[1], c = ric[2] / axes[2];
+            return sqrt(r * r + i * i + c * c) - 1.0;
+        }
+
+        // Steps before the first init or propagation failure, from the error records
+        size_t SpanOf(const SatelliteData& satellite)
+        {
+            size_t count = satellite.timeSteps.size();
+            for (const StepErrorRecord& record : satellite.errors)
+            {
+                if (record.code == STEP_INIT_FAILED || record.code == STEP_PROPAGATION_ERROR)
+                    return std::min(count, (size_t)record.step);
+            }
+            return count;
+        }
+
+        std::string SatNum(const PropagationResults& results, int index)
+        {
+            const std::string& line1 = results.satellites[index].line1;
+            return line1.size() >= 7 ? line1.substr(2, 5) : std::to_string(index);
+        }
+
+#ifdef RELATIVEMOTION_SSE2
+        inline __m128d Dot(__m128d ax, __m128d ay, __m128d az, __m128d bx, __m128d by, __m128d bz)
+        {
+            return _mm_add_pd(_mm_add_pd(_mm_mul_pd(ax, bx), _mm_mul_pd(ay, by)), _mm_mul_pd(az, bz));
+        }
+
+        inline __m128d CrossTerm(__m128d a1, __m128d b2, __m128d a2, __m128d b1)
+        {
+            return _mm_sub_pd(_mm_mul_pd(a1, b2), _mm_mul_pd(a2, b1));
+        }
+#endif
+
+    } // namespace
+
+    void RelativeMotion::ToRic(const double* const chief[6], const double* const deputy[6], size_t count,
+                               double* const out[NUM_RELATIVE_FIELDS])
+    {
+        size_t i = 0;
+#ifdef RELATIVEMOTION_SSE2
+        const __m128d tiny = _mm_set1_pd(DBL_MIN);
+        for (; i + 2 <= count; i += 2)
+        {
+            __m128d c0 = _mm_loadu_pd(chief[0] + i), c1 = _mm_loadu_pd(chief[1] + i), c2 = _mm_loadu_pd(chief[2] + i);
+            __m128d c3 = _mm_loadu_pd(chief[3] + i), c4 = _mm_loadu_pd(chief[4] + i), c5 = _mm_loadu_pd(chief[5] + i);
+            __m128d r2 = Dot(c0, c1, c2, c0, c1, c2);
+            __m128d r = _mm_sqrt_pd(r2);
+            __m128d hx = CrossTerm(c1, c5, c2, c4);
+            __m128d hy = CrossTerm(c2, c3, c0, c5);
+            __m128d hz = CrossTerm(c0, c4, c1, c3);
+            __m128d h = _mm_max_pd(_mm_sqrt_pd(Dot(hx, hy, hz, hx, hy, hz)), tiny);
+            __m128d rx = _mm_div_pd(c0, r), ry = _mm_div_pd(c1, r), rz = _mm_div_pd(c2, r);
+            __m128d cx = _mm_div_pd(hx, h), cy = _mm_div_pd(hy, h), cz = _mm_div_pd(hz, h);
+            __m128d ix = CrossTerm(cy, rz, cz, ry), iy = CrossTerm(cz, rx, cx, rz), iz = CrossTerm(cx, ry, cy, rx);
+
+            __m128d px = _mm_sub_pd(_mm_loadu_pd(deputy[0] + i), c0);
+            __m128d py = _mm_sub_pd(_mm_loadu_pd(deputy[1] + i), c1);
+            __m128d pz = _mm_sub_pd(_mm_loadu_pd(deputy[2] + i), c2);
+            __m128d vx = _mm_sub_pd(_mm_loadu_pd(deputy[3] + i), c3);
+            __m128d vy = _mm_sub_pd(_mm_loadu_pd(deputy[4] + i), c4);
+            __m128d vz = _mm_sub_pd(_mm_loadu_pd(deputy[5] + i), c5);
+            __m128d wx = _mm_div_pd(hx, r2), wy = _mm_div_pd(hy, r2), wz = _mm_div_pd(hz, r2);
+            __m128d ux = _mm_sub_pd(vx, CrossTerm(wy, pz, wz, py));
+            __m128d uy = _mm_sub_pd(vy, CrossTerm(wz, px, wx, pz));
+            __m128d uz = _mm_sub_pd(vz, CrossTerm(wx, py, wy, px));
+
+            __m128d range = _mm_sqrt_pd(Dot(px, py, pz, px, py, pz));
+            _mm_storeu_pd(out[REL_R] + i, Dot(px, py, pz, rx, ry, rz));
+            _mm_storeu_pd(out[REL_I] + i, Dot(px, py, pz, ix, iy, iz));
+            _mm_storeu_pd(out[REL_C] + i, Dot(px, py, pz, cx, cy, cz));
+            _mm_storeu_pd(out[REL_VR] + i, Dot(ux, uy, uz, rx, ry, rz));
+            _mm_storeu_pd(out[REL_VI] + i, Dot(ux, uy, uz, ix, iy, iz));
+            _mm_storeu_pd(out[REL_VC] + i, Dot(ux, uy, uz, cx, cy, cz));
+            _mm_storeu_pd(out[REL_RANGE] + i, range);
+            _mm_storeu_pd(out[REL_RANGE_RATE] + i, _mm_div_pd(Dot(px, py, pz, vx, vy, vz), _mm_max_pd(range, tiny)));
+            _mm_storeu_pd(out[REL_SPEED] + i, _mm_sqrt_pd(Dot(vx, vy, vz, vx, vy, vz)));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            double c[6], d[6], o[NUM_RELATIVE_FIELDS];
+            for (int k = 0; k < 6; k++)
+            {
+                c[k] = chief[k][i];
+                d[k] = deputy[k][i];
+            }
+            RicState(c, d, o);
+            for (int k = 0; k < NUM_RELATIVE_FIELDS; k++)
+                out[k][i] = o[k];
+        }
+    }
+
+    ProximityReport RelativeMotion::Run(const PropagationResults& results, const std::vector<SatellitePair>& pairs,
+                                        const ProximityOptions& options)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ProximityReport report;
+        report.pairs.resize(pairs.size());
+
+        size_t numSatellites = results.satellites.size();
+        std::vector<size_t> spans(numSatellites);
+        for (size_t s = 0; s < numSatellites; s++)
+            spans[s] = SpanOf(results.satellites[s]);
+        const double* axes = options.keepOutKm;
+        bool keepOut = axes[0] > 0.0 && axes[1] > 0.0 && axes[2] > 0.0;
+        double maxAxis = std::max(axes[0], std::max(axes[1], axes[2]));
+        double tol = options.toleranceSeconds / 86400.0;
+
+        std::vector<int> order(pairs.size());
+        for (size_t p = 0; p < pairs.size(); p++)
+            order[p] = (int)p;
+        WorkScheduler::Run(order, options.numThreads, [&](int p)
+        {
+            PairProximity& proximity = report.pairs[p];
+            proximity.pair = pairs[p];
+            int chief = pairs[p].chief, deputy = pairs[p].deputy;
+            if (chief < 0 || deputy < 0 || chief >= (int)numSatellites || deputy >= (int)numSatellites)
+            {
+                proximity.error = "No such satellite";
+                return;
+            }
+            const auto& chiefSteps = results.satellites[chief].timeSteps;
+            const auto& deputySteps = results.satellites[deputy].timeSteps;
+            size_t count = std::min(spans[chief], spans[deputy]);
+            if (count == 0)
+            {
+                proximity.error = "No shared steps";
+                return;
+            }
+
+            double base = chiefSteps[0].ds50UTC;
+            double slack = GRID_EPSILON * (count > 1 ? fabs(chiefSteps[1].ds50UTC - base) : 1.0);
+            std::vector<double> columns(NUM_COLUMNS * count);
+            double* column[NUM_COLUMNS];
+            for (int c = 0; c < NUM_COLUMNS; c++)
+                column[c] = &columns[c * count];
+            bool onGrid = true;
+            for (size_t i = 0; i < count; i++)
+            {
+                const TimeStepData& a = chiefSteps[i];
+                const TimeStepData& b = deputySteps[i];
+                for (int k = 0; k < 3; k++)
+                {
+                    column[COL_CHIEF + k][i] = a.pos[k];
+                    column[COL_CHIEF + 3 + k][i] = a.vel[k];
+                    column[COL_DEPUTY + k][i] = b.pos[k];
+                    column[COL_DEPUTY + 3 + k][i] = b.vel[k];
+                }
+                onGrid = onGrid && fabs(a.ds50UTC - b.ds50UTC) <= slack;
+            }
+            if (!onGrid)
+            {
+                proximity.error = "Steps off the shared grid";
+                return;
+            }
+            ToRic(column + COL_CHIEF, column + COL_DEPUTY, count, column + COL_OUT);
+            proximity.steps = (int)count;
+
+            const double* out[NUM_RELATIVE_FIELDS];
+            for (int k = 0; k < NUM_RELATIVE_FIELDS; k++)
+                out[k] = column[COL_OUT + k];
+            auto stepState = [&](size_t i)
+            {
+                RelativeState state;
+                state.ds50UTC = chiefSteps[i].ds50UTC;
+                for (int k = 0; k < 6; k++)
+                    state.ric[k] = out[REL_R + k][i];
+                state.range = out[REL_RANGE][i];
+                state.rangeRate = out[REL_RANGE_RATE][i];
+                return state;
+            };
+            if (options.keepStates)
+            {
+                proximity.states.resize(count);
+                for (size_t i = 0; i < count; i++)
+                    proximity.states[i] = stepState(i);
+            }
+
+            const double* range = out[REL_RANGE];
+            const double* rangeRate = out[REL_RANGE_RATE];
+            size_t closest = 0, closing = 0, opening = 0;
+            for (size_t i = 1; i < count; i++)
+            {
+                closest = range[i] < range[closest] ? i : closest;
+                closing = rangeRate[i] < rangeRate[closing] ? i : closing;
+                opening = rangeRate[i] > rangeRate[opening] ? i : opening;
+            }
+            proximity.closest = stepState(closest);
+            proximity.fastestClosing = stepState(closing);
+            proximity.fastestOpening = stepState(opening);
+
+            double* keepOutValue = column[COL_KEEP_OUT];
+            for (size_t i = 0; i < count && keepOut; i++)
+            {
+                double ric[3] = {out[REL_R][i], out[REL_I][i], out[REL_C][i]};
+                keepOutValue[i] = KeepOut(ric, axes);
+            }
+
+            // interpolated pair at t inside the two steps either side of step i
+            auto time = [&](size_t i) { return chiefSteps[i].ds50UTC - base; };
+            auto at = [&](double t, size_t i, bool isKeepOut)
+            {
+                size_t k = i > 0 && (i + 1 == count || t < time(i)) ? i - 1 : i;
+                EphemerisState a, b;
+                EphemerisQuery::Between(chiefSteps[k], chiefSteps[k + 1], base + t, AXIS_DS50UTC, a);
+                EphemerisQuery::Between(deputySteps[k], deputySteps[k + 1], base + t, AXIS_DS50UTC, b);
+                double c[6] = {a.pos[0], a.pos[1], a.pos[2], a.vel[0], a.vel[1], a.vel[2]};
+                double d[6] = {b.pos[0], b.pos[1], b.pos[2], b.vel[0], b.vel[1], b.vel[2]};
+                double o[NUM_RELATIVE_FIELDS];
+                RicState(c, d, o);
+                Point point;
+                point.t = t;
+                point.state.ds50UTC = base + t;
+                std::copy(o, o + 6, point.state.ric);
+                point.state.range = o[REL_RANGE];
+                point.state.rangeRate = o[REL_RANGE_RATE];
+                point.f = isKeepOut ? KeepOut(o, axes) : o[REL_RANGE];
+                return point;
+            };
+
+            // least range the pair can reach over the steps either side of step i, at the
+            // greater of the two ends' speeds plus what gravity adds over the step
+            auto rangeBound = [&](size_t i)
+            {
+                double bound = DBL_MAX;
+                for (size_t k = i > 0 ? i - 1 : i; k < i + 1 && k + 1 < count; k++)
+                {
+                    double dt = fabs(time(k + 1) - time(k)) * 86400.0;
+                    double speed = std::max(out[REL_SPEED][k], out[REL_SPEED][k + 1]) + MAX_RELATIVE_ACCEL * dt;
+                    bound = std::min(bound, 0.5 * (range[k] + range[k + 1] - speed * dt));
+                }
+                return bound;
+            };
+            auto localMinima = [&](const double* f)
+            {
+                std::vector<size_t> minima;
+                for (size_t i = 0; i < count && count > 1; i++)
+                {
+                    if ((i == 0 || f[i] < f[i - 1]) && (i + 1 == count || f[i] <= f[i + 1]))
+                        minima.push_back(i);
+                }
+                std::sort(minima.begin(), minima.end(), [&](size_t a, size_t b) { return f[a] < f[b]; });
+                return minima;
+            };
+
+            // the closest approach near each local minimum that could still beat the best
+            for (size_t i : options.refine ? localMinima(range) : std::vector<size_t>())
+            {
+                if (rangeBound(i) >= proximity.closest.range)
+                    continue;
+                Point lowest = BrentMinimum<Point>([&](double t) { return at(t, i, false); },
+                                                   time(i > 0 ? i - 1 : i), time(std::min(i + 1, count - 1)), tol);
+                if (lowest.state.range < proximity.closest.range)
+                    proximity.closest = lowest.state;
+            }
+            if (!keepOut)
+                return;
+
+            // entries and exits where the steps change side of the ellipsoid
+            auto crossing = [&](Point before, Point after, size_t i)
+            {
+                if (options.refine)
+                    BrentBracket([&](double t) { return at(t, i, true); }, before, after, tol);
+                return base + (fabs(before.f) <= fabs(after.f) ? before.t : after.t);
+            };
+            auto gridPoint = [&](size_t i)
+            {
+                Point point;
+                point.t = time(i);
+                point.f = keepOutValue[i];
+                return point;
+            };
+            KeepOutViolation violation;
+            bool inside = keepOutValue[0] < 0.0;
+            violation.entry = base;
+            violation.minRange = range[0];
+            for (size_t i = 1; i < count; i++)
+            {
+                bool now = keepOutValue[i] < 0.0;
+                if (now != inside)
+                {
+                    double t = crossing(gridPoint(i - 1), gridPoint(i), i);
+                    if (now)
+                    {
+                        violation.entry = t;
+                        violation.minRange = range[i];
+                    }
+                    else
+                    {
+                        violation.exit = t;
+                        proximity.violations.push_back(violation);
+                    }
+                    inside = now;
+                }
+                else if (inside)
+                {
+                    violation.minRange = std::min(violation.minRange, range[i]);
+                }
+            }
+            if (inside)
+            {
+                violation.exit = chiefSteps[count - 1].ds50UTC;
+                proximity.violations.push_back(violation);
+            }
+
+            // passes in and out between steps, near local minima of the ellipsoid function
+            for (size_t i : options.refine ? localMinima(keepOutValue) : std::vector<size_t>())
+            {
+                if (keepOutValue[i] < 0.0 || rangeBound(i) >= maxAxis)
+                    continue;
+                size_t lo = i > 0 ? i - 1 : i, hi = std::min(i + 1, count - 1);
+                Point dip = BrentMinimum<Point>([&](double t) { return at(t, i, true); }, time(lo), time(hi), tol, 0.0);
+                if (dip.f >= 0.0)
+                    continue;
+                KeepOutViolation pass;
+                pass.entry = crossing(gridPoint(lo), dip, i);
+                pass.exit = crossing(dip, gridPoint(hi), i);
+                pass.minRange = dip.state.range;
+                proximity.violations.push_back(pass);
+                if (dip.state.range < proximity.closest.range)
+                    proximity.closest = dip.state;
+            }
+            std::sort(proximity.violations.begin(), proximity.violations.end(),
+                      [](const KeepOutViolation& a, const KeepOutViolation& b) { return a.entry < b.entry; });
+            for (KeepOutViolation& v : proximity.violations)
+            {
+                if (proximity.closest.ds50UTC >= v.entry && proximity.closest.ds50UTC <= v.exit)
+                    v.minRange = std::min(v.minRange, proximity.closest.range);
+            }
+        });
+
+        for (const PairProximity& proximity : report.pairs)
+        {
+            report.steps += proximity.steps;
+            report.violations += proximity.violations.size();
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    std::vector<SatellitePair> RelativeMotion::ChiefPairs(const PropagationResults& results, int chief)
+    {
+        std::vector<SatellitePair> pairs;
+        for (int s = 0; s < (int)results.satellites.size(); s++)
+        {
+            if (s != chief)
+                pairs.push_back({chief, s});
+        }
+        return pairs;
+    }
+
+    bool RelativeMotion::WriteReport(const std::string& filePath, const PropagationResults& results,
+                                     const ProximityReport& report, std::string* error)
+    {
+        FILE* fp = fopen(filePath.c_str(), "w");
+        if (!fp)
+        {
+            if (error)
+                *error = "Can't create " + filePath;
+            return false;
+        }
+        for (const PairProximity& proximity : report.pairs)
+        {
+            const SatellitePair& pair = proximity.pair;
+            bool known = pair.chief >= 0 && pair.deputy >= 0 && pair.chief < (int)results.satellites.size() &&
+                         pair.deputy < (int)results.satellites.size();
+            std::string chief = known ? SatNum(results, pair.chief) : std::to_string(pair.chief);
+            std::string deputy = known ? SatNum(results, pair.deputy) : std::to_string(pair.deputy);
+            if (!proximity.error.empty())
+            {
+                fprintf(fp, "%s %s error %s\n", chief.c_str(), deputy.c_str(), proximity.error.c_str());
+                continue;
+            }
+            const RelativeState& c = proximity.closest;
+            fprintf(fp, "%s %s %17.8f %s %12.4f %12.4f %12.4f %12.4f %10.6f %10.6f %zu\n", chief.c_str(),
+                    deputy.c_str(), c.ds50UTC, UTCToDtg20Str(c.ds50UTC), c.range, c.ric[REL_R], c.ric[REL_I],
+                    c.ric[REL_C], proximity.fastestClosing.rangeRate, proximity.fastestOpening.rangeRate,
+                    proximity.violations.size());
+            for (const KeepOutViolation& violation : proximity.violations)
+            {
+                std::string entry = UTCToDtg20Str(violation.entry);
+                fprintf(fp, "%s %s keep_out %17.8f %s %17.8f %s %12.4f\n", chief.c_str(), deputy.c_str(),
+                        violation.entry, entry.c_str(), violation.exit, UTCToDtg20Str(violation.exit),
+                        violation.minRange);
+            }
+        }
+        bool written = fclose(fp) == 0;
+        if (!written && error)
+            *error = "Can't write " + filePath;
+        return written;
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,118 @@
+//
+// RelativeMotion.h
+// Deputy states in the chief's radial/in-track/cross-track frame and proximity of satellite pairs
+//
+
+#ifndef RELATIVEMOTION_H
+#define RELATIVEMOTION_H
+
+#include <string>
+#include <vector>
+#include "PropResults.h"
+
+namespace SGP_IMPL {
+
+    // Columns of ToRic's output
+    enum RelativeField
+    {
+        REL_R = 0,                      // km, along the chief's position
+        REL_I,                          // km, completes the frame, along the velocity on a circular orbit
+        REL_C,                          // km, along the chief's angular momentum
+        REL_VR,                         // km/s, seen from the rotating frame
+        REL_VI,
+        REL_VC,
+        REL_RANGE,                      // km
+        REL_RANGE_RATE,                 // km/s, positive opening
+        REL_SPEED,                      // km/s, inertial relative speed
+        NUM_RELATIVE_FIELDS
+    };
+
+    // Indices into PropagationResults::satellites
+    struct SatellitePair
+    {
+        int chief = 0;
+        int deputy = 0;
+    };
+
+    struct RelativeState
+    {
+        double ds50UTC = 0.0;
+        double ric[6] = {};             // REL_R through REL_VC
+        double range = 0.0;             // km
+        double rangeRate = 0.0;         // km/s
+    };
+
+    // A stay of the deputy inside the keep-out ellipsoid; a pair inside at either end of
+    // its span enters at the start or leaves at the end
+    struct KeepOutViolation
+    {
+        double entry = 0.0;             // ds50UTC
+        double exit = 0.0;
+        double minRange = 0.0;          // km, least range seen inside
+    };
+
+    struct ProximityOptions
+    {
+        double keepOutKm[3] = {1.0, 2.0, 1.0};  // R, I, C semi-axes of the ellipsoid, any 0 for none
+        bool keepStates = true;         // the relative state at every step
+        bool refine = true;             // closest approach and violation times between steps
+        double toleranceSeconds = 1e-3;
+        int numThreads = 1;
+    };
+
+    struct PairProximity
+    {
+        SatellitePair pair;
+        std::vector<RelativeState> states;          // keepStates only
+        RelativeState closest;                      // least range, refined between steps
+        RelativeState fastestClosing;               // least range rate on the steps
+        RelativeState fastestOpening;               // greatest range rate on the steps
+        std::vector<KeepOutViolation> violations;   // in time order
+        int steps = 0;                  // shared steps compared
+        std::string error;              // no shared steps, or steps off the shared grid
+    };
+
+    struct ProximityReport
+    {
+        std::vector<PairProximity> pairs;           // in the order asked for
+        long long steps = 0;
+        long long violations = 0;
+        double seconds = 0.0;
+    };
+
+    // Works on the results of a job, whose satellites all step on one ds50UTC grid, so a
+    // pair is compared step for step without propagating again. Both satellites' states are
+    // copied into columns and the RIC frame of every step is built two steps at a time with
+    // SSE2 where the compiler targets it. The relative velocity is the one seen from the
+    // frame, rotating at h / r^2.
+    //
+    // The closest approach is refined with Brent's method on the Hermite interpolated
+    // ephemeris (see EphemerisQuery) around each local minimum of range on the steps, and
+    // keep-out entries and exits likewise, including passes that enter and leave between two
+    // steps. Range rate extremes are taken on the steps. A pair's span ends where either
+    // satellite's does, at its first init or propagation failure. Pairs run in parallel on
+    // numThreads.
+    class RelativeMotion
+    {
+    public:
+        static ProximityReport Run(const PropagationResults& results, const std::vector<SatellitePair>& pairs,
+                                   const ProximityOptions& options = ProximityOptions());
+
+        // The deputy relative to the chief for count steps, each satellite as columns of x,
+        // y, z, vx, vy, vz (km, km/s, same inertial frame); out holds NUM_RELATIVE_FIELDS
+        // columns of count
+        static void ToRic(const double* const chief[6], const double* const deputy[6], size_t count,
+                          double* const out[NUM_RELATIVE_FIELDS]);
+
+        // The chief against every other satellite of the results
+        static std::vector<SatellitePair> ChiefPairs(const PropagationResults& results, int chief);
+
+        // One line per pair: chief, deputy, closest approach time, date, range and RIC
+        // position, range rate extremes and violation count; then one line per violation
+        static bool WriteReport(const std::string& filePath, const PropagationResults& results,
+                                const ProximityReport& report, std::string* error = nullptr);
+    };
+
+} // SGP_IMPL
+
+#endif //RELATIVEMOTION_H
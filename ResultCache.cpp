@@ -0,0 +1,566 @@
+//
+// ResultCache.cpp
+// Propagated satellites kept across jobs, keyed by TLE and time grid, spilling to disk
+//
+
+#include "ResultCache.h"
+#include "io/ByteBuffer.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        // each cache spills into <spillDirectory>/process_<pid>_<n>
+        const char PROCESS_PREFIX[] = "process_";
+        std::atomic<unsigned> s_cacheCount{0};
+
+        unsigned long CurrentProcessId()
+        {
+#ifdef _WIN32
+            return (unsigned long)GetCurrentProcessId();
+#else
+            return (unsigned long)getpid();
+#endif
+        }
+
+        bool ProcessAlive(unsigned long pid)
+        {
+#ifdef _WIN32
+            HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+            if (!process)
+                return GetLastError() == ERROR_ACCESS_DENIED;
+            DWORD code = 0;
+            bool alive = GetExitCodeProcess(process, &code) && code == STILL_ACTIVE;
+            CloseHandle(process);
+            return alive;
+#else
+            return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+        }
+
+        // Spill directories whose process is gone, left behind by a crash
+        void RemoveStaleSpills(const std::filesystem::path& parent)
+        {
+            std::error_code error;
+            std::vector<std::filesystem::path> stale;
+            for (std::filesystem::directory_iterator it(parent, error), end; !error && it != end; it.increment(error))
+            {
+                std::string name = it->path().filename().string();
+                unsigned long pid = 0;
+                if (name.compare(0, sizeof(PROCESS_PREFIX) - 1, PROCESS_PREFIX) != 0 ||
+                    sscanf(name.c_str() + sizeof(PROCESS_PREFIX) - 1, "%lu", &pid) != 1)
+                    continue;
+                if (pid != CurrentProcessId() && !ProcessAlive(pid))
+                    stale.push_back(it->path());
+            }
+            for (const auto& path : stale)
+                std::filesystem::remove_all(path, error);
+        }
+
+        const uint32_t CACHE_MAGIC = 0x43525053;   // "SPRC"
+        const uint32_t CACHE_VERSION = 1;
+
+        // Offset and count of every CacheField group in TimeStepData's double array view,
+        // the same order EphemerisStore indexes fields in
+        struct FieldGroup
+        {
+            unsigned bit;
+            size_t offset;
+            int count;
+        };
+
+        const FieldGroup FIELD_GROUPS[] =
+        {
+            {CACHE_POS_VEL, offsetof(TimeStepData, pos), 6},
+            {CACHE_LLH, offsetof(TimeStepData, llh), 3},
+            {CACHE_MEAN_KEP, offsetof(TimeStepData, meanKep), 6},
+            {CACHE_OSC_KEP, offsetof(TimeStepData, oscKep), 6},
+            {CACHE_NODAL_AP_PER, offsetof(TimeStepData, nodalApPer), 3},
+            {CACHE_MEAN_MOTION, offsetof(TimeStepData, meanMotion), 1},
+        };
+
+        // pos and vel are adjacent, one group of six
+        static_assert(offsetof(TimeStepData, vel) == offsetof(TimeStepData, pos) + 3 * sizeof(double));
+
+        int FieldCount(unsigned fields)
+        {
+            int count = 2;      // mse, ds50UTC
+            for (const FieldGroup& group : FIELD_GROUPS)
+                if (fields & group.bit)
+                    count += group.count;
+            return count;
+        }
+
+        uint64_t Fnv1a(uint64_t hash, const void* data, size_t size)
+        {
+            const uint8_t* bytes = (const uint8_t*)data;
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= bytes[i];
+                hash *= 0x100000001B3ull;
+            }
+            return hash;
+        }
+
+        void PutKey(ByteWriter& out, const ResultCacheKey& key)
+        {
+            out.PutString(key.line1);
+            out.PutString(key.line2);
+            out.Put(key.startTime);
+            out.Put(key.stopTime);
+            out.Put(key.stepSize);
+            out.Put((uint32_t)key.fields);
+        }
+
+        bool GetKey(ByteReader& in, ResultCacheKey& key)
+        {
+            uint32_t fields;
+            if (!in.GetString(key.line1) || !in.GetString(key.line2) || !in.Get(key.startTime) ||
+                !in.Get(key.stopTime) || !in.Get(key.stepSize) || !in.Get(fields))
+                return false;
+            key.fields = fields;
+            return true;
+        }
+
+        // header, key, success, then per step its error code and the kept fields, then the
+        // error records with their texts
+        std::vector<uint8_t> Encode(const ResultCacheKey& key, const SatelliteData& satellite,
+                                    const std::vector<std::string>& errorTexts)
+        {
+            ByteWriter out;
+            out.data.reserve(ResultCache::EncodedBytes(satellite, key.fields) + 256);
+            out.Put(CACHE_MAGIC);
+            out.Put(CACHE_VERSION);
+            PutKey(out, key);
+            out.Put((uint8_t)(satellite.propagationSuccess ? 1 : 0));
+
+            out.Put((uint32_t)satellite.timeSteps.size());
+            for (const TimeStepData& step : satellite.timeSteps)
+            {
+                out.Put((uint8_t)step.error);
+                out.Put(step.mse);
+                out.Put(step.ds50UTC);
+                for (const FieldGroup& group : FIELD_GROUPS)
+                {
+                    if (!(key.fields & group.bit))
+                        continue;
+                    const uint8_t* values = (const uint8_t*)&step + group.offset;
+                    out.data.insert(out.data.end(), values, values + group.count * sizeof(double));
+                }
+            }
+
+            out.Put((uint32_t)satellite.errors.size());
+            for (size_t e = 0; e < satellite.errors.size(); e++)
+            {
+                const StepErrorRecord& record = satellite.errors[e];
+                out.Put((int32_t)record.step);
+                out.Put((uint8_t)record.code);
+                out.Put(record.value);
+                out.PutString(e < errorTexts.size() ? errorTexts[e] : std::string());
+            }
+            return std::move(out.data);
+        }
+
+        bool Decode(const std::vector<uint8_t>& blob, const ResultCacheKey& key, SatelliteData& satellite,
+                    std::vector<std::string>& errorTexts)
+        {
+            ByteReader in(blob.data(), blob.size());
+            uint32_t magic, version, steps, errors;
+            uint8_t success;
+            ResultCacheKey stored;
+            if (!in.Get(magic) || magic != CACHE_MAGIC || !in.Get(version) || version != CACHE_VERSION ||
+                !GetKey(in, stored) || !(stored == key) || !in.Get(success) || !in.Get(steps))
+                return false;
+
+            size_t rowBytes = 1 + FieldCount(key.fields) * sizeof(double);
+            if ((size_t)steps > in.Remaining() / rowBytes)
+                return false;
+
+            satellite.timeSteps.resize(steps);
+            for (TimeStepData& step : satellite.timeSteps)
+            {
+                step = {};
+                uint8_t error;
+                in.Get(error);
+                step.error = (StepError)error;
+                in.Get(step.mse);
+                in.Get(step.ds50UTC);
+                for (const FieldGroup& group : FIELD_GROUPS)
+                    if (key.fields & group.bit)
+                        in.GetBytes((uint8_t*)&step + group.offset, group.count * sizeof(double));
+            }
+
+            if (!in.Get(errors))
+                return false;
+            satellite.errors.clear();
+            errorTexts.clear();
+            for (uint32_t e = 0; e < errors; e++)
+            {
+                StepErrorRecord record = {};
+                int32_t step;
+                uint8_t code;
+                std::string text;
+                if (!in.Get(step) || !in.Get(code) || !in.Get(record.value) || !in.GetString(text))
+                    return false;
+                record.step = step;
+                record.code = (StepError)code;
+                satellite.errors.push_back(record);
+                errorTexts.push_back(std::move(text));
+            }
+            satellite.propagationSuccess = success != 0;
+            return true;
+        }
+
+        bool ReadFile(const std::string& path, std::vector<uint8_t>& data)
+        {
+            FILE* fp = fopen(path.c_str(), "rb");
+            if (!fp)
+                return false;
+            fseek(fp, 0, SEEK_END);
+            long size = ftell(fp);
+            fseek(fp, 0, SEEK_SET);
+            bool ok = size >= 0;
+            if (ok)
+            {
+                data.resize((size_t)size);
+                ok = fread(data.data(), 1, data.size(), fp) == data.size();
+            }
+            fclose(fp);
+            return ok;
+        }
+
+        bool WriteFile(const std::string& path, const std::vector<uint8_t>& data)
+        {
+            FILE* fp = fopen(path.c_str(), "wb");
+            if (!fp)
+                return false;
+            bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+            ok = fclose(fp) == 0 && ok;
+            if (!ok)
+                remove(path.c_str());
+            return ok;
+        }
+
+    }
+
+    ResultCacheKey ResultCacheKey::Make(const std::string& line1, const std::string& line2, double startTime,
+                                        double stopTime, double stepSize, unsigned fields)
+    {
+        ResultCacheKey key;
+        key.line1 = line1;
+        key.line2 = line2;
+        key.startTime = startTime;
+        key.stopTime = stopTime;
+        key.stepSize = stepSize;
+        key.fields = fields & CACHE_ALL_FIELDS;
+
+        uint64_t hash = 0xCBF29CE484222325ull;
+        hash = Fnv1a(hash, line1.data(), line1.size());
+        hash = Fnv1a(hash, "\n", 1);
+        hash = Fnv1a(hash, line2.data(), line2.size());
+        hash = Fnv1a(hash, &key.startTime, sizeof(double));
+        hash = Fnv1a(hash, &key.stopTime, sizeof(double));
+        hash = Fnv1a(hash, &key.stepSize, sizeof(double));
+        hash = Fnv1a(hash, &key.fields, sizeof(unsigned));
+        key.hash = hash;
+        return key;
+    }
+
+    bool ResultCacheKey::operator==(const ResultCacheKey& other) const
+    {
+        return startTime == other.startTime && stopTime == other.stopTime && stepSize == other.stepSize &&
+               fields == other.fields && line1 == other.line1 && line2 == other.line2;
+    }
+
+    ResultCache::ResultCache(const ResultCacheOptions& options) : m_options(options)
+    {
+        m_options.fields &= CACHE_ALL_FIELDS;
+        if (!m_options.spillDirectory.empty())
+        {
+            // other caches and processes may share the parent, each keeps to its own directory
+            std::filesystem::path parent(m_options.spillDirectory);
+            RemoveStaleSpills(parent);
+            std::filesystem::path own = parent / (PROCESS_PREFIX + std::to_string(CurrentProcessId()) + "_" +
+                                                  std::to_string(s_cacheCount++));
+            std::error_code error;
+            std::filesystem::create_directories(own, error);
+            m_options.spillDirectory = error ? std::string() : own.string();
+        }
+    }
+
+    ResultCache::~ResultCache()
+    {
+        Clear();
+        if (!m_options.spillDirectory.empty())
+        {
+            std::error_code error;
+            std::filesystem::remove_all(m_options.spillDirectory, error);
+        }
+    }
+
+    bool ResultCache::Lookup(const ResultCacheKey& key, SatelliteData& satellite, std::vector<std::string>& errorTexts)
+    {
+        Blob blob;
+        std::string path;
+        FileWork work;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto found = m_index.find(key.hash);
+            if (found == m_index.end() || !(found->second.entry->key == key))
+            {
+                m_stats.misses++;
+                return false;
+            }
+
+            Location& location = found->second;
+            blob = location.entry->blob;
+            if (!location.onDisk)
+            {
+                m_memory.splice(m_memory.begin(), m_memory, location.entry);
+                m_stats.hits++;
+            }
+            else if (blob)
+            {
+                // spilled but not written yet, the pending write finds it gone and drops the file
+                m_memory.splice(m_memory.begin(), m_disk, location.entry);
+                location.onDisk = false;
+                m_stats.diskBytes -= blob->size();
+                m_stats.diskEntries--;
+                m_stats.memoryBytes += blob->size();
+                m_stats.memoryEntries++;
+                m_stats.hits++;
+                m_stats.diskHits++;
+                Trim(work);
+            }
+            else
+            {
+                // out of the index while the file is read, back into memory after
+                path = SpillPath(key.hash, location.entry->spill);
+                m_stats.diskBytes -= location.entry->bytes;
+                m_stats.diskEntries--;
+                m_disk.erase(location.entry);
+                m_index.erase(found);
+            }
+        }
+
+        if (!path.empty())
+        {
+            auto data = std::make_shared<std::vector<uint8_t>>();
+            bool read = ReadFile(path, *data);
+            remove(path.c_str());
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!read)
+            {
+                m_stats.spillErrors++;
+                m_stats.misses++;
+                return false;
+            }
+            blob = data;
+            m_stats.hits++;
+            m_stats.diskHits++;
+            // an Insert of the same key meanwhile is at least as new
+            if (m_index.find(key.hash) == m_index.end())
+            {
+                m_memory.push_front({key, blob, blob->size()});
+                m_index[key.hash] = {false, m_memory.begin()};
+                m_stats.memoryBytes += blob->size();
+                m_stats.memoryEntries++;
+                Trim(work);
+            }
+        }
+        Finish(work);
+
+        // the blob stays alive through its shared pointer even if it's evicted meanwhile
+        if (Decode(*blob, key, satellite, errorTexts))
+            return true;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.hits--;
+            m_stats.misses++;
+            m_stats.spillErrors++;
+            Remove(key.hash, work);
+        }
+        Finish(work);
+        return false;
+    }
+
+    void ResultCache::Insert(const ResultCacheKey& key, const SatelliteData& satellite,
+                             const std::vector<std::string>& errorTexts)
+    {
+        auto blob = std::make_shared<const std::vector<uint8_t>>(Encode(key, satellite, errorTexts));
+        if (blob->size() > m_options.memoryBytes)
+            return;
+
+        FileWork work;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Remove(key.hash, work);
+
+            m_memory.push_front({key, blob, blob->size()});
+            m_index[key.hash] = {false, m_memory.begin()};
+            m_stats.memoryBytes += blob->size();
+            m_stats.memoryEntries++;
+            m_stats.inserts++;
+            Trim(work);
+        }
+        Finish(work);
+    }
+
+    void ResultCache::Clear()
+    {
+        FileWork work;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const Entry& entry : m_disk)
+                work.removals.push_back(SpillPath(entry.key.hash, entry.spill));
+            m_memory.clear();
+            m_disk.clear();
+            m_index.clear();
+            m_stats.memoryBytes = 0;
+            m_stats.memoryEntries = 0;
+            m_stats.diskBytes = 0;
+            m_stats.diskEntries = 0;
+        }
+        Finish(work);
+    }
+
+    ResultCacheStats ResultCache::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    size_t ResultCache::EncodedBytes(const SatelliteData& satellite, unsigned fields)
+    {
+        size_t bytes = satellite.timeSteps.size() * (1 + FieldCount(fields) * sizeof(double));
+        return bytes + satellite.errors.size() * 64 + satellite.line1.size() + satellite.line2.size() + 64;
+    }
+
+    std::string ResultCache::SpillPath(uint64_t hash, uint64_t spill) const
+    {
+        char name[48];
+        snprintf(name, sizeof(name), "%016llx_%llu.sprc", (unsigned long long)hash, (unsigned long long)spill);
+        return (std::filesystem::path(m_options.spillDirectory) / name).string();
+    }
+
+    // Drops the entry wherever it is, under the lock
+    void ResultCache::Remove(uint64_t hash, FileWork& work)
+    {
+        auto found = m_index.find(hash);
+        if (found == m_index.end())
+            return;
+
+        Location& location = found->second;
+        if (location.onDisk)
+        {
+            work.removals.push_back(SpillPath(hash, location.entry->spill));
+            m_stats.diskBytes -= location.entry->bytes;
+            m_stats.diskEntries--;
+            m_disk.erase(location.entry);
+        }
+        else
+        {
+            m_stats.memoryBytes -= location.entry->bytes;
+            m_stats.memoryEntries--;
+            m_memory.erase(location.entry);
+        }
+        m_index.erase(found);
+    }
+
+    // Least recently used memory entries out to disk, least recently spilled disk entries out
+    // for good, under the lock. Spilled entries keep their blob until Finish has written it.
+    void ResultCache::Trim(FileWork& work)
+    {
+        while (m_stats.memoryBytes > m_options.memoryBytes && !m_memory.empty())
+        {
+            auto entry = std::prev(m_memory.end());
+            uint64_t hash = entry->key.hash;
+            m_stats.memoryBytes -= entry->bytes;
+            m_stats.memoryEntries--;
+
+            if (m_options.spillDirectory.empty() || entry->bytes > m_options.diskBytes)
+            {
+                m_memory.erase(entry);
+                m_index.erase(hash);
+                m_stats.evictions++;
+                continue;
+            }
+
+            entry->spill = ++m_spillCount;
+            work.writes.push_back({hash, entry->spill, entry->blob});
+            m_disk.splice(m_disk.begin(), m_memory, entry);
+            m_index[hash].onDisk = true;
+            m_stats.diskBytes += entry->bytes;
+            m_stats.diskEntries++;
+            m_stats.spills++;
+        }
+
+        while (m_stats.diskBytes > m_options.diskBytes && !m_disk.empty())
+        {
+            auto entry = std::prev(m_disk.end());
+            work.removals.push_back(SpillPath(entry->key.hash, entry->spill));
+            m_stats.diskBytes -= entry->bytes;
+            m_stats.diskEntries--;
+            m_stats.evictions++;
+            m_index.erase(entry->key.hash);
+            m_disk.erase(entry);
+        }
+    }
+
+    // Does the file work without the lock, taking it only to settle each write. A write whose
+    // entry was looked up, replaced or evicted meanwhile leaves no file behind.
+    void ResultCache::Finish(FileWork& work)
+    {
+        for (const std::string& path : work.removals)
+            remove(path.c_str());
+        work.removals.clear();
+
+        for (const FileWork::Write& write : work.writes)
+        {
+            std::string path = SpillPath(write.hash, write.spill);
+            bool written = WriteFile(path, *write.blob);
+            bool keep = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto found = m_index.find(write.hash);
+                if (found != m_index.end() && found->second.onDisk && found->second.entry->spill == write.spill)
+                {
+                    keep = written;
+                    if (written)
+                    {
+                        found->second.entry->blob.reset();
+                    }
+                    else
+                    {
+                        m_stats.diskBytes -= found->second.entry->bytes;
+                        m_stats.diskEntries--;
+                        m_stats.spillErrors++;
+                        m_stats.evictions++;
+                        m_disk.erase(found->second.entry);
+                        m_index.erase(found);
+                    }
+                }
+            }
+            if (written && !keep)
+                remove(path.c_str());
+        }
+        work.writes.clear();
+    }
+
+} // SGP_IMPL
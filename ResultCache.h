@@ -0,0 +1,167 @@
+//
+// ResultCache.h
+// Propagated satellites kept across jobs, keyed by TLE and time grid, spilling to disk
+//
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "PropResults.h"
+
+namespace SGP_IMPL {
+
+    // Groups of TimeStepData fields an entry keeps. Times, step errors and error records
+    // always come along; fields left out read back as zero.
+    enum CacheField
+    {
+        CACHE_POS_VEL = 1 << 0,
+        CACHE_LLH = 1 << 1,
+        CACHE_MEAN_KEP = 1 << 2,
+        CACHE_OSC_KEP = 1 << 3,
+        CACHE_NODAL_AP_PER = 1 << 4,
+        CACHE_MEAN_MOTION = 1 << 5,
+        CACHE_ALL_FIELDS = (1 << 6) - 1,
+    };
+
+    // One satellite of one job: its lines, the job's time arguments and the fields wanted.
+    // Entries match only on all of them, the hash just finds them.
+    struct ResultCacheKey
+    {
+        std::string line1;
+        std::string line2;
+        double startTime = 0.0;
+        double stopTime = 0.0;
+        double stepSize = 0.0;
+        unsigned fields = CACHE_ALL_FIELDS;
+        uint64_t hash = 0;
+
+        static ResultCacheKey Make(const std::string& line1, const std::string& line2, double startTime,
+                                   double stopTime, double stepSize, unsigned fields);
+
+        bool operator==(const ResultCacheKey& other) const;
+    };
+
+    struct ResultCacheOptions
+    {
+        size_t memoryBytes = (size_t)512 << 20;
+        std::string spillDirectory;         // parent of this process's spill directory, empty to
+                                            // drop what memory can't hold
+        size_t diskBytes = (size_t)4 << 30;
+        unsigned fields = CACHE_ALL_FIELDS; // what the jobs using the cache ask for
+    };
+
+    struct ResultCacheStats
+    {
+        uint64_t hits = 0;                  // memory and disk
+        uint64_t diskHits = 0;
+        uint64_t misses = 0;
+        uint64_t inserts = 0;
+        uint64_t spills = 0;                // entries moved from memory to disk
+        uint64_t evictions = 0;             // entries dropped for good
+        uint64_t spillErrors = 0;           // spill files that couldn't be written or read back
+        size_t memoryEntries = 0;
+        size_t memoryBytes = 0;
+        size_t diskEntries = 0;
+        size_t diskBytes = 0;
+
+        double HitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0.0; }
+    };
+
+    // Most catalog refreshes change a few percent of the TLEs, so most satellites of a job
+    // were propagated before over the same times. Jobs look every satellite up before
+    // initializing it and insert what they propagate; a hit costs a decode instead of a
+    // propagation.
+    //
+    // Entries are encoded blobs, least recently used first out: past memoryBytes they move
+    // to one file each in the spill directory, past diskBytes they are deleted. A disk hit
+    // reads the file back into memory. Spill files belong to the cache and go with it: they
+    // live in a subdirectory named after the process and the cache, removed with the cache,
+    // so caches sharing spillDirectory never touch each other's files. Subdirectories of
+    // processes no longer running, left by a crash, are removed when a cache is created.
+    // Files are written, read and deleted outside the lock: the index changes first and the
+    // I/O follows, so one slow disk doesn't stall every lookup.
+    //
+    // Safe to use from any thread. Error texts travel as strings next to the records,
+    // message ids only mean something inside their own job's table.
+    class ResultCache
+    {
+    public:
+        explicit ResultCache(const ResultCacheOptions& options = ResultCacheOptions());
+        ~ResultCache();
+
+        ResultCache(const ResultCache&) = delete;
+        ResultCache& operator=(const ResultCache&) = delete;
+
+        unsigned Fields() const { return m_options.fields; }
+
+        // Fills the satellite's steps, errors and success flag; errorTexts[i] is the text of
+        // satellite.errors[i], whose message ids are left 0. Lines and satKey are the caller's.
+        bool Lookup(const ResultCacheKey& key, SatelliteData& satellite, std::vector<std::string>& errorTexts);
+
+        // errorTexts as Lookup returns them. Replaces an entry with the same key.
+        void Insert(const ResultCacheKey& key, const SatelliteData& satellite,
+                    const std::vector<std::string>& errorTexts);
+
+        void Clear();
+
+        ResultCacheStats GetStats() const;
+
+        // Entry size for a satellite, without encoding it
+        static size_t EncodedBytes(const SatelliteData& satellite, unsigned fields);
+
+    private:
+        typedef std::shared_ptr<const std::vector<uint8_t>> Blob;
+
+        struct Entry
+        {
+            ResultCacheKey key;
+            Blob blob;                      // on disk, kept until its file is written
+            size_t bytes = 0;
+            uint64_t spill = 0;             // names the file, new on every spill
+        };
+        typedef std::list<Entry> EntryList;
+
+        struct Location
+        {
+            bool onDisk = false;
+            EntryList::iterator entry;
+        };
+
+        // Spill file I/O picked under the lock, done by Finish after releasing it
+        struct FileWork
+        {
+            struct Write
+            {
+                uint64_t hash;
+                uint64_t spill;
+                Blob blob;
+            };
+            std::vector<Write> writes;
+            std::vector<std::string> removals;
+        };
+
+        std::string SpillPath(uint64_t hash, uint64_t spill) const;
+        void Remove(uint64_t hash, FileWork& work);
+        void Trim(FileWork& work);
+        void Finish(FileWork& work);
+
+        ResultCacheOptions m_options;
+        mutable std::mutex m_mutex;
+        EntryList m_memory;                 // most recently used first
+        EntryList m_disk;
+        std::unordered_map<uint64_t, Location> m_index;
+        ResultCacheStats m_stats;
+        uint64_t m_spillCount = 0;
+    };
+
+} // SGP_IMPL
+
+#endif //RESULTCACHE_H
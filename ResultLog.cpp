@@ -0,0 +1,333 @@
+//
+// ResultLog.cpp
+// Aggregate, rate limited logging of propagation results on a background thread
+//
+
+#include "ResultLog.h"
+#include "io/AsyncFileWriter.h"
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <spdlog/spdlog.h>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        typedef std::chrono::steady_clock Clock;
+
+        // JSON string body, the quotes are the caller's
+        void PutEscaped(AsyncFileWriter& out, const std::string& text)
+        {
+            for (char c : text)
+            {
+                switch (c)
+                {
+                    case '"': out.Write("\\\"", 2); break;
+                    case '\\': out.Write("\\\\", 2); break;
+                    case '\n': out.Write("\\n", 2); break;
+                    case '\r': out.Write("\\r", 2); break;
+                    case '\t': out.Write("\\t", 2); break;
+                    default:
+                        if ((unsigned char)c < 0x20)
+                            out.Printf("\\u%04x", (unsigned char)c);
+                        else
+                            out.Write(&c, 1);
+                }
+            }
+        }
+
+        // AstroStd texts come padded or with a line break
+        std::string Trimmed(std::string text)
+        {
+            while (!text.empty() && (unsigned char)text.back() <= ' ')
+                text.pop_back();
+            return text;
+        }
+
+        std::string ExampleText(const PropagationResults& results, const SatelliteData& sat, const StepErrorRecord& record)
+        {
+            double mse = record.step >= 0 && record.step < (int)sat.timeSteps.size() ? sat.timeSteps[record.step].mse : 0.0;
+            return fmt::format("sat {} step {} ({:.1f} min): {}", (long long)sat.satKey, record.step, mse,
+                               Trimmed(results.ErrorText(record)));
+        }
+
+    }
+
+    TokenBucket::TokenBucket(double perSecond, int burst)
+        : m_perSecond(std::max(0.0, perSecond)), m_burst(std::max(1, burst)), m_tokens(m_burst), m_last(Clock::now())
+    {
+    }
+
+    bool TokenBucket::Take()
+    {
+        auto now = Clock::now();
+        m_tokens = std::min(m_burst, m_tokens + m_perSecond * std::chrono::duration<double>(now - m_last).count());
+        m_last = now;
+        if (m_tokens < 1.0)
+            return false;
+        m_tokens -= 1.0;
+        return true;
+    }
+
+    ResultLog::ResultLog(std::shared_ptr<spdlog::logger> logger, std::shared_ptr<spdlog::logger> errorLogger,
+                         const ResultLogOptions& options)
+        : m_logger(std::move(logger)), m_errorLogger(std::move(errorLogger)), m_options(options),
+          m_bucket(options.eventsPerSecond, options.eventBurst)
+    {
+        m_thread = std::thread(&ResultLog::Run, this);
+    }
+
+    ResultLog::~ResultLog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+    void ResultLog::Submit(std::shared_ptr<const PropagationResults> results, const std::string& jobName,
+                           const std::string& detailFile)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back({std::move(results), jobName, detailFile});
+        }
+        m_changed.notify_all();
+    }
+
+    void ResultLog::Flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&]() { return m_jobs.empty() && !m_busy; });
+    }
+
+    uint64_t ResultLog::SuppressedLines() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_suppressedTotal;
+    }
+
+    void ResultLog::Run()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [&]() { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty())
+                    return;
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+                m_busy = true;
+            }
+
+            LogJob(job);
+            // the results can be the last reference, release them off the caller's thread too
+            job.results.reset();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_busy = false;
+            }
+            m_changed.notify_all();
+        }
+    }
+
+    void ResultLog::LogJob(const Job& job)
+    {
+        const PropagationResults& results = *job.results;
+        ResultLogSummary summary = Summarize(results, m_options);
+
+        uint64_t failedSteps = 0;
+        for (const ErrorTypeSummary& type : summary.errors)
+            failedSteps += type.steps;
+
+        Line(false, fmt::format("{}: {} satellites, {} steps, {} failed satellites, {} failed steps", job.name,
+                                summary.satellites, summary.steps, summary.failedSatellites, failedSteps));
+        if (!results.overallSuccess)
+            Line(true, fmt::format("{}: {}", job.name, results.generalError));
+
+        for (int code = STEP_OK + 1; code < NUM_STEP_ERRORS; code++)
+        {
+            const ErrorTypeSummary& type = summary.errors[code];
+            if (type.steps == 0)
+                continue;
+            Line(true, fmt::format("  {}: {} steps on {} satellites", ErrorName((StepError)code), type.steps,
+                                   type.satellites));
+            for (const auto& message : type.messages)
+                Line(true, fmt::format("    {} x {}", message.second, Trimmed(results.messages.Get(message.first))));
+            for (const std::string& example : type.examples)
+                Line(true, "    e.g. " + example);
+        }
+
+        if (m_suppressed > 0)
+        {
+            m_logger->warn("{}: {} log lines suppressed by the rate limit", job.name, m_suppressed);
+            m_suppressed = 0;
+        }
+
+        if (!job.detailFile.empty())
+        {
+            std::string error;
+            if (WriteDetails(job.detailFile, results, summary, &error))
+                m_logger->info("{}: details written to {}", job.name, job.detailFile);
+            else
+                m_errorLogger->error("{}: {}", job.name, error);
+        }
+    }
+
+    void ResultLog::Line(bool error, const std::string& text)
+    {
+        if (!m_bucket.Take())
+        {
+            m_suppressed++;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_suppressedTotal++;
+            return;
+        }
+        if (error)
+            m_errorLogger->error("{}", text);
+        else
+            m_logger->info("{}", text);
+    }
+
+    ResultLogSummary ResultLog::Summarize(const PropagationResults& results, const ResultLogOptions& options)
+    {
+        ResultLogSummary summary;
+        summary.satellites = (int)results.satellites.size();
+
+        std::unordered_map<uint32_t, uint64_t> messages[NUM_STEP_ERRORS];
+        // reservoir per type: (satellite, record) pairs, seen counts the candidates so far
+        std::vector<std::pair<size_t, size_t>> samples[NUM_STEP_ERRORS];
+        uint64_t seen[NUM_STEP_ERRORS] = {};
+        std::mt19937_64 random(1);
+        size_t keep = (size_t)std::max(0, options.examplesPerType);
+
+        for (size_t s = 0; s < results.satellites.size(); s++)
+        {
+            const SatelliteData& sat = results.satellites[s];
+            summary.steps += sat.timeSteps.size();
+            if (!sat.propagationSuccess)
+                summary.failedSatellites++;
+
+            bool hit[NUM_STEP_ERRORS] = {};
+            for (size_t r = 0; r < sat.errors.size(); r++)
+            {
+                const StepErrorRecord& record = sat.errors[r];
+                int code = record.code < NUM_STEP_ERRORS ? record.code : STEP_OK;
+                if (code == STEP_OK)
+                    continue;
+
+                ErrorTypeSummary& type = summary.errors[code];
+                type.steps++;
+                if (!hit[code])
+                {
+                    hit[code] = true;
+                    type.satellites++;
+                }
+                if (record.message)
+                    messages[code][record.message]++;
+
+                uint64_t candidate = seen[code]++;
+                if (samples[code].size() < keep)
+                    samples[code].push_back({s, r});
+                else if (keep > 0)
+                {
+                    uint64_t slot = random() % (candidate + 1);
+                    if (slot < keep)
+                        samples[code][slot] = {s, r};
+                }
+            }
+        }
+
+        for (int code = 0; code < NUM_STEP_ERRORS; code++)
+        {
+            ErrorTypeSummary& type = summary.errors[code];
+            type.messages.assign(messages[code].begin(), messages[code].end());
+            std::sort(type.messages.begin(), type.messages.end(), [](const auto& a, const auto& b)
+            {
+                return a.second != b.second ? a.second > b.second : a.first < b.first;
+            });
+            if (type.messages.size() > (size_t)std::max(0, options.messagesPerType))
+                type.messages.resize((size_t)std::max(0, options.messagesPerType));
+
+            // catalog order reads better than reservoir order
+            std::sort(samples[code].begin(), samples[code].end());
+            for (const auto& sample : samples[code])
+            {
+                const SatelliteData& sat = results.satellites[sample.first];
+                type.examples.push_back(ExampleText(results, sat, sat.errors[sample.second]));
+            }
+        }
+        return summary;
+    }
+
+    bool ResultLog::WriteDetails(const std::string& filePath, const PropagationResults& results,
+                                 const ResultLogSummary& summary, std::string* error)
+    {
+        AsyncFileWriter out;
+        if (!out.Open(filePath))
+        {
+            if (error)
+                *error = out.GetError();
+            return false;
+        }
+
+        for (size_t s = 0; s < results.satellites.size(); s++)
+        {
+            const SatelliteData& sat = results.satellites[s];
+            out.Printf("{\"event\":\"satellite\",\"index\":%zu,\"satKey\":%lld,\"success\":%s,\"steps\":%zu,\"errors\":%zu,\"line1\":\"",
+                       s, (long long)sat.satKey, sat.propagationSuccess ? "true" : "false", sat.timeSteps.size(),
+                       sat.errors.size());
+            PutEscaped(out, sat.line1);
+            out.Write("\",\"line2\":\"", 11);
+            PutEscaped(out, sat.line2);
+            out.Write("\"}\n", 3);
+
+            for (const StepErrorRecord& record : sat.errors)
+            {
+                double mse = record.step >= 0 && record.step < (int)sat.timeSteps.size() ? sat.timeSteps[record.step].mse : 0.0;
+                out.Printf("{\"event\":\"step_error\",\"index\":%zu,\"satKey\":%lld,\"step\":%d,\"mse\":%.6f,\"code\":\"%s\",\"value\":%.9g,\"message\":\"",
+                           s, (long long)sat.satKey, record.step, mse, ErrorName(record.code), record.value);
+                PutEscaped(out, results.ErrorText(record));
+                out.Write("\"}\n", 3);
+            }
+        }
+
+        out.Printf("{\"event\":\"summary\",\"satellites\":%d,\"failedSatellites\":%d,\"steps\":%llu,\"errors\":{",
+                   summary.satellites, summary.failedSatellites, (unsigned long long)summary.steps);
+        bool first = true;
+        for (int code = STEP_OK + 1; code < NUM_STEP_ERRORS; code++)
+        {
+            const ErrorTypeSummary& type = summary.errors[code];
+            out.Printf("%s\"%s\":{\"steps\":%llu,\"satellites\":%llu}", first ? "" : ",", ErrorName((StepError)code),
+                       (unsigned long long)type.steps, (unsigned long long)type.satellites);
+            first = false;
+        }
+        out.Write("}}\n", 3);
+
+        bool ok = out.Close();
+        if (!ok && error)
+            *error = out.GetError();
+        return ok;
+    }
+
+    const char* ResultLog::ErrorName(StepError code)
+    {
+        switch (code)
+        {
+            case STEP_OK: return "ok";
+            case STEP_INIT_FAILED: return "init_failed";
+            case STEP_PROPAGATION_ERROR: return "propagation_error";
+            case STEP_DECAY: return "decay";
+            case STEP_LOW_ALTITUDE: return "low_altitude";
+            default: return "unknown";
+        }
+    }
+
+} // SGP_IMPL
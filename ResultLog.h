@@ -0,0 +1,129 @@
+//
+// ResultLog.h
+// Aggregate, rate limited logging of propagation results on a background thread
+//
+
+#ifndef RESULTLOG_H
+#define RESULTLOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PropResults.h"
+
+namespace spdlog { class logger; }
+
+namespace SGP_IMPL {
+
+    struct ResultLogOptions
+    {
+        int examplesPerType = 3;            // failed steps quoted per error type, sampled over the catalog
+        int messagesPerType = 3;            // most frequent AstroStd texts per error type
+        double eventsPerSecond = 20.0;      // console lines, refilled continuously
+        int eventBurst = 40;
+    };
+
+    struct ErrorTypeSummary
+    {
+        uint64_t steps = 0;
+        uint64_t satellites = 0;            // with at least one step of this type
+        std::vector<std::pair<uint32_t, uint64_t>> messages;   // message id, steps, most frequent first
+        std::vector<std::string> examples;
+    };
+
+    struct ResultLogSummary
+    {
+        int satellites = 0;
+        int failedSatellites = 0;           // propagationSuccess false
+        uint64_t steps = 0;
+        ErrorTypeSummary errors[NUM_STEP_ERRORS];
+    };
+
+    // Console rate limit, one token per line
+    class TokenBucket
+    {
+    public:
+        TokenBucket(double perSecond, int burst);
+
+        bool Take();
+
+    private:
+        double m_perSecond;
+        double m_burst;
+        double m_tokens;
+        std::chrono::steady_clock::time_point m_last;
+    };
+
+    // Logging every satellite and failed step on the UI thread costs more than many jobs do.
+    // Submit() only queues the results; the log thread reduces them to a few aggregate
+    // events (counts per error type, the common AstroStd messages and a sample of failed
+    // steps), writes those to the console through the rate limiter and, when asked, every
+    // satellite and failed step to a JSON lines file.
+    //
+    // Lines the limiter holds back are counted and reported once at the end of their job;
+    // nothing is ever dropped from the detail file.
+    class ResultLog
+    {
+    public:
+        ResultLog(std::shared_ptr<spdlog::logger> logger, std::shared_ptr<spdlog::logger> errorLogger,
+                  const ResultLogOptions& options = ResultLogOptions());
+        ~ResultLog();   // logs whatever is still queued
+
+        ResultLog(const ResultLog&) = delete;
+        ResultLog& operator=(const ResultLog&) = delete;
+
+        // detailFile empty for console events only
+        void Submit(std::shared_ptr<const PropagationResults> results, const std::string& jobName,
+                    const std::string& detailFile = std::string());
+
+        // Blocks until everything submitted so far is logged and written
+        void Flush();
+
+        uint64_t SuppressedLines() const;
+
+        // Examples are a uniform sample, the same for the same results
+        static ResultLogSummary Summarize(const PropagationResults& results, const ResultLogOptions& options);
+
+        // One JSON object per line: a "satellite" record per satellite, a "step_error" record
+        // per failed step and a closing "summary". False when the file can't be written.
+        static bool WriteDetails(const std::string& filePath, const PropagationResults& results,
+                                 const ResultLogSummary& summary, std::string* error = nullptr);
+
+        static const char* ErrorName(StepError code);
+
+    private:
+        struct Job
+        {
+            std::shared_ptr<const PropagationResults> results;
+            std::string name;
+            std::string detailFile;
+        };
+
+        void Run();
+        void LogJob(const Job& job);
+        void Line(bool error, const std::string& text);
+
+        std::shared_ptr<spdlog::logger> m_logger;
+        std::shared_ptr<spdlog::logger> m_errorLogger;
+        ResultLogOptions m_options;
+        TokenBucket m_bucket;
+        uint64_t m_suppressed = 0;          // in the current job
+        uint64_t m_suppressedTotal = 0;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::deque<Job> m_jobs;
+        bool m_busy = false;
+        bool m_stopping = false;
+        std::thread m_thread;
+    };
+
+} // SGP_IMPL
+
+#endif //RESULTLOG_H
@@ -0,0 +1,175 @@
+//
+// RootFinder.h
+// Brent's root finder and minimizer over points of a scalar function of time
+//
+
+#ifndef ROOTFINDER_H
+#define ROOTFINDER_H
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+namespace SGP_IMPL {
+
+    // Both take the function as eval(t) returning a point with members t and f, so callers
+    // can carry what else they learn about each time along with it.
+    const int BRENT_MAX_ITERATIONS = 100;
+
+    // Narrows a bracket whose ends have f of opposite sign (f >= 0 counts as positive) to
+    // tol, by inverse quadratic interpolation with bisection as the fallback. Each end keeps
+    // its sign and they stay on either side of the root.
+    template <typename Point, typename Eval>
+    void BrentBracket(Eval&& eval, Point& first, Point& second, double tol)
+    {
+        bool firstPositive = first.f >= 0.0;
+        Point a = first, b = second, c = first;
+        double d = b.t - a.t, e = d;
+        for (int iter = 0; iter < BRENT_MAX_ITERATIONS; iter++)
+        {
+            if ((b.f >= 0.0) == (c.f >= 0.0))
+            {
+                c = a;
+                d = e = b.t - a.t;
+            }
+            if (fabs(c.f) < fabs(b.f))
+            {
+                a = b;
+                b = c;
+                c = a;
+            }
+            double tol1 = 2.0 * DBL_EPSILON * fabs(b.t) + 0.5 * tol;
+            double m = 0.5 * (c.t - b.t);
+            if (fabs(m) <= tol1 || b.f == 0.0)
+                break;
+
+            if (fabs(e) >= tol1 && fabs(a.f) > fabs(b.f))
+            {
+                // inverse quadratic interpolation, secant when two points coincide
+                double s = b.f / a.f, p, q;
+                if (a.t == c.t)
+                {
+                    p = 2.0 * m * s;
+                    q = 1.0 - s;
+                }
+                else
+                {
+                    double qa = a.f / c.f, r = b.f / c.f;
+                    p = s * (2.0 * m * qa * (qa - r) - (b.t - a.t) * (r - 1.0));
+                    q = (qa - 1.0) * (r - 1.0) * (s - 1.0);
+                }
+                if (p > 0.0)
+                    q = -q;
+                else
+                    p = -p;
+                if (2.0 * p < std::min(3.0 * m * q - fabs(tol1 * q), fabs(e * q)))
+                {
+                    e = d;
+                    d = p / q;
+                }
+                else
+                {
+                    d = m;
+                    e = m;
+                }
+            }
+            else
+            {
+                d = m;
+                e = m;
+            }
+            a = b;
+            b = eval(b.t + (fabs(d) > tol1 ? d : (m > 0.0 ? tol1 : -tol1)));
+        }
+
+        if ((b.f >= 0.0) == firstPositive)
+        {
+            first = b;
+            second = c;
+        }
+        else
+        {
+            first = c;
+            second = b;
+        }
+    }
+
+    // Brent's minimization over [lo, hi] to tol, golden section with parabolic steps.
+    // Stops early at the first point below stopBelow.
+    template <typename Point, typename Eval>
+    Point BrentMinimum(Eval&& eval, double lo, double hi, double tol, double stopBelow = -DBL_MAX)
+    {
+        const double GOLDEN = 0.381966011250105;    // (3 - sqrt 5) / 2
+        Point x = eval(lo + GOLDEN * (hi - lo));
+        Point w = x, v = x;
+        double d = 0.0, e = 0.0;
+        for (int iter = 0; iter < BRENT_MAX_ITERATIONS && x.f >= stopBelow; iter++)
+        {
+            double m = 0.5 * (lo + hi);
+            double tol2 = 2.0 * tol;
+            if (fabs(x.t - m) <= tol2 - 0.5 * (hi - lo))
+                break;
+
+            bool golden = true;
+            if (fabs(e) > tol)
+            {
+                // parabola through x, w and v
+                double r = (x.t - w.t) * (x.f - v.f);
+                double q = (x.t - v.t) * (x.f - w.f);
+                double p = (x.t - v.t) * q - (x.t - w.t) * r;
+                q = 2.0 * (q - r);
+                if (q > 0.0)
+                    p = -p;
+                else
+                    q = -q;
+                double last = e;
+                e = d;
+                if (fabs(p) < fabs(0.5 * q * last) && p > q * (lo - x.t) && p < q * (hi - x.t))
+                {
+                    d = p / q;
+                    double u = x.t + d;
+                    if (u - lo < tol2 || hi - u < tol2)
+                        d = x.t < m ? tol : -tol;
+                    golden = false;
+                }
+            }
+            if (golden)
+            {
+                e = (x.t < m ? hi : lo) - x.t;
+                d = GOLDEN * e;
+            }
+
+            Point u = eval(x.t + (fabs(d) >= tol ? d : (d > 0.0 ? tol : -tol)));
+            if (u.f <= x.f)
+            {
+                if (u.t < x.t)
+                    hi = x.t;
+                else
+                    lo = x.t;
+                v = w;
+                w = x;
+                x = u;
+            }
+            else
+            {
+                if (u.t < x.t)
+                    lo = u.t;
+                else
+                    hi = u.t;
+                if (u.f <= w.f || w.t == x.t)
+                {
+                    v = w;
+                    w = u;
+                }
+                else if (u.f <= v.f || v.t == x.t || v.t == w.t)
+                {
+                    v = u;
+                }
+            }
+        }
+        return x;
+    }
+
+} // SGP_IMPL
+
+#endif //ROOTFINDER_H
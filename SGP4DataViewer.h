@@ -9,6 +9,7 @@
 #include <sstream>
 
 #include "PropResults.h"
+#include "EphemerisQuery.h"
 
 class SGP4DataViewer
 {
@@ -18,6 +19,11 @@ private:
     int m_selectedTimeStep = 0;
     bool m_showOnlyErrors = false;
     bool m_autoScroll = true;
+    bool m_scrollToSelection = false;
+
+    // time lookup and interpolation over m_results, rebuilt with it
+    SGP_IMPL::EphemerisQuery m_query;
+    double m_scrubTime = 0.0;   // MSE of the scrubber
 
     // Helper function to format double values
     std::string FormatDouble(double value, int precision = 6)
@@ -46,8 +52,26 @@ public:
     void SetData(const PropagationResults& results)
     {
         m_results = results;
+        m_query.Build(m_results, SGP_IMPL::AXIS_MSE);
         m_selectedSatellite = 0;
         m_selectedTimeStep = 0;
+        m_scrubTime = 0.0;
+    }
+
+    int GetSelectedSatellite() const
+    {
+        return m_selectedSatellite;
+    }
+
+    // Selection coming from outside the viewer (e.g. a click on the map)
+    void SetSelectedSatellite(int index)
+    {
+        if (index < 0 || index >= (int)m_results.satellites.size() || index == m_selectedSatellite)
+            return;
+
+        m_selectedSatellite = index;
+        m_selectedTimeStep = 0;
+        m_scrollToSelection = m_autoScroll;
     }
 
     void Render()
@@ -171,6 +195,12 @@ private:
             ImGui::SameLine();
             ImGui::TextColored(ImVec4(0.7, 0.7, 0.7, 1), "(%d steps)", (int)sat.timeSteps.size());
 
+            if (isSelected && m_scrollToSelection)
+            {
+                ImGui::SetScrollHereY();
+                m_scrollToSelection = false;
+            }
+
             ImGui::PopID();
         }
     }
@@ -216,9 +246,53 @@ private:
         {
             if (ImGui::CollapsingHeader("Selected Step Details", ImGuiTreeNodeFlags_DefaultOpen))
             {
-                RenderTimeStepDetails(sat.timeSteps[m_selectedTimeStep]);
+                RenderTimeStepDetails(sat, m_selectedTimeStep);
             }
         }
+
+        // Any time between the stored steps
+        if (ImGui::CollapsingHeader("Scrub Time"))
+        {
+            RenderScrubber(m_selectedSatellite);
+        }
+    }
+
+    void RenderScrubber(int satellite)
+    {
+        double first, last;
+        if (!m_query.Span(satellite, &first, &last))
+        {
+            ImGui::Text("No usable steps to interpolate");
+            return;
+        }
+
+        m_scrubTime = std::clamp(m_scrubTime, first, last);
+        ImGui::PushItemWidth(300);
+        ImGui::SliderScalar("Time (MSE)##Scrub", ImGuiDataType_Double, &m_scrubTime, &first, &last, "%.4f");
+        ImGui::PopItemWidth();
+
+        SGP_IMPL::EphemerisState state;
+        if (!m_query.StateAt(satellite, m_scrubTime, state))
+            return;
+
+        ImGui::SameLine();
+        if (ImGui::Button("Go to Step"))
+        {
+            m_selectedTimeStep = state.step;
+        }
+
+        ImGui::Text("Position (km): %s  %s  %s", FormatDouble(state.pos[0], 3).c_str(),
+                    FormatDouble(state.pos[1], 3).c_str(), FormatDouble(state.pos[2], 3).c_str());
+        ImGui::Text("Velocity (km/s): %s  %s  %s", FormatDouble(state.vel[0], 6).c_str(),
+                    FormatDouble(state.vel[1], 6).c_str(), FormatDouble(state.vel[2], 6).c_str());
+        ImGui::Text("Estimated error: %s m, %s mm/s", FormatDouble(state.positionError * 1000.0, 3).c_str(),
+                    FormatDouble(state.velocityError * 1e6, 3).c_str());
+
+        // an hourly LEO grid is already tens of km off between steps
+        if (state.positionError > 1.0)
+        {
+            ImGui::TextColored(ImVec4(1, 0.5, 0, 1), "Steps are too coarse to interpolate, use a smaller step size");
+        }
     }
 
     void RenderTimeStepsNavigation(const SatelliteData& sat)
@@ -240,7 +314,7 @@ private:
         int firstErrorIndex = -1;
         for (int i = 0; i < totalSteps; i++)
         {
-            if (sat.timeSteps[i].hasError)
+            if (sat.timeSteps[i].hasError())
             {
                 errorCount++;
                 if (firstErrorIndex == -1) firstErrorIndex = i;
@@ -324,7 +398,7 @@ private:
                 // Find next error after current step
                 for (int i = m_selectedTimeStep + 1; i < totalSteps; i++)
                 {
-                    if (sat.timeSteps[i].hasError)
+                    if (sat.timeSteps[i].hasError())
                     {
                         m_selectedTimeStep = i;
                         break;
@@ -338,7 +412,7 @@ private:
                 // Find previous error before current step
                 for (int i = m_selectedTimeStep - 1; i >= 0; i--)
                 {
-                    if (sat.timeSteps[i].hasError)
+                    if (sat.timeSteps[i].hasError())
                     {
                         m_selectedTimeStep = i;
                         break;
@@ -376,10 +450,10 @@ private:
             ImGui::Separator();
             ImGui::Text("Current Step Info:");
 
-            if (currentStep.hasError)
+            if (currentStep.hasError())
             {
                 ImGui::TextColored(ImVec4(1, 0, 0, 1), "Status: ERROR");
-                ImGui::Text("Message: %s", currentStep.errorMsg.c_str());
+                ImGui::Text("Message: %s", m_results.ErrorText(sat, m_selectedTimeStep).c_str());
             }
             else
             {
@@ -396,11 +470,12 @@ private:
         }
     }
 
-    void RenderTimeStepDetails(const TimeStepData& step)
+    void RenderTimeStepDetails(const SatelliteData& sat, int stepIndex)
     {
-        if (step.hasError)
+        const TimeStepData& step = sat.timeSteps[stepIndex];
+        if (step.hasError())
         {
-            ImGui::TextColored(ImVec4(1, 0, 0, 1), "Error: %s", step.errorMsg.c_str());
+            ImGui::TextColored(ImVec4(1, 0, 0, 1), "Error: %s", m_results.ErrorText(sat, stepIndex).c_str());
             return;
         }
 
@@ -0,0 +1,82 @@
+//
+// ScratchTable.cpp
+// Element sets held in AstroStd's tables for one batch of propagations
+//
+
+#include "ScratchTable.h"
+#include <stdio.h>
+#include <algorithm>
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/TleDll.h"
+#include "wrappers/Sgp4PropDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace SGP_IMPL {
+
+    ScratchTable::~ScratchTable()
+    {
+        Clear();
+    }
+
+    int ScratchTable::Fill(const std::vector<const TleElements*>& sets)
+    {
+        Clear();
+        size_t count = std::min<size_t>(sets.size(), MAX_SETS);
+        m_keys.assign(count, 0);
+        m_errors.assign(count, std::string());
+
+        char line1[INPUTCARDLEN], line2[INPUTCARDLEN];
+        char errMsg[LOGMSGLEN];
+        std::string text1, text2;
+        int initialized = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!sets[i])
+                continue;
+            TleElements scratch = *sets[i];
+            scratch.satNum = (int)i + 1;
+            FormatTle(scratch, text1, text2);
+            snprintf(line1, sizeof(line1), "%s", text1.c_str());
+            snprintf(line2, sizeof(line2), "%s", text2.c_str());
+
+            __int64 satKey = TleAddSatFrLines(line1, line2);
+            if (satKey <= 0 || Sgp4InitSat(satKey) != 0)
+            {
+                GetLastErrMsg(errMsg);
+                errMsg[LOGMSGLEN - 1] = 0;
+                m_errors[i] = errMsg;
+                if (satKey > 0)
+                    TleRemoveSat(satKey);
+                continue;
+            }
+            m_keys[i] = satKey;
+            initialized++;
+        }
+        return initialized;
+    }
+
+    void ScratchTable::Clear()
+    {
+        for (__int64 satKey : m_keys)
+        {
+            if (satKey <= 0)
+                continue;
+            Sgp4RemoveSat(satKey);
+            TleRemoveSat(satKey);
+        }
+        m_keys.clear();
+        m_errors.clear();
+    }
+
+} // SGP_IMPL
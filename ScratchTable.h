@@ -0,0 +1,52 @@
+//
+// ScratchTable.h
+// Element sets held in AstroStd's tables for one batch of propagations
+//
+
+#ifndef SCRATCHTABLE_H
+#define SCRATCHTABLE_H
+
+#include <string>
+#include <vector>
+#include "TleUtil.h"
+
+namespace SGP_IMPL {
+
+    // Sets that only exist as elements, fit candidates or ensemble samples, go in under
+    // scratch satellite numbers 1 up, so sets of one satellite at one epoch don't collide.
+    // Filling and clearing change AstroStd's shared tables and stay on one thread;
+    // Sgp4PropDs50UTC on the keys is safe on any number of threads in between. Other
+    // satellites may stay loaded, but a job clears the tables and mustn't run meanwhile.
+    class ScratchTable
+    {
+    public:
+        static const int MAX_SETS = 99999;      // five digit satellite numbers
+
+        ScratchTable() = default;
+        ~ScratchTable();
+
+        ScratchTable(const ScratchTable&) = delete;
+        ScratchTable& operator=(const ScratchTable&) = delete;
+
+        // Clears the table, then adds and initializes up to MAX_SETS sets; null entries are
+        // skipped. Returns how many initialized.
+        int Fill(const std::vector<const TleElements*>& sets);
+
+        void Clear();
+
+        size_t Size() const { return m_keys.size(); }
+
+        // 0 for sets that were skipped or failed
+        __int64 Key(size_t index) const { return m_keys[index]; }
+
+        // AstroStd's message for sets that failed to add or initialize
+        const std::string& Error(size_t index) const { return m_errors[index]; }
+
+    private:
+        std::vector<__int64> m_keys;
+        std::vector<std::string> m_errors;
+    };
+
+} // SGP_IMPL
+
+#endif //SCRATCHTABLE_H
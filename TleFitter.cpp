@@ -0,0 +1,794 @@
+//
+// TleFitter.cpp
+// Element sets fitted to ephemerides by batch least squares through SGP4
+//
+
+#include "TleFitter.h"
+#include "CatalogDiff.h"
+#include "OrbitMath.h"
+#include "ScratchTable.h"
+#include "WorkScheduler.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/Sgp4PropDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const int MAX_PARAMS = 7;
+        const int BSTAR = 6;
+        const int BLOCK_OBSERVATIONS = 64;      // observation times per propagation task
+        const double MIN_LAMBDA = 1e-9;
+        const double MAX_LAMBDA = 1e8;
+
+        struct Candidate
+        {
+            int fit = 0;
+            TleElements elements;
+            bool valid = true;                  // false when the parameters left what a TLE can state
+            __int64 satKey = 0;
+            bool initialized = false;
+            std::string error;
+            size_t offset = 0;                  // first observation in the round's buffers
+        };
+
+        struct FitState
+        {
+            TleFitResult* result = nullptr;
+            std::vector<FitObservation> observations;
+            TleElements base;                   // identity, epoch, derivatives, and bstar when not fitted
+            int numParams = MAX_PARAMS;
+            double x[MAX_PARAMS] = {};
+            double trial[MAX_PARAMS] = {};
+            double alternative[MAX_PARAMS] = {}; // observation guess, against initial elements
+            bool hasAlternative = false;
+            double steps[MAX_PARAMS] = {};
+            double normal[MAX_PARAMS * MAX_PARAMS] = {};
+            double gradient[MAX_PARAMS] = {};
+            double cost = 0.0;                  // weighted sum of squares at x
+            double lambda = 1e-3;
+            bool wantJacobian = true;           // otherwise the trial set is up next
+            bool done = false;
+            int firstCandidate = 0;
+        };
+
+        double Revolutions(double angle)
+        {
+            angle = fmod(angle, 360.0);
+            return angle < 0.0 ? angle + 360.0 : angle;
+        }
+
+        // Angle as the TLE field writes it, 360.0000 comes back as 0
+        double AngleField(double deg)
+        {
+            double rounded = round(Revolutions(deg) * 1e4) / 1e4;
+            return rounded >= 360.0 ? 0.0 : rounded;
+        }
+
+        // n (rev/day), e cos(w + O), e sin(w + O), tan(i/2) sin O, tan(i/2) cos O, M + w + O (rad), bstar
+        void ToParams(const TleElements& elements, double x[MAX_PARAMS])
+        {
+            double raan = elements.raan * DEG2RAD;
+            double longPerigee = raan + elements.argPerigee * DEG2RAD;
+            double t = tan(0.5 * elements.inclination * DEG2RAD);
+            x[0] = elements.meanMotion;
+            x[1] = elements.eccentricity * cos(longPerigee);
+            x[2] = elements.eccentricity * sin(longPerigee);
+            x[3] = t * sin(raan);
+            x[4] = t * cos(raan);
+            x[5] = longPerigee + elements.meanAnomaly * DEG2RAD;
+            x[BSTAR] = elements.bstar;
+        }
+
+        // Rounded to the TLE fields, so the set is exactly what its lines state. False when
+        // the parameters leave what a TLE can state.
+        bool FromParams(const double x[MAX_PARAMS], TleElements& elements)
+        {
+            double e = hypot(x[1], x[2]);
+            if (!(x[0] > 0.05 && x[0] < 20.0 && e < 0.99 && fabs(x[BSTAR]) < 0.9))
+                return false;
+
+            double raan = atan2(x[3], x[4]);
+            double longPerigee = atan2(x[2], x[1]);
+            elements.meanMotion = round(x[0] * 1e8) / 1e8;
+            elements.eccentricity = round(e * 1e7) / 1e7;
+            elements.inclination = round(2.0 * atan(hypot(x[3], x[4])) * RAD2DEG * 1e4) / 1e4;
+            elements.raan = AngleField(raan * RAD2DEG);
+            elements.argPerigee = AngleField((longPerigee - raan) * RAD2DEG);
+            elements.meanAnomaly = AngleField((x[5] - longPerigee) * RAD2DEG);
+            elements.bstar = x[BSTAR];
+            return true;
+        }
+
+        // Forward difference steps, wide against the rounding of the fields they end up in
+        double ParamStep(int param, const double x[MAX_PARAMS])
+        {
+            if (param == 0)
+                return std::max(1e-6, 1e-6 * x[0]);
+            if (param == BSTAR)
+                return std::max(1e-5, 0.05 * fabs(x[BSTAR]));
+            return 1e-4;
+        }
+
+        // Osculating two-body elements of a TEME state, and its argument of latitude (rad)
+        bool StateToElements(const double pos[3], const double vel[3], TleElements& elements, double* argLatitude)
+        {
+            double h[3] = {pos[1] * vel[2] - pos[2] * vel[1], pos[2] * vel[0] - pos[0] * vel[2],
+                           pos[0] * vel[1] - pos[1] * vel[0]};
+            double hMag = sqrt(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+            double r = sqrt(pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2]);
+            double v2 = vel[0] * vel[0] + vel[1] * vel[1] + vel[2] * vel[2];
+            double a = 1.0 / (2.0 / r - v2 / MU_EARTH);
+            if (hMag <= 0.0 || r <= 0.0 || a <= 0.0)
+                return false;
+
+            double e[3];
+            for (int k = 0; k < 3; k++)
+            {
+                double vxh = vel[(k + 1) % 3] * h[(k + 2) % 3] - vel[(k + 2) % 3] * h[(k + 1) % 3];
+                e[k] = vxh / MU_EARTH - pos[k] / r;
+            }
+
+            // in plane basis from the ascending node, which is x for equatorial orbits
+            double node[3] = {-h[1], h[0], 0.0};
+            double nodeMag = hypot(node[0], node[1]);
+            if (nodeMag < 1e-12 * hMag)
+            {
+                node[0] = 1.0;
+                node[1] = 0.0;
+                nodeMag = 1.0;
+            }
+            double p[3] = {node[0] / nodeMag, node[1] / nodeMag, 0.0};
+            double q[3] = {(h[1] * p[2] - h[2] * p[1]) / hMag, (h[2] * p[0] - h[0] * p[2]) / hMag,
+                           (h[0] * p[1] - h[1] * p[0]) / hMag};
+
+            double ex = e[0] * p[0] + e[1] * p[1] + e[2] * p[2];
+            double ey = e[0] * q[0] + e[1] * q[1] + e[2] * q[2];
+            double ecc = hypot(ex, ey);
+            double argPerigee = atan2(ey, ex);
+            double u = atan2(pos[0] * q[0] + pos[1] * q[1] + pos[2] * q[2], pos[0] * p[0] + pos[1] * p[1]);
+            if (ecc >= 0.99)
+                return false;
+
+            double nu = u - argPerigee;
+            double E = 2.0 * atan(sqrt((1.0 - ecc) / (1.0 + ecc)) * tan(0.5 * nu));
+            elements.meanMotion = sqrt(MU_EARTH / (a * a * a)) * 86400.0 / TWO_PI;
+            elements.eccentricity = ecc;
+            elements.inclination = acos(std::clamp(h[2] / hMag, -1.0, 1.0)) * RAD2DEG;
+            elements.raan = Revolutions(atan2(p[1], p[0]) * RAD2DEG);
+            elements.argPerigee = Revolutions(argPerigee * RAD2DEG);
+            elements.meanAnomaly = Revolutions((E - ecc * sin(E)) * RAD2DEG);
+            *argLatitude = u;
+            return true;
+        }
+
+        // Starting mean elements at the epoch from the observations: the osculating orbit of
+        // the one nearest the epoch, carried to it with SGP4's secular rates, its mean motion
+        // matched to the along track rate when the observations span an orbit
+        bool GuessElements(const std::vector<FitObservation>& observations, double epoch, TleElements& elements)
+        {
+            int nearest = -1;
+            for (int o = 0; o < (int)observations.size(); o++)
+            {
+                if (observations[o].hasVelocity &&
+                    (nearest < 0 || fabs(observations[o].ds50UTC - epoch) < fabs(observations[nearest].ds50UTC - epoch)))
+                    nearest = o;
+            }
+            double u;
+            if (nearest < 0 || !StateToElements(observations[nearest].pos, observations[nearest].vel, elements, &u))
+                return false;
+
+            // argument of latitude unwrapped along the osculating rate, then a straight line
+            double n = elements.meanMotion * TWO_PI / 1440.0;
+            double first = 0.0, last = 0.0, previousTime = 0.0, previousAngle = 0.0;
+            double st = 0.0, su = 0.0, stt = 0.0, stu = 0.0;
+            int count = 0;
+            TleElements state;
+            for (const FitObservation& observation : observations)
+            {
+                double angle;
+                if (!observation.hasVelocity || !StateToElements(observation.pos, observation.vel, state, &angle))
+                    continue;
+                double t = (observation.ds50UTC - epoch) * 1440.0;
+                if (count > 0)
+                {
+                    double predicted = previousAngle + n * (t - previousTime);
+                    angle = predicted + remainder(angle - predicted, TWO_PI);
+                }
+                else
+                    first = t;
+                last = t;
+                previousTime = t;
+                previousAngle = angle;
+                st += t;
+                su += angle;
+                stt += t * t;
+                stu += t * angle;
+                count++;
+            }
+            double span = last - first;
+            if (count > 2 && span >= TlePeriodMinutes(elements))
+            {
+                double rate = (count * stu - st * su) / (count * stt - st * st);
+                for (int i = 0; i < 5 && rate > 0.0; i++)
+                {
+                    TleSecularRates rates = Sgp4SecularRates(elements);
+                    elements.meanMotion *= rate / (rates.meanAnomaly + rates.argPerigee);
+                }
+            }
+
+            TleSecularRates rates = Sgp4SecularRates(elements);
+            double minutes = (epoch - observations[nearest].ds50UTC) * 1440.0;
+            elements.meanAnomaly = Revolutions(elements.meanAnomaly + rates.meanAnomaly * minutes * RAD2DEG);
+            elements.argPerigee = Revolutions(elements.argPerigee + rates.argPerigee * minutes * RAD2DEG);
+            elements.raan = Revolutions(elements.raan + rates.raan * minutes * RAD2DEG);
+            return true;
+        }
+
+        void Finish(FitState& fit, FitStatus status, const std::string& error = std::string())
+        {
+            TleFitResult& result = *fit.result;
+            result.status = status;
+            result.error = error;
+            fit.done = true;
+            if (status == FIT_FAILED)
+                return;
+
+            result.elements = fit.base;
+            FromParams(fit.x, result.elements);
+            FormatTle(result.elements, result.line1, result.line2);
+        }
+
+        // Sorted, thinned observations and the starting parameters; false fails the fit
+        bool Start(const FitRequest& request, const TleFitOptions& options, FitState& fit)
+        {
+            TleFitResult& result = *fit.result;
+            result.elements = request.initial;
+            fit.observations = request.observations;
+            std::sort(fit.observations.begin(), fit.observations.end(),
+                      [](const FitObservation& a, const FitObservation& b) { return a.ds50UTC < b.ds50UTC; });
+            size_t count = fit.observations.size();
+            if (options.maxObservations > 1 && count > (size_t)options.maxObservations)
+            {
+                std::vector<FitObservation> thinned(options.maxObservations);
+                for (int i = 0; i < options.maxObservations; i++)
+                    thinned[i] = fit.observations[(size_t)llround((double)i * (count - 1) / (options.maxObservations - 1))];
+                fit.observations = std::move(thinned);
+            }
+            result.observations = (int)fit.observations.size();
+            fit.numParams = options.fitBstar ? MAX_PARAMS : MAX_PARAMS - 1;
+            if (result.observations * 3 < fit.numParams)
+            {
+                Finish(fit, FIT_FAILED, "Too few observations");
+                return false;
+            }
+
+            double epoch = request.epoch > 0.0 ? request.epoch : fit.observations.back().ds50UTC;
+            TleElements guess = request.initial;
+            bool guessed = GuessElements(fit.observations, epoch, guess);
+            fit.base = request.initial;
+            if (request.hasInitialElements)
+                fit.base = CatalogDiff::Predict(request.initial, epoch - TleEpochDs50UTC(request.initial));
+            else if (guessed)
+                fit.base = guess;
+            else
+            {
+                Finish(fit, FIT_FAILED, "No initial elements and no usable state with velocity");
+                return false;
+            }
+            TleSetEpochDs50UTC(fit.base, epoch);
+
+            ToParams(fit.base, fit.x);
+            if (!FromParams(fit.x, fit.base))
+            {
+                Finish(fit, FIT_FAILED, "Initial elements out of range");
+                return false;
+            }
+
+            // stale or wrong initial elements lose to the observations' own orbit
+            if (request.hasInitialElements && guessed)
+            {
+                ToParams(guess, fit.alternative);
+                fit.alternative[BSTAR] = fit.x[BSTAR];
+                fit.hasAlternative = true;
+            }
+            return true;
+        }
+
+        // Every candidate set of the round into the tables on this thread, propagated over
+        // blocks of observations on numThreads, and out again; chunks of as many as the
+        // scratch table takes
+        void Evaluate(std::vector<Candidate>& candidates, const std::vector<FitState>& fits, std::vector<double>& states,
+                      std::vector<char>& failed, int numThreads)
+        {
+            size_t total = 0;
+            for (Candidate& candidate : candidates)
+            {
+                candidate.offset = total;
+                total += fits[candidate.fit].observations.size();
+            }
+            states.assign(total * 6, 0.0);
+            failed.assign(total, 0);
+
+            ScratchTable table;
+            std::vector<const TleElements*> sets;
+            std::vector<std::pair<int, int>> tasks;     // candidate, first observation
+            std::vector<int> order;
+            for (size_t chunk = 0; chunk < candidates.size(); chunk += ScratchTable::MAX_SETS)
+            {
+                size_t chunkEnd = std::min(candidates.size(), chunk + ScratchTable::MAX_SETS);
+                sets.clear();
+                for (size_t c = chunk; c < chunkEnd; c++)
+                    sets.push_back(candidates[c].valid ? &candidates[c].elements : nullptr);
+                table.Fill(sets);
+
+                tasks.clear();
+                for (size_t c = chunk; c < chunkEnd; c++)
+                {
+                    Candidate& candidate = candidates[c];
+                    candidate.satKey = table.Key(c - chunk);
+                    candidate.initialized = candidate.satKey > 0;
+                    candidate.error = table.Error(c - chunk);
+                    if (!candidate.initialized)
+                        continue;
+                    int observations = (int)fits[candidate.fit].observations.size();
+                    for (int first = 0; first < observations; first += BLOCK_OBSERVATIONS)
+                        tasks.emplace_back((int)c, first);
+                }
+
+                order.resize(tasks.size());
+                std::iota(order.begin(), order.end(), 0);
+                WorkScheduler::Run(order, numThreads, [&](int task)
+                {
+                    const Candidate& candidate = candidates[tasks[task].first];
+                    const std::vector<FitObservation>& observations = fits[candidate.fit].observations;
+                    int end = std::min((int)observations.size(), tasks[task].second + BLOCK_OBSERVATIONS);
+                    double mse, llh[3];
+                    for (int o = tasks[task].second; o < end; o++)
+                    {
+                        double* state = &states[(candidate.offset + o) * 6];
+                        if (Sgp4PropDs50UTC(candidate.satKey, observations[o].ds50UTC, &mse, state, state + 3, llh) != 0)
+                            failed[candidate.offset + o] = 1;
+                    }
+                });
+            }
+            table.Clear();
+        }
+
+        // Observation minus model over sigma, six rows per observation with the velocity
+        // rows 0 where there's no velocity. False when the candidate didn't propagate to
+        // every observation.
+        bool Residuals(const FitState& fit, const Candidate& candidate, const std::vector<double>& states,
+                       const std::vector<char>& failed, const TleFitOptions& options, std::vector<double>& residuals)
+        {
+            if (!candidate.initialized)
+                return false;
+            size_t count = fit.observations.size();
+            residuals.assign(count * 6, 0.0);
+            for (size_t o = 0; o < count; o++)
+            {
+                if (failed[candidate.offset + o])
+                    return false;
+                const FitObservation& observation = fit.observations[o];
+                const double* state = &states[(candidate.offset + o) * 6];
+                for (int k = 0; k < 3; k++)
+                {
+                    residuals[o * 6 + k] = (observation.pos[k] - state[k]) / options.positionSigma;
+                    if (observation.hasVelocity)
+                        residuals[o * 6 + 3 + k] = (observation.vel[k] - state[3 + k]) / options.velocitySigma;
+                }
+            }
+            return true;
+        }
+
+        double SumOfSquares(const std::vector<double>& values)
+        {
+            double sum = 0.0;
+            for (double value : values)
+                sum += value * value;
+            return sum;
+        }
+
+        // Residual statistics of the fit's current set, from its weighted residuals
+        void Summarize(FitState& fit, const std::vector<double>& residuals, const TleFitOptions& options)
+        {
+            TleFitResult& result = *fit.result;
+            double position = 0.0, velocity = 0.0, largest = 0.0;
+            int withVelocity = 0;
+            for (size_t o = 0; o < fit.observations.size(); o++)
+            {
+                const double* r = &residuals[o * 6];
+                double squared = (r[0] * r[0] + r[1] * r[1] + r[2] * r[2]) * options.positionSigma * options.positionSigma;
+                position += squared;
+                largest = std::max(largest, squared);
+                if (fit.observations[o].hasVelocity)
+                {
+                    velocity += (r[3] * r[3] + r[4] * r[4] + r[5] * r[5]) * options.velocitySigma * options.velocitySigma;
+                    withVelocity++;
+                }
+            }
+            result.rmsKm = sqrt(position / fit.observations.size());
+            result.maxKm = sqrt(largest);
+            result.rmsVelocity = withVelocity > 0 ? sqrt(velocity / withVelocity) : 0.0;
+        }
+
+        // (N + lambda diag(N)) dx = g by Cholesky, false when that isn't positive definite
+        bool SolveDamped(const double* normal, const double* gradient, int n, double lambda, double* dx)
+        {
+            double largest = 0.0;
+            for (int i = 0; i < n; i++)
+                largest = std::max(largest, normal[i * n + i]);
+            if (largest <= 0.0)
+                return false;
+
+            double l[MAX_PARAMS * MAX_PARAMS];
+            for (int j = 0; j < n; j++)
+            {
+                double sum = normal[j * n + j] + lambda * std::max(normal[j * n + j], 1e-12 * largest);
+                for (int k = 0; k < j; k++)
+                    sum -= l[j * n + k] * l[j * n + k];
+                if (sum <= 0.0)
+                    return false;
+                l[j * n + j] = sqrt(sum);
+                for (int i = j + 1; i < n; i++)
+                {
+                    double value = normal[i * n + j];
+                    for (int k = 0; k < j; k++)
+                        value -= l[i * n + k] * l[j * n + k];
+                    l[i * n + j] = value / l[j * n + j];
+                }
+            }
+
+            double y[MAX_PARAMS];
+            for (int i = 0; i < n; i++)
+            {
+                double value = gradient[i];
+                for (int k = 0; k < i; k++)
+                    value -= l[i * n + k] * y[k];
+                y[i] = value / l[i * n + i];
+            }
+            for (int i = n - 1; i >= 0; i--)
+            {
+                double value = y[i];
+                for (int k = i + 1; k < n; k++)
+                    value -= l[k * n + i] * dx[k];
+                dx[i] = value / l[i * n + i];
+            }
+            return true;
+        }
+
+        // Next trial set from the stored normal equations, raising lambda past steps that
+        // don't solve or leave the TLE's range. Stalls when lambda runs out.
+        void NextTrial(FitState& fit)
+        {
+            TleElements elements = fit.base;
+            double dx[MAX_PARAMS];
+            for (; fit.lambda <= MAX_LAMBDA; fit.lambda *= 10.0)
+            {
+                if (!SolveDamped(fit.normal, fit.gradient, fit.numParams, fit.lambda, dx))
+                    continue;
+                std::copy(fit.x, fit.x + MAX_PARAMS, fit.trial);
+                for (int p = 0; p < fit.numParams; p++)
+                    fit.trial[p] += dx[p];
+                if (FromParams(fit.trial, elements))
+                    return;
+            }
+            Finish(fit, FIT_STALLED);
+        }
+
+        // One round's outcome for a fit: normal equations from a Jacobian round, or the
+        // trial set accepted or turned down
+        void Advance(FitState& fit, const std::vector<Candidate>& candidates, const std::vector<double>& states,
+                     const std::vector<char>& failed, const TleFitOptions& options)
+        {
+            TleFitResult& result = *fit.result;
+            const Candidate& first = candidates[fit.firstCandidate];
+            std::vector<double> residuals;
+            if (fit.hasAlternative)
+            {
+                fit.hasAlternative = false;
+                double initialCost = Residuals(fit, first, states, failed, options, residuals)
+                                         ? SumOfSquares(residuals) : std::numeric_limits<double>::infinity();
+                if (Residuals(fit, candidates[fit.firstCandidate + 1], states, failed, options, residuals) &&
+                    SumOfSquares(residuals) < initialCost)
+                    std::copy(fit.alternative, fit.alternative + MAX_PARAMS, fit.x);
+                return;
+            }
+            if (!fit.wantJacobian)
+            {
+                double trialCost = Residuals(fit, first, states, failed, options, residuals)
+                                       ? SumOfSquares(residuals) : std::numeric_limits<double>::infinity();
+                if (trialCost < fit.cost)
+                {
+                    double drop = (fit.cost - trialCost) / fit.cost;
+                    std::copy(fit.trial, fit.trial + MAX_PARAMS, fit.x);
+                    fit.cost = trialCost;
+                    fit.lambda = std::max(MIN_LAMBDA, fit.lambda * 0.1);
+                    Summarize(fit, residuals, options);
+                    if (drop < options.tolerance)
+                        Finish(fit, FIT_CONVERGED);
+                    else if (result.iterations >= options.maxIterations)
+                        Finish(fit, FIT_MAX_ITERATIONS);
+                    else
+                        fit.wantJacobian = true;
+                }
+                else if (trialCost - fit.cost <= options.tolerance * fit.cost)
+                    Finish(fit, FIT_CONVERGED);     // flat down to the rounding of the fields
+                else
+                {
+                    fit.lambda *= 10.0;
+                    NextTrial(fit);
+                }
+                return;
+            }
+
+            if (!Residuals(fit, first, states, failed, options, residuals))
+            {
+                Finish(fit, FIT_FAILED, first.error.empty() ? "Elements don't propagate over the observations"
+                                                            : first.error);
+                return;
+            }
+            fit.cost = SumOfSquares(residuals);
+            if (result.iterations == 0)
+            {
+                Summarize(fit, residuals, options);
+                result.initialRmsKm = result.rmsKm;
+            }
+            if (fit.cost <= 0.0)
+            {
+                Finish(fit, FIT_CONVERGED);
+                return;
+            }
+            result.iterations++;
+
+            // model over parameters, weighted as the residuals are
+            int n = fit.numParams;
+            size_t rows = residuals.size();
+            std::vector<double> jacobian(rows * n);
+            std::vector<double> perturbed;
+            for (int p = 0; p < n; p++)
+            {
+                if (!Residuals(fit, candidates[fit.firstCandidate + 1 + p], states, failed, options, perturbed))
+                {
+                    Finish(fit, FIT_FAILED, "Elements don't propagate next to the solution");
+                    return;
+                }
+                for (size_t row = 0; row < rows; row++)
+                    jacobian[row * n + p] = (residuals[row] - perturbed[row]) / fit.steps[p];
+            }
+
+            std::fill(fit.normal, fit.normal + MAX_PARAMS * MAX_PARAMS, 0.0);
+            std::fill(fit.gradient, fit.gradient + MAX_PARAMS, 0.0);
+            for (size_t row = 0; row < rows; row++)
+            {
+                const double* j = &jacobian[row * n];
+                for (int a = 0; a < n; a++)
+                {
+                    fit.gradient[a] += j[a] * residuals[row];
+                    for (int b = 0; b <= a; b++)
+                        fit.normal[a * n + b] += j[a] * j[b];
+                }
+            }
+            for (int a = 0; a < n; a++)
+            {
+                for (int b = 0; b < a; b++)
+                    fit.normal[b * n + a] = fit.normal[a * n + b];
+            }
+            fit.wantJacobian = false;
+            NextTrial(fit);
+        }
+
+        // The sets a fit needs propagated this round: both starting sets first, then its
+        // current set and one per parameter for a Jacobian, otherwise its trial set
+        void AddCandidates(FitState& fit, int index, std::vector<Candidate>& candidates)
+        {
+            fit.firstCandidate = (int)candidates.size();
+            Candidate candidate;
+            candidate.fit = index;
+            candidate.elements = fit.base;
+            if (fit.hasAlternative)
+            {
+                candidate.valid = FromParams(fit.x, candidate.elements);
+                candidates.push_back(candidate);
+                candidate.elements = fit.base;
+                candidate.valid = FromParams(fit.alternative, candidate.elements);
+                candidates.push_back(candidate);
+                return;
+            }
+            if (!fit.wantJacobian)
+            {
+                candidate.valid = FromParams(fit.trial, candidate.elements);
+                candidates.push_back(candidate);
+                return;
+            }
+
+            candidate.valid = FromParams(fit.x, candidate.elements);
+            candidates.push_back(candidate);
+            for (int p = 0; p < fit.numParams; p++)
+            {
+                double x[MAX_PARAMS];
+                std::copy(fit.x, fit.x + MAX_PARAMS, x);
+                fit.steps[p] = ParamStep(p, fit.x);
+                x[p] += fit.steps[p];
+                candidate.elements = fit.base;
+                if (!FromParams(x, candidate.elements))
+                {
+                    // against the edge of the range, step the other way
+                    fit.steps[p] = -fit.steps[p];
+                    x[p] = fit.x[p] + fit.steps[p];
+                    candidate.elements = fit.base;
+                    candidate.valid = FromParams(x, candidate.elements);
+                }
+                candidates.push_back(candidate);
+            }
+        }
+
+    } // namespace
+
+    TleFitBatch TleFitter::Fit(const std::vector<FitRequest>& requests, const TleFitOptions& options)
+    {
+        auto start = std::chrono::steady_clock::now();
+        TleFitBatch batch;
+        batch.results.resize(requests.size());
+
+        size_t batchSize = (size_t)std::max(1, options.batchSatellites);
+        std::vector<FitState> fits;
+        std::vector<Candidate> candidates;
+        std::vector<double> states;
+        std::vector<char> failed;
+        std::vector<int> order;
+        for (size_t first = 0; first < requests.size(); first += batchSize)
+        {
+            size_t count = std::min(batchSize, requests.size() - first);
+            fits.assign(count, FitState());
+            for (size_t i = 0; i < count; i++)
+            {
+                fits[i].result = &batch.results[first + i];
+                Start(requests[first + i], options, fits[i]);
+            }
+
+            while (true)
+            {
+                candidates.clear();
+                order.clear();
+                for (size_t i = 0; i < count; i++)
+                {
+                    if (fits[i].done)
+                        continue;
+                    size_t before = candidates.size();
+                    AddCandidates(fits[i], (int)i, candidates);
+                    fits[i].result->evaluations += (int)(candidates.size() - before);
+                    order.push_back((int)i);
+                }
+                if (candidates.empty())
+                    break;
+                batch.evaluations += (long long)candidates.size();
+
+                Evaluate(candidates, fits, states, failed, options.numThreads);
+                WorkScheduler::Run(order, options.numThreads, [&](int i)
+                {
+                    Advance(fits[i], candidates, states, failed, options);
+                });
+            }
+        }
+
+        for (const TleFitResult& result : batch.results)
+            batch.counts[result.status]++;
+        batch.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return batch;
+    }
+
+    bool TleFitter::RequestFromSatellite(const SatelliteData& satellite, FitRequest& request)
+    {
+        request = FitRequest();
+        request.hasInitialElements = ParseTle(satellite.line1, satellite.line2, request.initial);
+        for (const TimeStepData& step : satellite.timeSteps)
+        {
+            if (step.hasError())
+                continue;
+            FitObservation& observation = request.observations.emplace_back();
+            observation.ds50UTC = step.ds50UTC;
+            std::copy(step.pos, step.pos + 3, observation.pos);
+            std::copy(step.vel, step.vel + 3, observation.vel);
+            observation.hasVelocity = true;
+        }
+        return !request.observations.empty();
+    }
+
+    bool TleFitter::ReadEphemerisFile(const std::string& filePath, std::vector<FitRequest>& requests, std::string* error)
+    {
+        requests.clear();
+        FILE* fp = fopen(filePath.c_str(), "r");
+        if (!fp)
+        {
+            if (error)
+                *error = "Can't open " + filePath;
+            return false;
+        }
+
+        std::string previous;
+        double epoch = 0.0;
+        char line[512];
+        while (fgets(line, sizeof(line), fp))
+        {
+            std::string text(line);
+            while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+                text.pop_back();
+
+            if (text.size() > 1 && text[0] == '2' && text[1] == ' ' && previous.size() > 1 && previous[0] == '1' &&
+                previous[1] == ' ')
+            {
+                FitRequest& request = requests.emplace_back();
+                request.hasInitialElements = ParseTle(previous, text, request.initial);
+                epoch = request.hasInitialElements ? TleEpochDs50UTC(request.initial) : 0.0;
+                previous.clear();
+                continue;
+            }
+            previous = text;
+
+            double row[7];
+            if (requests.empty() || !requests.back().hasInitialElements ||
+                sscanf(text.c_str(), "%lf %lf %lf %lf %lf %lf %lf", &row[0], &row[1], &row[2], &row[3], &row[4],
+                       &row[5], &row[6]) != 7)
+                continue;
+            FitObservation& observation = requests.back().observations.emplace_back();
+            observation.ds50UTC = epoch + row[0] / 1440.0;
+            std::copy(row + 1, row + 4, observation.pos);
+            std::copy(row + 4, row + 7, observation.vel);
+            observation.hasVelocity = true;
+        }
+        fclose(fp);
+        return true;
+    }
+
+    bool TleFitter::WriteTleFile(const std::string& filePath, const TleFitBatch& batch, std::string* error)
+    {
+        FILE* fp = fopen(filePath.c_str(), "w");
+        if (!fp)
+        {
+            if (error)
+                *error = "Can't create " + filePath;
+            return false;
+        }
+        for (const TleFitResult& result : batch.results)
+        {
+            if (result.status != FIT_FAILED)
+                fprintf(fp, "%s\n%s\n", result.line1.c_str(), result.line2.c_str());
+        }
+        bool written = fclose(fp) == 0;
+        if (!written && error)
+            *error = "Can't write " + filePath;
+        return written;
+    }
+
+    const char* TleFitter::StatusName(FitStatus status)
+    {
+        switch (status)
+        {
+        case FIT_CONVERGED: return "converged";
+        case FIT_MAX_ITERATIONS: return "max_iterations";
+        case FIT_STALLED: return "stalled";
+        case FIT_FAILED: return "failed";
+        default: return "unknown";
+        }
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,118 @@
+//
+// TleFitter.h
+// Element sets fitted to ephemerides by batch least squares through SGP4
+//
+
+#ifndef TLEFITTER_H
+#define TLEFITTER_H
+
+#include <string>
+#include <vector>
+#include "PropResults.h"
+#include "TleUtil.h"
+
+namespace SGP_IMPL {
+
+    // One ephemeris point in TEME, the frame Sgp4PropDs50UTC gives
+    struct FitObservation
+    {
+        double ds50UTC = 0.0;
+        double pos[3] = {};             // km
+        double vel[3] = {};             // km/s
+        bool hasVelocity = false;
+    };
+
+    struct FitRequest
+    {
+        std::vector<FitObservation> observations;
+        TleElements initial;            // number, designator and bstar are always used
+        bool hasInitialElements = false; // otherwise the start comes from the observations
+        double epoch = 0.0;             // ds50UTC of the fitted set, 0 for the last observation
+    };
+
+    struct TleFitOptions
+    {
+        int maxIterations = 20;         // Jacobians per satellite
+        double tolerance = 1e-4;        // relative drop of the weighted residuals that ends a fit
+        double positionSigma = 1.0;     // km, weighs positions against velocities
+        double velocitySigma = 1e-3;    // km/s
+        bool fitBstar = true;
+        int maxObservations = 240;      // evenly thinned past this, 0 keeps all
+        int batchSatellites = 500;      // fitted side by side, bounds the state buffers
+        int numThreads = 1;
+    };
+
+    enum FitStatus
+    {
+        FIT_CONVERGED = 0,
+        FIT_MAX_ITERATIONS,
+        FIT_STALLED,                    // no step lowers the residuals, the best set is kept
+        FIT_FAILED,                     // no element set, see error
+        NUM_FIT_STATUSES
+    };
+
+    struct TleFitResult
+    {
+        FitStatus status = FIT_FAILED;
+        TleElements elements;
+        std::string line1;
+        std::string line2;
+        int iterations = 0;             // Jacobians
+        int evaluations = 0;            // element sets propagated
+        int observations = 0;           // after thinning
+        double initialRmsKm = 0.0;      // position residuals of the starting set
+        double rmsKm = 0.0;
+        double maxKm = 0.0;
+        double rmsVelocity = 0.0;       // km/s, over the observations with velocities
+        std::string error;
+
+        bool Converged() const { return status == FIT_CONVERGED; }
+    };
+
+    struct TleFitBatch
+    {
+        std::vector<TleFitResult> results;  // request order
+        int counts[NUM_FIT_STATUSES] = {};
+        long long evaluations = 0;
+        double seconds = 0.0;
+    };
+
+    // Differential correction of mean elements against ephemerides: SGP4 itself is the
+    // model, so the fitted set reproduces the ephemeris as well as SGP4 can. Parameters are
+    // the mean motion, equinoctial eccentricity and inclination vectors, mean longitude and
+    // optionally bstar, which stay well conditioned for circular and equatorial orbits.
+    // Steps are Levenberg-Marquardt on Jacobians by forward differences; each difference
+    // is wide enough that rounding the elements into the TLE fields doesn't show in it,
+    // and every set propagated is the exact set the lines state.
+    //
+    // Satellites are fitted side by side in batches. Each round puts every candidate set
+    // of the batch in a ScratchTable on one thread and propagates them over blocks of
+    // observation times on numThreads, so fits can't run alongside a job.
+    //
+    // The start is the initial elements carried to the epoch or, when it fits better or
+    // there are none, the osculating orbit of the observation nearest the epoch with the
+    // mean motion matched to the observed along track rate. The guess needs velocities;
+    // for near earth orbits over a day of ephemeris it converges on its own.
+    class TleFitter
+    {
+    public:
+        static TleFitBatch Fit(const std::vector<FitRequest>& requests, const TleFitOptions& options = TleFitOptions());
+
+        // The satellite's good steps with velocities, its lines as the initial elements
+        static bool RequestFromSatellite(const SatelliteData& satellite, FitRequest& request);
+
+        // Every satellite of an osculating state file as the pipeline writes it: the lines,
+        // then minutes since their epoch with positions and velocities. The lines are the
+        // initial elements, error and header lines are skipped.
+        static bool ReadEphemerisFile(const std::string& filePath, std::vector<FitRequest>& requests,
+                                      std::string* error = nullptr);
+
+        // Lines of every fit that has them, failed fits are left out
+        static bool WriteTleFile(const std::string& filePath, const TleFitBatch& batch, std::string* error = nullptr);
+
+        static const char* StatusName(FitStatus status);
+    };
+
+} // SGP_IMPL
+
+#endif //TLEFITTER_H
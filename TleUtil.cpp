@@ -0,0 +1,222 @@
+//
+// TleUtil.cpp
+// Two line element formatting, checksums and field parsing
+//
+
+#include "TleUtil.h"
+#include "OrbitMath.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        // WGS-72 as SGP4 uses it, in earth radii and minutes
+        const double XKE = 0.0743669161;        // sqrt(GM) (er^1.5/min)
+        const double CK2 = 5.413080e-4;         // J2 / 2
+        const double CK4 = 0.62098875e-6;       // -3 J4 / 8
+
+        // " 12345-3" style field: sign, five digit mantissa with implied leading decimal point,
+        // exponent sign and digit. 0.00012345 becomes " 12345-3"
+        std::string FormatImpliedExponent(double value)
+        {
+            char sign = value < 0 ? '-' : ' ';
+            double magnitude = fabs(value);
+            int mantissa = 0;
+            int exponent = 0;
+            if (magnitude > 0.0)
+            {
+                exponent = (int)floor(log10(magnitude)) + 1;
+                mantissa = (int)lround(magnitude / pow(10.0, exponent) * 1e5);
+                if (mantissa >= 100000)
+                {
+                    mantissa /= 10;
+                    exponent++;
+                }
+                // out of the field's range: the nearest value it holds rather than spilling into
+                // the next column, so tiny values shift down the mantissa to zero
+                if (exponent < -9)
+                {
+                    exponent = -9;
+                    mantissa = (int)lround(magnitude * 1e14);
+                }
+                else if (exponent > 9)
+                {
+                    exponent = 9;
+                    mantissa = 99999;
+                }
+            }
+            if (mantissa == 0)
+            {
+                sign = ' ';
+                exponent = 0;
+            }
+
+            // a zero exponent is written "-0" as in published element sets
+            char field[32];
+            snprintf(field, sizeof(field), "%c%05d%c%d", sign, mantissa, exponent > 0 ? '+' : '-', abs(exponent));
+            return field;
+        }
+
+        double ParseImpliedExponent(const std::string& field)
+        {
+            // "-11606-4" -> -0.11606e-4, blanks are allowed in place of the signs
+            if (field.size() < 8)
+                return 0.0;
+            double mantissa = atof(field.substr(1, 5).c_str()) / 1e5;
+            int exponent = atoi(field.substr(7, 1).c_str());
+            if (field[6] == '-')
+                exponent = -exponent;
+            double value = mantissa * pow(10.0, exponent);
+            return field[0] == '-' ? -value : value;
+        }
+
+        double Field(const std::string& line, size_t column, size_t width)
+        {
+            // columns are 1 based as in the TLE format description
+            return atof(line.substr(column - 1, width).c_str());
+        }
+
+        bool IsLeapYear(int year)
+        {
+            return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        }
+
+    } // namespace
+
+    int TleChecksum(const std::string& line)
+    {
+        int sum = 0;
+        size_t count = std::min<size_t>(line.size(), 68);
+        for (size_t i = 0; i < count; i++)
+        {
+            char c = line[i];
+            if (c >= '0' && c <= '9')
+                sum += c - '0';
+            else if (c == '-')
+                sum += 1;
+        }
+        return sum % 10;
+    }
+
+    bool TleChecksumValid(const std::string& line)
+    {
+        return line.size() >= 69 && line[68] - '0' == TleChecksum(line);
+    }
+
+    void FormatTle(const TleElements& elements, std::string& line1, std::string& line2)
+    {
+        char buffer[80];
+
+        // first derivative is written as a signed fraction, " .00001234"
+        double nDot = std::max(-0.99999999, std::min(0.99999999, elements.nDot));
+        char nDotField[32];
+        snprintf(nDotField, sizeof(nDotField), "%c.%08ld", nDot < 0 ? '-' : ' ', lround(fabs(nDot) * 1e8));
+
+        snprintf(buffer, sizeof(buffer), "1 %05d%c %-8.8s %02d%012.8f %s %s %s %d %4d",
+                 elements.satNum % 100000, elements.classification, elements.intlDesignator.c_str(),
+                 elements.epochYear % 100, elements.epochDay, nDotField,
+                 FormatImpliedExponent(elements.nDotDot).c_str(), FormatImpliedExponent(elements.bstar).c_str(),
+                 elements.ephemerisType % 10, elements.elementSetNum % 10000);
+        line1 = buffer;
+        line1 += (char)('0' + TleChecksum(line1));
+
+        // eccentricity has an implied leading decimal point
+        long ecc = std::min(9999999L, lround(elements.eccentricity * 1e7));
+        snprintf(buffer, sizeof(buffer), "2 %05d %8.4f %8.4f %07ld %8.4f %8.4f %11.8f%5d",
+                 elements.satNum % 100000, elements.inclination, elements.raan, ecc,
+                 elements.argPerigee, elements.meanAnomaly, elements.meanMotion, elements.revNum % 100000);
+        line2 = buffer;
+        line2 += (char)('0' + TleChecksum(line2));
+    }
+
+    bool ParseTle(const std::string& line1, const std::string& line2, TleElements& elements)
+    {
+        if (line1.size() < 68 || line2.size() < 68 || line1[0] != '1' || line2[0] != '2')
+            return false;
+
+        elements.satNum = (int)Field(line1, 3, 5);
+        elements.classification = line1[7];
+        elements.intlDesignator = line1.substr(9, 8);
+        elements.intlDesignator.erase(elements.intlDesignator.find_last_not_of(' ') + 1);
+
+        // two digit years, 57 to 99 are 1900s as everywhere else
+        int year = (int)Field(line1, 19, 2);
+        elements.epochYear = year < 57 ? 2000 + year : 1900 + year;
+        elements.epochDay = Field(line1, 21, 12);
+
+        elements.nDot = Field(line1, 34, 10);
+        elements.nDotDot = ParseImpliedExponent(line1.substr(44, 8));
+        elements.bstar = ParseImpliedExponent(line1.substr(53, 8));
+        elements.ephemerisType = (int)Field(line1, 63, 1);
+        elements.elementSetNum = (int)Field(line1, 65, 4);
+
+        elements.inclination = Field(line2, 9, 8);
+        elements.raan = Field(line2, 18, 8);
+        elements.eccentricity = Field(line2, 27, 7) / 1e7;
+        elements.argPerigee = Field(line2, 35, 8);
+        elements.meanAnomaly = Field(line2, 44, 8);
+        elements.meanMotion = Field(line2, 53, 11);
+        elements.revNum = (int)Field(line2, 64, 5);
+        return true;
+    }
+
+    double TleEpochDs50UTC(const TleElements& elements)
+    {
+        // ds50UTC 1.0 is 1950 Jan 1 00:00, epochDay 1.0 is Jan 1 00:00 of the epoch year
+        double days = 0.0;
+        for (int year = 1950; year < elements.epochYear; year++)
+            days += IsLeapYear(year) ? 366.0 : 365.0;
+        return days + elements.epochDay;
+    }
+
+    void TleSetEpochDs50UTC(TleElements& elements, double ds50UTC)
+    {
+        int year = 1950;
+        double day = ds50UTC;
+        while (day >= (IsLeapYear(year) ? 367.0 : 366.0))
+            day -= IsLeapYear(year++) ? 366.0 : 365.0;
+        elements.epochYear = year;
+        elements.epochDay = day;
+    }
+
+    TleSecularRates Sgp4SecularRates(const TleElements& elements)
+    {
+        TleSecularRates rates;
+        double n0 = elements.meanMotion * TWO_PI / 1440.0;
+        double e = std::clamp(elements.eccentricity, 0.0, 0.999);
+        if (n0 <= 0.0)
+            return rates;
+
+        double cosio = cos(elements.inclination * DEG2RAD);
+        double theta2 = cosio * cosio;
+        double theta4 = theta2 * theta2;
+        double x3thm1 = 3.0 * theta2 - 1.0;
+        double betao2 = 1.0 - e * e;
+        double betao = sqrt(betao2);
+
+        double a1 = pow(XKE / n0, 2.0 / 3.0);
+        double del1 = 1.5 * CK2 * x3thm1 / (a1 * a1 * betao * betao2);
+        double ao = a1 * (1.0 - del1 * (1.0 / 3.0 + del1 * (1.0 + 134.0 / 81.0 * del1)));
+        double delo = 1.5 * CK2 * x3thm1 / (ao * ao * betao * betao2);
+        double xnodp = n0 / (1.0 + delo);
+        double aodp = ao / (1.0 - delo);
+
+        double pinvsq = 1.0 / (aodp * aodp * betao2 * betao2);
+        double temp1 = 3.0 * CK2 * pinvsq * xnodp;
+        double temp2 = temp1 * CK2 * pinvsq;
+        double temp3 = 1.25 * CK4 * pinvsq * pinvsq * xnodp;
+
+        rates.meanAnomaly = xnodp + 0.5 * temp1 * betao * x3thm1 +
+                            0.0625 * temp2 * betao * (13.0 - 78.0 * theta2 + 137.0 * theta4);
+        rates.argPerigee = -0.5 * temp1 * (1.0 - 5.0 * theta2) +
+                           0.0625 * temp2 * (7.0 - 114.0 * theta2 + 395.0 * theta4) +
+                           temp3 * (3.0 - 36.0 * theta2 + 49.0 * theta4);
+        rates.raan = -temp1 * cosio + (0.5 * temp2 * (4.0 - 19.0 * theta2) + 2.0 * temp3 * (3.0 - 7.0 * theta2)) * cosio;
+        return rates;
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,72 @@
+//
+// TleUtil.h
+// Two line element formatting, checksums and field parsing
+//
+
+#ifndef TLEUTIL_H
+#define TLEUTIL_H
+
+#include <string>
+
+namespace SGP_IMPL {
+
+    // Fields of a two line element set, in the units the lines use
+    struct TleElements
+    {
+        int satNum = 0;
+        char classification = 'U';
+        std::string intlDesignator;   // e.g. "98067A", up to 8 characters
+        int epochYear = 0;            // four digit year
+        double epochDay = 1.0;        // day of year plus fraction, 1.0 is Jan 1 00:00
+        double nDot = 0.0;            // first derivative of mean motion / 2 (rev/day^2)
+        double nDotDot = 0.0;         // second derivative of mean motion / 6 (rev/day^3)
+        double bstar = 0.0;           // drag term (1/earth radii)
+        int ephemerisType = 0;
+        int elementSetNum = 999;
+        double inclination = 0.0;     // deg
+        double raan = 0.0;            // deg
+        double eccentricity = 0.0;
+        double argPerigee = 0.0;      // deg
+        double meanAnomaly = 0.0;     // deg
+        double meanMotion = 0.0;      // rev/day
+        int revNum = 0;
+    };
+
+    // Modulo 10 checksum over the first 68 columns, digits count their value and '-' counts 1
+    int TleChecksum(const std::string& line);
+
+    // True when the line is at least 69 columns and the last one matches the checksum
+    bool TleChecksumValid(const std::string& line);
+
+    // Writes both lines including checksums
+    void FormatTle(const TleElements& elements, std::string& line1, std::string& line2);
+
+    // Parses both lines, returns false when they are malformed. Checksums are not enforced.
+    bool ParseTle(const std::string& line1, const std::string& line2, TleElements& elements);
+
+    // Epoch of the element set in days since 1950 UTC (AstroStd ds50UTC)
+    double TleEpochDs50UTC(const TleElements& elements);
+
+    // Sets epochYear and epochDay to the time, the inverse of TleEpochDs50UTC
+    void TleSetEpochDs50UTC(TleElements& elements, double ds50UTC);
+
+    // SGP4's secular rates (rad/min) of the mean anomaly, argument of perigee and node, from
+    // its initialization with the Kozai mean motion recovered to Brouwer's. Near earth terms.
+    struct TleSecularRates
+    {
+        double meanAnomaly = 0.0;
+        double argPerigee = 0.0;
+        double raan = 0.0;
+    };
+
+    TleSecularRates Sgp4SecularRates(const TleElements& elements);
+
+    // Orbital period (min) from the mean motion
+    inline double TlePeriodMinutes(const TleElements& elements)
+    {
+        return elements.meanMotion > 0.0 ? 1440.0 / elements.meanMotion : 0.0;
+    }
+
+} // SGP_IMPL
+
+#endif //TLEUTIL_H
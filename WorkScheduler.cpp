@@ -0,0 +1,149 @@
+//
+// WorkScheduler.cpp
+// Per satellite cost estimates from the TLE, and longest first scheduling of a job's satellites
+//
+
+#include "WorkScheduler.h"
+#include "Instrumentation.h"
+#include "OrbitMath.h"
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const double DEEP_SPACE_PERIOD_MIN = 225.0;
+        const double REENTRY_MEAN_MOTION = 16.5;       // rev/day, about 120 km circular
+        const double NO_DECAY_DAYS = 1e9;
+
+        // per step, in near earth steps
+        const double STEP_WEIGHT[NUM_SAT_REGIMES] = {1.0, 1.8, 2.5};
+        // Sgp4InitSat, deep space init sets up the lunar and solar terms
+        const double INIT_WEIGHT[NUM_SAT_REGIMES] = {10.0, 40.0, 60.0};
+
+        double PerigeeHeightKm(const TleElements& elements)
+        {
+            if (elements.meanMotion <= 0.0)
+                return 0.0;
+            double n = elements.meanMotion * TWO_PI / 86400.0;     // rad/s
+            double a = cbrt(MU_EARTH / (n * n));
+            return a * (1.0 - elements.eccentricity) - EARTH_RADIUS;
+        }
+
+        int CostBucket(double cost)
+        {
+            return cost > 1.0 ? (int)log2(cost) : 0;
+        }
+
+    } // namespace
+
+    SatelliteRegime CostModel::Classify(const TleElements& elements)
+    {
+        if (TlePeriodMinutes(elements) < DEEP_SPACE_PERIOD_MIN)
+            return SAT_NEAR_EARTH;
+
+        // SDP4's resonance bands: geosynchronous, and 12 hour orbits with e >= 0.5
+        double n = elements.meanMotion;
+        bool synchronous = n > 0.8 && n < 1.2;
+        bool halfDay = n > 1.89 && n < 2.12 && elements.eccentricity >= 0.5;
+        return synchronous || halfDay ? SAT_RESONANT : SAT_DEEP_SPACE;
+    }
+
+    double CostModel::DaysToDecay(const TleElements& elements)
+    {
+        if (PerigeeHeightKm(elements) < 100.0)
+            return -1.0;
+        if (elements.meanMotion >= REENTRY_MEAN_MOTION)
+            return 0.0;
+        if (elements.nDot <= 0.0)
+            return NO_DECAY_DAYS;
+
+        // n(t) = n0 + 2 * nDot * t, the TLE field is half the derivative. Drag speeds up as
+        // the orbit sinks, so this is a late estimate.
+        return (REENTRY_MEAN_MOTION - elements.meanMotion) / (2.0 * elements.nDot);
+    }
+
+    SatelliteCost CostModel::Estimate(const TleElements& elements, double startTime, double stopTime, double stepSize)
+    {
+        SatelliteCost estimate;
+        estimate.regime = Classify(elements);
+
+        double stepDays = fabs(stepSize) / 1440.0;
+        double windowSteps = stepDays > 0.0 ? floor(fabs(stopTime - startTime) / stepDays) + 2.0 : 1.0;
+
+        // forward windows end at the decay, backward ones start from it
+        double decay = TleEpochDs50UTC(elements) + DaysToDecay(elements);
+        double steps = windowSteps;
+        if (startTime >= decay)
+            steps = 1.0;
+        else if (stopTime > startTime && stopTime > decay)
+            steps = std::min(windowSteps, floor((decay - startTime) / stepDays) + 1.0);
+        estimate.expectedSteps = steps;
+
+        double stepWeight = STEP_WEIGHT[estimate.regime] * (1.0 + elements.eccentricity);
+        estimate.cost = INIT_WEIGHT[estimate.regime] + steps * stepWeight;
+        return estimate;
+    }
+
+    const char* CostModel::RegimeName(SatelliteRegime regime)
+    {
+        switch (regime)
+        {
+            case SAT_NEAR_EARTH: return "near earth";
+            case SAT_DEEP_SPACE: return "deep space";
+            case SAT_RESONANT: return "resonant";
+            default: return "unknown";
+        }
+    }
+
+    std::vector<int> WorkScheduler::Order(const std::vector<SatelliteCost>& costs)
+    {
+        std::vector<int> order;
+        order.reserve(costs.size());
+        for (int i = 0; i < (int)costs.size(); i++)
+        {
+            if (costs[i].cost > 0.0)
+                order.push_back(i);
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+        {
+            int bucketA = CostBucket(costs[a].cost);
+            int bucketB = CostBucket(costs[b].cost);
+            if (bucketA != bucketB)
+                return bucketA > bucketB;
+            if (costs[a].regime != costs[b].regime)
+                return costs[a].regime > costs[b].regime;
+            return costs[a].cost > costs[b].cost;
+        });
+        return order;
+    }
+
+    void WorkScheduler::Run(const std::vector<int>& order, int numThreads, const std::function<void(int)>& work)
+    {
+        std::atomic<size_t> next{0};
+        auto worker = [&]()
+        {
+            SATPROP_SCOPE(PHASE_WORKER);
+            for (size_t i = next++; i < order.size(); i = next++)
+                work(order[i]);
+        };
+
+        int threadCount = (int)std::max<size_t>(1, std::min<size_t>(std::max(1, numThreads), order.size()));
+        if (threadCount == 1)
+        {
+            worker();
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++)
+            threads.emplace_back(worker);
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+} // SGP_IMPL
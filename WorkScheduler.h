@@ -0,0 +1,69 @@
+//
+// WorkScheduler.h
+// Per satellite cost estimates from the TLE, and longest first scheduling of a job's satellites
+//
+
+#ifndef WORKSCHEDULER_H
+#define WORKSCHEDULER_H
+
+#include <functional>
+#include <vector>
+#include "TleUtil.h"
+
+namespace SGP_IMPL {
+
+    // Which SGP4 code path a satellite takes, the thresholds are SGP4's own
+    enum SatelliteRegime
+    {
+        SAT_NEAR_EARTH = 0,     // period under 225 min, plain SGP4
+        SAT_DEEP_SPACE,         // SDP4 with lunar and solar terms
+        SAT_RESONANT,           // SDP4 plus the 12 h or 24 h resonance integrator
+        NUM_SAT_REGIMES
+    };
+
+    struct SatelliteCost
+    {
+        SatelliteRegime regime = SAT_NEAR_EARTH;
+        double expectedSteps = 0.0;     // the window, cut short by an expected decay
+        double cost = 0.0;              // in near earth steps
+    };
+
+    // Relative cost of propagating one satellite through a window. One near earth step
+    // (Sgp4PropDs50UTC plus the three Sgp4GetPropOut calls) is the unit; deep space and
+    // resonant steps weigh more, eccentric orbits take more Kepler iterations, and objects
+    // whose mean motion decay reaches re-entry inside the window stop early. The weights are
+    // rough, what matters is the order they put satellites in.
+    class CostModel
+    {
+    public:
+        // start and stop in ds50UTC, step in minutes, as Propagator::RunOneSgp4Job takes them
+        static SatelliteCost Estimate(const TleElements& elements, double startTime, double stopTime, double stepSize);
+
+        static SatelliteRegime Classify(const TleElements& elements);
+
+        // Days from epoch until the mean motion reaches re-entry, extrapolating the TLE's
+        // first derivative. Negative when perigee is already under 100 km, a large number
+        // when the orbit isn't decaying.
+        static double DaysToDecay(const TleElements& elements);
+
+        static const char* RegimeName(SatelliteRegime regime);
+    };
+
+    // Orders satellites longest first (LPT), so the last satellites any thread picks up are
+    // the short ones and the job ends close to total work / threads. Within a factor of two
+    // in cost, satellites of the same regime are kept together so a thread runs the same
+    // SGP4 or SDP4 path back to back.
+    class WorkScheduler
+    {
+    public:
+        // Indices of costs in scheduling order, zero cost entries are left out
+        static std::vector<int> Order(const std::vector<SatelliteCost>& costs);
+
+        // Calls work(index) for every index of order on numThreads threads, each thread
+        // taking the next index as it finishes the last one
+        static void Run(const std::vector<int>& order, int numThreads, const std::function<void(int)>& work);
+    };
+
+} // SGP_IMPL
+
+#endif //WORKSCHEDULER_H
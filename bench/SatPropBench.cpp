@@ -0,0 +1,1350 @@
+//
+// SatPropBench.cpp
+// Propagation throughput benchmark over synthetic catalogs, with baseline comparison
+//
+// Usage: SatPropBench [--quick] [--sizes 100,1000] [--regimes leo,geo] [--steps 60,1440]
+//                     [--threads 1,8] [--repeat 3] [--seed 1] [--max-steps-per-run 2000000]
+//                     [--work-dir .] [--out bench.json] [--baseline base.json] [--threshold 0.10]
+//                     [--disk-mb 1024]
+//
+// Every measurement is written to --out as {name, value, unit, higherIsBetter}. With
+// --baseline, entries with the same name are compared and the run exits with 1 when any of
+// them got worse by more than --threshold (a fraction, 0.10 is 10%).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../AstroStdDlls.h"
+#include "../CatalogDiff.h"
+#include "../DecayFinder.h"
+#include "../Eclipse.h"
+#include "../Ensemble.h"
+#include "../EventDetector.h"
+#include "../EphemerisQuery.h"
+#include "../EphemerisStore.h"
+#include "../Instrumentation.h"
+#include "../PropagationPipeline.h"
+#include "../Propagator.h"
+#include "../PropResults.h"
+#include "../RelativeMotion.h"
+#include "../ResultCache.h"
+#include "../TleFitter.h"
+#include "../TleUtil.h"
+#include "../io/AsyncFileWriter.h"
+#include "../io/EphemerisArchive.h"
+#include "SyntheticCatalog.h"
+
+// C interface wrapper
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "services/DllMainDll_Service.h"
+#include "wrappers/DllMainDll.h"
+#include "wrappers/TleDll.h"
+#include "wrappers/Sgp4PropDll.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+using namespace SGP_IMPL;
+
+struct BenchOptions
+{
+    std::vector<int> sizes = {100, 1000, 10000, 50000};
+    std::vector<OrbitRegime> regimes = {REGIME_LEO, REGIME_MEO, REGIME_GEO, REGIME_HEO, REGIME_MIXED};
+    std::vector<int> steps = {60, 1440};
+    std::vector<int> threads;             // defaults to 1 and the hardware thread count
+    int repeat = 3;                       // best of, to keep scheduler noise out of the baseline
+    uint64_t seed = 1;
+    // satellites x steps per propagation run; results are kept in memory, so this bounds RAM
+    long long maxStepsPerRun = 2000000;
+    std::string workDir = ".";
+    std::string outFile = "satprop_bench.json";
+    std::string baselineFile;
+    double threshold = 0.10;
+    int diskMegabytes = 1024;             // sequential write test, large enough to get past the page cache
+};
+
+struct BenchResult
+{
+    std::string name;
+    double value = 0.0;
+    std::string unit;
+    bool higherIsBetter = true;
+};
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::vector<std::string> Split(const char* list)
+{
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* c = list; ; c++)
+    {
+        if (*c == ',' || *c == 0)
+        {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*c == 0)
+                break;
+        }
+        else
+        {
+            item += *c;
+        }
+    }
+    return items;
+}
+
+static std::vector<int> ParseIntList(const char* list)
+{
+    std::vector<int> values;
+    for (const auto& item : Split(list))
+    {
+        int value = atoi(item.c_str());
+        if (value > 0)
+            values.push_back(value);
+    }
+    return values;
+}
+
+static void PrintUsage()
+{
+    printf("Usage: SatPropBench [--quick] [--sizes 100,1000] [--regimes leo,meo,geo,heo,mixed]\n"
+           "                    [--steps 60,1440] [--threads 1,8] [--repeat 3] [--seed 1]\n"
+           "                    [--max-steps-per-run 2000000] [--work-dir .] [--out bench.json]\n"
+           "                    [--baseline base.json] [--threshold 0.10] [--disk-mb 1024]\n");
+}
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool takesValue = strcmp(arg, "--quick") != 0 && strcmp(arg, "--help") != 0;
+        if (takesValue && !value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (strcmp(arg, "--help") == 0)
+        {
+            PrintUsage();
+            exit(0);
+        }
+        else if (strcmp(arg, "--quick") == 0)
+        {
+            // smoke run for CI, small enough to finish in seconds
+            options.sizes = {100};
+            options.steps = {60};
+            options.repeat = 1;
+            options.diskMegabytes = 32;
+        }
+        else if (strcmp(arg, "--sizes") == 0)
+            options.sizes = ParseIntList(value);
+        else if (strcmp(arg, "--steps") == 0)
+            options.steps = ParseIntList(value);
+        else if (strcmp(arg, "--threads") == 0)
+            options.threads = ParseIntList(value);
+        else if (strcmp(arg, "--repeat") == 0)
+            options.repeat = std::max(1, atoi(value));
+        else if (strcmp(arg, "--seed") == 0)
+            options.seed = strtoull(value, nullptr, 10);
+        else if (strcmp(arg, "--max-steps-per-run") == 0)
+            options.maxStepsPerRun = std::max(1LL, atoll(value));
+        else if (strcmp(arg, "--work-dir") == 0)
+            options.workDir = value;
+        else if (strcmp(arg, "--out") == 0)
+            options.outFile = value;
+        else if (strcmp(arg, "--baseline") == 0)
+            options.baselineFile = value;
+        else if (strcmp(arg, "--threshold") == 0)
+            options.threshold = atof(value);
+        else if (strcmp(arg, "--disk-mb") == 0)
+            options.diskMegabytes = std::max(0, atoi(value));
+        else if (strcmp(arg, "--regimes") == 0)
+        {
+            options.regimes.clear();
+            for (const auto& name : Split(value))
+            {
+                OrbitRegime regime;
+                if (!ParseRegime(name, regime))
+                {
+                    fprintf(stderr, "Unknown regime: %s\n", name.c_str());
+                    return false;
+                }
+                options.regimes.push_back(regime);
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            PrintUsage();
+            return false;
+        }
+
+        if (takesValue)
+            i++;
+    }
+
+    if (options.threads.empty())
+    {
+        int hardware = (int)std::thread::hardware_concurrency();
+        options.threads.push_back(1);
+        if (hardware > 1)
+            options.threads.push_back(hardware);
+    }
+
+    return !options.sizes.empty() && !options.steps.empty() && !options.regimes.empty();
+}
+
+static void Report(std::vector<BenchResult>& results, const std::string& name, double value, const char* unit,
+                   bool higherIsBetter)
+{
+    printf("  %-60s %14.2f %s\n", name.c_str(), value, unit);
+    results.push_back({name, value, unit, higherIsBetter});
+}
+
+// Heap bytes held by the results, the vector slack included
+static size_t ResultBytes(const PropagationResults& results, size_t& steps)
+{
+    size_t bytes = results.satellites.capacity() * sizeof(SatelliteData);
+    steps = 0;
+    for (const auto& sat : results.satellites)
+    {
+        bytes += sat.timeSteps.capacity() * sizeof(TimeStepData);
+        bytes += sat.line1.capacity() + sat.line2.capacity();
+        bytes += sat.errors.capacity() * sizeof(StepErrorRecord);
+        for (const auto& step : sat.timeSteps)
+        {
+            if (!step.hasError())
+                steps++;
+        }
+    }
+    return bytes;
+}
+
+// Same layout as the propagator's osculating state output
+static const char* const TEXT_ROW = " %17.7f%17.7f%17.7f%17.7f%17.7f%17.7f%17.7f\n";
+
+static void PutRow(FILE* fp, const TimeStepData& step)
+{
+    fprintf(fp, TEXT_ROW, step.mse, step.pos[0], step.pos[1], step.pos[2], step.vel[0], step.vel[1], step.vel[2]);
+}
+
+static void PutRow(AsyncFileWriter* out, const TimeStepData& step)
+{
+    out->Printf(TEXT_ROW, step.mse, step.pos[0], step.pos[1], step.pos[2], step.vel[0], step.vel[1], step.vel[2]);
+}
+
+static void PutRecord(FILE* fp, const double* record, size_t size)
+{
+    fwrite(record, size, 1, fp);
+}
+
+static void PutRecord(AsyncFileWriter* out, const double* record, size_t size)
+{
+    out->Write(record, size);
+}
+
+template <typename Out>
+static size_t WriteText(Out out, const PropagationResults& results)
+{
+    size_t steps = 0;
+    for (const auto& sat : results.satellites)
+    {
+        for (const auto& step : sat.timeSteps)
+        {
+            if (step.hasError())
+                continue;
+            PutRow(out, step);
+            steps++;
+        }
+    }
+    return steps;
+}
+
+// The numeric part of every step, written as is
+template <typename Out>
+static size_t WriteBinary(Out out, const PropagationResults& results)
+{
+    size_t steps = 0;
+    double record[26];
+    for (const auto& sat : results.satellites)
+    {
+        for (const auto& step : sat.timeSteps)
+        {
+            if (step.hasError())
+                continue;
+            record[0] = step.mse;
+            record[1] = step.ds50UTC;
+            memcpy(record + 2, step.pos, sizeof(step.pos));
+            memcpy(record + 5, step.vel, sizeof(step.vel));
+            memcpy(record + 8, step.llh, sizeof(step.llh));
+            memcpy(record + 11, step.meanKep, sizeof(step.meanKep));
+            memcpy(record + 17, step.oscKep, sizeof(step.oscKep));
+            memcpy(record + 23, step.nodalApPer, sizeof(step.nodalApPer));
+            PutRecord(out, record, sizeof(record));
+            steps++;
+        }
+    }
+    return steps;
+}
+
+static void BenchOutput(std::vector<BenchResult>& results, const std::string& prefix, const PropagationResults& propResults,
+                        const BenchOptions& options)
+{
+    std::string path = options.workDir + "/satprop_bench_output.tmp";
+    const char* modes[] = {"text", "binary"};
+    for (int mode = 0; mode < 2; mode++)
+    {
+        double best = 0.0;
+        size_t steps = 0;
+        long bytes = 0;
+        for (int r = 0; r < options.repeat; r++)
+        {
+            FILE* fp = fopen(path.c_str(), mode == 0 ? "w" : "wb");
+            if (!fp)
+            {
+                fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            steps = mode == 0 ? WriteText(fp, propResults) : WriteBinary(fp, propResults);
+            fflush(fp);
+            double elapsed = Seconds(start);
+            bytes = ftell(fp);
+            fclose(fp);
+            if (r == 0 || elapsed < best)
+                best = elapsed;
+        }
+        remove(path.c_str());
+
+        if (steps == 0 || best <= 0.0)
+            continue;
+        Report(results, prefix + "/write_" + modes[mode] + "_steps", steps / best, "steps/s", true);
+        Report(results, prefix + "/write_" + modes[mode] + "_bytes", bytes / best / 1e6, "MB/s", true);
+
+        // the same rows through the async writer, timed as the producer sees it
+        for (AsyncBackend backend : {ASYNC_IO_URING, ASYNC_THREAD_POOL})
+        {
+            if (backend == ASYNC_IO_URING && !AsyncFileWriter::IoUringAvailable())
+                continue;
+            AsyncWriteOptions writeOptions;
+            writeOptions.backend = backend;
+            double bestAsync = 0.0;
+            double stall = 0.0;
+            for (int r = 0; r < options.repeat; r++)
+            {
+                AsyncFileWriter out;
+                if (!out.Open(path, writeOptions))
+                {
+                    fprintf(stderr, "%s\n", out.GetError().c_str());
+                    return;
+                }
+                auto start = std::chrono::steady_clock::now();
+                mode == 0 ? WriteText(&out, propResults) : WriteBinary(&out, propResults);
+                double elapsed = Seconds(start);
+                out.Close();
+                if (r == 0 || elapsed < bestAsync)
+                {
+                    bestAsync = elapsed;
+                    stall = out.GetStats().stallSeconds;
+                }
+            }
+            remove(path.c_str());
+
+            std::string name = prefix + "/write_" + modes[mode] + "_async/" + AsyncFileWriter::BackendName(backend);
+            if (bestAsync > 0.0)
+            {
+                Report(results, name + "_steps", steps / bestAsync, "steps/s", true);
+                Report(results, name + "_stall", stall / bestAsync, "fraction", false);
+            }
+        }
+    }
+}
+
+// Sequential writes of large buffers, the device limit the output paths are measured against.
+// fwrite ends in the page cache, the async writers with direct I/O end on the device.
+static void BenchDisk(std::vector<BenchResult>& results, const BenchOptions& options)
+{
+    if (options.diskMegabytes <= 0)
+        return;
+
+    std::string path = options.workDir + "/satprop_bench_disk.tmp";
+    const size_t chunk = 1 << 20;
+    std::vector<char> data(chunk);
+    for (size_t i = 0; i < chunk; i++)
+        data[i] = (char)(i * 131 + 7);
+    uint64_t total = (uint64_t)options.diskMegabytes * chunk;
+
+    double best = 0.0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int m = 0; m < options.diskMegabytes; m++)
+            fwrite(data.data(), chunk, 1, fp);
+        fclose(fp);
+        double elapsed = Seconds(start);
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    if (best > 0.0)
+        Report(results, "disk/fwrite", total / best / 1e6, "MB/s", true);
+
+    for (AsyncBackend backend : {ASYNC_IO_URING, ASYNC_THREAD_POOL})
+    {
+        if (backend == ASYNC_IO_URING && !AsyncFileWriter::IoUringAvailable())
+            continue;
+        AsyncWriteOptions writeOptions;
+        writeOptions.backend = backend;
+        AsyncWriteStats bestStats;
+        for (int r = 0; r < options.repeat; r++)
+        {
+            AsyncFileWriter out;
+            if (!out.Open(path, writeOptions))
+            {
+                fprintf(stderr, "%s\n", out.GetError().c_str());
+                return;
+            }
+            for (int m = 0; m < options.diskMegabytes; m++)
+                out.Write(data.data(), chunk);
+            if (!out.Close())
+            {
+                fprintf(stderr, "%s\n", out.GetError().c_str());
+                return;
+            }
+            if (r == 0 || out.GetStats().seconds < bestStats.seconds)
+                bestStats = out.GetStats();
+        }
+
+        std::string name = std::string("disk/") + AsyncFileWriter::BackendName(backend);
+        Report(results, name, bestStats.Throughput() / 1e6, "MB/s", true);
+        Report(results, name + "_stall", bestStats.stallSeconds / bestStats.seconds, "fraction", false);
+        printf("  %s: direct I/O %s\n", name.c_str(), bestStats.direct ? "on" : "off");
+    }
+    remove(path.c_str());
+}
+
+// Footprint and speed of each compact storage mode on the same results
+static void BenchStorage(std::vector<BenchResult>& results, const std::string& prefix, const PropagationResults& propResults,
+                         const BenchOptions& options)
+{
+    size_t steps = 0;
+    for (const auto& sat : propResults.satellites)
+        steps += sat.timeSteps.size();
+    if (steps == 0)
+        return;
+
+    std::vector<TimeStepData> decoded;
+    for (int mode = 0; mode < NUM_STORAGE_MODES; mode++)
+    {
+        EphemerisStore store((StorageMode)mode);
+        std::string name = prefix + "/store_" + EphemerisStore::ModeName((StorageMode)mode);
+
+        double bestEncode = 0.0;
+        double bestDecode = 0.0;
+        for (int r = 0; r < options.repeat; r++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            store.Build(propResults);
+            double elapsed = Seconds(start);
+            if (r == 0 || elapsed < bestEncode)
+                bestEncode = elapsed;
+
+            start = std::chrono::steady_clock::now();
+            for (int sat = 0; sat < store.SatelliteCount(); sat++)
+                store.DecodeSatellite(sat, decoded);
+            elapsed = Seconds(start);
+            if (r == 0 || elapsed < bestDecode)
+                bestDecode = elapsed;
+        }
+
+        Report(results, name + "_bytes_per_step", (double)store.MemoryBytes() / steps, "bytes", false);
+        if (bestEncode > 0.0)
+            Report(results, name + "_encode", steps / bestEncode, "steps/s", true);
+        if (bestDecode > 0.0)
+            Report(results, name + "_decode", steps / bestDecode, "steps/s", true);
+    }
+}
+
+// Compression ratio of the long-term archive and how fast it decodes back
+// Interpolated states at times between the steps, every satellite at the same batch of times
+static void BenchQuery(std::vector<BenchResult>& results, const std::string& prefix, const PropagationResults& propResults,
+                       const BenchOptions& options)
+{
+    EphemerisQuery query(propResults);
+    std::vector<int> satellites;
+    double first = 0.0, last = 0.0;
+    for (int s = 0; s < query.SatelliteCount(); s++)
+    {
+        double satFirst, satLast;
+        if (!query.Span(s, &satFirst, &satLast))
+            continue;
+        if (satellites.empty() || satLast - satFirst > last - first)
+        {
+            first = satFirst;
+            last = satLast;
+        }
+        satellites.push_back(s);
+    }
+    if (satellites.empty() || last <= first)
+        return;
+
+    const int timeCount = 64;
+    std::vector<double> times(timeCount);
+    for (int t = 0; t < timeCount; t++)
+        times[t] = first + (last - first) * (t + 0.37) / timeCount;
+
+    std::vector<EphemerisState> states;
+    double best = 0.0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        query.StatesAt(satellites, times, states);
+        double elapsed = Seconds(start);
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    if (best > 0.0)
+        Report(results, prefix + "/query_states", states.size() / best, "states/s", true);
+}
+
+// Element sets fitted back to the propagated states, started from the states alone so
+// every fit takes the long way. The first satellites of large catalogs only.
+static void BenchEclipse(std::vector<BenchResult>& results, const std::string& prefix, const PropagationResults& propResults,
+                         const BenchOptions& options)
+{
+    EclipseOptions eclipseOptions;
+    eclipseOptions.keepStates = false;
+    eclipseOptions.numThreads = options.threads.back();
+    std::string name = prefix + "/threads=" + std::to_string(eclipseOptions.numThreads);
+    for (bool transitions : {false, true})
+    {
+        eclipseOptions.findTransitions = transitions;
+        EclipseReport best;
+        for (int r = 0; r < options.repeat; r++)
+        {
+            EclipseReport report = Eclipse::Run(propResults, eclipseOptions);
+            if (r == 0 || report.seconds < best.seconds)
+                best = std::move(report);
+        }
+        if (best.seconds > 0.0)
+            Report(results, name + (transitions ? "/eclipse_transitions" : "/eclipse"), best.steps / best.seconds,
+                   "steps/s", true);
+    }
+}
+
+static void BenchProximity(std::vector<BenchResult>& results, const std::string& prefix,
+                           const PropagationResults& propResults, const BenchOptions& options)
+{
+    // neighbours in the catalog as pairs, the largest job stands in for a day of them
+    const size_t maxPairs = 4000;
+    std::vector<SatellitePair> pairs;
+    for (size_t s = 0; s + 1 < propResults.satellites.size() && pairs.size() < maxPairs; s++)
+        pairs.push_back({(int)s, (int)s + 1});
+    if (pairs.empty())
+        return;
+
+    ProximityOptions proximityOptions;
+    proximityOptions.keepStates = false;
+    proximityOptions.numThreads = options.threads.back();
+    ProximityReport best;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        ProximityReport report = RelativeMotion::Run(propResults, pairs, proximityOptions);
+        if (r == 0 || report.seconds < best.seconds)
+            best = std::move(report);
+    }
+    std::string name = prefix + "/threads=" + std::to_string(proximityOptions.numThreads);
+    if (best.seconds > 0.0)
+    {
+        Report(results, name + "/proximity", pairs.size() / best.seconds, "pairs/s", true);
+        Report(results, name + "/proximity_steps", best.steps / best.seconds, "steps/s", true);
+    }
+}
+
+static void BenchTleFit(std::vector<BenchResult>& results, const std::string& prefix, const PropagationResults& propResults,
+                        const BenchOptions& options)
+{
+    const size_t maxSatellites = 2000;
+    std::vector<FitRequest> requests;
+    for (const SatelliteData& satellite : propResults.satellites)
+    {
+        if (requests.size() == maxSatellites)
+            break;
+        FitRequest request;
+        if (!TleFitter::RequestFromSatellite(satellite, request))
+            continue;
+        request.hasInitialElements = false;
+        requests.push_back(std::move(request));
+    }
+    if (requests.empty())
+        return;
+
+    TleFitOptions fitOptions;
+    fitOptions.numThreads = options.threads.back();
+    TleFitBatch best;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        TleFitBatch batch = TleFitter::Fit(requests, fitOptions);
+        if (r == 0 || batch.seconds < best.seconds)
+            best = std::move(batch);
+    }
+
+    std::vector<double> rms;
+    for (const TleFitResult& result : best.results)
+    {
+        if (result.status != FIT_FAILED)
+            rms.push_back(result.rmsKm);
+    }
+    std::string name = prefix + "/threads=" + std::to_string(fitOptions.numThreads);
+    if (best.seconds > 0.0)
+        Report(results, name + "/tle_fit", requests.size() / best.seconds, "sats/s", true);
+    Report(results, prefix + "/tle_fit_converged", (double)best.counts[FIT_CONVERGED] / requests.size(), "ratio", true);
+    if (!rms.empty())
+    {
+        std::nth_element(rms.begin(), rms.begin() + rms.size() / 2, rms.end());
+        Report(results, prefix + "/tle_fit_median_rms", rms[rms.size() / 2], "km", false);
+    }
+}
+
+static void BenchArchive(std::vector<BenchResult>& results, const std::string& prefix, const PropagationResults& propResults,
+                         const BenchOptions& options)
+{
+    std::string path = options.workDir + "/satprop_bench_archive.tmp";
+    ArchiveStats stats;
+    double best = 0.0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = EphemerisArchive::Write(path, propResults, options.threads.back(), &stats);
+        double elapsed = Seconds(start);
+        if (!ok)
+        {
+            fprintf(stderr, "Failed to write archive: %s\n", path.c_str());
+            return;
+        }
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    if (stats.steps == 0)
+    {
+        remove(path.c_str());
+        return;
+    }
+
+    Report(results, prefix + "/archive_ratio", stats.Ratio(), "x", true);
+    Report(results, prefix + "/archive_bytes_per_step", (double)stats.compressedBytes / stats.steps, "bytes", false);
+    if (best > 0.0)
+        Report(results, prefix + "/archive_write", stats.steps / best, "steps/s", true);
+
+    EphemerisArchiveReader reader;
+    if (!reader.Open(path))
+    {
+        fprintf(stderr, "%s\n", reader.GetError().c_str());
+        remove(path.c_str());
+        return;
+    }
+    for (int threads : options.threads)
+    {
+        best = 0.0;
+        for (int r = 0; r < options.repeat; r++)
+        {
+            PropagationResults decoded;
+            auto start = std::chrono::steady_clock::now();
+            reader.ReadAll(decoded, threads);
+            double elapsed = Seconds(start);
+            if (r == 0 || elapsed < best)
+                best = elapsed;
+        }
+        if (best > 0.0)
+            Report(results, prefix + "/archive_decode/threads=" + std::to_string(threads), stats.steps / best,
+                   "steps/s", true);
+    }
+    reader.Close();
+    remove(path.c_str());
+}
+
+// Propagation plus text output: the batch job followed by a write, against the staged
+// pipeline that overlaps them. pipeline_over_bottleneck is the pipeline's wall time over its
+// slowest stage, 1.0 is perfect overlap.
+static void BenchPipeline(std::vector<BenchResult>& results, const std::string& prefix, const std::string& catalogFile,
+                          double startTime, int steps, const BenchOptions& options)
+{
+    std::string path = options.workDir + "/satprop_bench_pipeline.tmp";
+    double stopTime = startTime + (steps - 1) / 1440.0;
+    int threads = options.threads.back();
+    std::string name = prefix + "/steps=" + std::to_string(steps) + "/threads=" + std::to_string(threads);
+
+    double bestBatch = 0.0;
+    double bestPipeline = 0.0;
+    size_t producedSteps = 0;
+    PipelineStats bestStats;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        {
+            PropagationResults propResults = Propagator::RunOneSgp4Job((char*)catalogFile.c_str(), startTime, stopTime,
+                                                                       1.0, threads);
+            FILE* fp = fopen(path.c_str(), "w");
+            if (!fp)
+            {
+                fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+                return;
+            }
+            WriteText(fp, propResults);
+            fclose(fp);
+        }
+        double elapsed = Seconds(start);
+        if (r == 0 || elapsed < bestBatch)
+            bestBatch = elapsed;
+
+        PipelineOptions pipelineOptions;
+        pipelineOptions.propagateThreads = threads;
+        pipelineOptions.formatThreads = std::max(1, threads / 2);
+        pipelineOptions.keepResults = false;
+        PipelineStats stats;
+        start = std::chrono::steady_clock::now();
+        PropagationResults streamed = PropagationPipeline::Run(catalogFile.c_str(), startTime, stopTime, 1.0, path,
+                                                               pipelineOptions, &stats);
+        elapsed = Seconds(start);
+        if (!streamed.overallSuccess)
+        {
+            fprintf(stderr, "Pipeline failed: %s\n", streamed.generalError.c_str());
+            break;
+        }
+        if (r == 0 || elapsed < bestPipeline)
+        {
+            bestPipeline = elapsed;
+            bestStats = stats;
+        }
+        producedSteps = (size_t)streamed.totalSatellites * steps;
+    }
+    remove(path.c_str());
+
+    if (bestBatch <= 0.0 || bestPipeline <= 0.0 || producedSteps == 0)
+        return;
+    Report(results, name + "/batch_then_text", producedSteps / bestBatch, "steps/s", true);
+    Report(results, name + "/pipeline_text", producedSteps / bestPipeline, "steps/s", true);
+    if (bestStats.BottleneckSeconds() > 0.0)
+        Report(results, name + "/pipeline_over_bottleneck", bestStats.wallSeconds / bestStats.BottleneckSeconds(), "x",
+               false);
+    for (int s = 0; s < NUM_PIPELINE_STAGES; s++)
+    {
+        const StageStats& stage = bestStats.stages[s];
+        printf("    %-10s %2d threads  occupancy %5.1f%%  starved %6.2f s  held back %6.2f s\n",
+               PropagationPipeline::StageName((PipelineStage)s), stage.workers,
+               stage.Occupancy(bestStats.wallSeconds) * 100.0, stage.waitInputSeconds, stage.waitOutputSeconds);
+    }
+}
+
+// A routine catalog update: every tenth satellite gets an element set half a day later,
+// every hundredth of those after a plane change
+static bool WriteCatalogUpdate(const std::string& catalogFile, const std::string& updateFile,
+                               std::vector<CatalogEntry>& previous, int* planeChanges = nullptr)
+{
+    if (!CatalogDiff::ReadCatalog(catalogFile, previous) || previous.empty())
+        return false;
+
+    std::vector<CatalogEntry> current = previous;
+    int burns = 0;
+    for (size_t i = 0; i < current.size(); i += 10)
+    {
+        CatalogEntry& entry = current[i];
+        entry.elements = CatalogDiff::Predict(entry.elements, 0.5);
+        if (i % 1000 == 0)
+        {
+            entry.elements.inclination += 0.1;
+            burns++;
+        }
+        FormatTle(entry.elements, entry.line1, entry.line2);
+    }
+    if (planeChanges)
+        *planeChanges = burns;
+
+    FILE* fp = fopen(updateFile.c_str(), "w");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to open file: %s\n", updateFile.c_str());
+        return false;
+    }
+    for (const CatalogEntry& entry : current)
+        fprintf(fp, "%s\n%s\n", entry.line1.c_str(), entry.line2.c_str());
+    fclose(fp);
+    return true;
+}
+
+// The diff of a routine update and a pipeline job that carries the unchanged satellites
+// over against one that redoes them all
+static void BenchCatalogDiff(std::vector<BenchResult>& results, const std::string& prefix, const std::string& catalogFile,
+                             double startTime, int steps, const BenchOptions& options)
+{
+    std::string updateFile = options.workDir + "/satprop_bench_update.tle";
+    std::vector<CatalogEntry> previous;
+    std::vector<CatalogEntry> current;
+    int burns = 0;
+    if (!WriteCatalogUpdate(catalogFile, updateFile, previous, &burns))
+        return;
+
+    int threads = options.threads.back();
+    CatalogDiffResult diff;
+    double best = 0.0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        CatalogDiff::ReadCatalog(updateFile, current);
+        diff = CatalogDiff::Compare(previous, current, ManeuverThresholds(), threads);
+        double elapsed = Seconds(start);
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    if (best > 0.0)
+        Report(results, prefix + "/catalog_diff", current.size() / best, "sats/s", true);
+    printf("    %d updated, %d flagged, %d plane changes\n", diff.counts[CHANGE_UPDATED], diff.flagged, burns);
+
+    double stopTime = startTime + (steps - 1) / 1440.0;
+    PipelineOptions pipelineOptions;
+    pipelineOptions.propagateThreads = threads;
+    pipelineOptions.formatThreads = std::max(1, threads / 2);
+    PropagationResults before = PropagationPipeline::Run(catalogFile.c_str(), startTime, stopTime, 1.0, std::string(),
+                                                         pipelineOptions);
+    if (!before.overallSuccess)
+    {
+        remove(updateFile.c_str());
+        return;
+    }
+
+    double bestFull = 0.0;
+    double bestIncremental = 0.0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        PipelineOptions full = pipelineOptions;
+        full.keepResults = false;
+        auto start = std::chrono::steady_clock::now();
+        PropagationPipeline::Run(updateFile.c_str(), startTime, stopTime, 1.0, std::string(), full);
+        double elapsed = Seconds(start);
+        if (r == 0 || elapsed < bestFull)
+            bestFull = elapsed;
+
+        PipelineOptions incremental = pipelineOptions;
+        incremental.previous = &before;
+        incremental.carryOver = &diff.carryOver;
+        start = std::chrono::steady_clock::now();
+        PropagationPipeline::Run(updateFile.c_str(), startTime, stopTime, 1.0, std::string(), incremental);
+        elapsed = Seconds(start);
+        if (r == 0 || elapsed < bestIncremental)
+            bestIncremental = elapsed;
+    }
+    remove(updateFile.c_str());
+
+    if (bestFull > 0.0 && bestIncremental > 0.0)
+        Report(results, prefix + "/steps=" + std::to_string(steps) + "/incremental_speedup", bestFull / bestIncremental,
+               "x", true);
+}
+
+// RunOneSgp4Job on a routine update with the cache filled by the job before it, against the
+// same job without a cache. Once with room for the whole catalog in memory, once with an
+// eighth of it and the rest spilled to disk.
+static void BenchResultCache(std::vector<BenchResult>& results, const std::string& prefix, const std::string& catalogFile,
+                             double startTime, int steps, const BenchOptions& options)
+{
+    std::string updateFile = options.workDir + "/satprop_bench_update.tle";
+    std::string spillDirectory = options.workDir + "/satprop_bench_cache";
+    std::vector<CatalogEntry> previous;
+    if (!WriteCatalogUpdate(catalogFile, updateFile, previous))
+        return;
+
+    double stopTime = startTime + (steps - 1) / 1440.0;
+    int threads = options.threads.back();
+    std::string name = prefix + "/steps=" + std::to_string(steps);
+
+    double bestFull = 0.0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Propagator::RunOneSgp4Job((char*)updateFile.c_str(), startTime, stopTime, 1.0, threads);
+        double elapsed = Seconds(start);
+        if (r == 0 || elapsed < bestFull)
+            bestFull = elapsed;
+    }
+
+    size_t catalogBytes = 0;
+    for (int spill = 0; spill < 2; spill++)
+    {
+        double bestRefresh = 0.0;
+        ResultCacheStats stats;
+        for (int r = 0; r < options.repeat; r++)
+        {
+            ResultCacheOptions cacheOptions;
+            if (spill)
+            {
+                cacheOptions.memoryBytes = std::max<size_t>(1, catalogBytes / 8);
+                cacheOptions.spillDirectory = spillDirectory;
+            }
+            ResultCache cache(cacheOptions);
+            Propagator::RunOneSgp4Job((char*)catalogFile.c_str(), startTime, stopTime, 1.0, threads, &cache);
+            if (!spill)
+                catalogBytes = cache.GetStats().memoryBytes;
+
+            ResultCacheStats filled = cache.GetStats();
+            auto start = std::chrono::steady_clock::now();
+            Propagator::RunOneSgp4Job((char*)updateFile.c_str(), startTime, stopTime, 1.0, threads, &cache);
+            double elapsed = Seconds(start);
+            if (r == 0 || elapsed < bestRefresh)
+            {
+                bestRefresh = elapsed;
+                stats = cache.GetStats();
+                stats.hits -= filled.hits;
+                stats.misses -= filled.misses;
+            }
+        }
+
+        if (bestFull <= 0.0 || bestRefresh <= 0.0)
+            continue;
+        std::string variant = spill ? "/cache_spilled" : "/cache";
+        Report(results, name + variant + "_refresh_over_full", bestRefresh / bestFull, "x", false);
+        Report(results, name + variant + "_hit_rate", stats.HitRate(), "ratio", true);
+    }
+    remove(updateFile.c_str());
+    std::error_code error;
+    std::filesystem::remove_all(spillDirectory, error);
+}
+
+// One satellite of the catalog as a 500 sample ensemble, against the jobs of one sample
+// each it replaces: a few are timed and scaled up to the sample count
+static void BenchEnsemble(std::vector<BenchResult>& results, const std::string& prefix, const std::string& catalogFile,
+                          double startTime, int steps, const BenchOptions& options)
+{
+    std::vector<CatalogEntry> catalog;
+    if (!CatalogDiff::ReadCatalog(catalogFile, catalog) || catalog.empty() || !catalog[0].parsed)
+        return;
+    std::string sampleFile = options.workDir + "/satprop_bench_sample.tle";
+    FILE* fp = fopen(sampleFile.c_str(), "w");
+    if (!fp)
+        return;
+    fprintf(fp, "%s\n%s\n", catalog[0].line1.c_str(), catalog[0].line2.c_str());
+    fclose(fp);
+
+    double stopTime = startTime + (steps - 1) / 1440.0;
+    EnsembleSpread spread;
+    spread.sigma[ENS_MEAN_MOTION] = 1e-5;
+    spread.sigma[ENS_MEAN_ANOMALY] = 0.01;
+    spread.sigma[ENS_BSTAR] = 0.1 * fabs(catalog[0].elements.bstar);
+    EnsembleOptions ensembleOptions;
+    ensembleOptions.numThreads = options.threads.back();
+
+    double bestEnsemble = 0.0;
+    size_t states = 0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        EnsembleResult ensemble = Ensemble::Run(catalog[0].elements, spread, startTime, stopTime, 1.0, ensembleOptions);
+        states = ensemble.steps.size() * ensemble.samples.size();
+        if (r == 0 || ensemble.seconds < bestEnsemble)
+            bestEnsemble = ensemble.seconds;
+    }
+
+    const int timedJobs = 8;
+    auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < timedJobs; j++)
+        Propagator::RunOneSgp4Job((char*)sampleFile.c_str(), startTime, stopTime, 1.0, 1);
+    double perJob = Seconds(start) / timedJobs;
+    remove(sampleFile.c_str());
+
+    std::string name = prefix + "/steps=" + std::to_string(steps) + "/threads=" + std::to_string(ensembleOptions.numThreads);
+    if (bestEnsemble > 0.0)
+    {
+        Report(results, name + "/ensemble", states / bestEnsemble, "states/s", true);
+        Report(results, name + "/ensemble_over_jobs", bestEnsemble / (perJob * ensembleOptions.samples), "x", false);
+    }
+}
+
+// Decay search over the catalog's 30 days after its epochs, and the propagations it takes
+// over what stepping every minute would
+static void BenchDecay(std::vector<BenchResult>& results, const std::string& prefix, const std::string& catalogFile,
+                       const BenchOptions& options)
+{
+    std::vector<CatalogEntry> catalog;
+    if (!CatalogDiff::ReadCatalog(catalogFile, catalog))
+        return;
+    std::vector<TleElements> elements;
+    for (const CatalogEntry& entry : catalog)
+    {
+        if (entry.parsed)
+            elements.push_back(entry.elements);
+    }
+    if (elements.empty())
+        return;
+
+    DecayOptions decayOptions;
+    decayOptions.numThreads = options.threads.back();
+    DecayReport best;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        DecayReport report = DecayFinder::Find(elements, 0.0, decayOptions);
+        if (r == 0 || report.seconds < best.seconds)
+            best = std::move(report);
+    }
+
+    std::string name = prefix + "/threads=" + std::to_string(decayOptions.numThreads);
+    if (best.seconds > 0.0)
+        Report(results, name + "/decay_search", elements.size() / best.seconds, "sats/s", true);
+    double stepped = elements.size() * decayOptions.horizonDays * 1440.0;
+    Report(results, prefix + "/decay_over_stepping", best.evaluations / stepped, "x", false);
+}
+
+// Nodes, apsides and a 500 km altitude over the job's window, found on its grid with
+// the crossings refined, against the propagations of the grid alone
+static void BenchEvents(std::vector<BenchResult>& results, const std::string& prefix, const std::string& catalogFile,
+                        double startTime, int steps, const BenchOptions& options)
+{
+    std::vector<CatalogEntry> catalog;
+    if (!CatalogDiff::ReadCatalog(catalogFile, catalog))
+        return;
+    std::vector<TleElements> elements;
+    for (const CatalogEntry& entry : catalog)
+    {
+        if (entry.parsed)
+            elements.push_back(entry.elements);
+    }
+    if (elements.empty())
+        return;
+
+    std::vector<EventFunction> functions = {EventFunctions::Nodes(), EventFunctions::Apsides(),
+                                            EventFunctions::Altitude(500.0)};
+    double stopTime = startTime + (steps - 1) / 1440.0;
+    EventOptions eventOptions;
+    eventOptions.numThreads = options.threads.back();
+    EventReport best;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        EventReport report = EventDetector::Run(elements, functions, startTime, stopTime, 1.0, eventOptions);
+        if (r == 0 || report.seconds < best.seconds)
+            best = std::move(report);
+    }
+
+    long long gridSteps = 0;
+    for (const SatelliteEvents& satellite : best.satellites)
+        gridSteps += satellite.steps;
+    std::string name = prefix + "/steps=" + std::to_string(steps) + "/threads=" + std::to_string(eventOptions.numThreads);
+    if (best.seconds > 0.0)
+        Report(results, name + "/events", gridSteps / best.seconds, "steps/s", true);
+    if (gridSteps > 0)
+        Report(results, name + "/events_refine_overhead", (double)(best.evaluations - gridSteps) / gridSteps, "x", false);
+}
+
+// Load balance of the propagation threads: the longest thread over the mean one, 1.0 is a
+// job that ends at total work / threads. Needs the instrumentation compiled in.
+static void BenchSchedule(std::vector<BenchResult>& results, const std::string& prefix, const std::string& catalogFile,
+                          double startTime, int steps, const BenchOptions& options)
+{
+#ifdef SATPROP_INSTRUMENTATION
+    int threads = options.threads.back();
+    if (threads < 2)
+        return;
+
+    Instrumentation::Reset();
+    Instrumentation::SetEnabled(true);
+    Propagator::RunOneSgp4Job((char*)catalogFile.c_str(), startTime, startTime + (steps - 1) / 1440.0, 1.0, threads);
+    Instrumentation::SetEnabled(false);
+
+    InstrumentationSummary summary = Instrumentation::Summarize();
+    const PhaseStats& workers = summary.phases[PHASE_WORKER];
+    Instrumentation::Reset();
+    if (workers.count > 0 && workers.totalNs > 0)
+        Report(results, prefix + "/steps=" + std::to_string(steps) + "/threads=" + std::to_string(threads) +
+               "/schedule_tail_ratio", (double)workers.maxNs * workers.count / workers.totalNs, "x", false);
+#endif
+}
+
+static void BenchCatalog(std::vector<BenchResult>& results, OrbitRegime regime, int size, const BenchOptions& options)
+{
+    std::string prefix = std::string(RegimeName(regime)) + "/" + std::to_string(size);
+    std::string catalogFile = options.workDir + "/satprop_bench_" + RegimeName(regime) + "_" + std::to_string(size) + ".tle";
+
+    std::vector<TleElements> catalog = GenerateCatalog(regime, size, options.seed);
+    if (!WriteCatalog(catalogFile, catalog))
+    {
+        fprintf(stderr, "Failed to write catalog: %s\n", catalogFile.c_str());
+        return;
+    }
+    printf("%s\n", prefix.c_str());
+
+    // AstroStd load, the first thing every job does
+    double best = 0.0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Sgp4LoadFileAll((char*)catalogFile.c_str());
+        double elapsed = Seconds(start);
+        TleRemoveAllSats();
+        Sgp4RemoveAllSats();
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    if (best > 0.0)
+        Report(results, prefix + "/load", size / best, "sats/s", true);
+
+    // our own parser, from memory so the disk isn't measured
+    std::vector<std::string> lines;
+    {
+        FILE* fp = fopen(catalogFile.c_str(), "r");
+        char buffer[128];
+        while (fp && fgets(buffer, sizeof(buffer), fp))
+        {
+            buffer[strcspn(buffer, "\r\n")] = 0;
+            lines.push_back(buffer);
+        }
+        if (fp)
+            fclose(fp);
+    }
+    best = 0.0;
+    for (int r = 0; r < options.repeat; r++)
+    {
+        TleElements el;
+        int parsed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i + 1 < lines.size(); i += 2)
+        {
+            if (TleChecksumValid(lines[i]) && TleChecksumValid(lines[i + 1]) && ParseTle(lines[i], lines[i + 1], el))
+                parsed++;
+        }
+        double elapsed = Seconds(start);
+        if (parsed != size)
+            fprintf(stderr, "Parsed %d of %d element sets\n", parsed, size);
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    if (best > 0.0)
+        Report(results, prefix + "/parse", size / best, "sats/s", true);
+
+    // propagate from just after the latest epoch in the catalog, one minute steps
+    TleElements epoch;
+    epoch.epochYear = CATALOG_EPOCH_YEAR;
+    epoch.epochDay = CATALOG_EPOCH_DAY + 1.0;
+    double startTime = TleEpochDs50UTC(epoch);
+
+    PropagationResults largest;
+    int largestSteps = 0;
+    for (int steps : options.steps)
+    {
+        if ((long long)size * steps > options.maxStepsPerRun)
+        {
+            printf("  skipping %d steps, %lld steps per run is over the limit\n", steps, (long long)size * steps);
+            continue;
+        }
+
+        double stopTime = startTime + (steps - 1) / 1440.0;
+        for (int threads : options.threads)
+        {
+            best = 0.0;
+            size_t producedSteps = 0;
+            for (int r = 0; r < options.repeat; r++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                PropagationResults propResults = Propagator::RunOneSgp4Job((char*)catalogFile.c_str(), startTime, stopTime,
+                                                                           1.0, threads);
+                double elapsed = Seconds(start);
+
+                size_t bytes = ResultBytes(propResults, producedSteps);
+                if (r == 0 || elapsed < best)
+                    best = elapsed;
+
+                if (threads == options.threads.front() && r == 0 && steps >= largestSteps)
+                {
+                    if (producedSteps > 0)
+                        Report(results, prefix + "/steps=" + std::to_string(steps) + "/result_bytes_per_step",
+                               (double)bytes / producedSteps, "bytes", false);
+                    if (propResults.arena)
+                        Report(results, prefix + "/steps=" + std::to_string(steps) + "/arena_allocations_per_sat",
+                               (double)propResults.arena->Allocations() / size, "allocs", false);
+                    largest = std::move(propResults);
+                    largestSteps = steps;
+                }
+            }
+
+            if (best > 0.0 && producedSteps > 0)
+                Report(results, prefix + "/steps=" + std::to_string(steps) + "/threads=" + std::to_string(threads) +
+                       "/propagate", producedSteps / best, "steps/s", true);
+        }
+    }
+
+    if (largestSteps > 0)
+    {
+        BenchSchedule(results, prefix, catalogFile, startTime, largestSteps, options);
+        BenchPipeline(results, prefix, catalogFile, startTime, largestSteps, options);
+        BenchCatalogDiff(results, prefix, catalogFile, startTime, largestSteps, options);
+        BenchResultCache(results, prefix, catalogFile, startTime, largestSteps, options);
+        BenchEnsemble(results, prefix, catalogFile, startTime, largestSteps, options);
+        BenchDecay(results, prefix, catalogFile, options);
+        BenchEvents(results, prefix, catalogFile, startTime, largestSteps, options);
+        BenchOutput(results, prefix, largest, options);
+        BenchStorage(results, prefix, largest, options);
+        BenchArchive(results, prefix, largest, options);
+        BenchQuery(results, prefix, largest, options);
+        BenchTleFit(results, prefix, largest, options);
+        BenchEclipse(results, prefix, largest, options);
+        BenchProximity(results, prefix, largest, options);
+    }
+
+    remove(catalogFile.c_str());
+}
+
+static bool WriteResults(const std::string& filePath, const std::vector<BenchResult>& results, const BenchOptions& options)
+{
+    FILE* fp = fopen(filePath.c_str(), "w");
+    if (!fp)
+        return false;
+
+    fprintf(fp, "{\n  \"seed\": %llu,\n  \"hardwareThreads\": %u,\n  \"results\": [\n",
+            (unsigned long long)options.seed, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& result = results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\", \"higherIsBetter\": %s}%s\n",
+                result.name.c_str(), result.value, result.unit.c_str(), result.higherIsBetter ? "true" : "false",
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    bool ok = ferror(fp) == 0;
+    fclose(fp);
+    return ok;
+}
+
+// Reads back the files WriteResults produces, not general JSON: every result object is
+// searched for its name, value and higherIsBetter keys
+static bool ReadResults(const std::string& filePath, std::vector<BenchResult>& results)
+{
+    FILE* fp = fopen(filePath.c_str(), "r");
+    if (!fp)
+        return false;
+
+    std::string text;
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        text.append(buffer, count);
+    fclose(fp);
+
+    size_t pos = 0;
+    while ((pos = text.find("\"name\"", pos)) != std::string::npos)
+    {
+        size_t end = text.find('}', pos);
+        if (end == std::string::npos)
+            break;
+        std::string object = text.substr(pos, end - pos);
+        pos = end;
+
+        BenchResult result;
+        size_t nameStart = object.find('"', object.find(':') + 1);
+        size_t nameEnd = object.find('"', nameStart + 1);
+        size_t valueKey = object.find("\"value\"");
+        if (nameStart == std::string::npos || nameEnd == std::string::npos || valueKey == std::string::npos)
+            continue;
+        result.name = object.substr(nameStart + 1, nameEnd - nameStart - 1);
+        result.value = atof(object.c_str() + object.find(':', valueKey) + 1);
+
+        size_t better = object.find("\"higherIsBetter\"");
+        result.higherIsBetter = better == std::string::npos || object.find("true", better) != std::string::npos;
+        results.push_back(result);
+    }
+    return true;
+}
+
+// Returns the number of regressions past the threshold
+static int CompareResults(const std::vector<BenchResult>& baseline, const std::vector<BenchResult>& current,
+                          double threshold)
+{
+    int regressions = 0;
+    int compared = 0;
+    printf("\nComparison against baseline (threshold %.1f%%)\n", threshold * 100.0);
+    for (const auto& result : current)
+    {
+        auto base = std::find_if(baseline.begin(), baseline.end(),
+                                 [&](const BenchResult& b) { return b.name == result.name; });
+        if (base == baseline.end() || base->value == 0.0)
+            continue;
+
+        compared++;
+        // positive is worse, whichever way the metric goes
+        double change = (result.value - base->value) / base->value;
+        double worse = result.higherIsBetter ? -change : change;
+        bool regressed = worse > threshold;
+        if (regressed)
+            regressions++;
+        printf("  %-60s %14.2f -> %14.2f %+7.1f%%%s\n", result.name.c_str(), base->value, result.value,
+               change * 100.0, regressed ? "  REGRESSION" : "");
+    }
+    printf("%d compared, %d regression(s)\n", compared, regressions);
+    return regressions;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options))
+        return 2;
+
+    LoadAstroStdDlls();
+
+    char sgp4DllInfo[INFOSTRLEN];
+    Sgp4GetInfo(sgp4DllInfo);
+    sgp4DllInfo[INFOSTRLEN - 1] = 0;
+    printf("%s\n", sgp4DllInfo);
+
+    std::vector<BenchResult> results;
+    BenchDisk(results, options);
+    for (OrbitRegime regime : options.regimes)
+    {
+        for (int size : options.sizes)
+            BenchCatalog(results, regime, size, options);
+    }
+
+    FreeAstroStdDlls();
+
+    if (!WriteResults(options.outFile, results, options))
+    {
+        fprintf(stderr, "Failed to write results: %s\n", options.outFile.c_str());
+        return 2;
+    }
+    printf("Wrote %zu results to %s\n", results.size(), options.outFile.c_str());
+
+    if (!options.baselineFile.empty())
+    {
+        std::vector<BenchResult> baseline;
+        if (!ReadResults(options.baselineFile, baseline))
+        {
+            fprintf(stderr, "Failed to read baseline: %s\n", options.baselineFile.c_str());
+            return 2;
+        }
+        if (CompareResults(baseline, results, options.threshold) > 0)
+            return 1;
+    }
+
+    return 0;
+}
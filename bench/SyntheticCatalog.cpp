@@ -0,0 +1,176 @@
+//
+// SyntheticCatalog.cpp
+// Reproducible TLE catalogs in the common orbit regimes for benchmarking
+//
+
+#include "SyntheticCatalog.h"
+#include <stdio.h>
+#include <math.h>
+#include <random>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        // std::uniform_real_distribution differs between standard libraries, the raw
+        // mt19937_64 sequence doesn't, so values are mapped by hand
+        class CatalogRandom
+        {
+        public:
+            explicit CatalogRandom(uint64_t seed) : m_engine(seed) {}
+
+            double Uniform(double lo, double hi)
+            {
+                double unit = (double)(m_engine() >> 11) * (1.0 / 9007199254740992.0);
+                return lo + (hi - lo) * unit;
+            }
+
+            bool Chance(double probability) { return Uniform(0.0, 1.0) < probability; }
+
+        private:
+            std::mt19937_64 m_engine;
+        };
+
+        void FillLeo(TleElements& el, CatalogRandom& rng)
+        {
+            el.meanMotion = rng.Uniform(14.0, 16.0);
+            el.eccentricity = rng.Uniform(0.0001, 0.02);
+            // sun synchronous, ISS-like and starlink-like shells
+            double shell = rng.Uniform(0.0, 1.0);
+            el.inclination = shell < 0.4 ? rng.Uniform(97.0, 99.0)
+                           : shell < 0.7 ? rng.Uniform(51.0, 54.0)
+                           : rng.Uniform(0.0, 110.0);
+            el.bstar = rng.Uniform(1e-5, 5e-4);
+            el.nDot = rng.Uniform(0.0, 5e-5);
+        }
+
+        void FillMeo(TleElements& el, CatalogRandom& rng)
+        {
+            el.meanMotion = rng.Uniform(2.004, 2.007);
+            el.eccentricity = rng.Uniform(0.0001, 0.01);
+            el.inclination = rng.Uniform(55.0, 65.0);
+            el.bstar = 0.0;
+            el.nDot = rng.Uniform(-1e-7, 1e-7);
+        }
+
+        void FillGeo(TleElements& el, CatalogRandom& rng)
+        {
+            el.meanMotion = rng.Uniform(1.0025, 1.0029);
+            el.eccentricity = rng.Uniform(0.0, 0.001);
+            el.inclination = rng.Uniform(0.0, 0.1);
+            el.bstar = 0.0;
+            el.nDot = rng.Uniform(-3e-6, 3e-6);
+        }
+
+        void FillHeo(TleElements& el, CatalogRandom& rng)
+        {
+            if (rng.Chance(0.5))
+            {
+                // Molniya, critical inclination keeps apogee over the northern hemisphere
+                el.meanMotion = rng.Uniform(2.005, 2.008);
+                el.eccentricity = rng.Uniform(0.68, 0.74);
+                el.inclination = rng.Uniform(62.8, 64.0);
+                el.argPerigee = rng.Uniform(265.0, 275.0);
+            }
+            else
+            {
+                // geostationary transfer, perigee a few hundred km up
+                el.meanMotion = rng.Uniform(2.2, 2.3);
+                el.eccentricity = rng.Uniform(0.72, 0.74);
+                el.inclination = rng.Chance(0.5) ? rng.Uniform(5.0, 7.0) : rng.Uniform(26.0, 29.0);
+            }
+            el.bstar = rng.Uniform(1e-5, 2e-4);
+            el.nDot = rng.Uniform(0.0, 1e-5);
+        }
+
+    } // namespace
+
+    const char* RegimeName(OrbitRegime regime)
+    {
+        switch (regime)
+        {
+            case REGIME_LEO: return "leo";
+            case REGIME_MEO: return "meo";
+            case REGIME_GEO: return "geo";
+            case REGIME_HEO: return "heo";
+            case REGIME_MIXED: return "mixed";
+            default: return "unknown";
+        }
+    }
+
+    bool ParseRegime(const std::string& name, OrbitRegime& regime)
+    {
+        for (int r = 0; r < NUM_REGIMES; r++)
+        {
+            if (name == RegimeName((OrbitRegime)r))
+            {
+                regime = (OrbitRegime)r;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<TleElements> GenerateCatalog(OrbitRegime regime, int count, uint64_t seed)
+    {
+        // each regime gets its own stream so "leo" in a mixed run doesn't shift the others
+        CatalogRandom rng(seed * 0x9E3779B97F4A7C15ull + (uint64_t)regime);
+
+        std::vector<TleElements> catalog;
+        catalog.reserve(count);
+        for (int i = 0; i < count; i++)
+        {
+            TleElements el;
+            el.satNum = 10000 + i % 90000;
+            el.classification = 'U';
+
+            char designator[16];
+            snprintf(designator, sizeof(designator), "%02d%03d%c", CATALOG_EPOCH_YEAR % 100, (i / 26) % 1000, 'A' + i % 26);
+            el.intlDesignator = designator;
+
+            el.epochYear = CATALOG_EPOCH_YEAR;
+            el.epochDay = CATALOG_EPOCH_DAY + rng.Uniform(0.0, 1.0);
+            el.raan = rng.Uniform(0.0, 360.0);
+            el.argPerigee = rng.Uniform(0.0, 360.0);
+            el.meanAnomaly = rng.Uniform(0.0, 360.0);
+            el.elementSetNum = 999;
+            el.revNum = (int)rng.Uniform(1.0, 50000.0);
+
+            OrbitRegime fill = regime;
+            if (regime == REGIME_MIXED)
+            {
+                double pick = rng.Uniform(0.0, 1.0);
+                fill = pick < 0.80 ? REGIME_LEO : pick < 0.88 ? REGIME_MEO : pick < 0.96 ? REGIME_GEO : REGIME_HEO;
+            }
+
+            switch (fill)
+            {
+                case REGIME_MEO: FillMeo(el, rng); break;
+                case REGIME_GEO: FillGeo(el, rng); break;
+                case REGIME_HEO: FillHeo(el, rng); break;
+                default: FillLeo(el, rng); break;
+            }
+            catalog.push_back(el);
+        }
+        return catalog;
+    }
+
+    bool WriteCatalog(const std::string& filePath, const std::vector<TleElements>& catalog)
+    {
+        FILE* fp = fopen(filePath.c_str(), "w");
+        if (!fp)
+            return false;
+
+        std::string line1, line2;
+        for (const auto& el : catalog)
+        {
+            FormatTle(el, line1, line2);
+            fprintf(fp, "%s\n%s\n", line1.c_str(), line2.c_str());
+        }
+
+        bool ok = ferror(fp) == 0;
+        fclose(fp);
+        return ok;
+    }
+
+} // SGP_IMPL
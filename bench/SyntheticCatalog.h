@@ -0,0 +1,43 @@
+//
+// SyntheticCatalog.h
+// Reproducible TLE catalogs in the common orbit regimes for benchmarking
+//
+
+#ifndef SYNTHETICCATALOG_H
+#define SYNTHETICCATALOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../TleUtil.h"
+
+namespace SGP_IMPL {
+
+    enum OrbitRegime
+    {
+        REGIME_LEO = 0,     // 14-16 rev/day, near circular, any inclination
+        REGIME_MEO,         // navigation constellations, 2 rev/day at 55-65 deg
+        REGIME_GEO,         // 1 rev/day, near zero eccentricity and inclination (deep space)
+        REGIME_HEO,         // Molniya and GTO, high eccentricity (deep space)
+        REGIME_MIXED,       // roughly the public catalog mix, mostly LEO
+        NUM_REGIMES
+    };
+
+    const char* RegimeName(OrbitRegime regime);
+
+    // Returns false for unknown names, accepts the names RegimeName returns
+    bool ParseRegime(const std::string& name, OrbitRegime& regime);
+
+    // The same regime, size and seed always give the same elements on every platform. Epochs
+    // are spread over one day starting at CATALOG_EPOCH_YEAR/CATALOG_EPOCH_DAY.
+    std::vector<TleElements> GenerateCatalog(OrbitRegime regime, int count, uint64_t seed);
+
+    // Writes the catalog as plain two line element sets, returns false when the file can't be written
+    bool WriteCatalog(const std::string& filePath, const std::vector<TleElements>& catalog);
+
+    constexpr int CATALOG_EPOCH_YEAR = 2025;
+    constexpr double CATALOG_EPOCH_DAY = 200.0;
+
+} // SGP_IMPL
+
+#endif //SYNTHETICCATALOG_H
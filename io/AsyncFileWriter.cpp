@@ -0,0 +1,719 @@
+//
+// AsyncFileWriter.cpp
+// Double buffered file output submitted through io_uring or a pool of positional writes
+//
+
+#include "AsyncFileWriter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef SATPROP_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        typedef std::chrono::steady_clock Clock;
+
+        double Since(Clock::time_point start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        size_t AlignUp(size_t size, size_t alignment)
+        {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        char* AllocAligned(size_t size)
+        {
+#ifdef _WIN32
+            return (char*)_aligned_malloc(size, AsyncFileWriter::DIRECT_ALIGNMENT);
+#else
+            void* data = nullptr;
+            return posix_memalign(&data, AsyncFileWriter::DIRECT_ALIGNMENT, size) == 0 ? (char*)data : nullptr;
+#endif
+        }
+
+        void FreeAligned(char* data)
+        {
+#ifdef _WIN32
+            _aligned_free(data);
+#else
+            free(data);
+#endif
+        }
+
+        // Positional file access, the offset is always explicit so writes can complete in any order
+        const intptr_t NO_FILE = -1;
+
+#ifdef _WIN32
+        std::string SystemError()
+        {
+            char text[256] = {};
+            FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, nullptr, GetLastError(), 0,
+                           text, sizeof(text), nullptr);
+            return text;
+        }
+
+        intptr_t OpenNative(const std::string& filePath, bool direct)
+        {
+            DWORD flags = FILE_ATTRIBUTE_NORMAL | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+            HANDLE file = CreateFileA(filePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, flags,
+                                      nullptr);
+            return file == INVALID_HANDLE_VALUE ? NO_FILE : (intptr_t)file;
+        }
+
+        // Bytes written, or -1. After a short write the rest starts again at the last multiple
+        // of alignment, which unbuffered files need for every offset.
+        int64_t WriteAt(intptr_t file, const char* data, size_t size, uint64_t offset, size_t alignment)
+        {
+            size_t done = 0;
+            while (done < size)
+            {
+                OVERLAPPED position = {};
+                position.Offset = (DWORD)(offset + done);
+                position.OffsetHigh = (DWORD)((offset + done) >> 32);
+                DWORD chunk = (DWORD)std::min<size_t>(size - done, 1u << 30);
+                DWORD written = 0;
+                if (!WriteFile((HANDLE)file, data + done, chunk, &written, &position) || written == 0)
+                    return -1;
+                size_t next = done + written;
+                if (next < size)
+                    next -= next % alignment;
+                if (next == done)
+                {
+                    SetLastError(ERROR_WRITE_FAULT);
+                    return -1;
+                }
+                done = next;
+            }
+            return (int64_t)done;
+        }
+
+        bool TruncateNative(intptr_t file, uint64_t size)
+        {
+            FILE_END_OF_FILE_INFO end = {};
+            end.EndOfFile.QuadPart = (LONGLONG)size;
+            return SetFileInformationByHandle((HANDLE)file, FileEndOfFileInfo, &end, sizeof(end)) != 0;
+        }
+
+        bool CloseNative(intptr_t file)
+        {
+            return CloseHandle((HANDLE)file) != 0;
+        }
+#else
+        std::string SystemError()
+        {
+            return strerror(errno);
+        }
+
+        intptr_t OpenNative(const std::string& filePath, bool direct)
+        {
+            int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+            if (direct)
+                flags |= O_DIRECT;
+#endif
+            int fd = open(filePath.c_str(), flags, 0644);
+#if defined(__APPLE__)
+            if (fd >= 0 && direct)
+                fcntl(fd, F_NOCACHE, 1);
+#endif
+            return fd;
+        }
+
+        int64_t WriteAt(intptr_t file, const char* data, size_t size, uint64_t offset, size_t alignment)
+        {
+            size_t done = 0;
+            while (done < size)
+            {
+                ssize_t written = pwrite((int)file, data + done, size - done, (off_t)(offset + done));
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                    return -1;
+                size_t next = done + (size_t)written;
+                if (next < size)
+                    next -= next % alignment;
+                if (next == done)
+                {
+                    errno = EIO;
+                    return -1;
+                }
+                done = next;
+            }
+            return (int64_t)done;
+        }
+
+        bool TruncateNative(intptr_t file, uint64_t size)
+        {
+            return ftruncate((int)file, (off_t)size) == 0;
+        }
+
+        bool CloseNative(intptr_t file)
+        {
+            return close((int)file) == 0;
+        }
+#endif
+
+        // Shared by every writer on the thread pool backend. Writes to different offsets are
+        // independent, so a writer with several buffers in flight keeps several threads busy.
+        class IoThreadPool
+        {
+        public:
+            static IoThreadPool& Instance()
+            {
+                static IoThreadPool pool;
+                return pool;
+            }
+
+            void Post(std::function<void()> job)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_jobs.push_back(std::move(job));
+                }
+                m_changed.notify_one();
+            }
+
+        private:
+            IoThreadPool()
+            {
+                int threads = std::clamp((int)std::thread::hardware_concurrency() / 2, 2, 8);
+                for (int t = 0; t < threads; t++)
+                    m_threads.emplace_back(&IoThreadPool::Work, this);
+            }
+
+            ~IoThreadPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stopping = true;
+                }
+                m_changed.notify_all();
+                for (auto& thread : m_threads)
+                    thread.join();
+            }
+
+            void Work()
+            {
+                while (true)
+                {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_changed.wait(lock, [&]() { return m_stopping || !m_jobs.empty(); });
+                        if (m_jobs.empty())
+                            return;
+                        job = std::move(m_jobs.front());
+                        m_jobs.pop_front();
+                    }
+                    job();
+                }
+            }
+
+            std::mutex m_mutex;
+            std::condition_variable m_changed;
+            std::deque<std::function<void()>> m_jobs;
+            std::vector<std::thread> m_threads;
+            bool m_stopping = false;
+        };
+
+    }
+
+    struct AsyncFileWriter::Buffer
+    {
+        char* data = nullptr;
+        size_t capacity = 0;
+        size_t size = 0;            // bytes submitted, padding included
+        size_t payload = 0;         // bytes that belong to the file
+        uint64_t offset = 0;
+        size_t index = 0;           // in m_buffers, the ring's user data
+        bool inFlight = false;
+#ifdef SATPROP_HAVE_IO_URING
+        struct iovec iov = {};
+#endif
+    };
+
+#ifdef SATPROP_HAVE_IO_URING
+    // A submission and a completion ring shared with the kernel, sized for one entry per buffer
+    struct AsyncFileWriter::Ring
+    {
+        int fd = -1;
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned* sqMask = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned* cqMask = nullptr;
+        io_uring_sqe* sqes = nullptr;
+        io_uring_cqe* cqes = nullptr;
+        void* sqMap = MAP_FAILED;
+        size_t sqMapSize = 0;
+        void* cqMap = MAP_FAILED;
+        size_t cqMapSize = 0;
+        size_t sqesSize = 0;
+
+        bool Setup(unsigned entries)
+        {
+            io_uring_params params = {};
+            fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+            if (fd < 0)
+                return false;
+
+            sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (singleMap)
+                sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+
+            sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sqMap == MAP_FAILED)
+                return false;
+            if (singleMap)
+                cqMap = sqMap;
+            else
+            {
+                cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                             IORING_OFF_CQ_RING);
+                if (cqMap == MAP_FAILED)
+                    return false;
+            }
+
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            void* sqesMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                 IORING_OFF_SQES);
+            if (sqesMap == MAP_FAILED)
+                return false;
+            sqes = (io_uring_sqe*)sqesMap;
+
+            char* sq = (char*)sqMap;
+            sqHead = (unsigned*)(sq + params.sq_off.head);
+            sqTail = (unsigned*)(sq + params.sq_off.tail);
+            sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+            sqArray = (unsigned*)(sq + params.sq_off.array);
+            char* cq = (char*)cqMap;
+            cqHead = (unsigned*)(cq + params.cq_off.head);
+            cqTail = (unsigned*)(cq + params.cq_off.tail);
+            cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+            cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+            return true;
+        }
+
+        ~Ring()
+        {
+            if (sqes)
+                munmap(sqes, sqesSize);
+            if (cqMap != MAP_FAILED && cqMap != sqMap)
+                munmap(cqMap, cqMapSize);
+            if (sqMap != MAP_FAILED)
+                munmap(sqMap, sqMapSize);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        bool Push(int file, const struct iovec* iov, uint64_t offset, uint64_t userData)
+        {
+            unsigned tail = *sqTail;
+            if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > *sqMask)
+                return false;
+            unsigned index = tail & *sqMask;
+            io_uring_sqe& sqe = sqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_WRITEV;
+            sqe.fd = file;
+            sqe.addr = (uint64_t)(uintptr_t)iov;
+            sqe.len = 1;
+            sqe.off = offset;
+            sqe.user_data = userData;
+            sqArray[index] = index;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+            while (true)
+            {
+                int submitted = (int)syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+                if (submitted >= 0)
+                    return submitted == 1;
+                if (errno != EINTR && errno != EAGAIN)
+                    return false;
+            }
+        }
+
+        bool Wait()
+        {
+            int result = (int)syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            return result >= 0 || errno == EINTR;
+        }
+    };
+#else
+    struct AsyncFileWriter::Ring
+    {
+    };
+#endif
+
+    AsyncFileWriter::AsyncFileWriter() = default;
+
+    AsyncFileWriter::~AsyncFileWriter()
+    {
+        if (m_open)
+            Close();
+    }
+
+    const char* AsyncFileWriter::BackendName(AsyncBackend backend)
+    {
+        switch (backend)
+        {
+        case ASYNC_AUTO: return "auto";
+        case ASYNC_IO_URING: return "io_uring";
+        case ASYNC_THREAD_POOL: return "thread_pool";
+        default: return "unknown";
+        }
+    }
+
+    bool AsyncFileWriter::IoUringAvailable()
+    {
+#ifdef SATPROP_HAVE_IO_URING
+        // container seccomp profiles and kernel.io_uring_disabled both show up as a failed setup
+        static const bool available = []()
+        {
+            Ring probe;
+            return probe.Setup(1);
+        }();
+        return available;
+#else
+        return false;
+#endif
+    }
+
+    bool AsyncFileWriter::Open(const std::string& filePath, const AsyncWriteOptions& options)
+    {
+        if (m_open)
+            Close();
+
+        m_path = filePath;
+        m_options = options;
+        m_options.buffers = std::max(2, options.buffers);
+        m_options.bufferBytes = AlignUp(std::max<size_t>(options.bufferBytes, DIRECT_ALIGNMENT), DIRECT_ALIGNMENT);
+        m_stats = AsyncWriteStats();
+        m_error.clear();
+        m_failed = false;
+        m_current = 0;
+        m_used = 0;
+        m_fileOffset = 0;
+        m_opened = Clock::now();
+
+        // file systems without direct I/O (tmpfs, most network mounts) refuse the flag
+        m_stats.direct = options.direct;
+        m_file = OpenNative(filePath, options.direct);
+        if (m_file == NO_FILE && options.direct)
+        {
+            m_stats.direct = false;
+            m_file = OpenNative(filePath, false);
+        }
+        if (m_file == NO_FILE)
+            return Fail("Can't open " + filePath + ": " + SystemError());
+
+        m_stats.backend = options.backend;
+        if (m_stats.backend == ASYNC_AUTO)
+            m_stats.backend = IoUringAvailable() ? ASYNC_IO_URING : ASYNC_THREAD_POOL;
+#ifdef SATPROP_HAVE_IO_URING
+        if (m_stats.backend == ASYNC_IO_URING)
+        {
+            m_ring = new Ring();
+            if (!m_ring->Setup((unsigned)m_options.buffers))
+            {
+                delete m_ring;
+                m_ring = nullptr;
+                m_stats.backend = ASYNC_THREAD_POOL;
+            }
+        }
+#else
+        if (m_stats.backend == ASYNC_IO_URING)
+            m_stats.backend = ASYNC_THREAD_POOL;
+#endif
+
+        for (int b = 0; b < m_options.buffers; b++)
+        {
+            Buffer* buffer = new Buffer();
+            buffer->index = (size_t)b;
+            buffer->capacity = m_options.bufferBytes;
+            buffer->data = AllocAligned(buffer->capacity);
+            m_buffers.push_back(buffer);
+            if (!buffer->data)
+            {
+                Release();
+                return Fail("Out of memory for the buffers of " + filePath);
+            }
+        }
+
+        m_open = true;
+        return true;
+    }
+
+    bool AsyncFileWriter::Write(const void* data, size_t size)
+    {
+        if (!m_open || m_failed)
+            return false;
+
+        const char* in = (const char*)data;
+        while (size > 0)
+        {
+            Buffer& buffer = *m_buffers[m_current];
+            size_t chunk = std::min(size, buffer.capacity - m_used);
+            memcpy(buffer.data + m_used, in, chunk);
+            m_used += chunk;
+            in += chunk;
+            size -= chunk;
+            if (m_used == buffer.capacity && !Flip())
+                return false;
+        }
+        return true;
+    }
+
+    bool AsyncFileWriter::Printf(const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        bool ok = VPrintf(format, args);
+        va_end(args);
+        return ok;
+    }
+
+    bool AsyncFileWriter::VPrintf(const char* format, va_list args)
+    {
+        if (!m_open || m_failed)
+            return false;
+
+        // straight into the buffer when it fits, the terminator lands in the free space
+        Buffer& buffer = *m_buffers[m_current];
+        size_t space = buffer.capacity - m_used;
+        va_list copy;
+        va_copy(copy, args);
+        int length = vsnprintf(buffer.data + m_used, space, format, copy);
+        va_end(copy);
+        if (length < 0)
+            return Fail("Bad format string writing " + m_path);
+        if ((size_t)length < space)
+        {
+            m_used += (size_t)length;
+            return true;
+        }
+
+        m_format.resize((size_t)length + 1);
+        vsnprintf(m_format.data(), m_format.size(), format, args);
+        return Write(m_format.data(), (size_t)length);
+    }
+
+    bool AsyncFileWriter::Flip()
+    {
+        if (!Submit(*m_buffers[m_current], m_used))
+            return false;
+        m_fileOffset += m_used;
+        m_used = 0;
+        m_current = (m_current + 1) % m_buffers.size();
+        return WaitFor(*m_buffers[m_current]);
+    }
+
+    bool AsyncFileWriter::Submit(Buffer& buffer, size_t size)
+    {
+        buffer.offset = m_fileOffset;
+        buffer.payload = size;
+        buffer.size = size;
+        if (m_stats.direct && size % DIRECT_ALIGNMENT != 0)
+        {
+            // only the last buffer of a file is partial
+            buffer.size = AlignUp(size, DIRECT_ALIGNMENT);
+            memset(buffer.data + size, 0, buffer.size - size);
+        }
+        m_stats.submissions++;
+
+#ifdef SATPROP_HAVE_IO_URING
+        if (m_ring)
+        {
+            buffer.iov.iov_base = buffer.data;
+            buffer.iov.iov_len = buffer.size;
+            buffer.inFlight = true;
+            if (!m_ring->Push((int)m_file, &buffer.iov, buffer.offset, buffer.index))
+            {
+                buffer.inFlight = false;
+                return Fail("io_uring submission failed for " + m_path + ": " + SystemError());
+            }
+            return true;
+        }
+#endif
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            buffer.inFlight = true;
+        }
+        Buffer* target = &buffer;
+        IoThreadPool::Instance().Post([this, target]()
+        {
+            int64_t result = WriteAt(m_file, target->data, target->size, target->offset,
+                                     m_stats.direct ? DIRECT_ALIGNMENT : 1);
+            Complete(*target, result < 0 ? -1 : result);
+        });
+        return true;
+    }
+
+    void AsyncFileWriter::Complete(Buffer& buffer, int64_t result)
+    {
+        std::string error;
+        if (result >= 0 && (size_t)result < buffer.size)
+        {
+            // a short write from the ring, finish it in place from an offset direct I/O takes
+            size_t alignment = m_stats.direct ? DIRECT_ALIGNMENT : 1;
+            size_t done = (size_t)result - (size_t)result % alignment;
+            int64_t rest = WriteAt(m_file, buffer.data + done, buffer.size - done, buffer.offset + done, alignment);
+            result = rest < 0 ? -1 : (int64_t)(done + rest);
+        }
+        if (result < 0)
+            error = "Failed to write " + m_path + ": " + SystemError();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            buffer.inFlight = false;
+            if (!error.empty() && !m_failed)
+            {
+                m_error = error;
+                m_failed = true;
+            }
+        }
+        m_completed.notify_all();
+    }
+
+    bool AsyncFileWriter::Reap(bool wait)
+    {
+#ifdef SATPROP_HAVE_IO_URING
+        if (wait && !m_ring->Wait())
+            return Fail("io_uring wait failed for " + m_path + ": " + SystemError());
+
+        unsigned head = *m_ring->cqHead;
+        while (head != __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe& cqe = m_ring->cqes[head & *m_ring->cqMask];
+            Buffer& buffer = *m_buffers[(size_t)cqe.user_data];
+            int result = cqe.res;
+            head++;
+            __atomic_store_n(m_ring->cqHead, head, __ATOMIC_RELEASE);
+            if (result < 0)
+                errno = -result;
+            Complete(buffer, result < 0 ? -1 : result);
+        }
+#else
+        (void)wait;
+#endif
+        return true;
+    }
+
+    bool AsyncFileWriter::WaitFor(Buffer& buffer)
+    {
+        auto start = Clock::now();
+        bool waited = false;
+        if (m_ring)
+        {
+            // a failed write doesn't end this, the buffer is the kernel's until it completes
+            while (buffer.inFlight)
+            {
+                waited = true;
+                if (!Reap(true))
+                    break;
+            }
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            waited = buffer.inFlight;
+            m_completed.wait(lock, [&]() { return !buffer.inFlight; });
+        }
+        if (waited)
+            m_stats.stallSeconds += Since(start);
+        return !m_failed;
+    }
+
+    bool AsyncFileWriter::WaitAll()
+    {
+        for (Buffer* buffer : m_buffers)
+            WaitFor(*buffer);
+        return !m_failed;
+    }
+
+    bool AsyncFileWriter::Close()
+    {
+        if (!m_open)
+            return false;
+        m_open = false;
+
+        uint64_t size = m_fileOffset + m_used;
+        if (m_used > 0 && !m_failed)
+            Submit(*m_buffers[m_current], m_used);
+        WaitAll();
+
+        if (!m_failed && m_stats.direct && size % DIRECT_ALIGNMENT != 0 && !TruncateNative(m_file, size))
+            Fail("Can't truncate " + m_path + ": " + SystemError());
+        if (!CloseNative(m_file) && !m_failed)
+            Fail("Failed to close " + m_path + ": " + SystemError());
+        m_file = NO_FILE;
+
+        Release();
+        m_stats.bytes = size;
+        m_stats.seconds = Since(m_opened);
+        return !m_failed;
+    }
+
+    bool AsyncFileWriter::Fail(const std::string& error)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_failed)
+        {
+            m_error = error;
+            m_failed = true;
+        }
+        return false;
+    }
+
+    void AsyncFileWriter::Release()
+    {
+        for (Buffer* buffer : m_buffers)
+        {
+            // only when the ring itself broke; the kernel may still read it, so it's left be
+            if (buffer->inFlight)
+                continue;
+            FreeAligned(buffer->data);
+            delete buffer;
+        }
+        m_buffers.clear();
+        delete m_ring;
+        m_ring = nullptr;
+        if (m_file != NO_FILE)
+        {
+            CloseNative(m_file);
+            m_file = NO_FILE;
+        }
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,128 @@
+//
+// AsyncFileWriter.h
+// Double buffered file output submitted through io_uring or a pool of positional writes
+//
+
+#ifndef ASYNCFILEWRITER_H
+#define ASYNCFILEWRITER_H
+
+#include <stdarg.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// io_uring is driven through its system calls, so only the kernel headers are needed
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SATPROP_HAVE_IO_URING 1
+#endif
+#endif
+
+namespace SGP_IMPL {
+
+    enum AsyncBackend
+    {
+        ASYNC_AUTO = 0,         // io_uring when the kernel allows it, else the thread pool
+        ASYNC_IO_URING,
+        ASYNC_THREAD_POOL,      // pwrite / positioned WriteFile on shared I/O threads
+        NUM_ASYNC_BACKENDS
+    };
+
+    struct AsyncWriteOptions
+    {
+        size_t bufferBytes = 8 << 20;   // rounded up to a multiple of DIRECT_ALIGNMENT
+        int buffers = 2;                // one filling while the others are on their way to disk
+        bool direct = true;             // bypass the page cache when the file system supports it
+        AsyncBackend backend = ASYNC_AUTO;
+    };
+
+    struct AsyncWriteStats
+    {
+        AsyncBackend backend = ASYNC_AUTO;
+        bool direct = false;
+        uint64_t bytes = 0;             // file size at Close()
+        uint64_t submissions = 0;
+        double stallSeconds = 0.0;      // the caller waiting for a free buffer
+        double seconds = 0.0;           // Open() to the end of Close()
+
+        double Throughput() const { return seconds > 0.0 ? bytes / seconds : 0.0; }
+    };
+
+    // Write() copies into the current buffer and returns; a full buffer is handed to the
+    // backend and the next one is filled meanwhile. The caller only waits when every buffer
+    // is still in flight, which is the disk being slower than the producer.
+    //
+    // Full buffers go out at buffer aligned offsets, so direct I/O is used for all but the
+    // tail, which is padded to the alignment and the file truncated to its exact size.
+    // Not thread safe, give each producer thread its own writer or serialize the calls.
+    class AsyncFileWriter
+    {
+    public:
+        static constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+        AsyncFileWriter();
+        ~AsyncFileWriter();
+
+        AsyncFileWriter(const AsyncFileWriter&) = delete;
+        AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+        // Creates or truncates the file
+        bool Open(const std::string& filePath, const AsyncWriteOptions& options = AsyncWriteOptions());
+
+        // False once any write has failed, see GetError()
+        bool Write(const void* data, size_t size);
+        bool Printf(const char* format, ...);
+        bool VPrintf(const char* format, va_list args);
+
+        // Waits for every buffer, returns false if anything failed since Open()
+        bool Close();
+
+        bool IsOpen() const { return m_open; }
+        uint64_t Position() const { return m_fileOffset + m_used; }
+        const std::string& GetError() const { return m_error; }
+        const AsyncWriteStats& GetStats() const { return m_stats; }
+
+        static const char* BackendName(AsyncBackend backend);
+        static bool IoUringAvailable();
+
+    private:
+        struct Buffer;
+        struct Ring;
+
+        bool Flip();        // sends the full current buffer and moves to the next
+        bool Submit(Buffer& buffer, size_t size);
+        bool WaitFor(Buffer& buffer);
+        bool WaitAll();
+        bool Reap(bool wait);
+        void Complete(Buffer& buffer, int64_t result);
+        bool Fail(const std::string& error);
+        void Release();
+
+        std::string m_path;
+        AsyncWriteOptions m_options;
+        AsyncWriteStats m_stats;
+        std::string m_error;
+        bool m_open = false;
+        std::chrono::steady_clock::time_point m_opened;
+
+        intptr_t m_file = -1;               // fd, or the HANDLE on Windows
+        std::vector<Buffer*> m_buffers;
+        size_t m_current = 0;
+        size_t m_used = 0;                  // bytes in the current buffer
+        uint64_t m_fileOffset = 0;          // where the current buffer goes
+        Ring* m_ring = nullptr;
+
+        // completions from the thread pool
+        std::mutex m_mutex;
+        std::condition_variable m_completed;
+        std::atomic<bool> m_failed{false};
+        std::vector<char> m_format;
+    };
+
+} // SGP_IMPL
+
+#endif //ASYNCFILEWRITER_H
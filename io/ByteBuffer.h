@@ -0,0 +1,106 @@
+//
+// ByteBuffer.h
+// Little helpers for the binary formats: append plain values to a buffer, read them back
+//
+
+#ifndef BYTEBUFFER_H
+#define BYTEBUFFER_H
+
+#include <string.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace SGP_IMPL {
+
+    // Values are copied in native byte order, the formats that use these are only exchanged
+    // between little endian machines
+    class ByteWriter
+    {
+    public:
+        template <typename T>
+        void Put(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const uint8_t* bytes = (const uint8_t*)&value;
+            data.insert(data.end(), bytes, bytes + sizeof(T));
+        }
+
+        // Up to 64 KiB, longer text is cut
+        void PutString(const std::string& text)
+        {
+            uint16_t length = (uint16_t)std::min<size_t>(text.size(), 0xFFFF);
+            Put(length);
+            data.insert(data.end(), text.begin(), text.begin() + length);
+        }
+
+        // Any length
+        void PutBlob(const void* bytes, uint64_t size)
+        {
+            Put(size);
+            data.insert(data.end(), (const uint8_t*)bytes, (const uint8_t*)bytes + size);
+        }
+
+        std::vector<uint8_t> data;
+    };
+
+    // Every getter returns false instead of reading past the end
+    class ByteReader
+    {
+    public:
+        ByteReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+        template <typename T>
+        bool Get(T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (m_pos + sizeof(T) > m_size)
+                return false;
+            memcpy(&value, m_data + m_pos, sizeof(T));
+            m_pos += sizeof(T);
+            return true;
+        }
+
+        bool GetString(std::string& text)
+        {
+            uint16_t length;
+            if (!Get(length) || m_pos + length > m_size)
+                return false;
+            text.assign((const char*)m_data + m_pos, length);
+            m_pos += length;
+            return true;
+        }
+
+        bool GetBlob(std::string& bytes)
+        {
+            uint64_t size;
+            if (!Get(size) || size > m_size - m_pos)
+                return false;
+            bytes.assign((const char*)m_data + m_pos, (size_t)size);
+            m_pos += (size_t)size;
+            return true;
+        }
+
+        bool GetBytes(void* bytes, size_t size)
+        {
+            if (size > m_size - m_pos)
+                return false;
+            memcpy(bytes, m_data + m_pos, size);
+            m_pos += size;
+            return true;
+        }
+
+        size_t Remaining() const { return m_size - m_pos; }
+
+    private:
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_pos = 0;
+    };
+
+} // SGP_IMPL
+
+#endif //BYTEBUFFER_H
@@ -0,0 +1,676 @@
+//
+// EphemerisArchive.cpp
+// Compressed long-term archive of propagated results with a block index for random access
+//
+
+#include "EphemerisArchive.h"
+#include "AsyncFileWriter.h"
+#include "ByteBuffer.h"
+#include "RangeCoder.h"
+#include "../OrbitMath.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <thread>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const uint32_t ARCHIVE_MAGIC = 0x41455053;     // "SPEA"
+        const uint32_t ARCHIVE_VERSION = 1;
+
+        // bit lengths 0..64 of the zigzagged residual
+        constexpr int LENGTH_BITS = 7;
+        constexpr int ERROR_BITS = 3;
+
+        struct BlockModel
+        {
+            uint16_t lengths[NUM_FIELDS][1 << LENGTH_BITS];
+            uint16_t errors[1 << ERROR_BITS];
+
+            BlockModel()
+            {
+                std::fill(&lengths[0][0], &lengths[0][0] + NUM_FIELDS * (1 << LENGTH_BITS), RC_PROB_INIT);
+                std::fill(errors, errors + (1 << ERROR_BITS), RC_PROB_INIT);
+            }
+        };
+
+        inline int64_t ToQuanta(double value, double quantum, int64_t fallback)
+        {
+            // NaN and wild values fall back, which also keeps residuals away from overflow
+            double quanta = value / quantum;
+            return fabs(quanta) < 1e18 ? llround(quanta) : fallback;
+        }
+
+        void TwoBodyAcceleration(const double pos[3], double acc[3])
+        {
+            double r2 = pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2];
+            if (r2 < 1.0)
+            {
+                // failed steps store a zero position
+                acc[0] = acc[1] = acc[2] = 0.0;
+                return;
+            }
+            double scale = -MU_EARTH / (r2 * sqrt(r2));
+            for (int i = 0; i < 3; i++)
+                acc[i] = scale * pos[i];
+        }
+
+        // Predicts every quantized field of a step from the block's previous steps. The writer
+        // and the reader run exactly the same calls in the same order, so the predictions match
+        // bit for bit and only the residuals need storing.
+        class BlockPredictor
+        {
+        public:
+            explicit BlockPredictor(const double* quanta) : m_quanta(quanta) {}
+
+            // row holds the fields before `field` of the current step
+            int64_t Predict(int field, const int64_t* row)
+            {
+                if (m_rows == 0)
+                    return 0;
+
+                const int64_t* last = m_prev[0];
+                int64_t linear = m_rows == 1 ? last[field] : 2 * last[field] - m_prev[1][field];
+                if (field < FIELD_POS || field >= FIELD_LLH)
+                    return linear;
+
+                double dt1 = row[FIELD_DS50] * m_quanta[FIELD_DS50] * 60.0 - m_time[0];
+                double dt0 = m_rows >= 2 ? m_time[0] - m_time[1] : 0.0;
+                if (dt1 == 0.0 || (m_rows >= 2 && dt0 <= 0.0))
+                    return linear;
+
+                int axis = (field - FIELD_POS) % 3;
+                double predicted;
+                if (field < FIELD_VEL)
+                {
+                    // Stoermer-Verlet with the two body acceleration, good to metres at 1 min LEO steps
+                    if (m_rows == 1)
+                        predicted = m_pos[0][axis] + m_vel[0][axis] * dt1 + 0.5 * m_acc[0][axis] * dt1 * dt1;
+                    else
+                        predicted = m_pos[0][axis] + (m_pos[0][axis] - m_pos[1][axis]) * dt1 / dt0 +
+                                    0.5 * m_acc[0][axis] * dt1 * (dt1 + dt0);
+                }
+                else
+                {
+                    // trapezoid on the acceleration at the position just decoded, plus the
+                    // previous step's trapezoid error scaled to this step
+                    if (field == FIELD_VEL)
+                    {
+                        double pos[3];
+                        for (int i = 0; i < 3; i++)
+                            pos[i] = row[FIELD_POS + i] * m_quanta[FIELD_POS + i];
+                        TwoBodyAcceleration(pos, m_accNow);
+                    }
+                    predicted = m_vel[0][axis] + 0.5 * dt1 * (m_acc[0][axis] + m_accNow[axis]);
+                    if (m_rows >= 2)
+                    {
+                        double error = m_vel[0][axis] - m_vel[1][axis] - 0.5 * dt0 * (m_acc[1][axis] + m_acc[0][axis]);
+                        double ratio = dt1 / dt0;
+                        predicted += error * ratio * ratio * ratio;
+                    }
+                }
+                return ToQuanta(predicted, m_quanta[field], linear);
+            }
+
+            void Push(const int64_t* row)
+            {
+                memcpy(m_prev[1], m_prev[0], sizeof(m_prev[0]));
+                memcpy(m_prev[0], row, sizeof(m_prev[0]));
+                m_time[1] = m_time[0];
+                m_time[0] = row[FIELD_DS50] * m_quanta[FIELD_DS50] * 60.0;
+                for (int i = 0; i < 3; i++)
+                {
+                    m_pos[1][i] = m_pos[0][i];
+                    m_vel[1][i] = m_vel[0][i];
+                    m_acc[1][i] = m_acc[0][i];
+                    m_pos[0][i] = row[FIELD_POS + i] * m_quanta[FIELD_POS + i];
+                    m_vel[0][i] = row[FIELD_VEL + i] * m_quanta[FIELD_VEL + i];
+                }
+                TwoBodyAcceleration(m_pos[0], m_acc[0]);
+                m_rows++;
+            }
+
+        private:
+            const double* m_quanta;
+            int m_rows = 0;
+            int64_t m_prev[2][NUM_FIELDS] = {};     // [0] is the last step
+            double m_time[2] = {};                  // s from the block start
+            double m_pos[2][3] = {};
+            double m_vel[2][3] = {};
+            double m_acc[2][3] = {};
+            double m_accNow[3] = {};
+        };
+
+        void EncodeResidual(RangeEncoder& rc, uint16_t* lengthProbs, int64_t residual)
+        {
+            uint64_t zigzag = ((uint64_t)residual << 1) ^ (uint64_t)(residual >> 63);
+            int length = (int)std::bit_width(zigzag);
+            rc.EncodeTree(lengthProbs, LENGTH_BITS, length);
+
+            // the leading one is implied by the length, the bits below it are close to noise
+            int bits = length - 1;
+            if (bits > 32)
+            {
+                rc.EncodeDirect((uint32_t)(zigzag >> 32), bits - 32);
+                rc.EncodeDirect((uint32_t)zigzag, 32);
+            }
+            else if (bits > 0)
+            {
+                rc.EncodeDirect((uint32_t)zigzag, bits);
+            }
+        }
+
+        int64_t DecodeResidual(RangeDecoder& rc, uint16_t* lengthProbs)
+        {
+            int length = (int)rc.DecodeTree(lengthProbs, LENGTH_BITS);
+            if (length == 0)
+                return 0;
+            if (length > 64)
+                length = 64;
+
+            int bits = length - 1;
+            uint64_t zigzag = 1;
+            if (bits > 32)
+            {
+                zigzag = (zigzag << (bits - 32)) | rc.DecodeDirect(bits - 32);
+                zigzag = (zigzag << 32) | rc.DecodeDirect(32);
+            }
+            else if (bits > 0)
+            {
+                zigzag = (zigzag << bits) | rc.DecodeDirect(bits);
+            }
+            return (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        }
+
+        void EncodeBlock(const TimeStepData* steps, const ArchiveBlockInfo& block, const double* quanta,
+                         std::vector<uint8_t>& out)
+        {
+            BlockModel model;
+            BlockPredictor predictor(quanta);
+            RangeEncoder rc(out);
+            int64_t row[NUM_FIELDS];
+
+            for (uint32_t s = 0; s < block.steps; s++)
+            {
+                const TimeStepData& step = steps[s];
+                rc.EncodeTree(model.errors, ERROR_BITS, step.error);
+
+                for (int f = 0; f < NUM_FIELDS; f++)
+                {
+                    double value = f == FIELD_MSE ? step.mse - block.baseMse
+                                 : f == FIELD_DS50 ? (step.ds50UTC - block.baseDs50) * 1440.0
+                                 : EphemerisStore::ReadField(step, (EphemerisField)f);
+                    row[f] = ToQuanta(value, quanta[f], 0);
+                    EncodeResidual(rc, model.lengths[f], row[f] - predictor.Predict(f, row));
+                }
+                predictor.Push(row);
+            }
+            rc.Flush();
+        }
+
+        void DecodeBlock(const uint8_t* payload, size_t size, const ArchiveBlockInfo& block, const double* quanta,
+                         TimeStepData* steps)
+        {
+            BlockModel model;
+            BlockPredictor predictor(quanta);
+            RangeDecoder rc(payload, size);
+            int64_t row[NUM_FIELDS];
+
+            for (uint32_t s = 0; s < block.steps; s++)
+            {
+                TimeStepData step = {};
+                step.error = (StepError)rc.DecodeTree(model.errors, ERROR_BITS);
+
+                for (int f = 0; f < NUM_FIELDS; f++)
+                {
+                    row[f] = predictor.Predict(f, row) + DecodeResidual(rc, model.lengths[f]);
+                    double value = row[f] * quanta[f];
+                    if (f == FIELD_MSE)
+                        step.mse = block.baseMse + value;
+                    else if (f == FIELD_DS50)
+                        step.ds50UTC = block.baseDs50 + value / 1440.0;
+                    else
+                        EphemerisStore::WriteField(step, (EphemerisField)f, value);
+                }
+                predictor.Push(row);
+                steps[s] = step;
+            }
+        }
+
+        // Runs work(i) for i in [0, count) on up to numThreads threads, handing out one i at a time
+        template <typename Work>
+        void ParallelFor(size_t count, int numThreads, Work work)
+        {
+            int threadCount = (int)std::max<size_t>(1, std::min<size_t>(numThreads, count));
+            if (threadCount == 1)
+            {
+                for (size_t i = 0; i < count; i++)
+                    work(i);
+                return;
+            }
+
+            std::atomic<size_t> next{0};
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threadCount; t++)
+            {
+                workers.emplace_back([&]()
+                {
+                    for (size_t i = next++; i < count; i = next++)
+                        work(i);
+                });
+            }
+            for (auto& worker : workers)
+                worker.join();
+        }
+
+        int Seek(FILE* fp, uint64_t offset, int origin)
+        {
+#ifdef _WIN32
+            return _fseeki64(fp, (__int64)offset, origin);
+#else
+            return fseeko(fp, (off_t)offset, origin);
+#endif
+        }
+
+        uint64_t Tell(FILE* fp)
+        {
+#ifdef _WIN32
+            return (uint64_t)_ftelli64(fp);
+#else
+            return (uint64_t)ftello(fp);
+#endif
+        }
+
+        const uint64_t HEADER_BYTES = 4 * sizeof(uint32_t) + NUM_FIELDS * sizeof(double);
+        const uint64_t FOOTER_BYTES = sizeof(uint64_t) + sizeof(uint32_t);
+
+        // Least bytes a table record takes, so that a count from the file can be checked
+        // against what is left of the tables before anything is allocated for it
+        const size_t SATELLITE_RECORD_BYTES = sizeof(int64_t) + sizeof(uint8_t) + 3 * sizeof(uint32_t) +
+                                              2 * sizeof(uint16_t) + sizeof(uint32_t);
+        const size_t ERROR_RECORD_BYTES = sizeof(int32_t) + sizeof(uint8_t) + sizeof(uint32_t) + sizeof(double);
+        const size_t BLOCK_RECORD_BYTES = 3 * sizeof(uint32_t) + 3 * sizeof(double) + sizeof(uint64_t) +
+                                          sizeof(uint32_t);
+
+    } // namespace
+
+    bool EphemerisArchive::Write(const std::string& filePath, const PropagationResults& results, int numThreads,
+                                 ArchiveStats* stats, int blockSteps)
+    {
+        blockSteps = std::clamp(blockSteps, 2, MAX_BLOCK_STEPS);
+
+        double quanta[NUM_FIELDS];
+        for (int f = 0; f < NUM_FIELDS; f++)
+            quanta[f] = EphemerisStore::FieldQuantum((EphemerisField)f);
+
+        // split every satellite into blocks
+        std::vector<ArchiveBlockInfo> blocks;
+        std::vector<const TimeStepData*> blockData;
+        std::vector<ArchiveSatellite> satellites(results.satellites.size());
+        uint64_t totalSteps = 0;
+        for (size_t i = 0; i < results.satellites.size(); i++)
+        {
+            const SatelliteData& sat = results.satellites[i];
+            ArchiveSatellite& entry = satellites[i];
+            entry.steps = (uint32_t)sat.timeSteps.size();
+            entry.firstBlock = (uint32_t)blocks.size();
+            totalSteps += entry.steps;
+
+            for (uint32_t first = 0; first < entry.steps; first += blockSteps)
+            {
+                ArchiveBlockInfo block;
+                block.satellite = (uint32_t)i;
+                block.firstStep = first;
+                block.steps = std::min<uint32_t>(blockSteps, entry.steps - first);
+                block.baseMse = sat.timeSteps[first].mse;
+                block.baseDs50 = sat.timeSteps[first].ds50UTC;
+                block.lastDs50 = sat.timeSteps[first + block.steps - 1].ds50UTC;
+                blocks.push_back(block);
+                blockData.push_back(sat.timeSteps.data() + first);
+            }
+            entry.blockCount = (uint32_t)blocks.size() - entry.firstBlock;
+        }
+
+        std::vector<std::vector<uint8_t>> payloads(blocks.size());
+        ParallelFor(blocks.size(), numThreads, [&](size_t b)
+        {
+            EncodeBlock(blockData[b], blocks[b], quanta, payloads[b]);
+        });
+
+        AsyncFileWriter out;
+        if (!out.Open(filePath))
+            return false;
+
+        ByteWriter header;
+        header.Put(ARCHIVE_MAGIC);
+        header.Put(ARCHIVE_VERSION);
+        header.Put((uint32_t)NUM_FIELDS);
+        header.Put((uint32_t)blockSteps);
+        for (double quantum : quanta)
+            header.Put(quantum);
+        out.Write(header.data.data(), header.data.size());
+
+        uint64_t offset = header.data.size();
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            blocks[b].offset = offset;
+            blocks[b].bytes = (uint32_t)payloads[b].size();
+            out.Write(payloads[b].data(), payloads[b].size());
+            offset += payloads[b].size();
+        }
+
+        ByteWriter tables;
+        tables.Put((uint32_t)satellites.size());
+        for (size_t i = 0; i < satellites.size(); i++)
+        {
+            const SatelliteData& sat = results.satellites[i];
+            const ArchiveSatellite& entry = satellites[i];
+            tables.Put((int64_t)sat.satKey);
+            tables.Put((uint8_t)(sat.propagationSuccess ? 1 : 0));
+            tables.Put(entry.steps);
+            tables.Put(entry.firstBlock);
+            tables.Put(entry.blockCount);
+            tables.PutString(sat.line1);
+            tables.PutString(sat.line2);
+            tables.Put((uint32_t)sat.errors.size());
+            for (const auto& record : sat.errors)
+            {
+                tables.Put((int32_t)record.step);
+                tables.Put((uint8_t)record.code);
+                tables.Put(record.message);
+                tables.Put(record.value);
+            }
+        }
+
+        tables.Put((uint32_t)results.messages.Size());
+        for (size_t m = 1; m <= results.messages.Size(); m++)
+            tables.PutString(results.messages.Get((uint32_t)m));
+
+        tables.Put((uint32_t)blocks.size());
+        for (const auto& block : blocks)
+        {
+            tables.Put(block.satellite);
+            tables.Put(block.firstStep);
+            tables.Put(block.steps);
+            tables.Put(block.baseMse);
+            tables.Put(block.baseDs50);
+            tables.Put(block.lastDs50);
+            tables.Put(block.offset);
+            tables.Put(block.bytes);
+        }
+
+        tables.Put(offset);
+        tables.Put(ARCHIVE_MAGIC);
+        out.Write(tables.data.data(), tables.data.size());
+        bool ok = out.Close();
+
+        if (stats)
+        {
+            stats->steps = totalSteps;
+            stats->rawBytes = totalSteps * (NUM_FIELDS * sizeof(double) + 1);
+            stats->compressedBytes = offset + tables.data.size();
+            stats->blocks = blocks.size();
+        }
+        return ok;
+    }
+
+    EphemerisArchiveReader::~EphemerisArchiveReader()
+    {
+        Close();
+    }
+
+    bool EphemerisArchiveReader::Fail(const std::string& error)
+    {
+        m_error = error;
+        return false;
+    }
+
+    void EphemerisArchiveReader::Close()
+    {
+        if (m_file)
+            fclose(m_file);
+        m_file = nullptr;
+        m_satellites.clear();
+        m_messages.clear();
+        m_blocks.clear();
+        m_stats = ArchiveStats();
+    }
+
+    bool EphemerisArchiveReader::Open(const std::string& filePath)
+    {
+        Close();
+        m_error.clear();
+
+        m_file = fopen(filePath.c_str(), "rb");
+        if (!m_file)
+            return Fail("Failed to open " + filePath);
+
+        uint8_t headerBytes[HEADER_BYTES];
+        if (fread(headerBytes, 1, sizeof(headerBytes), m_file) != sizeof(headerBytes))
+            return Fail("Archive header is truncated");
+
+        ByteReader header(headerBytes, sizeof(headerBytes));
+        uint32_t magic, version, fields, blockSteps;
+        header.Get(magic);
+        header.Get(version);
+        header.Get(fields);
+        header.Get(blockSteps);
+        if (magic != ARCHIVE_MAGIC)
+            return Fail("Not an ephemeris archive");
+        if (version != ARCHIVE_VERSION || fields != NUM_FIELDS)
+            return Fail("Unsupported archive version");
+        if (blockSteps == 0 || blockSteps > (uint32_t)EphemerisArchive::MAX_BLOCK_STEPS)
+            return Fail("Archive header is damaged");
+        for (double& quantum : m_quanta)
+            header.Get(quantum);
+        m_blockSteps = (int)blockSteps;
+        m_payloadStart = HEADER_BYTES;
+
+        Seek(m_file, 0, SEEK_END);
+        uint64_t fileSize = Tell(m_file);
+        if (fileSize < HEADER_BYTES + FOOTER_BYTES)
+            return Fail("Archive is truncated");
+
+        uint8_t footerBytes[FOOTER_BYTES];
+        Seek(m_file, fileSize - FOOTER_BYTES, SEEK_SET);
+        if (fread(footerBytes, 1, sizeof(footerBytes), m_file) != sizeof(footerBytes))
+            return Fail("Archive footer is truncated");
+        ByteReader footer(footerBytes, sizeof(footerBytes));
+        footer.Get(m_tablesOffset);
+        footer.Get(magic);
+        if (magic != ARCHIVE_MAGIC || m_tablesOffset < HEADER_BYTES || m_tablesOffset > fileSize - FOOTER_BYTES)
+            return Fail("Archive footer is damaged");
+
+        std::vector<uint8_t> tableBytes(fileSize - FOOTER_BYTES - m_tablesOffset);
+        Seek(m_file, m_tablesOffset, SEEK_SET);
+        if (fread(tableBytes.data(), 1, tableBytes.size(), m_file) != tableBytes.size())
+            return Fail("Archive tables are truncated");
+
+        ByteReader tables(tableBytes.data(), tableBytes.size());
+        uint32_t count;
+        if (!tables.Get(count))
+            return Fail("Archive tables are damaged");
+        if (count > tables.Remaining() / SATELLITE_RECORD_BYTES)
+            return Fail("Archive satellite table is damaged");
+        m_satellites.resize(count);
+        for (auto& sat : m_satellites)
+        {
+            int64_t key;
+            uint8_t success;
+            uint32_t errors;
+            bool ok = tables.Get(key) && tables.Get(success) && tables.Get(sat.steps) && tables.Get(sat.firstBlock) &&
+                      tables.Get(sat.blockCount) && tables.GetString(sat.line1) && tables.GetString(sat.line2) &&
+                      tables.Get(errors) && errors <= tables.Remaining() / ERROR_RECORD_BYTES;
+            if (ok)
+                sat.errors.reserve(errors);
+            for (uint32_t e = 0; ok && e < errors; e++)
+            {
+                int32_t step;
+                uint8_t code;
+                StepErrorRecord record;
+                // an init failure is recorded at step 0 of a satellite without steps
+                ok = tables.Get(step) && tables.Get(code) && tables.Get(record.message) && tables.Get(record.value) &&
+                     step >= 0 && (uint32_t)step <= sat.steps && code < NUM_STEP_ERRORS;
+                record.step = step;
+                record.code = (StepError)code;
+                sat.errors.push_back(record);
+            }
+            if (!ok)
+                return Fail("Archive satellite table is damaged");
+            sat.satKey = key;
+            sat.propagationSuccess = success != 0;
+            m_stats.steps += sat.steps;
+        }
+
+        if (!tables.Get(count))
+            return Fail("Archive message table is damaged");
+        if (count > tables.Remaining() / sizeof(uint16_t))
+            return Fail("Archive message table is damaged");
+        m_messages.assign(1, std::string());
+        m_messages.reserve((size_t)count + 1);
+        for (uint32_t m = 0; m < count; m++)
+        {
+            std::string message;
+            if (!tables.GetString(message))
+                return Fail("Archive message table is damaged");
+            m_messages.push_back(message);
+        }
+        for (const auto& sat : m_satellites)
+        {
+            for (const auto& record : sat.errors)
+            {
+                if (record.message >= m_messages.size())
+                    return Fail("Archive satellite table is damaged");
+            }
+        }
+
+        if (!tables.Get(count))
+            return Fail("Archive block index is damaged");
+        if (count > tables.Remaining() / BLOCK_RECORD_BYTES)
+            return Fail("Archive block index is damaged");
+        m_blocks.resize(count);
+        for (auto& block : m_blocks)
+        {
+            bool ok = tables.Get(block.satellite) && tables.Get(block.firstStep) && tables.Get(block.steps) &&
+                      tables.Get(block.baseMse) && tables.Get(block.baseDs50) && tables.Get(block.lastDs50) &&
+                      tables.Get(block.offset) && tables.Get(block.bytes);
+            // everything the decoder will index with is checked once here
+            if (!ok || block.satellite >= m_satellites.size() || block.steps == 0 || block.steps > blockSteps ||
+                (uint64_t)block.firstStep + block.steps > m_satellites[block.satellite].steps ||
+                block.offset < m_payloadStart || block.offset + block.bytes > m_tablesOffset)
+                return Fail("Archive block index is damaged");
+        }
+
+        // a satellite's blocks cover its steps from the first on, so its step count is no
+        // more than its blocks can hold, and that's what ReadAll allocates
+        for (uint32_t s = 0; s < (uint32_t)m_satellites.size(); s++)
+        {
+            const ArchiveSatellite& sat = m_satellites[s];
+            if ((uint64_t)sat.firstBlock + sat.blockCount > m_blocks.size())
+                return Fail("Archive satellite table is damaged");
+
+            uint64_t covered = 0;
+            for (uint32_t b = sat.firstBlock; b < sat.firstBlock + sat.blockCount; b++)
+            {
+                const ArchiveBlockInfo& block = m_blocks[b];
+                if (block.satellite != s || block.firstStep != covered)
+                    return Fail("Archive block index is damaged");
+                covered += block.steps;
+            }
+            if (covered != sat.steps)
+                return Fail("Archive satellite table is damaged");
+        }
+
+        m_stats.rawBytes = m_stats.steps * (NUM_FIELDS * sizeof(double) + 1);
+        m_stats.compressedBytes = fileSize;
+        m_stats.blocks = m_blocks.size();
+        return true;
+    }
+
+    bool EphemerisArchiveReader::ReadBlock(const ArchiveBlockInfo& block, std::vector<uint8_t>& payload)
+    {
+        payload.resize(block.bytes);
+        if (Seek(m_file, block.offset, SEEK_SET) != 0 ||
+            fread(payload.data(), 1, payload.size(), m_file) != payload.size())
+            return Fail("Failed to read archive block");
+        return true;
+    }
+
+    bool EphemerisArchiveReader::ReadRange(int satellite, double startDs50, double stopDs50,
+                                           std::vector<TimeStepData>& steps)
+    {
+        steps.clear();
+        if (!m_file || satellite < 0 || satellite >= (int)m_satellites.size())
+            return Fail("No such satellite in the archive");
+
+        double lo = std::min(startDs50, stopDs50);
+        double hi = std::max(startDs50, stopDs50);
+
+        const ArchiveSatellite& sat = m_satellites[satellite];
+        std::vector<uint8_t> payload;
+        std::vector<TimeStepData> decoded;
+        for (uint32_t b = sat.firstBlock; b < sat.firstBlock + sat.blockCount; b++)
+        {
+            const ArchiveBlockInfo& block = m_blocks[b];
+            // steps may run backwards in time, so compare against both ends
+            if (std::max(block.baseDs50, block.lastDs50) < lo || std::min(block.baseDs50, block.lastDs50) > hi)
+                continue;
+
+            if (!ReadBlock(block, payload))
+                return false;
+            decoded.resize(block.steps);
+            DecodeBlock(payload.data(), payload.size(), block, m_quanta, decoded.data());
+            for (const auto& step : decoded)
+            {
+                if (step.ds50UTC >= lo && step.ds50UTC <= hi)
+                    steps.push_back(step);
+            }
+        }
+        return true;
+    }
+
+    bool EphemerisArchiveReader::ReadAll(PropagationResults& results, int numThreads)
+    {
+        if (!m_file)
+            return Fail("No archive is open");
+
+        // one read for every payload, the decoding is what gets spread over threads
+        std::vector<uint8_t> payloads(m_tablesOffset - m_payloadStart);
+        if (Seek(m_file, m_payloadStart, SEEK_SET) != 0 ||
+            fread(payloads.data(), 1, payloads.size(), m_file) != payloads.size())
+            return Fail("Failed to read archive blocks");
+
+        results = PropagationResults();
+        results.arena = std::make_shared<ResultArena>(m_stats.steps * sizeof(TimeStepData));
+        results.totalSatellites = (int)m_satellites.size();
+        results.overallSuccess = true;
+        for (size_t m = 1; m < m_messages.size(); m++)
+            results.messages.Intern(m_messages[m].c_str());
+
+        results.satellites.reserve(m_satellites.size());
+        for (const auto& entry : m_satellites)
+        {
+            SatelliteData& sat = results.satellites.emplace_back(results.arena.get());
+            sat.satKey = entry.satKey;
+            sat.line1 = entry.line1;
+            sat.line2 = entry.line2;
+            sat.propagationSuccess = entry.propagationSuccess;
+            sat.errors = entry.errors;
+            sat.timeSteps.resize(entry.steps);
+        }
+
+        // every block fills its own slice of one satellite's steps
+        ParallelFor(m_blocks.size(), numThreads, [&](size_t b)
+        {
+            const ArchiveBlockInfo& block = m_blocks[b];
+            DecodeBlock(payloads.data() + (block.offset - m_payloadStart), block.bytes, block, m_quanta,
+                        results.satellites[block.satellite].timeSteps.data() + block.firstStep);
+        });
+        return true;
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,126 @@
+//
+// EphemerisArchive.h
+// Compressed long-term archive of propagated results with a block index for random access
+//
+
+#ifndef EPHEMERISARCHIVE_H
+#define EPHEMERISARCHIVE_H
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../PropResults.h"
+#include "../EphemerisStore.h"
+
+namespace SGP_IMPL {
+
+    // File layout (native little endian):
+    //   header    "SPEA", version, field count, block steps, the quantum of every field
+    //   blocks    range coded payloads, back to back
+    //   tables    satellites (keys, TLE lines, error records), error messages, block index
+    //   footer    offset of the tables, "SPEA"
+    //
+    // A block holds up to blockSteps consecutive steps of one satellite and decodes on its
+    // own, so any (satellite, time range) only touches the blocks that overlap it and whole
+    // archives decode in parallel. Values are quantized as in EphemerisStore's fixed mode
+    // and predicted from the previous steps of the block: positions and velocities with a
+    // two body step, everything else by second differences. The residuals go through an
+    // adaptive range coder with per field bit length models.
+    //
+    // The predictor is plain IEEE arithmetic that the writer and reader share, archives are
+    // meant to be read back by the same build family that wrote them.
+
+    struct ArchiveBlockInfo
+    {
+        uint32_t satellite = 0;
+        uint32_t firstStep = 0;
+        uint32_t steps = 0;
+        double baseMse = 0.0;       // time fields of the block are relative to its first step
+        double baseDs50 = 0.0;
+        double lastDs50 = 0.0;
+        uint64_t offset = 0;        // payload position in the file
+        uint32_t bytes = 0;
+    };
+
+    struct ArchiveSatellite
+    {
+        __int64 satKey = 0;
+        std::string line1;
+        std::string line2;
+        bool propagationSuccess = false;
+        uint32_t steps = 0;
+        uint32_t firstBlock = 0;
+        uint32_t blockCount = 0;
+        std::vector<StepErrorRecord> errors;
+    };
+
+    struct ArchiveStats
+    {
+        uint64_t steps = 0;
+        uint64_t rawBytes = 0;          // the numeric fields as doubles plus the error code
+        uint64_t compressedBytes = 0;   // the whole file
+        size_t blocks = 0;
+
+        double Ratio() const { return compressedBytes ? (double)rawBytes / compressedBytes : 0.0; }
+    };
+
+    class EphemerisArchive
+    {
+    public:
+        static constexpr int DEFAULT_BLOCK_STEPS = 256;
+        static constexpr int MAX_BLOCK_STEPS = 1 << 16;     // readers refuse longer blocks
+
+        // Blocks are compressed on numThreads threads and written in order.
+        // Returns false when the file can't be written.
+        static bool Write(const std::string& filePath, const PropagationResults& results, int numThreads = 1,
+                          ArchiveStats* stats = nullptr, int blockSteps = DEFAULT_BLOCK_STEPS);
+    };
+
+    // Not thread safe itself, ReadAll uses threads internally
+    class EphemerisArchiveReader
+    {
+    public:
+        EphemerisArchiveReader() = default;
+        ~EphemerisArchiveReader();
+
+        EphemerisArchiveReader(const EphemerisArchiveReader&) = delete;
+        EphemerisArchiveReader& operator=(const EphemerisArchiveReader&) = delete;
+
+        // Reads the header and tables only
+        bool Open(const std::string& filePath);
+        void Close();
+
+        const std::string& GetError() const { return m_error; }
+        const ArchiveStats& GetStats() const { return m_stats; }
+
+        int SatelliteCount() const { return (int)m_satellites.size(); }
+        const ArchiveSatellite& GetSatellite(int satellite) const { return m_satellites[satellite]; }
+        const std::vector<ArchiveBlockInfo>& GetBlocks() const { return m_blocks; }
+
+        // Steps of one satellite with ds50UTC in [startDs50, stopDs50], reading only the
+        // blocks that overlap the range
+        bool ReadRange(int satellite, double startDs50, double stopDs50, std::vector<TimeStepData>& steps);
+
+        // The whole archive as propagation results, blocks decoded on numThreads threads
+        bool ReadAll(PropagationResults& results, int numThreads = 1);
+
+    private:
+        bool ReadBlock(const ArchiveBlockInfo& block, std::vector<uint8_t>& payload);
+        bool Fail(const std::string& error);
+
+        FILE* m_file = nullptr;
+        std::string m_error;
+        int m_blockSteps = 0;
+        double m_quanta[NUM_FIELDS] = {};
+        uint64_t m_payloadStart = 0;
+        uint64_t m_tablesOffset = 0;
+        std::vector<ArchiveSatellite> m_satellites;
+        std::vector<std::string> m_messages;    // [0] is the empty message
+        std::vector<ArchiveBlockInfo> m_blocks;
+        ArchiveStats m_stats;
+    };
+
+} // SGP_IMPL
+
+#endif //EPHEMERISARCHIVE_H
@@ -0,0 +1,187 @@
+//
+// RangeCoder.h
+// Adaptive binary range coder, the entropy stage of the ephemeris archive
+//
+
+#ifndef RANGECODER_H
+#define RANGECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SGP_IMPL {
+
+    // Same scheme as LZMA's coder: 11 bit probabilities that adapt by 1/32 per coded bit, carry
+    // propagation through a cached byte. Symbols are coded through bit trees, so a model is
+    // just an array of probabilities that both sides start from RC_PROB_INIT.
+    constexpr int RC_PROB_BITS = 11;
+    constexpr uint16_t RC_PROB_INIT = 1 << (RC_PROB_BITS - 1);
+    constexpr int RC_MOVE_BITS = 5;
+    constexpr uint32_t RC_TOP = 1u << 24;
+
+    class RangeEncoder
+    {
+    public:
+        explicit RangeEncoder(std::vector<uint8_t>& out) : m_out(out) {}
+
+        void EncodeBit(uint16_t& prob, int bit)
+        {
+            uint32_t bound = (m_range >> RC_PROB_BITS) * prob;
+            if (bit == 0)
+            {
+                m_range = bound;
+                prob += ((1 << RC_PROB_BITS) - prob) >> RC_MOVE_BITS;
+            }
+            else
+            {
+                m_low += bound;
+                m_range -= bound;
+                prob -= prob >> RC_MOVE_BITS;
+            }
+            Normalize();
+        }
+
+        // Fixed probability 1/2, for bits that carry no pattern
+        void EncodeDirect(uint32_t value, int bits)
+        {
+            while (bits > 0)
+            {
+                bits--;
+                m_range >>= 1;
+                m_low += m_range & (0u - ((value >> bits) & 1));
+                Normalize();
+            }
+        }
+
+        // Most significant bit first, probs has 1 << bits entries
+        void EncodeTree(uint16_t* probs, int bits, uint32_t symbol)
+        {
+            uint32_t node = 1;
+            while (bits > 0)
+            {
+                bits--;
+                int bit = (symbol >> bits) & 1;
+                EncodeBit(probs[node], bit);
+                node = (node << 1) | bit;
+            }
+        }
+
+        void Flush()
+        {
+            for (int i = 0; i < 5; i++)
+                ShiftLow();
+        }
+
+    private:
+        void Normalize()
+        {
+            while (m_range < RC_TOP)
+            {
+                m_range <<= 8;
+                ShiftLow();
+            }
+        }
+
+        void ShiftLow()
+        {
+            if ((uint32_t)m_low < 0xFF000000u || (m_low >> 32) != 0)
+            {
+                uint8_t carry = (uint8_t)(m_low >> 32);
+                uint8_t temp = m_cache;
+                do
+                {
+                    m_out.push_back((uint8_t)(temp + carry));
+                    temp = 0xFF;
+                } while (--m_cacheSize != 0);
+                m_cache = (uint8_t)(m_low >> 24);
+            }
+            m_cacheSize++;
+            m_low = (m_low & 0x00FFFFFFu) << 8;
+        }
+
+        std::vector<uint8_t>& m_out;
+        uint64_t m_low = 0;
+        uint32_t m_range = 0xFFFFFFFFu;
+        uint8_t m_cache = 0;
+        uint64_t m_cacheSize = 1;
+    };
+
+    class RangeDecoder
+    {
+    public:
+        // Reading past the end yields zero bytes, so a truncated block decodes to garbage
+        // rather than out of bounds
+        RangeDecoder(const uint8_t* data, size_t size) : m_data(data), m_size(size)
+        {
+            for (int i = 0; i < 5; i++)
+                m_code = (m_code << 8) | Next();
+        }
+
+        int DecodeBit(uint16_t& prob)
+        {
+            uint32_t bound = (m_range >> RC_PROB_BITS) * prob;
+            int bit;
+            if (m_code < bound)
+            {
+                m_range = bound;
+                prob += ((1 << RC_PROB_BITS) - prob) >> RC_MOVE_BITS;
+                bit = 0;
+            }
+            else
+            {
+                m_code -= bound;
+                m_range -= bound;
+                prob -= prob >> RC_MOVE_BITS;
+                bit = 1;
+            }
+            Normalize();
+            return bit;
+        }
+
+        uint32_t DecodeDirect(int bits)
+        {
+            uint32_t value = 0;
+            while (bits > 0)
+            {
+                bits--;
+                m_range >>= 1;
+                uint32_t bit = m_code >= m_range ? 1 : 0;
+                if (bit)
+                    m_code -= m_range;
+                value = (value << 1) | bit;
+                Normalize();
+            }
+            return value;
+        }
+
+        uint32_t DecodeTree(uint16_t* probs, int bits)
+        {
+            uint32_t node = 1;
+            for (int i = 0; i < bits; i++)
+                node = (node << 1) | DecodeBit(probs[node]);
+            return node - (1u << bits);
+        }
+
+    private:
+        uint8_t Next() { return m_pos < m_size ? m_data[m_pos++] : 0; }
+
+        void Normalize()
+        {
+            while (m_range < RC_TOP)
+            {
+                m_range <<= 8;
+                m_code = (m_code << 8) | Next();
+            }
+        }
+
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_pos = 0;
+        uint32_t m_range = 0xFFFFFFFFu;
+        uint32_t m_code = 0;
+    };
+
+} // SGP_IMPL
+
+#endif //RANGECODER_H
@@ -0,0 +1,262 @@
+//
+// ResultStream.cpp
+// Exact binary form of propagation results, for files and for shards sent between processes
+//
+
+#include "ResultStream.h"
+#include "AsyncFileWriter.h"
+#include <stdio.h>
+#include <string.h>
+#include <cstddef>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        const uint32_t STREAM_MAGIC = 0x53525053;      // "SPRS"
+        const uint32_t STREAM_VERSION = 1;
+
+        // mse through meanMotion are one block of doubles
+        const size_t STEP_FIELD_BYTES = offsetof(TimeStepData, meanMotion) + sizeof(double);
+        static_assert(offsetof(TimeStepData, mse) == 0);
+        static_assert(STEP_FIELD_BYTES == 27 * sizeof(double));
+
+        bool ReadExact(FILE* fp, void* data, size_t size)
+        {
+            return fread(data, 1, size, fp) == size;
+        }
+
+    } // namespace
+
+    void ResultStream::WriteSatellite(ByteWriter& out, const SatelliteData& satellite)
+    {
+        out.Put(satellite.satKey);
+        out.PutString(satellite.line1);
+        out.PutString(satellite.line2);
+        out.Put((uint8_t)satellite.propagationSuccess);
+
+        uint32_t steps = (uint32_t)satellite.timeSteps.size();
+        out.Put(steps);
+        out.data.reserve(out.data.size() + steps * (STEP_FIELD_BYTES + 1));
+        for (const TimeStepData& step : satellite.timeSteps)
+        {
+            const uint8_t* fields = (const uint8_t*)&step;
+            out.data.insert(out.data.end(), fields, fields + STEP_FIELD_BYTES);
+            out.Put((uint8_t)step.error);
+        }
+
+        out.Put((uint32_t)satellite.errors.size());
+        for (const StepErrorRecord& record : satellite.errors)
+        {
+            out.Put((int32_t)record.step);
+            out.Put((uint8_t)record.code);
+            out.Put(record.message);
+            out.Put(record.value);
+        }
+    }
+
+    bool ResultStream::ReadSatellite(ByteReader& in, SatelliteData& satellite)
+    {
+        uint8_t success;
+        uint32_t steps;
+        if (!in.Get(satellite.satKey) || !in.GetString(satellite.line1) || !in.GetString(satellite.line2) ||
+            !in.Get(success) || !in.Get(steps))
+            return false;
+        satellite.propagationSuccess = success != 0;
+
+        if (steps > in.Remaining() / (STEP_FIELD_BYTES + 1))
+            return false;
+        satellite.timeSteps.resize(steps);
+        for (TimeStepData& step : satellite.timeSteps)
+        {
+            uint8_t error = 0;
+            in.GetBytes(&step, STEP_FIELD_BYTES);
+            in.Get(error);
+            step.error = (StepError)error;
+        }
+
+        uint32_t errors;
+        if (!in.Get(errors))
+            return false;
+        satellite.errors.clear();
+        satellite.errors.reserve(errors);
+        for (uint32_t i = 0; i < errors; i++)
+        {
+            int32_t step;
+            uint8_t code;
+            StepErrorRecord record;
+            if (!in.Get(step) || !in.Get(code) || !in.Get(record.message) || !in.Get(record.value))
+                return false;
+            record.step = step;
+            record.code = (StepError)code;
+            satellite.errors.push_back(record);
+        }
+        return true;
+    }
+
+    void ResultStream::WriteMessages(ByteWriter& out, const ErrorMessageTable& messages)
+    {
+        out.Put((uint32_t)messages.Size());
+        for (uint32_t id = 1; id <= messages.Size(); id++)
+            out.PutString(messages.Get(id));
+    }
+
+    bool ResultStream::ReadMessages(ByteReader& in, std::vector<std::string>& messages)
+    {
+        uint32_t count;
+        if (!in.Get(count))
+            return false;
+        messages.assign(1, std::string());
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (!in.GetString(messages.emplace_back()))
+                return false;
+        }
+        return true;
+    }
+
+    std::vector<uint32_t> ResultStream::RemapMessages(const std::vector<std::string>& messages, ErrorMessageTable& table)
+    {
+        std::vector<uint32_t> remap(std::max<size_t>(messages.size(), 1), 0);
+        for (size_t id = 1; id < messages.size(); id++)
+            remap[id] = table.Intern(messages[id].c_str());
+        return remap;
+    }
+
+    void ResultStream::ApplyRemap(SatelliteData& satellite, const std::vector<uint32_t>& remap)
+    {
+        for (StepErrorRecord& record : satellite.errors)
+            record.message = record.message < remap.size() ? remap[record.message] : 0;
+    }
+
+    bool ResultStream::WriteFile(const std::string& filePath, const PropagationResults& results)
+    {
+        AsyncFileWriter out;
+        if (!out.Open(filePath))
+            return false;
+
+        ByteWriter header;
+        header.Put(STREAM_MAGIC);
+        header.Put(STREAM_VERSION);
+        header.Put((int32_t)results.totalSatellites);
+        header.Put((uint8_t)results.overallSuccess);
+        header.PutString(results.generalError);
+        WriteMessages(header, results.messages);
+        header.Put((uint32_t)results.satellites.size());
+        bool ok = out.Write(header.data.data(), header.data.size());
+
+        // one length prefixed record per satellite, so reading never holds more than one
+        ByteWriter record;
+        for (const SatelliteData& satellite : results.satellites)
+        {
+            if (!ok)
+                break;
+            record.data.clear();
+            WriteSatellite(record, satellite);
+            uint64_t size = record.data.size();
+            ok = out.Write(&size, sizeof(size)) && out.Write(record.data.data(), record.data.size());
+        }
+
+        return out.Close() && ok;
+    }
+
+    bool ResultStream::ReadFile(const std::string& filePath, PropagationResults& results, std::string* error)
+    {
+        auto fail = [&](const char* text)
+        {
+            if (error)
+                *error = std::string(text) + ": " + filePath;
+            return false;
+        };
+
+        FILE* fp = fopen(filePath.c_str(), "rb");
+        if (!fp)
+            return fail("Can't open results file");
+
+        fseek(fp, 0, SEEK_END);
+        long fileBytes = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+
+        uint32_t magic = 0, version = 0;
+        int32_t totalSatellites = 0;
+        uint8_t success = 0;
+        uint16_t errorLength = 0;
+        if (!ReadExact(fp, &magic, sizeof(magic)) || !ReadExact(fp, &version, sizeof(version)) ||
+            magic != STREAM_MAGIC || version != STREAM_VERSION)
+        {
+            fclose(fp);
+            return fail("Not a results file");
+        }
+        std::string generalError;
+        if (!ReadExact(fp, &totalSatellites, sizeof(totalSatellites)) || !ReadExact(fp, &success, sizeof(success)) ||
+            !ReadExact(fp, &errorLength, sizeof(errorLength)))
+        {
+            fclose(fp);
+            return fail("Truncated results file");
+        }
+        generalError.resize(errorLength);
+        if (errorLength && !ReadExact(fp, generalError.data(), errorLength))
+        {
+            fclose(fp);
+            return fail("Truncated results file");
+        }
+
+        // the message table has no length prefix of its own, read it text by text
+        uint32_t messageCount = 0;
+        bool ok = ReadExact(fp, &messageCount, sizeof(messageCount));
+        results.messages = ErrorMessageTable();
+        for (uint32_t i = 0; ok && i < messageCount; i++)
+        {
+            uint16_t length;
+            std::string text;
+            ok = ReadExact(fp, &length, sizeof(length));
+            text.resize(length);
+            ok = ok && (length == 0 || ReadExact(fp, text.data(), length));
+            if (ok)
+                results.messages.Intern(text.c_str());
+        }
+
+        uint32_t satelliteCount = 0;
+        ok = ok && ReadExact(fp, &satelliteCount, sizeof(satelliteCount));
+        if (!ok)
+        {
+            fclose(fp);
+            return fail("Truncated results file");
+        }
+
+        results.arena = std::make_shared<ResultArena>((size_t)std::max(0L, fileBytes));
+        results.satellites.clear();
+        results.satellites.reserve(satelliteCount);
+        results.totalSatellites = totalSatellites;
+        results.overallSuccess = success != 0;
+        results.generalError = generalError;
+
+        std::vector<uint8_t> record;
+        for (uint32_t i = 0; i < satelliteCount; i++)
+        {
+            uint64_t size;
+            if (!ReadExact(fp, &size, sizeof(size)) || size > (uint64_t)std::max(0L, fileBytes))
+            {
+                ok = false;
+                break;
+            }
+            record.resize((size_t)size);
+            if (!ReadExact(fp, record.data(), record.size()))
+            {
+                ok = false;
+                break;
+            }
+            ByteReader in(record.data(), record.size());
+            SatelliteData& satellite = results.satellites.emplace_back(results.arena.get());
+            if (!ReadSatellite(in, satellite))
+            {
+                ok = false;
+                break;
+            }
+        }
+        fclose(fp);
+
+        return ok ? true : fail("Truncated results file");
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,42 @@
+//
+// ResultStream.h
+// Exact binary form of propagation results, for files and for shards sent between processes
+//
+
+#ifndef RESULTSTREAM_H
+#define RESULTSTREAM_H
+
+#include <string>
+#include <vector>
+#include "../PropResults.h"
+#include "ByteBuffer.h"
+
+namespace SGP_IMPL {
+
+    // Unlike the archive nothing is quantized, results read back bit for bit. Satellites are
+    // written one at a time, so a sender can stream them as they are encoded. A satellite's
+    // error records refer to the message table of the results it came from; readers that
+    // merge several sources remap them with RemapMessages().
+    class ResultStream
+    {
+    public:
+        static void WriteSatellite(ByteWriter& out, const SatelliteData& satellite);
+        // Steps go to the satellite's own allocator
+        static bool ReadSatellite(ByteReader& in, SatelliteData& satellite);
+
+        // Every message except the empty one, in id order
+        static void WriteMessages(ByteWriter& out, const ErrorMessageTable& messages);
+        static bool ReadMessages(ByteReader& in, std::vector<std::string>& messages);
+
+        // Interns the texts read by ReadMessages into the table, returns old id -> new id
+        static std::vector<uint32_t> RemapMessages(const std::vector<std::string>& messages, ErrorMessageTable& table);
+        static void ApplyRemap(SatelliteData& satellite, const std::vector<uint32_t>& remap);
+
+        // Whole results as a file, "SPRS" header then messages and satellites
+        static bool WriteFile(const std::string& filePath, const PropagationResults& results);
+        static bool ReadFile(const std::string& filePath, PropagationResults& results, std::string* error = nullptr);
+    };
+
+} // SGP_IMPL
+
+#endif //RESULTSTREAM_H
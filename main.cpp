@@ -1,9 +1,13 @@
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 #include <string>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <filesystem>
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include "extern/imgui/imgui.h"
 #include "extern/imgui/backends/imgui_impl_glfw.h"
@@ -38,6 +42,17 @@ extern "C"
 #endif
 
 #include "Propagator.h"
+#include "PropagationPipeline.h"
+#include "AstroStdDlls.h"
+#include "FrameScheduler.h"
+#include "Instrumentation.h"
+#include "ResultLog.h"
+#include "CatalogDiff.h"
+#include "ResultCache.h"
+#include "TleFitter.h"
+#include "DecayFinder.h"
+#include "Eclipse.h"
+#include "RelativeMotion.h"
 
 // application state
 struct AppState {
@@ -45,12 +60,15 @@ struct AppState {
     char outputFile[512] = "";
     bool showDemo = true;
     bool showAbout = false;
+    bool showInstrumentation = false;
 
     // Propagation parameters
     double startTime = 0.0;
     double stopTime = 1440.0; // 24 hours in minutes
     double stepSize = 60.0;    // 1 hour in minutes
     bool useEpochRelative = true;
+    int numThreads = 1;        // propagation threads, initialization is always serial
+    bool writeResultLog = false;   // every satellite and failed step to <output>_log.jsonl
 
     std::string statusMessage = "Ready";
     bool isProcessing = false;
@@ -63,21 +81,49 @@ struct AppState {
 
     SatelliteMapWindow satelliteMapWindow;
 
+    // last satellite index both the viewer and the map agreed on
+    int syncedSelection = -1;
+
+    // only draws when something changed, see FrameScheduler
+    FrameScheduler frameScheduler;
+
+    // job results are summarized and logged off the ui thread
+    std::unique_ptr<SGP_IMPL::ResultLog> resultLog;
+
+    // satellites propagated by earlier jobs, whatever the catalog they came in
+    std::unique_ptr<SGP_IMPL::ResultCache> resultCache;
+
+    // catalog as last loaded, and the one the last job propagated with its results and
+    // times, so the next job only redoes the satellites that changed
+    std::vector<SGP_IMPL::CatalogEntry> catalog;
+    std::vector<SGP_IMPL::CatalogEntry> processedCatalog;
+    std::shared_ptr<const PropagationResults> processedResults;
+    double processedStart = 0.0;
+    double processedStop = 0.0;
+    double processedStep = 0.0;
 };
 
 // why is sgp4prop so awful
-void LoadAstroStdDlls();
-void FreeAstroStdDlls();
 bool InitializeOpenGL(GLFWwindow** window);
 void InitializeImGui(GLFWwindow* window);
 void RenderUI(AppState& state);
 void ProcessSatellites(AppState& state);
 void LoadTLEFile(AppState& state);
+void FitTLEs(AppState& state);
+void PredictDecays(AppState& state);
+void FindEclipses(AppState& state);
+void AnalyzeProximity(AppState& state);
 void ShowMainMenuBar(AppState& state);
 void ShowFileDialog(AppState& state);
 void ShowPropagationControls(AppState& state);
 void ShowSatelliteList(AppState& state);
 void ShowStatusBar(AppState& state);
+void SyncSelection(AppState& state);
+void ShowInstrumentationWindow(AppState& state);
+std::string LogCatalogDiff(const SGP_IMPL::CatalogDiffResult& diff, const std::vector<SGP_IMPL::CatalogEntry>& current);
+bool ResultsReady(const AppState& state);
+bool NeedsContinuousFrames(const AppState& state);
+int ParseMaxFps(int argc, char* argv[]);
 
 
 
@@ -92,8 +138,9 @@ constexpr int FT_MEAN_ELEM = 2;
 constexpr int FT_LLH_ELEM = 3;
 constexpr int FT_NODAL_AP_PER = 4;
 
-auto logger = spdlog::stdout_color_mt("console");
-auto err_logger = spdlog::stderr_color_mt("stderr");
+// async so a burst of messages never holds up the ui thread, the oldest are dropped when the queue is full
+auto logger = spdlog::stdout_color_mt<spdlog::async_factory_nonblock>("console");
+auto err_logger = spdlog::stderr_color_mt<spdlog::async_factory_nonblock>("stderr");
 
 
 static void glfw_error_callback(int error, const char* description)
@@ -124,15 +171,32 @@ int main(int argc, char* argv[])
     sgp4DllInfo[INFOSTRLEN-1] = 0;
     logger->info("{}", sgp4DllInfo);
 
+    // app state owns GL objects (map imagery, point buffers), so it has to go before the context does
+    {
     // setup app state
     AppState appState;
     appState.statusMessage = std::string("Loaded: ") + sgp4DllInfo;
+    appState.resultLog = std::make_unique<SGP_IMPL::ResultLog>(logger, err_logger);
+
+    SGP_IMPL::ResultCacheOptions cacheOptions;
+    std::error_code tempError;
+    std::filesystem::path tempDir = std::filesystem::temp_directory_path(tempError);
+    if (!tempError) {
+        cacheOptions.spillDirectory = (tempDir / "satprop_cache").string();
+    }
+    appState.resultCache = std::make_unique<SGP_IMPL::ResultCache>(cacheOptions);
+
+    // hooked after ImGui so input reaches the backend first
+    appState.frameScheduler.Attach(window);
+    appState.frameScheduler.SetMaxFps(ParseMaxFps(argc, argv));
 
 
     // main window loop
     while (!glfwWindowShouldClose(window))
     {
-        glfwPollEvents(); // poll events
+        // sleeps while the ui is static, polls at full rate while something is moving
+        if (!appState.frameScheduler.WaitForNextFrame(NeedsContinuousFrames(appState)))
+            continue;
 
         // imgui start frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -153,6 +217,7 @@ int main(int argc, char* argv[])
 
         glfwSwapBuffers(window);
     }
+    }
 
     // shutdown imgui and opengl
     ImGui_ImplOpenGL3_Shutdown();
@@ -165,6 +230,9 @@ int main(int argc, char* argv[])
     // Free AstroStd DLLs
     FreeAstroStdDlls();
 
+    // drains the async loggers
+    spdlog::shutdown();
+
     return 0;
 }
 
@@ -250,9 +318,14 @@ void RenderUI(AppState& state)
     //if (state.showDemo)
         //ImGui::ShowDemoWindow(&state.showDemo);
 
-    if (state.statusMessage == "Processing complete. Results saved.") {
+    if (ResultsReady(state)) {
         state.viewer.Render();
         state.satelliteMapWindow.render();
+        SyncSelection(state);
+    }
+
+    if (state.showInstrumentation) {
+        ShowInstrumentationWindow(state);
     }
 
     // about dialog
@@ -288,6 +361,13 @@ void ShowMainMenuBar(AppState& state)
         if (ImGui::BeginMenu("View"))
         {
             ImGui::MenuItem("Show Demo", nullptr, &state.showDemo);
+            ImGui::MenuItem("Instrumentation", nullptr, &state.showInstrumentation);
+
+            int maxFps = state.frameScheduler.GetMaxFps();
+            ImGui::SetNextItemWidth(120);
+            if (ImGui::SliderInt("Max FPS", &maxFps, 0, 240, maxFps == 0 ? "vsync" : "%d")) {
+                state.frameScheduler.SetMaxFps(maxFps);
+            }
             ImGui::EndMenu();
         }
 
@@ -329,6 +409,26 @@ void ShowFileDialog(AppState& state)
         ProcessSatellites(state);
     }
 
+    ImGui::SameLine();
+    if (ImGui::Button("Fit TLEs to Output") && !state.isProcessing) {
+        FitTLEs(state);
+    }
+
+    ImGui::SameLine();
+    if (ImGui::Button("Predict Decays") && !state.isProcessing) {
+        PredictDecays(state);
+    }
+
+    ImGui::SameLine();
+    if (ImGui::Button("Find Eclipses") && !state.isProcessing) {
+        FindEclipses(state);
+    }
+
+    ImGui::SameLine();
+    if (ImGui::Button("Proximity to Selected") && !state.isProcessing) {
+        AnalyzeProximity(state);
+    }
+
     if (state.isProcessing) {
         ImGui::SameLine();
         ImGui::Text("Processing...");
@@ -351,6 +451,10 @@ void ShowPropagationControls(AppState& state)
     }
 
     ImGui::InputDouble("Step Size (minutes)", &state.stepSize, 1.0, 10.0, "%.1f");
+    if (ImGui::InputInt("Threads", &state.numThreads)) {
+        state.numThreads = std::max(1, std::min(state.numThreads, 256));
+    }
+    ImGui::Checkbox("Detailed result log (<output>_log.jsonl)", &state.writeResultLog);
 
     // quick presets for common prop times
     ImGui::Text("Quick Presets:");
@@ -389,12 +493,132 @@ void ShowSatelliteList(AppState& state)
     }
 }
 
+// keep the viewer and the map pointing at the same satellite, whichever side changed it
+void SyncSelection(AppState& state)
+{
+    if (state.satelliteMapWindow.consumeSelectionChanged()) {
+        int selected = state.satelliteMapWindow.getSelectedSatellite();
+        if (selected >= 0)
+            state.viewer.SetSelectedSatellite(selected);
+        state.syncedSelection = state.viewer.GetSelectedSatellite();
+    } else if (state.viewer.GetSelectedSatellite() != state.syncedSelection) {
+        state.syncedSelection = state.viewer.GetSelectedSatellite();
+        state.satelliteMapWindow.setSelectedSatellite(state.syncedSelection);
+    }
+}
+
 void ShowStatusBar(AppState& state)
 {
     ImGui::Separator();
     ImGui::Text("Status: %s", state.statusMessage.c_str());
 }
 
+// phase timings of the last job, see Instrumentation.h
+void ShowInstrumentationWindow(AppState& state)
+{
+    if (!ImGui::Begin("Instrumentation", &state.showInstrumentation)) {
+        ImGui::End();
+        return;
+    }
+
+#ifndef SATPROP_INSTRUMENTATION
+    ImGui::TextDisabled("Built without SATPROP_INSTRUMENTATION, nothing is recorded.");
+#endif
+
+    bool enabled = SGP_IMPL::Instrumentation::IsEnabled();
+    if (ImGui::Checkbox("Record next jobs", &enabled)) {
+        SGP_IMPL::Instrumentation::SetEnabled(enabled);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+        SGP_IMPL::Instrumentation::Reset();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Log Summary")) {
+        SGP_IMPL::Instrumentation::LogSummary(*logger);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export Chrome Trace")) {
+        std::string path = std::string(strlen(state.outputFile) ? state.outputFile : "satprop") + "_trace.json";
+        if (SGP_IMPL::Instrumentation::WriteChromeTrace(path)) {
+            logger->info("Wrote Chrome trace to {}", path);
+            state.statusMessage = "Trace written to " + path;
+        } else {
+            err_logger->error("Could not write Chrome trace to {}", path);
+        }
+    }
+
+    SGP_IMPL::InstrumentationSummary summary = SGP_IMPL::Instrumentation::Summarize();
+    ImGui::Text("Threads: %d  Trace events: %llu (%llu dropped)", summary.threads,
+                (unsigned long long)summary.traceEvents, (unsigned long long)summary.droppedEvents);
+
+    if (ImGui::BeginTable("Phases", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Phase");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Total (ms)");
+        ImGui::TableSetupColumn("Avg (us)");
+        ImGui::TableSetupColumn("Min (us)");
+        ImGui::TableSetupColumn("Max (us)");
+        ImGui::TableHeadersRow();
+        for (int p = 0; p < SGP_IMPL::NUM_PHASES; p++) {
+            const SGP_IMPL::PhaseStats& stats = summary.phases[p];
+            if (stats.count == 0) continue;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::Text("%s", SGP_IMPL::Instrumentation::PhaseName((SGP_IMPL::Phase)p));
+            ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)stats.count);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.totalNs / 1e6);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.totalNs / 1e3 / stats.count);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.minNs / 1e3);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.maxNs / 1e3);
+        }
+        ImGui::EndTable();
+    }
+
+    for (int c = 0; c < SGP_IMPL::NUM_COUNTERS; c++) {
+        ImGui::Text("%s: %llu", SGP_IMPL::Instrumentation::CounterName((SGP_IMPL::Counter)c),
+                    (unsigned long long)summary.counters[c]);
+    }
+
+    // only plot up to the slowest bucket that has anything in it
+    float buckets[SGP_IMPL::HISTOGRAM_BUCKETS];
+    int used = 0;
+    for (int b = 0; b < SGP_IMPL::HISTOGRAM_BUCKETS; b++) {
+        buckets[b] = (float)summary.histogram[b];
+        if (summary.histogram[b]) used = b + 1;
+    }
+    if (used > 0) {
+        ImGui::Text("Time per satellite, bucket n covers 2^n to 2^(n+1) us");
+        ImGui::PlotHistogram("##SatelliteTimes", buckets, used, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 120));
+    }
+
+    ImGui::End();
+}
+
+// the last job succeeded; the status line is free for whatever ran since
+bool ResultsReady(const AppState& state)
+{
+    return state.processedResults != nullptr;
+}
+
+// anything that changes on screen without input keeps the loop running at full rate
+bool NeedsContinuousFrames(const AppState& state)
+{
+    if (state.isProcessing)
+        return true;
+    return ResultsReady(state) && state.satelliteMapWindow.isAnimating();
+}
+
+// --max-fps <n>, 0 (the default) leaves the frame rate to vsync
+int ParseMaxFps(int argc, char* argv[])
+{
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--max-fps") == 0) {
+            return std::max(0, atoi(argv[i + 1]));
+        }
+    }
+    return 0;
+}
+
 void LoadTLEFile(AppState& state)
 {
     if (strlen(state.inputFile) == 0) {
@@ -447,6 +671,251 @@ void LoadTLEFile(AppState& state)
     logger->info(statusMsg);
 
     state.statusMessage = statusMsg;
+
+    // what changed since the last load
+    std::vector<SGP_IMPL::CatalogEntry> catalog;
+    std::string catalogError;
+    if (!SGP_IMPL::CatalogDiff::ReadCatalog(state.inputFile, catalog, &catalogError)) {
+        err_logger->error("Catalog diff: {}", catalogError);
+        return;
+    }
+    if (!state.catalog.empty()) {
+        SGP_IMPL::CatalogDiffResult diff = SGP_IMPL::CatalogDiff::Compare(state.catalog, catalog,
+                                                                          SGP_IMPL::ManeuverThresholds(), state.numThreads);
+        state.statusMessage += " (" + LogCatalogDiff(diff, catalog) + ")";
+    }
+    state.catalog = std::move(catalog);
+}
+
+// counts to the console, flagged updates to the error log; returns the counts
+std::string LogCatalogDiff(const SGP_IMPL::CatalogDiffResult& diff, const std::vector<SGP_IMPL::CatalogEntry>& current)
+{
+    std::string counts = fmt::format("{} new, {} removed, {} updated, {} flagged",
+                                     diff.counts[SGP_IMPL::CHANGE_NEW], diff.counts[SGP_IMPL::CHANGE_REMOVED],
+                                     diff.counts[SGP_IMPL::CHANGE_UPDATED], diff.flagged);
+    logger->info("Catalog diff: {}, {} unchanged in {:.3f} s", counts, diff.counts[SGP_IMPL::CHANGE_UNCHANGED],
+                 diff.seconds);
+
+    // worst first, a burst of maneuvers shouldn't flood the console
+    std::vector<const SGP_IMPL::CatalogChangeRecord*> flagged;
+    for (const auto& record : diff.changes) {
+        if (record.Flagged())
+            flagged.push_back(&record);
+    }
+    std::sort(flagged.begin(), flagged.end(), [](const auto* a, const auto* b) {
+        return a->residuals.score > b->residuals.score;
+    });
+    const size_t shown = 20;
+    for (size_t i = 0; i < std::min(shown, flagged.size()); i++) {
+        const SGP_IMPL::CatalogChangeRecord& record = *flagged[i];
+        const SGP_IMPL::ElementResiduals& r = record.residuals;
+        err_logger->warn("  {} {}: {} after {:.2f} days, sma {:+.2f} km, ecc {:+.5f}, inc {:+.4f} deg, "
+                         "raan {:+.4f} deg, along track {:+.1f} km",
+                         record.satNum, current[record.currentIndex].elements.intlDesignator,
+                         SGP_IMPL::CatalogDiff::JumpNames(r.jumps), r.days, r.smaKm, r.eccentricity,
+                         r.inclinationDeg, r.raanDeg, r.alongTrackKm);
+    }
+    if (flagged.size() > shown) {
+        err_logger->warn("  ... and {} more flagged updates", flagged.size() - shown);
+    }
+    return counts;
+}
+
+// fits element sets to the ephemeris in the output file, whatever wrote it, and saves
+// them next to it as <output>_fit.tle
+void FitTLEs(AppState& state)
+{
+    if (strlen(state.outputFile) == 0) {
+        state.statusMessage = "Error: No output file specified";
+        return;
+    }
+
+    std::vector<SGP_IMPL::FitRequest> requests;
+    std::string error;
+    if (!SGP_IMPL::TleFitter::ReadEphemerisFile(state.outputFile, requests, &error)) {
+        state.statusMessage = "Error: " + error;
+        return;
+    }
+
+    SGP_IMPL::TleFitOptions fitOptions;
+    fitOptions.numThreads = state.numThreads;
+    SGP_IMPL::TleFitBatch batch = SGP_IMPL::TleFitter::Fit(requests, fitOptions);
+
+    std::vector<double> rms;
+    for (size_t i = 0; i < batch.results.size(); i++) {
+        const SGP_IMPL::TleFitResult& result = batch.results[i];
+        if (result.status == SGP_IMPL::FIT_FAILED) {
+            err_logger->warn("  fit {} of {}: {}", requests[i].initial.satNum, state.outputFile, result.error);
+            continue;
+        }
+        rms.push_back(result.rmsKm);
+    }
+    std::sort(rms.begin(), rms.end());
+    logger->info("Fitted {} satellites in {:.2f} s: {} converged, {} at the iteration limit, {} stalled, {} failed, "
+                 "median rms {:.3f} km, worst {:.3f} km",
+                 batch.results.size(), batch.seconds, batch.counts[SGP_IMPL::FIT_CONVERGED],
+                 batch.counts[SGP_IMPL::FIT_MAX_ITERATIONS], batch.counts[SGP_IMPL::FIT_STALLED],
+                 batch.counts[SGP_IMPL::FIT_FAILED], rms.empty() ? 0.0 : rms[rms.size() / 2],
+                 rms.empty() ? 0.0 : rms.back());
+
+    std::string fitFile = std::string(state.outputFile) + "_fit.tle";
+    if (!SGP_IMPL::TleFitter::WriteTleFile(fitFile, batch, &error)) {
+        state.statusMessage = "Error: " + error;
+        return;
+    }
+    state.statusMessage = fmt::format("Fitted {} of {} satellites to {}", batch.results.size() -
+                                      batch.counts[SGP_IMPL::FIT_FAILED], batch.results.size(), fitFile);
+}
+
+// first 100 km crossing of every loaded satellite within 30 days of its epoch, soonest
+// logged and all saved next to the output as <output>_decay.txt
+void PredictDecays(AppState& state)
+{
+    std::vector<SGP_IMPL::TleElements> elements;
+    for (const auto& entry : state.catalog) {
+        if (entry.parsed)
+            elements.push_back(entry.elements);
+    }
+    if (elements.empty()) {
+        state.statusMessage = "Error: No satellites loaded";
+        return;
+    }
+
+    SGP_IMPL::DecayOptions decayOptions;
+    decayOptions.numThreads = state.numThreads;
+    SGP_IMPL::DecayReport report = SGP_IMPL::DecayFinder::Find(elements, 0.0, decayOptions);
+    logger->info("Decay search of {} satellites in {:.2f} s, {} propagations: {} cross {:.0f} km, {} already below, "
+                 "{} fail first, {} stay up, {} failed to initialize",
+                 elements.size(), report.seconds, report.evaluations, report.counts[SGP_IMPL::DECAY_CROSSING],
+                 decayOptions.altitudeKm, report.counts[SGP_IMPL::DECAY_BELOW_AT_START],
+                 report.counts[SGP_IMPL::DECAY_PROPAGATION_ERROR], report.counts[SGP_IMPL::DECAY_NONE],
+                 report.counts[SGP_IMPL::DECAY_INIT_FAILED]);
+
+    std::vector<const SGP_IMPL::DecayPrediction*> decaying;
+    for (const auto& prediction : report.predictions) {
+        if (prediction.status == SGP_IMPL::DECAY_CROSSING || prediction.status == SGP_IMPL::DECAY_PROPAGATION_ERROR)
+            decaying.push_back(&prediction);
+    }
+    std::sort(decaying.begin(), decaying.end(), [](const auto* a, const auto* b) {
+        return a->ds50UTC < b->ds50UTC;
+    });
+    const size_t shown = 20;
+    for (size_t i = 0; i < std::min(shown, decaying.size()); i++) {
+        const SGP_IMPL::DecayPrediction& prediction = *decaying[i];
+        logger->info("  {}: {} at {} ({:.3f} deg, {:.3f} deg)", prediction.satNum,
+                     SGP_IMPL::DecayFinder::StatusName(prediction.status), UTCToDtg20Str(prediction.ds50UTC),
+                     prediction.latitude, prediction.longitude);
+    }
+
+    if (strlen(state.outputFile) == 0) {
+        state.statusMessage = fmt::format("{} of {} satellites decay within {:.0f} days", decaying.size(),
+                                          elements.size(), decayOptions.horizonDays);
+        return;
+    }
+    std::string decayFile = std::string(state.outputFile) + "_decay.txt";
+    std::string error;
+    if (!SGP_IMPL::DecayFinder::WriteReport(decayFile, report, &error)) {
+        state.statusMessage = "Error: " + error;
+        return;
+    }
+    state.statusMessage = fmt::format("{} of {} satellites decay within {:.0f} days, see {}", decaying.size(),
+                                      elements.size(), decayOptions.horizonDays, decayFile);
+}
+
+// shadow state of every step of the last job, with entry and exit times saved next to
+// the output as <output>_shadow.txt
+void FindEclipses(AppState& state)
+{
+    if (!state.processedResults) {
+        state.statusMessage = "Error: Process satellites first";
+        return;
+    }
+
+    SGP_IMPL::EclipseOptions eclipseOptions;
+    eclipseOptions.keepStates = false;
+    eclipseOptions.numThreads = state.numThreads;
+    SGP_IMPL::EclipseReport report = SGP_IMPL::Eclipse::Run(*state.processedResults, eclipseOptions);
+
+    double seconds[SGP_IMPL::SHADOW_UNKNOWN] = {};
+    for (const auto& satellite : report.satellites) {
+        for (int s = 0; s < SGP_IMPL::SHADOW_UNKNOWN; s++)
+            seconds[s] += satellite.seconds[s];
+    }
+    double total = seconds[SGP_IMPL::SHADOW_SUNLIT] + seconds[SGP_IMPL::SHADOW_PENUMBRA] + seconds[SGP_IMPL::SHADOW_UMBRA];
+    logger->info("Shadow of {} steps of {} satellites in {:.3f} s, {} transitions; {:.1f}% sunlit, {:.1f}% penumbra, "
+                 "{:.1f}% umbra", report.steps, report.satellites.size(), report.seconds, report.transitions,
+                 total > 0.0 ? seconds[SGP_IMPL::SHADOW_SUNLIT] / total * 100.0 : 0.0,
+                 total > 0.0 ? seconds[SGP_IMPL::SHADOW_PENUMBRA] / total * 100.0 : 0.0,
+                 total > 0.0 ? seconds[SGP_IMPL::SHADOW_UMBRA] / total * 100.0 : 0.0);
+
+    if (strlen(state.outputFile) == 0) {
+        state.statusMessage = fmt::format("{} shadow transitions of {} satellites", report.transitions,
+                                          report.satellites.size());
+        return;
+    }
+    std::string shadowFile = std::string(state.outputFile) + "_shadow.txt";
+    std::string error;
+    if (!SGP_IMPL::Eclipse::WriteTransitions(shadowFile, *state.processedResults, report, &error)) {
+        state.statusMessage = "Error: " + error;
+        return;
+    }
+    state.statusMessage = fmt::format("{} shadow transitions of {} satellites, see {}", report.transitions,
+                                      report.satellites.size(), shadowFile);
+}
+
+// the selected satellite against every other one of the last job, closest approaches
+// logged and all saved next to the output as <output>_proximity.txt
+void AnalyzeProximity(AppState& state)
+{
+    if (!state.processedResults) {
+        state.statusMessage = "Error: Process satellites first";
+        return;
+    }
+    const PropagationResults& results = *state.processedResults;
+    int chief = state.viewer.GetSelectedSatellite();
+    if (chief < 0 || chief >= (int)results.satellites.size() || results.satellites.size() < 2) {
+        state.statusMessage = "Error: Select a satellite with others to compare against";
+        return;
+    }
+
+    SGP_IMPL::ProximityOptions proximityOptions;
+    proximityOptions.keepStates = false;
+    proximityOptions.numThreads = state.numThreads;
+    SGP_IMPL::ProximityReport report = SGP_IMPL::RelativeMotion::Run(
+        results, SGP_IMPL::RelativeMotion::ChiefPairs(results, chief), proximityOptions);
+    logger->info("Proximity of {} pairs over {} steps in {:.3f} s, {} keep-out violations", report.pairs.size(),
+                 report.steps, report.seconds, report.violations);
+
+    std::vector<const SGP_IMPL::PairProximity*> closest;
+    for (const auto& proximity : report.pairs) {
+        if (proximity.error.empty())
+            closest.push_back(&proximity);
+    }
+    std::sort(closest.begin(), closest.end(), [](const auto* a, const auto* b) {
+        return a->closest.range < b->closest.range;
+    });
+    const size_t shown = 20;
+    for (size_t i = 0; i < std::min(shown, closest.size()); i++) {
+        const SGP_IMPL::RelativeState& approach = closest[i]->closest;
+        logger->info("  {}: {:.3f} km at {} (R {:.3f}, I {:.3f}, C {:.3f} km)",
+                     results.satellites[closest[i]->pair.deputy].line1.substr(2, 5), approach.range,
+                     UTCToDtg20Str(approach.ds50UTC), approach.ric[SGP_IMPL::REL_R], approach.ric[SGP_IMPL::REL_I],
+                     approach.ric[SGP_IMPL::REL_C]);
+    }
+
+    if (strlen(state.outputFile) == 0) {
+        state.statusMessage = fmt::format("{} keep-out violations among {} pairs", report.violations,
+                                          report.pairs.size());
+        return;
+    }
+    std::string proximityFile = std::string(state.outputFile) + "_proximity.txt";
+    std::string error;
+    if (!SGP_IMPL::RelativeMotion::WriteReport(proximityFile, results, report, &error)) {
+        state.statusMessage = "Error: " + error;
+        return;
+    }
+    state.statusMessage = fmt::format("{} keep-out violations among {} pairs, see {}", report.violations,
+                                      report.pairs.size(), proximityFile);
 }
 
 // file opener b/c i don't have a file dialog yet
@@ -467,7 +936,7 @@ void ProcessSatellites(AppState& state)
         return;
     }
 
-    if (strlen(state.outputFile) == 0) { // can remove atm b/c not outputting to file
+    if (strlen(state.outputFile) == 0) {
         state.statusMessage = "Error: No output file specified";
         return;
     }
@@ -476,57 +945,74 @@ void ProcessSatellites(AppState& state)
     state.statusMessage = "Processing satellites...";
 
 
-    try {
-        PropagationResults results = SGP_IMPL::Propagator().RunOneSgp4Job(state.inputFile, state.startTime, state.stopTime, state.stepSize);
-        static bool dataSet = false;
+    // profile just this job
+    bool profiling = SGP_IMPL::Instrumentation::IsEnabled();
+    if (profiling) {
+        SGP_IMPL::Instrumentation::Reset();
+    }
 
-        if (!dataSet)
-        {
-            state.viewer.SetData(results);
-            state.satelliteMapWindow.updateSatelliteData(results);
-            dataSet = true;
+    try {
+        // propagation and the osculating state output overlap, see PropagationPipeline
+        SGP_IMPL::PipelineOptions pipelineOptions;
+        pipelineOptions.propagateThreads = state.numThreads;
+        pipelineOptions.formatThreads = std::max(1, state.numThreads / 2);
+
+        // satellites whose lines are the same as in the last job over the same times are
+        // copied from its results instead of propagated again
+        SGP_IMPL::CatalogDiffResult diff;
+        if (state.processedResults && state.processedStart == state.startTime && state.processedStop == state.stopTime &&
+            state.processedStep == state.stepSize) {
+            diff = SGP_IMPL::CatalogDiff::Compare(state.processedCatalog, state.catalog, SGP_IMPL::ManeuverThresholds(),
+                                                  state.numThreads);
+            pipelineOptions.previous = state.processedResults.get();
+            pipelineOptions.carryOver = &diff.carryOver;
         }
-
-        logger->info("Processed {} satellites", results.totalSatellites);
-        if (results.overallSuccess) {
-            for (const auto& sat : results.satellites) {
-                logger->info("Satellite: {}", sat.line1);
-                for (const auto& step : sat.timeSteps) {
-                    if (step.hasError) {
-                        err_logger->error("Error in step: {}", step.errorMsg);
-                    }
-                }
-            }
+        pipelineOptions.cache = state.resultCache.get();
+
+        SGP_IMPL::PipelineStats pipelineStats;
+        PropagationResults results = SGP_IMPL::PropagationPipeline::Run(state.inputFile, state.startTime, state.stopTime,
+                                                                        state.stepSize, state.outputFile, pipelineOptions,
+                                                                        &pipelineStats);
+        auto shared = std::make_shared<const PropagationResults>(std::move(results));
+        state.viewer.SetData(*shared);
+        state.satelliteMapWindow.updateSatelliteData(*shared);
+
+        logger->info("Processed {} satellites in {:.2f} s, {} carried over from the last job, {} from the cache",
+                     shared->totalSatellites, pipelineStats.wallSeconds, pipelineStats.carriedOver,
+                     pipelineStats.cacheHits);
+        SGP_IMPL::ResultCacheStats cacheStats = state.resultCache->GetStats();
+        logger->info("  cache: {:.0f}% hit rate, {} entries {:.1f} MB in memory, {} entries {:.1f} MB on disk, {} evicted",
+                     cacheStats.HitRate() * 100.0, cacheStats.memoryEntries, cacheStats.memoryBytes / 1048576.0,
+                     cacheStats.diskEntries, cacheStats.diskBytes / 1048576.0, cacheStats.evictions);
+        for (int s = 0; s < SGP_IMPL::NUM_PIPELINE_STAGES; s++) {
+            const SGP_IMPL::StageStats& stage = pipelineStats.stages[s];
+            logger->info("  {} x{}: {:.0f}% busy, starved {:.2f} s, held back {:.2f} s",
+                         SGP_IMPL::PropagationPipeline::StageName((SGP_IMPL::PipelineStage)s), stage.workers,
+                         stage.Occupancy(pipelineStats.wallSeconds) * 100.0, stage.waitInputSeconds,
+                         stage.waitOutputSeconds);
+        }
+        if (profiling) {
+            SGP_IMPL::Instrumentation::LogSummary(*logger);
+        }
+        if (shared->overallSuccess) {
             state.statusMessage = "Processing complete. Results saved.";
-            state.isProcessing = false;
+            state.processedCatalog = state.catalog;
+            state.processedResults = shared;
+            state.processedStart = state.startTime;
+            state.processedStop = state.stopTime;
+            state.processedStep = state.stepSize;
+        } else {
+            state.statusMessage = "Error: " + shared->generalError;
+            state.processedResults.reset();
         }
+
+        // per satellite details only go to the file, the console gets the aggregate
+        std::string detailFile = state.writeResultLog ? std::string(state.outputFile) + "_log.jsonl" : std::string();
+        state.resultLog->Submit(shared, state.inputFile, detailFile);
+        state.isProcessing = false;
     } catch (const std::exception& e) {
         state.statusMessage = std::string("Error: ") + e.what();
+        state.processedResults.reset();
         state.isProcessing = false;
     }
 }
-
-
-
-// load dlls because AstroSTD is a mess and uses GetFnPtr wrappers
-void LoadAstroStdDlls()
-{
-    LoadDllMainDll();
-    LoadEnvConstDll();
-    LoadTimeFuncDll();
-    LoadAstroFuncDll();
-    LoadTleDll();
-    LoadSgp4PropDll();
-}
-
-// free
-void FreeAstroStdDlls()
-{
-    FreeDllMainDll();
-    FreeEnvConstDll();
-    FreeAstroFuncDll();
-    FreeTimeFuncDll();
-    FreeTleDll();
-    FreeSgp4PropDll();
-}
-
@@ -0,0 +1,270 @@
+//
+// CatalogAnimator.cpp
+// Background evaluation of catalog positions for the live map
+//
+
+#include "CatalogAnimator.h"
+#include "../FrameScheduler.h"
+#include "../OrbitMath.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// below this many satellites a single worker is faster than splitting the frame
+constexpr size_t PARALLEL_EVAL_THRESHOLD = 4096;
+
+CatalogAnimator::CatalogAnimator()
+    : m_catalog(std::make_shared<Catalog>()) {
+    m_worker = std::thread(&CatalogAnimator::workerLoop, this);
+}
+
+CatalogAnimator::~CatalogAnimator() {
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        m_stopping = true;
+    }
+    m_requestCv.notify_one();
+    if (m_worker.joinable())
+        m_worker.join();
+    stopHelpers();
+}
+
+void CatalogAnimator::setData(const PropagationResults& results) {
+    auto catalog = std::make_shared<Catalog>();
+
+    // all satellites of a job share the same time grid, take it from the longest one
+    const SatelliteData* longest = nullptr;
+    for (const auto& sat : results.satellites) {
+        if (!longest || sat.timeSteps.size() > longest->timeSteps.size())
+            longest = &sat;
+    }
+    std::vector<double> gridTimes;
+    if (longest) {
+        for (const auto& step : longest->timeSteps) {
+            if (step.hasError()) break;
+            gridTimes.push_back(step.ds50UTC);
+        }
+    }
+    catalog->grid.Assign(std::move(gridTimes));
+
+    catalog->firstSample.reserve(results.satellites.size());
+    catalog->sampleCount.reserve(results.satellites.size());
+
+    for (const auto& sat : results.satellites) {
+        int first = (int)catalog->samples.size();
+        int count = 0;
+        for (const auto& step : sat.timeSteps) {
+            // init failures and the final error/decay step carry no usable state
+            if (step.hasError() || count >= (int)catalog->grid.Size()) break;
+            catalog->samples.push_back(makeSample(step.oscKep));
+            count++;
+        }
+        catalog->firstSample.push_back(first);
+        catalog->sampleCount.push_back(count);
+    }
+
+    m_size = results.satellites.size();
+    m_startTime = catalog->grid.Empty() ? 0.0 : catalog->grid.First();
+    m_stopTime = catalog->grid.Empty() ? 0.0 : catalog->grid.Last();
+
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        m_catalog = catalog;
+    }
+}
+
+void CatalogAnimator::requestTime(double ds50UTC) {
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        m_requestedTime = ds50UTC;
+        m_hasRequest = true;
+    }
+    m_requestCv.notify_one();
+}
+
+const CatalogAnimator::Frame& CatalogAnimator::latestFrame() {
+    std::lock_guard<std::mutex> lock(m_swapMutex);
+    if (m_fresh) {
+        std::swap(m_front, m_ready);
+        m_fresh = false;
+    }
+    return m_frames[m_front];
+}
+
+void CatalogAnimator::workerLoop() {
+    while (true) {
+        std::shared_ptr<const Catalog> catalog;
+        double time;
+        {
+            std::unique_lock<std::mutex> lock(m_requestMutex);
+            m_requestCv.wait(lock, [this] { return m_stopping || m_hasRequest; });
+            if (m_stopping)
+                return;
+            m_hasRequest = false;
+            time = m_requestedTime;
+            catalog = m_catalog;
+        }
+
+        Frame& frame = m_frames[m_back];
+        size_t count = catalog->sampleCount.size();
+        frame.time = time;
+        frame.lat.resize(count);
+        frame.lon.resize(count);
+
+        unsigned int workers = std::max(1u, std::thread::hardware_concurrency() / 2);
+        if (count < PARALLEL_EVAL_THRESHOLD || workers == 1) {
+            evaluate(*catalog, time, frame, 0, count);
+        } else {
+            if (m_helpers.empty())
+                startHelpers(workers - 1);
+            size_t chunk = (count + m_helpers.size()) / (m_helpers.size() + 1);
+            {
+                std::lock_guard<std::mutex> lock(m_helperMutex);
+                m_splitCatalog = catalog.get();
+                m_splitFrame = &frame;
+                m_splitTime = time;
+                m_splitChunk = chunk;
+                m_helpersBusy = (int)m_helpers.size();
+                m_split++;
+            }
+            m_helperCv.notify_all();
+            evaluate(*catalog, time, frame, 0, std::min(count, chunk));
+
+            std::unique_lock<std::mutex> lock(m_helperMutex);
+            m_helperDoneCv.wait(lock, [this] { return m_helpersBusy == 0; });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_swapMutex);
+            frame.serial = ++m_serial;
+            std::swap(m_back, m_ready);
+            m_fresh = true;
+        }
+        FrameScheduler::Wake();
+    }
+}
+
+void CatalogAnimator::helperLoop(unsigned int index) {
+    uint64_t seen = 0;
+    while (true) {
+        const Catalog* catalog;
+        Frame* frame;
+        double time;
+        size_t chunk;
+        {
+            std::unique_lock<std::mutex> lock(m_helperMutex);
+            m_helperCv.wait(lock, [&] { return m_helpersStopping || m_split != seen; });
+            if (m_helpersStopping)
+                return;
+            seen = m_split;
+            catalog = m_splitCatalog;
+            frame = m_splitFrame;
+            time = m_splitTime;
+            chunk = m_splitChunk;
+        }
+
+        size_t count = catalog->sampleCount.size();
+        size_t begin = std::min(count, (index + 1) * chunk);
+        evaluate(*catalog, time, *frame, begin, std::min(count, begin + chunk));
+
+        std::lock_guard<std::mutex> lock(m_helperMutex);
+        if (--m_helpersBusy == 0)
+            m_helperDoneCv.notify_one();
+    }
+}
+
+void CatalogAnimator::startHelpers(unsigned int count) {
+    for (unsigned int i = 0; i < count; i++)
+        m_helpers.emplace_back(&CatalogAnimator::helperLoop, this, i);
+}
+
+void CatalogAnimator::stopHelpers() {
+    {
+        std::lock_guard<std::mutex> lock(m_helperMutex);
+        m_helpersStopping = true;
+    }
+    m_helperCv.notify_all();
+    for (auto& helper : m_helpers)
+        helper.join();
+    m_helpers.clear();
+}
+
+CatalogAnimator::Sample CatalogAnimator::makeSample(const double oscKep[6]) {
+    using namespace SGP_IMPL;
+    double a = oscKep[0];
+    double e = oscKep[1];
+    double incl = oscKep[2] * DEG2RAD;
+    double node = oscKep[4] * DEG2RAD;
+    double argp = oscKep[5] * DEG2RAD;
+
+    double cO = cos(node), sO = sin(node);
+    double cw = cos(argp), sw = sin(argp);
+    double ci = cos(incl), si = sin(incl);
+    double b = a * sqrt(1.0 - e * e);
+
+    Sample sample;
+    sample.meanAnomaly = oscKep[3] * DEG2RAD;
+    sample.meanMotion = sqrt(MU_EARTH / (a * a * a)) * 60.0;
+    sample.ecc = e;
+    sample.p[0] = a * (cO * cw - sO * sw * ci);
+    sample.p[1] = a * (sO * cw + cO * sw * ci);
+    sample.p[2] = a * (sw * si);
+    sample.q[0] = b * (-cO * sw - sO * cw * ci);
+    sample.q[1] = b * (-sO * sw + cO * cw * ci);
+    sample.q[2] = b * (cw * si);
+    return sample;
+}
+
+void CatalogAnimator::samplePosition(const Sample& sample, double dtMin, double pos[3]) {
+    double E = SGP_IMPL::SolveKepler(fmod(sample.meanAnomaly + sample.meanMotion * dtMin, SGP_IMPL::TWO_PI), sample.ecc);
+    double cE = cos(E) - sample.ecc;
+    double sE = sin(E);
+    for (int j = 0; j < 3; j++)
+        pos[j] = sample.p[j] * cE + sample.q[j] * sE;
+}
+
+void CatalogAnimator::evaluate(const Catalog& catalog, double time, Frame& frame, size_t begin, size_t end) {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const SGP_IMPL::TimeGrid& grid = catalog.grid;
+
+    // one lookup for the whole frame, division on the usual uniform grid
+    int gridIndex = grid.Locate(time);
+
+    // Earth rotation is the same for every satellite in the frame
+    double gmst = SGP_IMPL::GmstRad(time);
+    double cG = cos(gmst), sG = sin(gmst);
+
+    for (size_t i = begin; i < end; i++) {
+        int count = catalog.sampleCount[i];
+        if (gridIndex < 0 || gridIndex >= count) {
+            frame.lat[i] = nan;
+            frame.lon[i] = nan;
+            continue;
+        }
+
+        const Sample* sample = &catalog.samples[catalog.firstSample[i] + gridIndex];
+        double t0 = grid.Time(gridIndex);
+        double pos[3];
+        samplePosition(sample[0], (time - t0) * 1440.0, pos);
+
+        // blend with the orbit flown back from the next sample so the motion is continuous across steps
+        if (gridIndex + 1 < count) {
+            double t1 = grid.Time(gridIndex + 1);
+            double w = (time - t0) / (t1 - t0);
+            double pos1[3];
+            samplePosition(sample[1], (time - t1) * 1440.0, pos1);
+            for (int j = 0; j < 3; j++)
+                pos[j] = (1.0 - w) * pos[j] + w * pos1[j];
+        } else if (time > t0) {
+            // satellite decayed or errored after this sample
+            frame.lat[i] = nan;
+            frame.lon[i] = nan;
+            continue;
+        }
+
+        double x = cG * pos[0] + sG * pos[1];
+        double y = -sG * pos[0] + cG * pos[1];
+        frame.lat[i] = (float)(atan2(pos[2], sqrt(x * x + y * y)) * SGP_IMPL::RAD2DEG);
+        frame.lon[i] = (float)(atan2(y, x) * SGP_IMPL::RAD2DEG);
+    }
+}
@@ -0,0 +1,112 @@
+//
+// CatalogAnimator.h
+// Evaluates sub-satellite points for a whole catalog at a simulated clock
+//
+
+#ifndef CATALOGANIMATOR_H
+#define CATALOGANIMATOR_H
+
+#include "../PropResults.h"
+#include "../EphemerisQuery.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Positions come from the stored propagation results: the osculating elements of the
+// two bracketing steps are flown forward/back on a two-body orbit and blended, which stays
+// smooth even with coarse (e.g. hourly) step sizes. Evaluation runs on a background thread
+// and results are triple buffered, so the frame loop only ever swaps pointers.
+class CatalogAnimator {
+public:
+    struct Frame {
+        double time = 0.0;        // ds50UTC the positions were evaluated at
+        std::vector<float> lat;   // Sub-satellite latitude (deg), NaN when not available
+        std::vector<float> lon;   // Sub-satellite longitude (deg)
+        uint64_t serial = 0;      // Increments with every published frame
+    };
+
+    CatalogAnimator();
+    ~CatalogAnimator();
+
+    CatalogAnimator(const CatalogAnimator&) = delete;
+    CatalogAnimator& operator=(const CatalogAnimator&) = delete;
+
+    // Copies the samples needed for animation out of the results
+    void setData(const PropagationResults& results);
+
+    // Asks the worker to evaluate the catalog at this time. Never waits, only the newest request is kept
+    void requestTime(double ds50UTC);
+
+    // Newest finished frame. Never waits on the worker
+    const Frame& latestFrame();
+
+    double startTime() const { return m_startTime; }
+    double stopTime() const { return m_stopTime; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+private:
+    // Osculating orbit of one stored step, pre-rotated so evaluation is a Kepler solve and two axpys
+    struct Sample {
+        double meanAnomaly;    // Mean anomaly at the step (rad)
+        double meanMotion;     // Two-body mean motion (rad/min)
+        double ecc;
+        double p[3];           // a * perifocal P axis (km)
+        double q[3];           // a * sqrt(1 - e^2) * perifocal Q axis (km)
+    };
+
+    // Immutable sample tables, swapped as a whole when new results arrive
+    struct Catalog {
+        SGP_IMPL::TimeGrid grid;         // Shared time grid (ds50UTC)
+        std::vector<int> firstSample;    // Per satellite offset into samples
+        std::vector<int> sampleCount;    // Per satellite number of valid samples
+        std::vector<Sample> samples;     // Per satellite samples, sampleCount[i] of them from firstSample[i]
+    };
+
+    void workerLoop();
+    void helperLoop(unsigned int index);
+    void startHelpers(unsigned int count);
+    void stopHelpers();
+    static Sample makeSample(const double oscKep[6]);
+    static void samplePosition(const Sample& sample, double dtMin, double pos[3]);
+    static void evaluate(const Catalog& catalog, double time, Frame& frame, size_t begin, size_t end);
+
+    std::shared_ptr<const Catalog> m_catalog;
+    double m_startTime = 0.0;
+    double m_stopTime = 0.0;
+    size_t m_size = 0;
+
+    std::thread m_worker;
+    std::mutex m_requestMutex;
+    std::condition_variable m_requestCv;
+    bool m_hasRequest = false;
+    bool m_stopping = false;
+    double m_requestedTime = 0.0;
+
+    // Large catalogs split every frame with helpers that live as long as the animator;
+    // helper i evaluates chunk i + 1, the worker chunk 0
+    std::vector<std::thread> m_helpers;
+    std::mutex m_helperMutex;
+    std::condition_variable m_helperCv;       // a new split, or stopping
+    std::condition_variable m_helperDoneCv;   // the last helper finished its chunk
+    uint64_t m_split = 0;                     // increments with every frame handed out
+    int m_helpersBusy = 0;
+    bool m_helpersStopping = false;
+    const Catalog* m_splitCatalog = nullptr;
+    Frame* m_splitFrame = nullptr;
+    double m_splitTime = 0.0;
+    size_t m_splitChunk = 0;
+
+    std::mutex m_swapMutex;
+    Frame m_frames[3];
+    int m_front = 0;
+    int m_ready = 1;
+    int m_back = 2;
+    bool m_fresh = false;
+    uint64_t m_serial = 0;
+};
+
+#endif //CATALOGANIMATOR_H
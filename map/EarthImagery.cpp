@@ -0,0 +1,333 @@
+//
+// EarthImagery.cpp
+// Background-decoded, mipmapped Earth imagery with optional tiled pyramid streaming
+//
+
+#include "EarthImagery.h"
+#include "../FrameScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <utility>
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+// uploads per frame, a 512x512 tile plus mipmaps is roughly a millisecond on the GL thread
+constexpr int MAX_UPLOADS_PER_FRAME = 4;
+// expected pyramid tile edge, used to pick the level before any tile has been decoded
+constexpr float PYRAMID_TILE_SIZE = 512.0f;
+constexpr int DECODE_THREADS = 2;
+
+static std::atomic<int> maxTextureSize{0};
+
+// 2x2 box filter in place, used when a single image is larger than GL_MAX_TEXTURE_SIZE
+static void halveImage(unsigned char* pixels, int* width, int* height) {
+    int w = *width / 2;
+    int h = *height / 2;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            const unsigned char* a = pixels + ((size_t)(2 * y) * *width + 2 * x) * 4;
+            const unsigned char* b = a + (size_t)*width * 4;
+            unsigned char* dst = pixels + ((size_t)y * w + x) * 4;
+            for (int c = 0; c < 4; c++) {
+                dst[c] = (unsigned char)((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) / 4);
+            }
+        }
+    }
+    *width = w;
+    *height = h;
+}
+
+EarthImagery::EarthImagery() {
+    for (int i = 0; i < DECODE_THREADS; i++) {
+        m_workers.emplace_back(&EarthImagery::workerLoop, this);
+    }
+}
+
+EarthImagery::~EarthImagery() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+
+    reset();
+}
+
+uint64_t EarthImagery::tileKey(int level, int row, int col) {
+    return ((uint64_t)level << 56) | ((uint64_t)row << 28) | (uint64_t)col;
+}
+
+std::string EarthImagery::tilePath(int level, int row, int col) const {
+    if (!m_singleImage.empty()) return m_singleImage;
+    return m_root + "/" + std::to_string(level) + "/" + std::to_string(row) + "_" + std::to_string(col) + ".jpg";
+}
+
+void EarthImagery::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;
+    m_requests.clear();
+    m_inFlight.clear();
+    for (auto& done : m_done) {
+        if (done.second.pixels) stbi_image_free(done.second.pixels);
+    }
+    m_done.clear();
+
+    for (auto& entry : m_tiles) {
+        glDeleteTextures(1, &entry.second.texture);
+    }
+    m_tiles.clear();
+    m_failed.clear();
+    m_gpuBytes = 0;
+}
+
+void EarthImagery::loadImageAsync(const std::string& filePath) {
+    reset();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_singleImage = filePath;
+    m_root.clear();
+    m_baseCols = 1;
+    m_baseRows = 1;
+    m_maxLevel = 0;
+    m_requests.push_back(tileKey(0, 0, 0));
+    m_cv.notify_one();
+}
+
+bool EarthImagery::openPyramid(const std::string& rootDir) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    if (!fs::is_directory(fs::path(rootDir) / "0", ec)) return false;
+
+    reset();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_singleImage.clear();
+    m_root = rootDir;
+    m_baseCols = 2;
+    m_baseRows = 1;
+    m_maxLevel = 0;
+    while (m_maxLevel < 20 && fs::is_directory(fs::path(rootDir) / std::to_string(m_maxLevel + 1), ec)) {
+        m_maxLevel++;
+    }
+
+    // the coarse level is always resident so there is never a hole in the map
+    for (int col = 0; col < m_baseCols; col++) {
+        m_requests.push_back(tileKey(0, 0, col));
+    }
+    m_cv.notify_all();
+    return true;
+}
+
+void EarthImagery::workerLoop() {
+    while (true) {
+        uint64_t key;
+        int generation;
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stopping || !m_requests.empty(); });
+            if (m_stopping) return;
+
+            key = m_requests.front();
+            m_requests.pop_front();
+            m_inFlight.insert(key);
+            generation = m_generation;
+            path = tilePath((int)(key >> 56), (int)((key >> 28) & 0xFFFFFFF), (int)(key & 0xFFFFFFF));
+        }
+
+        Decoded decoded;
+        decoded.key = key;
+        int channels;
+        decoded.pixels = stbi_load(path.c_str(), &decoded.width, &decoded.height, &channels, 4);
+        if (!decoded.pixels) {
+            const char* reason = stbi_failure_reason();
+            decoded.error = path + " (" + (reason ? reason : "unknown error") + ")";
+        }
+
+        int limit = maxTextureSize.load();
+        while (decoded.pixels && limit > 0 && (decoded.width > limit || decoded.height > limit)) {
+            halveImage(decoded.pixels, &decoded.width, &decoded.height);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (generation != m_generation) {
+                if (decoded.pixels) stbi_image_free(decoded.pixels);
+                continue;
+            }
+            m_done.emplace_back(generation, decoded);
+        }
+        // the upload happens on the next frame
+        FrameScheduler::Wake();
+    }
+}
+
+void EarthImagery::update() {
+    m_frame++;
+    if (maxTextureSize.load() == 0) {
+        GLint size = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &size);
+        maxTextureSize = size;
+    }
+
+    for (int i = 0; i < MAX_UPLOADS_PER_FRAME; i++) {
+        Decoded decoded;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_done.empty()) break;
+            decoded = m_done.front().second;
+            m_done.pop_front();
+            m_inFlight.erase(decoded.key);
+        }
+        upload(decoded);
+    }
+
+    evict();
+}
+
+void EarthImagery::upload(const Decoded& decoded) {
+    if (!decoded.pixels) {
+        std::cerr << "Failed to load earth imagery: " << decoded.error << "\n";
+        m_failed.insert(decoded.key);
+        return;
+    }
+
+    Tile tile;
+    glGenTextures(1, &tile.texture);
+    glBindTexture(GL_TEXTURE_2D, tile.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, decoded.width, decoded.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, decoded.pixels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    stbi_image_free(decoded.pixels);
+
+    // base level plus the mip chain is 4/3 of the base
+    tile.bytes = (size_t)decoded.width * decoded.height * 4 * 4 / 3;
+    tile.lastUsed = m_frame;
+    m_gpuBytes += tile.bytes;
+    m_tiles[decoded.key] = tile;
+}
+
+void EarthImagery::evict() {
+    if (m_gpuBytes <= m_gpuBudget) return;
+
+    // oldest first, never the coarse level or anything drawn this frame
+    std::vector<std::pair<uint64_t, uint64_t>> candidates;
+    for (const auto& entry : m_tiles) {
+        if ((entry.first >> 56) != 0 && entry.second.lastUsed < m_frame) {
+            candidates.emplace_back(entry.second.lastUsed, entry.first);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const auto& candidate : candidates) {
+        if (m_gpuBytes <= m_gpuBudget) break;
+        Tile& tile = m_tiles[candidate.second];
+        glDeleteTextures(1, &tile.texture);
+        m_gpuBytes -= tile.bytes;
+        m_tiles.erase(candidate.second);
+    }
+}
+
+bool EarthImagery::appendTile(int level, int row, int col, std::vector<ImageryTile>& out) {
+    auto it = m_tiles.find(tileKey(level, row, col));
+    if (it == m_tiles.end()) return false;
+    it->second.lastUsed = m_frame;
+
+    float lonStep = 360.0f / columns(level);
+    float latStep = 180.0f / rows(level);
+
+    ImageryTile tile;
+    tile.texture = it->second.texture;
+    tile.lonMin = -180.0f + col * lonStep;
+    tile.lonMax = tile.lonMin + lonStep;
+    tile.latMax = 90.0f - row * latStep;
+    tile.latMin = tile.latMax - latStep;
+    tile.uv0 = ImVec2(0.0f, 0.0f);
+    tile.uv1 = ImVec2(1.0f, 1.0f);
+    out.push_back(tile);
+    return true;
+}
+
+void EarthImagery::collectVisible(double latMin, double latMax, double lonMin, double lonMax,
+                                  float worldWidthPx, std::vector<ImageryTile>& out) {
+    if (m_singleImage.empty() && m_root.empty()) return;
+
+    latMin = std::clamp(latMin, -90.0, 90.0);
+    latMax = std::clamp(latMax, -90.0, 90.0);
+    lonMin = std::clamp(lonMin, -180.0, 180.0);
+    lonMax = std::clamp(lonMax, -180.0, 180.0);
+    if (latMin >= latMax || lonMin >= lonMax) return;
+
+    // coarsest level whose texels are at least as dense as screen pixels
+    int level = 0;
+    if (m_maxLevel > 0) {
+        float ratio = worldWidthPx / (m_baseCols * PYRAMID_TILE_SIZE);
+        level = ratio > 1.0f ? (int)std::ceil(std::log2(ratio)) : 0;
+        level = std::clamp(level, 0, m_maxLevel);
+    }
+
+    int cols = columns(level);
+    int rowCount = rows(level);
+    int colMin = std::clamp((int)((lonMin + 180.0) / 360.0 * cols), 0, cols - 1);
+    int colMax = std::clamp((int)((lonMax + 180.0) / 360.0 * cols), 0, cols - 1);
+    int rowMin = std::clamp((int)((90.0 - latMax) / 180.0 * rowCount), 0, rowCount - 1);
+    int rowMax = std::clamp((int)((90.0 - latMin) / 180.0 * rowCount), 0, rowCount - 1);
+
+    std::vector<uint64_t> missing;
+    for (int row = rowMin; row <= rowMax; row++) {
+        for (int col = colMin; col <= colMax; col++) {
+            if (appendTile(level, row, col, out)) continue;
+
+            uint64_t key = tileKey(level, row, col);
+            if (!m_failed.count(key)) missing.push_back(key);
+
+            // fill in with the part of the nearest resident ancestor
+            for (int up = 1; up <= level; up++) {
+                size_t before = out.size();
+                if (!appendTile(level - up, row >> up, col >> up, out)) continue;
+
+                ImageryTile& tile = out[before];
+                int scale = 1 << up;
+                float lonStep = (tile.lonMax - tile.lonMin) / scale;
+                float latStep = (tile.latMax - tile.latMin) / scale;
+                int subCol = col & (scale - 1);
+                int subRow = row & (scale - 1);
+                tile.lonMin += subCol * lonStep;
+                tile.lonMax = tile.lonMin + lonStep;
+                tile.latMax -= subRow * latStep;
+                tile.latMin = tile.latMax - latStep;
+                tile.uv0 = ImVec2((float)subCol / scale, (float)subRow / scale);
+                tile.uv1 = ImVec2((float)(subCol + 1) / scale, (float)(subRow + 1) / scale);
+                break;
+            }
+        }
+    }
+
+    // only the current view is worth decoding, drop whatever an earlier view queued
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests.erase(std::remove_if(m_requests.begin(), m_requests.end(),
+                                    [](uint64_t key) { return (key >> 56) != 0; }),
+                     m_requests.end());
+    for (uint64_t key : missing) {
+        if (!m_inFlight.count(key) && std::find(m_requests.begin(), m_requests.end(), key) == m_requests.end()) {
+            m_requests.push_back(key);
+        }
+    }
+    if (!m_requests.empty()) m_cv.notify_all();
+}
+
+bool EarthImagery::hasPendingWork() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_requests.empty() || !m_inFlight.empty() || !m_done.empty();
+}
@@ -0,0 +1,120 @@
+//
+// EarthImagery.h
+// Background-decoded, mipmapped Earth imagery with optional tiled pyramid streaming
+//
+
+#ifndef EARTHIMAGERY_H
+#define EARTHIMAGERY_H
+
+#include <imgui.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "glad.h"
+
+// A resident texture (or part of one) covering a lat/lon rectangle of the map
+struct ImageryTile {
+    GLuint texture;
+    float latMin, latMax;
+    float lonMin, lonMax;
+    ImVec2 uv0, uv1;
+};
+
+// Images are decoded on worker threads and uploaded (with mipmaps) on the render thread a
+// few per frame, so nothing on startup or while panning waits on JPEG decoding.
+//
+// Two sources are supported:
+//  - a single equirectangular image (the classic assets/earth_texture.jpg)
+//  - a tiled pyramid laid out as <root>/<level>/<row>_<col>.jpg, where level 0 is two
+//    tiles side by side (west/east hemispheres) and every level doubles rows and columns.
+//    Only tiles visible at the current zoom are streamed in, least recently used tiles are
+//    evicted once the GPU budget is exceeded, and coarser parents fill in while children load.
+class EarthImagery {
+public:
+    EarthImagery();
+    ~EarthImagery();
+
+    EarthImagery(const EarthImagery&) = delete;
+    EarthImagery& operator=(const EarthImagery&) = delete;
+
+    // Starts decoding a single equirectangular image, returns immediately
+    void loadImageAsync(const std::string& filePath);
+
+    // Switches to a tiled pyramid, returns false when rootDir has no level 0
+    bool openPyramid(const std::string& rootDir);
+
+    // Render thread: uploads finished decodes, a bounded number per call
+    void update();
+
+    // Best available tiles covering the visible window. worldWidthPx is how wide the whole
+    // 360 deg world currently is on screen, which picks the pyramid level
+    void collectVisible(double latMin, double latMax, double lonMin, double lonMax,
+                        float worldWidthPx, std::vector<ImageryTile>& out);
+
+    // True while decodes or uploads are outstanding
+    bool hasPendingWork() const;
+
+    void setGpuBudget(size_t bytes) { m_gpuBudget = bytes; }
+    size_t gpuBytes() const { return m_gpuBytes; }
+    int maxLevel() const { return m_maxLevel; }
+
+private:
+    struct Tile {
+        GLuint texture = 0;
+        size_t bytes = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    struct Decoded {
+        uint64_t key;
+        int width = 0;
+        int height = 0;
+        unsigned char* pixels = nullptr;   // stbi owned, nullptr when decoding failed
+        std::string error;
+    };
+
+    static uint64_t tileKey(int level, int row, int col);
+    int columns(int level) const { return m_baseCols << level; }
+    int rows(int level) const { return m_baseRows << level; }
+    std::string tilePath(int level, int row, int col) const;
+
+    void reset();
+    void workerLoop();
+    void upload(const Decoded& decoded);
+    void evict();
+    bool appendTile(int level, int row, int col, std::vector<ImageryTile>& out);
+
+    // Source description
+    std::string m_singleImage;
+    std::string m_root;
+    int m_baseCols = 1;
+    int m_baseRows = 1;
+    int m_maxLevel = 0;
+    int m_generation = 0;   // bumps when the source changes so stale decodes are dropped
+
+    // Resident tiles, render thread only
+    std::unordered_map<uint64_t, Tile> m_tiles;
+    std::unordered_set<uint64_t> m_failed;      // never re-requested
+    size_t m_gpuBytes = 0;
+    size_t m_gpuBudget = 256u * 1024u * 1024u;
+    uint64_t m_frame = 0;
+
+    // Decode queue shared with the workers
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<uint64_t> m_requests;            // newest view first
+    std::unordered_set<uint64_t> m_inFlight;     // requested or decoding, not yet uploaded
+    std::deque<std::pair<int, Decoded>> m_done;  // (generation, image)
+    bool m_stopping = false;
+    std::vector<std::thread> m_workers;
+};
+
+#endif //EARTHIMAGERY_H
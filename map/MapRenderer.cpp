@@ -0,0 +1,512 @@
+//
+// MapRenderer.cpp
+// GPU drawing of the world map layers, projected in the vertex shader
+//
+
+#include "MapRenderer.h"
+#include "SatelliteMapWindow.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+// Tessellation of one imagery tile, fine enough that the globe limb stays round
+constexpr int TILE_MESH_COLS = 64;
+constexpr int TILE_MESH_ROWS = 32;
+// Spacing of the grid line samples (deg), grid lines every GRID_STEP_DEG
+constexpr int GRID_SAMPLE_DEG = 2;
+constexpr int GRID_STEP_DEG = 30;
+
+// Projection math shared by every map shader. Returns the projected position relative to
+// the map center at zoom 1 (px, y down) and a visibility term, negative on the far side of
+// the globe or beyond the polar limit. MapProjection mirrors this on the CPU for picking.
+static const char* PROJECTION_GLSL = R"(
+#version 130
+uniform int uProjection;        // MapRenderer::Projection
+uniform vec2 uCenter;           // view center lat, lon (deg)
+uniform vec2 uProjectionSize;
+uniform vec2 uOrigin;
+uniform float uZoom;
+uniform vec2 uDisplaySize;
+
+const float DEG2RAD = 0.017453292519943295;
+const float POLAR_LIMIT = 60.0;  // polar views reach this far past the equator
+
+vec3 projectLatLon(vec2 latLon)
+{
+    float lat = latLon.x;
+    float dLon = latLon.y - uCenter.y;
+    if (uProjection == 1) {
+        float radius = uProjectionSize.y * 0.5;
+        float phi = lat * DEG2RAD;
+        float phi0 = uCenter.x * DEG2RAD;
+        float lambda = dLon * DEG2RAD;
+        float x = radius * cos(phi) * sin(lambda);
+        float y = -radius * (cos(phi0) * sin(phi) - sin(phi0) * cos(phi) * cos(lambda));
+        float facing = sin(phi0) * sin(phi) + cos(phi0) * cos(phi) * cos(lambda);
+        return vec3(x, y, facing);
+    }
+    if (uProjection == 2 || uProjection == 3) {
+        float hemisphere = uProjection == 2 ? 1.0 : -1.0;
+        float polarLat = max(hemisphere * lat, -POLAR_LIMIT - 10.0);
+        float r = uProjectionSize.y * 0.25 * tan((90.0 - polarLat) * 0.5 * DEG2RAD);
+        float lambda = dLon * DEG2RAD;
+        return vec3(r * sin(lambda), hemisphere * r * cos(lambda), hemisphere * lat + POLAR_LIMIT);
+    }
+    float lon = latLon.y;
+    if (lon > 180.0) lon -= 360.0;
+    if (lon < -180.0) lon += 360.0;
+    return vec3(lon / 360.0 * uProjectionSize.x, -lat / 180.0 * uProjectionSize.y, 1.0);
+}
+
+vec4 toClip(vec2 projected)
+{
+    vec2 screen = uOrigin + projected * uZoom;
+    return vec4(screen.x / uDisplaySize.x * 2.0 - 1.0, 1.0 - screen.y / uDisplaySize.y * 2.0, 0.0, 1.0);
+}
+)";
+
+static const char* LINE_VERTEX_GLSL = R"(
+in vec2 aLatLon;
+uniform float uPointSize;
+out float vVisible;
+void main()
+{
+    if (isnan(aLatLon.x) || isnan(aLatLon.y)) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0); // outside the clip volume
+        vVisible = -1.0;
+        return;
+    }
+    vec3 p = projectLatLon(aLatLon);
+    vVisible = p.z;
+    gl_Position = toClip(p.xy);
+    gl_PointSize = uPointSize;
+}
+)";
+
+static const char* LINE_FRAGMENT_GLSL = R"(
+#version 130
+uniform vec4 uColor;
+uniform bool uRoundPoints;
+in float vVisible;
+out vec4 outColor;
+void main()
+{
+    if (vVisible < 0.0)
+        discard;
+    if (uRoundPoints) {
+        vec2 d = gl_PointCoord - vec2(0.5);
+        if (dot(d, d) > 0.25)
+            discard;
+    }
+    outColor = uColor;
+}
+)";
+
+static const char* TILE_VERTEX_GLSL = R"(
+in vec2 aLatLon;                 // position inside the tile, (0, 0) is the north west corner
+uniform vec4 uTileBounds;        // latMin, latMax, lonMin, lonMax
+uniform vec4 uTileUV;            // uv0, uv1
+out vec2 vTexCoord;
+out float vVisible;
+void main()
+{
+    vec2 latLon = vec2(mix(uTileBounds.y, uTileBounds.x, aLatLon.y), mix(uTileBounds.z, uTileBounds.w, aLatLon.x));
+    vec3 p = projectLatLon(latLon);
+    vVisible = p.z;
+    vTexCoord = mix(uTileUV.xy, uTileUV.zw, aLatLon);
+    gl_Position = toClip(p.xy);
+}
+)";
+
+static const char* TILE_FRAGMENT_GLSL = R"(
+#version 130
+uniform sampler2D uTexture;
+in vec2 vTexCoord;
+in float vVisible;
+out vec4 outColor;
+void main()
+{
+    if (vVisible < 0.0)
+        discard;
+    outColor = texture(uTexture, vTexCoord);
+}
+)";
+
+static GLuint compileShader(GLenum type, const char* source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Failed to compile map shader: " << log << "\n";
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static void setLatLonLayout(GLuint vao, GLuint vbo) {
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+}
+
+MapRenderer::~MapRenderer() {
+    GLuint buffers[] = { m_pointVbo, m_trackVbo, m_gridVbo, m_tileVbo, m_tileEbo };
+    for (GLuint buffer : buffers) {
+        if (buffer) glDeleteBuffers(1, &buffer);
+    }
+    GLuint arrays[] = { m_pointVao, m_trackVao, m_gridVao, m_tileVao };
+    for (GLuint vao : arrays) {
+        if (vao) glDeleteVertexArrays(1, &vao);
+    }
+    if (m_lineProgram.id) glDeleteProgram(m_lineProgram.id);
+    if (m_tileProgram.id) glDeleteProgram(m_tileProgram.id);
+}
+
+bool MapRenderer::buildProgram(Program& program, const char* fragmentSource, const char* vertexBody) {
+    std::string vertexSource = std::string(PROJECTION_GLSL) + vertexBody;
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource.c_str());
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vs || !fs) {
+        if (vs) glDeleteShader(vs);
+        if (fs) glDeleteShader(fs);
+        return false;
+    }
+
+    program.id = glCreateProgram();
+    glAttachShader(program.id, vs);
+    glAttachShader(program.id, fs);
+    glBindAttribLocation(program.id, 0, "aLatLon");
+    glBindFragDataLocation(program.id, 0, "outColor");
+    glLinkProgram(program.id);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    GLint ok = 0;
+    glGetProgramiv(program.id, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        std::cerr << "Failed to link map shader.\n";
+        glDeleteProgram(program.id);
+        program.id = 0;
+        return false;
+    }
+
+    program.projection = glGetUniformLocation(program.id, "uProjection");
+    program.center = glGetUniformLocation(program.id, "uCenter");
+    program.projectionSize = glGetUniformLocation(program.id, "uProjectionSize");
+    program.origin = glGetUniformLocation(program.id, "uOrigin");
+    program.zoom = glGetUniformLocation(program.id, "uZoom");
+    program.displaySize = glGetUniformLocation(program.id, "uDisplaySize");
+    program.color = glGetUniformLocation(program.id, "uColor");
+    program.pointSize = glGetUniformLocation(program.id, "uPointSize");
+    program.roundPoints = glGetUniformLocation(program.id, "uRoundPoints");
+    program.tileBounds = glGetUniformLocation(program.id, "uTileBounds");
+    program.tileUV = glGetUniformLocation(program.id, "uTileUV");
+    program.texture = glGetUniformLocation(program.id, "uTexture");
+    return true;
+}
+
+bool MapRenderer::ensureResources() {
+    if (m_ready) return true;
+    if (m_failed) return false;
+
+    if (!buildProgram(m_lineProgram, LINE_FRAGMENT_GLSL, LINE_VERTEX_GLSL) ||
+        !buildProgram(m_tileProgram, TILE_FRAGMENT_GLSL, TILE_VERTEX_GLSL)) {
+        m_failed = true;
+        return false;
+    }
+
+    glGenVertexArrays(1, &m_pointVao);
+    glGenBuffers(1, &m_pointVbo);
+    setLatLonLayout(m_pointVao, m_pointVbo);
+
+    glGenVertexArrays(1, &m_trackVao);
+    glGenBuffers(1, &m_trackVbo);
+    setLatLonLayout(m_trackVao, m_trackVbo);
+
+    glGenVertexArrays(1, &m_gridVao);
+    glGenBuffers(1, &m_gridVbo);
+    setLatLonLayout(m_gridVao, m_gridVbo);
+    buildGrid();
+
+    glGenVertexArrays(1, &m_tileVao);
+    glGenBuffers(1, &m_tileVbo);
+    glGenBuffers(1, &m_tileEbo);
+    setLatLonLayout(m_tileVao, m_tileVbo);
+    buildTileMesh();
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_ready = true;
+    return true;
+}
+
+void MapRenderer::buildTileMesh() {
+    // unit grid shared by every tile, the shader maps it onto the tile bounds
+    std::vector<float> vertices;
+    vertices.reserve((TILE_MESH_COLS + 1) * (TILE_MESH_ROWS + 1) * 2);
+    for (int row = 0; row <= TILE_MESH_ROWS; row++) {
+        for (int col = 0; col <= TILE_MESH_COLS; col++) {
+            vertices.push_back((float)col / TILE_MESH_COLS);
+            vertices.push_back((float)row / TILE_MESH_ROWS);
+        }
+    }
+
+    std::vector<GLushort> indices;
+    indices.reserve(TILE_MESH_COLS * TILE_MESH_ROWS * 6);
+    for (int row = 0; row < TILE_MESH_ROWS; row++) {
+        for (int col = 0; col < TILE_MESH_COLS; col++) {
+            GLushort topLeft = (GLushort)(row * (TILE_MESH_COLS + 1) + col);
+            GLushort bottomLeft = (GLushort)(topLeft + TILE_MESH_COLS + 1);
+            indices.insert(indices.end(), { topLeft, bottomLeft, (GLushort)(topLeft + 1),
+                                            (GLushort)(topLeft + 1), bottomLeft, (GLushort)(bottomLeft + 1) });
+        }
+    }
+
+    // the element buffer binding is VAO state, so bind it while the tile VAO is current
+    glBindVertexArray(m_tileVao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_tileVbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_tileEbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    m_tileIndexCount = (int)indices.size();
+}
+
+void MapRenderer::buildGrid() {
+    std::vector<float> vertices;
+    auto addStrip = [&](std::vector<GLint>& first, std::vector<GLint>& count, bool parallel, int fixed) {
+        first.push_back((GLint)(vertices.size() / 2));
+        int limit = parallel ? 180 : 90;
+        for (int v = -limit; v <= limit; v += GRID_SAMPLE_DEG) {
+            vertices.push_back((float)(parallel ? fixed : v));
+            vertices.push_back((float)(parallel ? v : fixed));
+        }
+        count.push_back((GLint)(vertices.size() / 2) - first.back());
+    };
+
+    // parallels and meridians are sampled densely so they curve in every projection
+    for (int lat = -90 + GRID_STEP_DEG; lat < 90; lat += GRID_STEP_DEG) {
+        if (lat != 0) addStrip(m_gridFirst, m_gridCount, true, lat);
+    }
+    for (int lon = -180; lon < 180; lon += GRID_STEP_DEG) {
+        if (lon != 0) addStrip(m_gridFirst, m_gridCount, false, lon);
+    }
+    addStrip(m_primaryFirst, m_primaryCount, true, 0);    // Equator
+    addStrip(m_primaryFirst, m_primaryCount, false, 0);   // Prime meridian
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_gridVbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+}
+
+void MapRenderer::setPoints(const std::vector<float>& lat, const std::vector<float>& lon) {
+    if (!ensureResources()) return;
+
+    size_t count = std::min(lat.size(), lon.size());
+    m_staging.resize(count * 2);
+    for (size_t i = 0; i < count; i++) {
+        m_staging[i * 2] = lat[i];
+        m_staging[i * 2 + 1] = lon[i];
+    }
+
+    // orphan the old storage so we never wait on a frame still using it
+    glBindBuffer(GL_ARRAY_BUFFER, m_pointVbo);
+    glBufferData(GL_ARRAY_BUFFER, m_staging.size() * sizeof(float), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_staging.size() * sizeof(float), m_staging.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_pointCount = (int)count;
+}
+
+void MapRenderer::setTracks(const std::vector<SatelliteTrack>& tracks) {
+    m_trackRanges.clear();
+    if (!ensureResources()) return;
+
+    // Tracks become line segments. A segment crossing the antimeridian is split at +-180 so
+    // the equirectangular view does not streak across the map; on the globe the two halves
+    // meet again, so one buffer serves every projection.
+    m_staging.clear();
+    auto push = [&](float lat, float lon) {
+        m_staging.push_back(lat);
+        m_staging.push_back(lon);
+    };
+
+    for (const auto& track : tracks) {
+        TrackRange range;
+        range.first = (int)(m_staging.size() / 2);
+        range.verticesAtPoint.assign(track.geoPoints.size(), 0);
+
+        for (size_t i = 1; i < track.geoPoints.size(); i++) {
+            ImVec2 a = track.geoPoints[i - 1];
+            ImVec2 b = track.geoPoints[i];
+            if (!std::isnan(a.x) && !std::isnan(b.x)) {
+                float dLon = b.y - a.y;
+                if (std::fabs(dLon) > 180.0f) {
+                    float edge = a.y > 0.0f ? 180.0f : -180.0f;
+                    float unwrapped = b.y + (edge > 0.0f ? 360.0f : -360.0f);
+                    float t = (edge - a.y) / (unwrapped - a.y);
+                    float crossingLat = a.x + t * (b.x - a.x);
+                    push(a.x, a.y);
+                    push(crossingLat, edge);
+                    push(crossingLat, -edge);
+                    push(b.x, b.y);
+                } else {
+                    push(a.x, a.y);
+                    push(b.x, b.y);
+                }
+            }
+            range.verticesAtPoint[i] = (int)(m_staging.size() / 2) - range.first;
+        }
+        m_trackRanges.push_back(std::move(range));
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_trackVbo);
+    glBufferData(GL_ARRAY_BUFFER, m_staging.size() * sizeof(float), m_staging.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MapRenderer::beginFrame(const View& view) {
+    m_view = view;
+    m_layers.clear();
+}
+
+void MapRenderer::addTiles(const std::vector<ImageryTile>& tiles) {
+    for (const auto& tile : tiles) {
+        Layer layer{};
+        layer.type = LAYER_TILE;
+        layer.tile = tile;
+        m_layers.push_back(layer);
+    }
+}
+
+void MapRenderer::addGrid() {
+    Layer layer{};
+    layer.type = LAYER_GRID;
+    m_layers.push_back(layer);
+}
+
+void MapRenderer::addTrack(int trackIndex, ImU32 color, int pointLimit) {
+    if (trackIndex < 0 || trackIndex >= (int)m_trackRanges.size()) return;
+
+    const TrackRange& range = m_trackRanges[trackIndex];
+    if (range.verticesAtPoint.empty()) return;
+
+    int lastPoint = pointLimit < 0 ? (int)range.verticesAtPoint.size() - 1
+                                   : std::min(pointLimit, (int)range.verticesAtPoint.size()) - 1;
+    if (lastPoint < 1) return;
+
+    Layer layer{};
+    layer.type = LAYER_TRACK;
+    layer.first = range.first;
+    layer.count = range.verticesAtPoint[lastPoint];
+    layer.color = ImGui::ColorConvertU32ToFloat4(color);
+    m_layers.push_back(layer);
+}
+
+void MapRenderer::addPoints(float pointSize, const ImVec4& color) {
+    if (m_pointCount == 0) return;
+
+    Layer layer{};
+    layer.type = LAYER_POINTS;
+    layer.pointSize = pointSize;
+    layer.color = color;
+    m_layers.push_back(layer);
+}
+
+void MapRenderer::queue(ImDrawList* drawList, const ImVec2& clipMin, const ImVec2& clipMax) {
+    if (m_layers.empty() || !ensureResources()) return;
+
+    drawList->PushClipRect(clipMin, clipMax, true);
+    drawList->AddCallback(&MapRenderer::drawCallback, this);
+    drawList->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+    drawList->PopClipRect();
+}
+
+void MapRenderer::drawCallback(const ImDrawList*, const ImDrawCmd* cmd) {
+    static_cast<MapRenderer*>(cmd->UserCallbackData)->execute(cmd);
+}
+
+void MapRenderer::setViewUniforms(const Program& program) const {
+    const ImGuiIO& io = ImGui::GetIO();
+    glUseProgram(program.id);
+    glUniform1i(program.projection, m_view.projection);
+    glUniform2f(program.center, m_view.centerLat, m_view.centerLon);
+    glUniform2f(program.projectionSize, m_view.projectionSize.x, m_view.projectionSize.y);
+    glUniform2f(program.origin, m_view.origin.x, m_view.origin.y);
+    glUniform1f(program.zoom, m_view.zoom);
+    glUniform2f(program.displaySize, io.DisplaySize.x, io.DisplaySize.y);
+}
+
+void MapRenderer::execute(const ImDrawCmd* cmd) {
+    const ImGuiIO& io = ImGui::GetIO();
+
+    // clip rect is in display coordinates, scissor wants framebuffer pixels from the bottom left
+    ImVec2 scale = io.DisplayFramebufferScale;
+    glScissor((int)(cmd->ClipRect.x * scale.x),
+              (int)((io.DisplaySize.y - cmd->ClipRect.w) * scale.y),
+              (int)((cmd->ClipRect.z - cmd->ClipRect.x) * scale.x),
+              (int)((cmd->ClipRect.w - cmd->ClipRect.y) * scale.y));
+
+    const Program* current = nullptr;
+    auto use = [&](const Program& program) {
+        if (current == &program) return;
+        setViewUniforms(program);
+        current = &program;
+    };
+
+    for (const Layer& layer : m_layers) {
+        switch (layer.type) {
+            case LAYER_TILE:
+                use(m_tileProgram);
+                glUniform4f(m_tileProgram.tileBounds, layer.tile.latMin, layer.tile.latMax, layer.tile.lonMin, layer.tile.lonMax);
+                glUniform4f(m_tileProgram.tileUV, layer.tile.uv0.x, layer.tile.uv0.y, layer.tile.uv1.x, layer.tile.uv1.y);
+                glUniform1i(m_tileProgram.texture, 0);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, layer.tile.texture);
+                glBindVertexArray(m_tileVao);
+                glDrawElements(GL_TRIANGLES, m_tileIndexCount, GL_UNSIGNED_SHORT, nullptr);
+                break;
+
+            case LAYER_GRID:
+                use(m_lineProgram);
+                glUniform1i(m_lineProgram.roundPoints, 0);
+                glBindVertexArray(m_gridVao);
+                glUniform4f(m_lineProgram.color, 100 / 255.0f, 100 / 255.0f, 100 / 255.0f, 128 / 255.0f);
+                glMultiDrawArrays(GL_LINE_STRIP, m_gridFirst.data(), m_gridCount.data(), (GLsizei)m_gridFirst.size());
+                glLineWidth(2.0f);
+                glUniform4f(m_lineProgram.color, 150 / 255.0f, 150 / 255.0f, 150 / 255.0f, 200 / 255.0f);
+                glMultiDrawArrays(GL_LINE_STRIP, m_primaryFirst.data(), m_primaryCount.data(), (GLsizei)m_primaryFirst.size());
+                glLineWidth(1.0f);
+                break;
+
+            case LAYER_TRACK:
+                use(m_lineProgram);
+                glUniform1i(m_lineProgram.roundPoints, 0);
+                glUniform4f(m_lineProgram.color, layer.color.x, layer.color.y, layer.color.z, layer.color.w);
+                glBindVertexArray(m_trackVao);
+                glLineWidth(2.0f);
+                glDrawArrays(GL_LINES, layer.first, layer.count);
+                glLineWidth(1.0f);
+                break;
+
+            case LAYER_POINTS:
+                use(m_lineProgram);
+                glEnable(GL_PROGRAM_POINT_SIZE);
+                glUniform1i(m_lineProgram.roundPoints, 1);
+                glUniform1f(m_lineProgram.pointSize, layer.pointSize * scale.x);
+                glUniform4f(m_lineProgram.color, layer.color.x, layer.color.y, layer.color.z, layer.color.w);
+                glBindVertexArray(m_pointVao);
+                glDrawArrays(GL_POINTS, 0, m_pointCount);
+                glDisable(GL_PROGRAM_POINT_SIZE);
+                break;
+        }
+    }
+    glBindVertexArray(0);
+}
@@ -0,0 +1,123 @@
+//
+// MapRenderer.h
+// GPU drawing of the world map layers, projected in the vertex shader
+//
+
+#ifndef MAPRENDERER_H
+#define MAPRENDERER_H
+
+#include <imgui.h>
+#include <vector>
+
+#include "EarthImagery.h"
+#include "glad.h"
+
+struct SatelliteTrack;
+
+// All map geometry is uploaded once as raw lat/lon (deg) and projected on the GPU, so
+// switching projection or rotating the globe only changes uniforms. Layers are recorded
+// each frame and executed from a single ImDrawList callback, which also sidesteps the
+// 64k vertex limit of ImGui draw lists with the GL 3.0 backend.
+class MapRenderer {
+public:
+    // Projection ids, shared with the shader source
+    enum Projection {
+        EQUIRECTANGULAR = 0,
+        ORTHOGRAPHIC = 1,
+        POLAR_NORTH = 2,
+        POLAR_SOUTH = 3,
+    };
+
+    struct View {
+        int projection;
+        float centerLat;        // View center (deg), orthographic and polar use it to rotate
+        float centerLon;
+        ImVec2 projectionSize;  // Size of the projected map at zoom 1 (px)
+        ImVec2 origin;          // Screen position of the map center after pan (px)
+        float zoom;
+    };
+
+    MapRenderer() = default;
+    ~MapRenderer();
+
+    MapRenderer(const MapRenderer&) = delete;
+    MapRenderer& operator=(const MapRenderer&) = delete;
+
+    // Data uploads, only needed when the data itself changes
+    void setPoints(const std::vector<float>& lat, const std::vector<float>& lon);
+    void setTracks(const std::vector<SatelliteTrack>& tracks);
+
+    // Per frame layer recording, drawn in the order added
+    void beginFrame(const View& view);
+    void addTiles(const std::vector<ImageryTile>& tiles);
+    void addGrid();
+    void addTrack(int trackIndex, ImU32 color, int pointLimit);   // pointLimit < 0 draws the whole track
+    void addPoints(float pointSize, const ImVec4& color);
+
+    // Adds the callback to the list, clipped to the given screen rectangle
+    void queue(ImDrawList* drawList, const ImVec2& clipMin, const ImVec2& clipMax);
+
+private:
+    enum LayerType { LAYER_TILE, LAYER_GRID, LAYER_TRACK, LAYER_POINTS };
+
+    struct Layer {
+        LayerType type;
+        ImageryTile tile;       // LAYER_TILE
+        int first;              // LAYER_TRACK vertex range
+        int count;
+        ImVec4 color;
+        float pointSize;
+    };
+
+    struct Program {
+        GLuint id = 0;
+        GLint projection = -1;
+        GLint center = -1;
+        GLint projectionSize = -1;
+        GLint origin = -1;
+        GLint zoom = -1;
+        GLint displaySize = -1;
+        GLint color = -1;
+        GLint pointSize = -1;
+        GLint roundPoints = -1;
+        GLint tileBounds = -1;
+        GLint tileUV = -1;
+        GLint texture = -1;
+    };
+
+    struct TrackRange {
+        int first;
+        std::vector<int> verticesAtPoint;   // Line vertices needed to reach each track point
+    };
+
+    static void drawCallback(const ImDrawList* parentList, const ImDrawCmd* cmd);
+    void execute(const ImDrawCmd* cmd);
+    void setViewUniforms(const Program& program) const;
+
+    bool ensureResources();
+    bool buildProgram(Program& program, const char* fragmentSource, const char* vertexBody);
+    void buildTileMesh();
+    void buildGrid();
+
+    bool m_ready = false;
+    bool m_failed = false;
+    Program m_lineProgram;   // points and lines, flat color
+    Program m_tileProgram;   // textured lat/lon mesh
+
+    GLuint m_pointVao = 0, m_pointVbo = 0;
+    GLuint m_trackVao = 0, m_trackVbo = 0;
+    GLuint m_gridVao = 0, m_gridVbo = 0;
+    GLuint m_tileVao = 0, m_tileVbo = 0, m_tileEbo = 0;
+
+    int m_pointCount = 0;
+    int m_tileIndexCount = 0;
+    std::vector<GLint> m_gridFirst, m_gridCount;          // minor grid line strips
+    std::vector<GLint> m_primaryFirst, m_primaryCount;    // equator and prime meridian
+    std::vector<TrackRange> m_trackRanges;
+    std::vector<float> m_staging;
+
+    View m_view{};
+    std::vector<Layer> m_layers;
+};
+
+#endif //MAPRENDERER_H
@@ -4,50 +4,138 @@
 //
 
 #include "SatelliteMapWindow.h"
+#include "../OrbitMath.h"
 #include <imgui.h>
 #include <algorithm>
 #include <cmath>
-#define STB_IMAGE_IMPLEMENTATION
-#include <iostream>
+#include <limits>
+#include <utility>
 
 #include "glad.h"
-#include "../stb_image.h"
 
-GLuint earthTexture = 0;
+// mouse travel below this many pixels still counts as a click rather than a pan
+constexpr float CLICK_SLOP_PX = 4.0f;
+// hover/click pick radius around the cursor
+constexpr float PICK_RADIUS_PX = 8.0f;
+// box selections larger than this are still selected, just not all outlined
+constexpr size_t MAX_OUTLINED_SELECTION = 2000;
+// must match the projection shader in MapRenderer.cpp
+constexpr double POLAR_LIMIT_DEG = 60.0;
+
+ImVec2 MapProjection::project(double lat, double lon, double* facing) const {
+    double x, y;
+    double dLon = (lon - centerLon) * SGP_IMPL::DEG2RAD;
+    if (type == MapRenderer::ORTHOGRAPHIC) {
+        double radius = height * 0.5;
+        double phi = lat * SGP_IMPL::DEG2RAD;
+        double phi0 = centerLat * SGP_IMPL::DEG2RAD;
+        x = radius * std::cos(phi) * std::sin(dLon);
+        y = -radius * (std::cos(phi0) * std::sin(phi) - std::sin(phi0) * std::cos(phi) * std::cos(dLon));
+        *facing = std::sin(phi0) * std::sin(phi) + std::cos(phi0) * std::cos(phi) * std::cos(dLon);
+    } else if (type == MapRenderer::POLAR_NORTH || type == MapRenderer::POLAR_SOUTH) {
+        double hemisphere = type == MapRenderer::POLAR_NORTH ? 1.0 : -1.0;
+        double polarLat = std::max(hemisphere * lat, -POLAR_LIMIT_DEG - 10.0);
+        double r = height * 0.25 * std::tan((90.0 - polarLat) * 0.5 * SGP_IMPL::DEG2RAD);
+        x = r * std::sin(dLon);
+        y = hemisphere * r * std::cos(dLon);
+        *facing = hemisphere * lat + POLAR_LIMIT_DEG;
+    } else {
+        // Normalize longitude to [-180, 180]
+        x = std::remainder(lon, 360.0) / 360.0 * width;
+        y = -lat / 180.0 * height;
+        *facing = 1.0;
+    }
+    return ImVec2((float)x + width * 0.5f, (float)y + height * 0.5f);
+}
+
+ImVec2 MapProjection::projectToScreen(double lat, double lon) const {
+    double facing;
+    return project(lat, lon, &facing);
+}
+
+bool MapProjection::projectVisible(double lat, double lon, ImVec2* mapPos) const {
+    double facing;
+    *mapPos = project(lat, lon, &facing);
+    return facing >= 0.0;
+}
+
+bool MapProjection::unproject(const ImVec2& mapPos, double* lat, double* lon) const {
+    double x = mapPos.x - width * 0.5;
+    double y = mapPos.y - height * 0.5;
+
+    if (type == MapRenderer::ORTHOGRAPHIC) {
+        double radius = height * 0.5;
+        double xn = x / radius;
+        double yn = -y / radius;
+        double rho = std::hypot(xn, yn);
+        if (rho > 1.0) return false;
+
+        double phi0 = centerLat * SGP_IMPL::DEG2RAD;
+        if (rho < 1e-12) {
+            *lat = centerLat;
+            *lon = centerLon;
+            return true;
+        }
+        double c = std::asin(rho);
+        *lat = std::asin(std::cos(c) * std::sin(phi0) + yn * std::sin(c) * std::cos(phi0) / rho) * SGP_IMPL::RAD2DEG;
+        *lon = centerLon + std::atan2(xn * std::sin(c), rho * std::cos(c) * std::cos(phi0) - yn * std::sin(c) * std::sin(phi0))
+                           * SGP_IMPL::RAD2DEG;
+        *lon = std::remainder(*lon, 360.0);
+        return true;
+    }
+
+    if (type == MapRenderer::POLAR_NORTH || type == MapRenderer::POLAR_SOUTH) {
+        double hemisphere = type == MapRenderer::POLAR_NORTH ? 1.0 : -1.0;
+        double r = std::hypot(x, y);
+        double polarLat = 90.0 - 2.0 * std::atan(r / (height * 0.25)) * SGP_IMPL::RAD2DEG;
+        if (polarLat < -POLAR_LIMIT_DEG) return false;
+        *lat = hemisphere * polarLat;
+        *lon = std::remainder(centerLon + std::atan2(x, hemisphere * y) * SGP_IMPL::RAD2DEG, 360.0);
+        return true;
+    }
+
+    *lon = mapPos.x / width * 360.0 - 180.0;
+    *lat = 90.0 - mapPos.y / height * 180.0;
+    return true;
+}
 
 SatelliteMapWindow::SatelliteMapWindow()
     : mapSize(800, 400)
     , showGrid(true)
     , animateTracks(false)
-    , animationSpeed(1)
+    , animationSpeed(60)
+    , liveMode(false)
+    , simTime(0.0)
+    , requestedTime(std::numeric_limits<double>::quiet_NaN())
     , zoomLevel(1.0f)
     , panOffset(0, 0)
     , isDragging(false)
+    , isBoxSelecting(false)
+    , isRotating(false)
     , lastMousePos(0, 0)
+    , dragStart(0, 0)
+    , selectedSatellite(-1)
+    , selectionChanged(false)
+    , uploadedFrame(0)
+    , tracksDirty(true)
 {
     projection.width = mapSize.x;
     projection.height = mapSize.y;
     projection.centerLat = 0.0f;
     projection.centerLon = 0.0f;
-    loadEarthTexture("assets/earth_texture.jpg"); // Load the Earth texture
+    projection.type = MapRenderer::EQUIRECTANGULAR;
+    // Prefer the streamed pyramid when it is installed, fall back to the single image
+    if (!loadEarthPyramid("assets/earth_tiles")) {
+        loadEarthTexture("assets/earth_texture.jpg");
+    }
 }
 
 void SatelliteMapWindow::loadEarthTexture(const std::string& filePath) {
-    int width, height, channels;
-    unsigned char* data = stbi_load(filePath.c_str(), &width, &height, &channels, 4);
-    if (!data) {
-        std::cerr << "Failed to load earth texture.\n";
-        return;
-    }
-
-    glGenTextures(1, &earthTexture);
-    glBindTexture(GL_TEXTURE_2D, earthTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    imagery.loadImageAsync(filePath);
+}
 
-    stbi_image_free(data);
+bool SatelliteMapWindow::loadEarthPyramid(const std::string& rootDir) {
+    return imagery.openPyramid(rootDir);
 }
 
 void SatelliteMapWindow::render() {
@@ -56,7 +144,13 @@ void SatelliteMapWindow::render() {
         return;
     }
 
+    imagery.update();
     drawControls();
+    advanceClock();
+    syncTrackIndex();
+    if (liveMode) {
+        syncLiveFrame();
+    }
 
     // Get the draw list and canvas position
     ImDrawList* drawList = ImGui::GetWindowDrawList();
@@ -93,13 +187,36 @@ void SatelliteMapWindow::render() {
             panOffset.y -= mouseOffset.y * zoomDelta;
         }
 
-        // Pan with mouse drag
+        // Pan with mouse drag, box select with shift + drag
         if (ImGui::IsMouseClicked(0)) {
-            isDragging = true;
+            if (ImGui::GetIO().KeyShift) {
+                isBoxSelecting = true;
+            } else {
+                isDragging = true;
+            }
+            lastMousePos = mousePos;
+            dragStart = mousePos;
+        }
+
+        // Rotate the globe with right drag, the flat map has nothing to rotate
+        if (ImGui::IsMouseClicked(1) && projection.type != MapRenderer::EQUIRECTANGULAR) {
+            isRotating = true;
             lastMousePos = mousePos;
         }
     }
 
+    if (isRotating) {
+        if (ImGui::IsMouseDown(1)) {
+            // roughly keeps the point under the cursor following it near the view center
+            float degPerPx = 90.0f / (projection.height * 0.5f * zoomLevel);
+            projection.centerLon = (float)std::remainder(projection.centerLon - (mousePos.x - lastMousePos.x) * degPerPx, 360.0);
+            projection.centerLat = std::clamp(projection.centerLat + (mousePos.y - lastMousePos.y) * degPerPx, -90.0f, 90.0f);
+            lastMousePos = mousePos;
+        } else {
+            isRotating = false;
+        }
+    }
+
     if (isDragging) {
         if (ImGui::IsMouseDown(0)) {
             ImVec2 delta = ImVec2(mousePos.x - lastMousePos.x, mousePos.y - lastMousePos.y);
@@ -108,15 +225,55 @@ void SatelliteMapWindow::render() {
             lastMousePos = mousePos;
         } else {
             isDragging = false;
+
+            // a press and release without real movement is a click
+            float dx = mousePos.x - dragStart.x;
+            float dy = mousePos.y - dragStart.y;
+            if (dx * dx + dy * dy < CLICK_SLOP_PX * CLICK_SLOP_PX) {
+                selectAt(mousePos, canvasPos);
+            }
         }
     }
 
-    // Draw the map
-    drawWorldMap(drawList, canvasPos);
+    if (isBoxSelecting && !ImGui::IsMouseDown(0)) {
+        isBoxSelecting = false;
+        selectBox(dragStart, mousePos, canvasPos);
+    }
+
+    // Draw the map, the layers are recorded here and drawn on the GPU by the renderer
+    if (tracksDirty) {
+        renderer.setTracks(tracks);
+        tracksDirty = false;
+    }
+
+    MapRenderer::View view;
+    view.projection = projection.type;
+    view.centerLat = projection.centerLat;
+    view.centerLon = projection.centerLon;
+    view.projectionSize = ImVec2(projection.width, projection.height);
+    view.origin = ImVec2(canvasPos.x + mapSize.x * 0.5f + panOffset.x,
+                         canvasPos.y + mapSize.y * 0.5f + panOffset.y);
+    view.zoom = zoomLevel;
+    renderer.beginFrame(view);
+
+    drawWorldMap(canvasPos);
     if (showGrid) {
-        drawGrid(drawList, canvasPos);
+        drawGrid();
+    }
+    drawSatelliteTracks();
+    if (liveMode) {
+        drawLiveCatalog();
+    }
+    renderer.queue(drawList, canvasPos, ImVec2(canvasPos.x + mapSize.x, canvasPos.y + mapSize.y));
+
+    drawSelection(drawList, canvasPos);
+
+    if (isBoxSelecting) {
+        drawList->AddRectFilled(dragStart, mousePos, IM_COL32(100, 160, 255, 40));
+        drawList->AddRect(dragStart, mousePos, IM_COL32(100, 160, 255, 200));
+    } else if (isHovered && !isDragging) {
+        drawHoverTooltip(mousePos, canvasPos);
     }
-    drawSatelliteTracks(drawList, canvasPos);
 
     ImGui::EndChild();
     ImGui::End();
@@ -129,6 +286,14 @@ void SatelliteMapWindow::drawControls() {
     ImGui::Checkbox("Show Grid", &showGrid);
     ImGui::SameLine();
     ImGui::Checkbox("Animate Tracks", &animateTracks);
+    ImGui::SameLine();
+    ImGui::Checkbox("Live Catalog", &liveMode);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(180);
+    int projectionType = projection.type;
+    if (ImGui::Combo("Projection", &projectionType, "Equirectangular\0Orthographic (globe)\0Polar north\0Polar south\0")) {
+        setProjection(projectionType);
+    }
 
     if (ImGui::SliderFloat("Zoom", &zoomLevel, 0.1f, 10.0f, "%.1fx")) {
         // Clamp zoom level
@@ -139,42 +304,246 @@ void SatelliteMapWindow::drawControls() {
     if (ImGui::Button("Reset View")) {
         zoomLevel = 1.0f;
         panOffset = ImVec2(0, 0);
+        projection.centerLat = 0.0f;
+        projection.centerLon = 0.0f;
     }
 
-    if (animateTracks) {
-        ImGui::SliderInt("Animation Speed", &animationSpeed, 1, 10);
+    if (animateTracks || liveMode) {
+        drawAnimationControls();
     }
 
-    ImGui::Text("Satellites: %zu", tracks.size());
+    ImGui::Text("Satellites: %zu", liveMode ? animator.size() : tracks.size());
     ImGui::Separator();
 }
 
-void SatelliteMapWindow::drawWorldMap(ImDrawList* drawList, const ImVec2& canvasPos) {
-    if (earthTexture == 0) return;
+void SatelliteMapWindow::drawAnimationControls() {
+    if (ImGui::Button(animateTracks ? "Pause" : "Play")) {
+        animateTracks ? pauseAnimation() : playAnimation();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Rewind")) {
+        resetAnimation();
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(200);
+    if (ImGui::SliderInt("Speed", &animationSpeed, 1, 3600, "%dx", ImGuiSliderFlags_Logarithmic)) {
+        setAnimationSpeed(animationSpeed);
+    }
+
+    // scrub in hours from the start of the propagation span
+    float spanHours = (float)((animator.stopTime() - animator.startTime()) * 24.0);
+    float elapsedHours = (float)((simTime - animator.startTime()) * 24.0);
+    ImGui::SetNextItemWidth(400);
+    if (ImGui::SliderFloat("Time (h from start)", &elapsedHours, 0.0f, std::max(spanHours, 0.0f), "%.3f")) {
+        simTime = animator.startTime() + elapsedHours / 24.0;
+    }
+}
 
-    // Define corners of the full world in map coordinates
-    ImVec2 worldTopLeft = ImVec2(0.0f, 0.0f);
-    ImVec2 worldBottomRight = ImVec2(projection.width, projection.height);
+void SatelliteMapWindow::advanceClock() {
+    if (animator.empty()) return;
 
-    // Convert those to screen space using same transform as everything else
-    ImVec2 screenTopLeft = worldToScreen(worldTopLeft, canvasPos);
-    ImVec2 screenBottomRight = worldToScreen(worldBottomRight, canvasPos);
+    if (animateTracks) {
+        simTime += ImGui::GetIO().DeltaTime * animationSpeed / 86400.0;
+        if (simTime > animator.stopTime()) {
+            simTime = animator.startTime(); // loop over the propagated span
+        }
+    }
+    simTime = std::clamp(simTime, animator.startTime(), animator.stopTime());
 
-    ImVec2 uv0(0.0f, 0.0f);
-    ImVec2 uv1(1.0f, 1.0f);
+    for (auto& track : tracks) {
+        track.currentStep = (int)(std::upper_bound(track.pointTimes.begin(), track.pointTimes.end(), simTime)
+                                  - track.pointTimes.begin());
+    }
 
-    // Draw the Earth texture transformed by pan/zoom
-    drawList->AddImage(
-        (void*)(intptr_t)earthTexture,
-        screenTopLeft,
-        screenBottomRight,
-        uv0,
-        uv1
-    );
+    // only hand new times to the worker, a paused clock costs nothing
+    if (liveMode && simTime != requestedTime) {
+        animator.requestTime(simTime);
+        requestedTime = simTime;
+    }
 }
 
+void SatelliteMapWindow::syncLiveFrame() {
+    const CatalogAnimator::Frame& frame = animator.latestFrame();
+    if (frame.serial == uploadedFrame) return;
 
+    renderer.setPoints(frame.lat, frame.lon);
+    // most objects stay in their cell between frames, so this only re-buckets the few that moved
+    satelliteIndex.update(frame.lat, frame.lon);
+    uploadedFrame = frame.serial;
+}
+
+void SatelliteMapWindow::drawLiveCatalog() {
+    renderer.addPoints(3.0f, ImVec4(1.0f, 0.85f, 0.2f, 1.0f));
+}
+
+MapPick SatelliteMapWindow::pickAt(const ImVec2& screenPos, const ImVec2& canvasPos) const {
+    MapPick pick;
+    double lat, lon;
+    if (!screenToLatLon(screenPos, canvasPos, &lat, &lon)) return pick;
+
+    double pxPerDegLon, pxPerDegLat;
+    pixelsPerDegree(lat, lon, &pxPerDegLon, &pxPerDegLat);
+
+    if (liveMode) {
+        pick.satellite = satelliteIndex.nearest(lat, lon, pxPerDegLon, pxPerDegLat, PICK_RADIUS_PX);
+        if (pick.satellite >= 0) return pick;
+    }
+
+    int id = trackIndex.nearest(lat, lon, pxPerDegLon, pxPerDegLat, PICK_RADIUS_PX);
+    if (id >= 0) {
+        pick.track = trackPointRefs[id].first;
+        pick.trackPoint = trackPointRefs[id].second;
+        pick.satellite = tracks[pick.track].satellite;
+    }
+    return pick;
+}
 
+void SatelliteMapWindow::selectAt(const ImVec2& screenPos, const ImVec2& canvasPos) {
+    MapPick pick = pickAt(screenPos, canvasPos);
+    boxSelection.clear();
+    if (pick.satellite != selectedSatellite) {
+        selectedSatellite = pick.satellite;
+        selectionChanged = true;
+    }
+}
+
+void SatelliteMapWindow::selectBox(const ImVec2& cornerA, const ImVec2& cornerB, const ImVec2& canvasPos) {
+    ImVec2 rectMin(std::min(cornerA.x, cornerB.x), std::min(cornerA.y, cornerB.y));
+    ImVec2 rectMax(std::max(cornerA.x, cornerB.x), std::max(cornerA.y, cornerB.y));
+
+    boxSelection.clear();
+    double latMin, latMax, lonMin, lonMax;
+    if (visibleBounds(rectMin, rectMax, canvasPos, &latMin, &latMax, &lonMin, &lonMax)) {
+        const SpatialGrid& index = liveMode ? satelliteIndex : trackIndex;
+        std::vector<int> candidates;
+        index.queryBox(latMin, latMax, lonMin, lonMax, candidates);
+
+        // the lat/lon box is exact on the flat map, elsewhere it only bounds the rectangle
+        bool exact = projection.type == MapRenderer::EQUIRECTANGULAR;
+        for (int id : candidates) {
+            if (!exact) {
+                ImVec2 mapPos;
+                if (!projection.projectVisible(index.latOf(id), index.lonOf(id), &mapPos)) continue;
+                ImVec2 p = worldToScreen(mapPos, canvasPos);
+                if (p.x < rectMin.x || p.x > rectMax.x || p.y < rectMin.y || p.y > rectMax.y) continue;
+            }
+            boxSelection.push_back(liveMode ? id : tracks[trackPointRefs[id].first].satellite);
+        }
+    }
+    std::sort(boxSelection.begin(), boxSelection.end());
+    boxSelection.erase(std::unique(boxSelection.begin(), boxSelection.end()), boxSelection.end());
+
+    int primary = boxSelection.empty() ? -1 : boxSelection.front();
+    if (primary != selectedSatellite) {
+        selectedSatellite = primary;
+        selectionChanged = true;
+    }
+}
+
+void SatelliteMapWindow::rebuildTrackIndex() {
+    trackPointRefs.clear();
+    for (int t = 0; t < (int)tracks.size(); t++) {
+        const auto& geo = tracks[t].geoPoints;
+        for (int p = 0; p < (int)geo.size(); p++) {
+            if (std::isnan(geo[p].x)) continue;
+            trackPointRefs.emplace_back(t, p);
+        }
+    }
+    trackIndex.clear();
+    indexedPoints.assign(tracks.size(), -1);
+    syncTrackIndex();
+}
+
+void SatelliteMapWindow::syncTrackIndex() {
+    // the same cut MapRenderer::addTrack makes, a line needs two points
+    bool changed = indexedPoints.size() != tracks.size();
+    indexedPoints.resize(tracks.size(), -1);
+    for (int t = 0; t < (int)tracks.size(); t++) {
+        const auto& track = tracks[t];
+        int shown = (int)track.geoPoints.size();
+        if (!track.visible) shown = 0;
+        else if (animateTracks) shown = std::min(track.currentStep, shown);
+        if (shown < 2) shown = 0;
+        if (shown != indexedPoints[t]) {
+            indexedPoints[t] = shown;
+            changed = true;
+        }
+    }
+    if (!changed) return;
+
+    // points stay in the index as NaN, update() only re-buckets the ones that came or went
+    std::vector<float> lat(trackPointRefs.size()), lon(trackPointRefs.size());
+    for (size_t id = 0; id < trackPointRefs.size(); id++) {
+        auto [t, p] = trackPointRefs[id];
+        bool shown = p < indexedPoints[t];
+        lat[id] = shown ? tracks[t].geoPoints[p].x : NAN;
+        lon[id] = shown ? tracks[t].geoPoints[p].y : NAN;
+    }
+    trackIndex.update(lat, lon);
+}
+
+void SatelliteMapWindow::drawSelection(ImDrawList* drawList, const ImVec2& canvasPos) {
+    // only live positions are known for every satellite, tracks highlight themselves
+    if (!liveMode) return;
+
+    ImU32 boxColor = IM_COL32(100, 160, 255, 220);
+    size_t outlined = std::min(boxSelection.size(), MAX_OUTLINED_SELECTION);
+    for (size_t i = 0; i < outlined; i++) {
+        int id = boxSelection[i];
+        if (id >= (int)satelliteIndex.size() || std::isnan(satelliteIndex.latOf(id))) continue;
+        ImVec2 mapPos;
+        if (!projection.projectVisible(satelliteIndex.latOf(id), satelliteIndex.lonOf(id), &mapPos)) continue;
+        drawList->AddCircle(worldToScreen(mapPos, canvasPos), 4.0f, boxColor, 8, 1.0f);
+    }
+
+    ImVec2 mapPos;
+    if (selectedSatellite >= 0 && selectedSatellite < (int)satelliteIndex.size() &&
+        !std::isnan(satelliteIndex.latOf(selectedSatellite)) &&
+        projection.projectVisible(satelliteIndex.latOf(selectedSatellite), satelliteIndex.lonOf(selectedSatellite), &mapPos)) {
+        drawList->AddCircle(worldToScreen(mapPos, canvasPos), 7.0f, IM_COL32(255, 255, 255, 255), 16, 2.0f);
+    }
+}
+
+void SatelliteMapWindow::drawHoverTooltip(const ImVec2& mousePos, const ImVec2& canvasPos) {
+    MapPick pick = pickAt(mousePos, canvasPos);
+    if (pick.satellite < 0) return;
+
+    ImGui::BeginTooltip();
+    if (pick.satellite < (int)satelliteNames.size()) {
+        ImGui::Text("%s", satelliteNames[pick.satellite].c_str());
+    }
+    if (pick.trackPoint >= 0) {
+        const auto& track = tracks[pick.track];
+        const ImVec2& geo = track.geoPoints[pick.trackPoint];
+        ImGui::Text("Track: %s", track.name.c_str());
+        ImGui::Text("Lat %.3f  Lon %.3f", geo.x, geo.y);
+        ImGui::Text("T+%.3f h", (track.pointTimes[pick.trackPoint] - animator.startTime()) * 24.0);
+    } else {
+        ImGui::Text("Lat %.3f  Lon %.3f", satelliteIndex.latOf(pick.satellite), satelliteIndex.lonOf(pick.satellite));
+    }
+    ImGui::TextDisabled("Click to select, shift + drag to box select");
+    ImGui::EndTooltip();
+}
+
+void SatelliteMapWindow::drawWorldMap(const ImVec2& canvasPos) {
+    // Visible part of the world, only those tiles get streamed in
+    visibleTiles.clear();
+    double latMin, latMax, lonMin, lonMax;
+    ImVec2 canvasMax(canvasPos.x + mapSize.x, canvasPos.y + mapSize.y);
+    if (visibleBounds(canvasPos, canvasMax, canvasPos, &latMin, &latMax, &lonMin, &lonMax)) {
+        // the pyramid level follows the scale at the middle of the view
+        float worldWidthPx = projection.width * zoomLevel;
+        double lat, lon, pxPerDegLon, pxPerDegLat;
+        if (projection.type != MapRenderer::EQUIRECTANGULAR &&
+            screenToLatLon(ImVec2(canvasPos.x + mapSize.x * 0.5f, canvasPos.y + mapSize.y * 0.5f), canvasPos, &lat, &lon)) {
+            pixelsPerDegree(lat, lon, &pxPerDegLon, &pxPerDegLat);
+            worldWidthPx = (float)(pxPerDegLat * 360.0);
+        }
+        imagery.collectVisible(latMin, latMax, lonMin, lonMax, worldWidthPx, visibleTiles);
+    }
+
+    renderer.addTiles(visibleTiles);
+}
 
 void SatelliteMapWindow::drawContinentOutlines(ImDrawList* drawList, const ImVec2& canvasPos) {
     ImU32 coastColor = IM_COL32(200, 200, 200, 255);
@@ -220,62 +589,21 @@ void SatelliteMapWindow::drawContinentOutlines(ImDrawList* drawList, const ImVec
     drawContinent(asia);
 }
 
-void SatelliteMapWindow::drawGrid(ImDrawList* drawList, const ImVec2& canvasPos) {
-    ImU32 gridColor = IM_COL32(100, 100, 100, 128);
-
-    // Draw latitude lines (every 30 degrees)
-    for (int lat = -90; lat <= 90; lat += 30) {
-        ImVec2 start = worldToScreen(projection.projectToScreen(lat, -180), canvasPos);
-        ImVec2 end = worldToScreen(projection.projectToScreen(lat, 180), canvasPos);
-        drawList->AddLine(start, end, gridColor, 1.0f);
-    }
-
-    // Draw longitude lines (every 30 degrees)
-    for (int lon = -180; lon <= 180; lon += 30) {
-        ImVec2 start = worldToScreen(projection.projectToScreen(-90, lon), canvasPos);
-        ImVec2 end = worldToScreen(projection.projectToScreen(90, lon), canvasPos);
-        drawList->AddLine(start, end, gridColor, 1.0f);
-    }
-
-    // Draw equator and prime meridian more prominently
-    ImU32 primaryGridColor = IM_COL32(150, 150, 150, 200);
-
-    // Equator
-    ImVec2 equatorStart = worldToScreen(projection.projectToScreen(0, -180), canvasPos);
-    ImVec2 equatorEnd = worldToScreen(projection.projectToScreen(0, 180), canvasPos);
-    drawList->AddLine(equatorStart, equatorEnd, primaryGridColor, 2.0f);
-
-    // Prime meridian
-    ImVec2 primeStart = worldToScreen(projection.projectToScreen(-90, 0), canvasPos);
-    ImVec2 primeEnd = worldToScreen(projection.projectToScreen(90, 0), canvasPos);
-    drawList->AddLine(primeStart, primeEnd, primaryGridColor, 2.0f);
+void SatelliteMapWindow::drawGrid() {
+    // lines every 30 degrees, equator and prime meridian more prominently
+    renderer.addGrid();
 }
 
-void SatelliteMapWindow::drawSatelliteTracks(ImDrawList* drawList, const ImVec2& canvasPos) {
-    for (auto& track : tracks) {
-        if (!track.visible || track.screenPoints.size() < 2) continue;
-
-        std::vector<ImVec2> currentSegment;
+void SatelliteMapWindow::drawSatelliteTracks() {
+    for (int i = 0; i < (int)tracks.size(); i++) {
+        const auto& track = tracks[i];
+        if (!track.visible) continue;
 
-        for (const auto& point : track.screenPoints) {
-            if (point.x < -9999.0f) {
-                if (currentSegment.size() >= 2) {
-                    drawList->AddPolyline(currentSegment.data(), currentSegment.size(), track.color, false, 2.0f);
-                }
-                currentSegment.clear();
-            } else {
-                currentSegment.push_back(worldToScreen(point, canvasPos));
-            }
-        }
-
-        if (currentSegment.size() >= 2) {
-            drawList->AddPolyline(currentSegment.data(), currentSegment.size(), track.color, false, 2.0f);
-        }
+        // while animating, tracks only grow up to the simulated clock
+        renderer.addTrack(i, track.color, animateTracks ? track.currentStep : -1);
     }
 }
 
-
-
 ImVec2 SatelliteMapWindow::worldToScreen(const ImVec2& worldPos, const ImVec2& canvasPos) const {
     ImVec2 centered = ImVec2(worldPos.x - projection.width * 0.5f,
                             worldPos.y - projection.height * 0.5f);
@@ -296,22 +624,119 @@ ImVec2 SatelliteMapWindow::screenToWorld(const ImVec2& screenPos, const ImVec2&
                   unzoomed.y + projection.height * 0.5f);
 }
 
+bool SatelliteMapWindow::screenToLatLon(const ImVec2& screenPos, const ImVec2& canvasPos, double* lat, double* lon) const {
+    return projection.unproject(screenToWorld(screenPos, canvasPos), lat, lon);
+}
+
+void SatelliteMapWindow::pixelsPerDegree(double lat, double lon, double* pxPerDegLon, double* pxPerDegLat) const {
+    if (projection.type == MapRenderer::EQUIRECTANGULAR) {
+        *pxPerDegLon = projection.width * zoomLevel / 360.0;
+        *pxPerDegLat = projection.height * zoomLevel / 180.0;
+        return;
+    }
+
+    // local scale from a one degree step each way, plenty for pick radii and level selection
+    auto distance = [this](double latA, double lonA, double latB, double lonB) {
+        ImVec2 a = projection.projectToScreen(latA, lonA);
+        ImVec2 b = projection.projectToScreen(latB, lonB);
+        return (double)std::hypot(a.x - b.x, a.y - b.y) * zoomLevel;
+    };
+    double north = std::min(lat + 0.5, 90.0);
+    double south = std::max(lat - 0.5, -90.0);
+    *pxPerDegLon = std::max(distance(lat, lon - 0.5, lat, lon + 0.5), 1e-3);
+    *pxPerDegLat = std::max(distance(south, lon, north, lon) / (north - south), 1e-3);
+}
+
+bool SatelliteMapWindow::visibleBounds(const ImVec2& rectMin, const ImVec2& rectMax, const ImVec2& canvasPos,
+                                       double* latMin, double* latMax, double* lonMin, double* lonMax) const {
+    if (projection.type == MapRenderer::EQUIRECTANGULAR) {
+        screenToLatLon(rectMin, canvasPos, latMax, lonMin);
+        screenToLatLon(rectMax, canvasPos, latMin, lonMax);
+        if (*lonMax - *lonMin >= 360.0) {
+            *lonMin = -180.0;
+            *lonMax = 180.0;
+        }
+        return true;
+    }
+
+    // parallels and meridians curve in the other projections, so sample the rectangle
+    constexpr int SAMPLES = 16;
+    bool any = false;
+    *latMin = 90.0;
+    *latMax = -90.0;
+    *lonMin = 180.0;
+    *lonMax = -180.0;
+    for (int i = 0; i <= SAMPLES; i++) {
+        for (int j = 0; j <= SAMPLES; j++) {
+            ImVec2 p(rectMin.x + (rectMax.x - rectMin.x) * i / SAMPLES,
+                     rectMin.y + (rectMax.y - rectMin.y) * j / SAMPLES);
+            double lat, lon;
+            if (!screenToLatLon(p, canvasPos, &lat, &lon)) continue;
+            *latMin = std::min(*latMin, lat);
+            *latMax = std::max(*latMax, lat);
+            *lonMin = std::min(*lonMin, lon);
+            *lonMax = std::max(*lonMax, lon);
+            any = true;
+        }
+    }
+    if (!any) return false;
+
+    // pad by about a sample spacing so the limb and small features between samples are kept
+    double latPad = (*latMax - *latMin) / SAMPLES + 1.0;
+    double lonPad = (*lonMax - *lonMin) / SAMPLES + 1.0;
+    *latMin = std::max(*latMin - latPad, -90.0);
+    *latMax = std::min(*latMax + latPad, 90.0);
+    *lonMin = std::max(*lonMin - lonPad, -180.0);
+    *lonMax = std::min(*lonMax + lonPad, 180.0);
+
+    // a visible pole inside the rectangle takes every longitude with it
+    for (double pole : { 90.0, -90.0 }) {
+        ImVec2 mapPos;
+        if (!projection.projectVisible(pole, 0.0, &mapPos)) continue;
+        ImVec2 p = worldToScreen(mapPos, canvasPos);
+        if (p.x >= rectMin.x && p.x <= rectMax.x && p.y >= rectMin.y && p.y <= rectMax.y) {
+            *latMin = std::min(*latMin, pole);
+            *latMax = std::max(*latMax, pole);
+            *lonMin = -180.0;
+            *lonMax = 180.0;
+        }
+    }
+    return true;
+}
+
 void SatelliteMapWindow::updateSatelliteData(const PropagationResults& results) {
     tracks.clear();
 
-    const auto& satellite = results.satellites.front();  // Only one satellite
+    animator.setData(results);
+    simTime = animator.startTime();
+    requestedTime = std::numeric_limits<double>::quiet_NaN();
 
-    if (!satellite.propagationSuccess || satellite.timeSteps.empty())
+    satelliteNames.clear();
+    satelliteNames.reserve(results.satellites.size());
+    for (const auto& sat : results.satellites) {
+        satelliteNames.push_back(sat.line1.length() > 24 ? sat.line1.substr(2, 22) : "Unknown Satellite");
+    }
+    satelliteIndex.clear();
+    uploadedFrame = 0;
+    boxSelection.clear();
+    selectedSatellite = -1;
+
+    // without a track the index still has to forget the last job's points
+    tracksDirty = true;
+    if (results.satellites.empty() || !results.satellites.front().propagationSuccess ||
+        results.satellites.front().timeSteps.empty()) {
+        rebuildTrackIndex();
         return;
+    }
+
+    const auto& satellite = results.satellites.front();  // Only one satellite
 
     SatelliteTrack track;
     track.color = IM_COL32(255, 100, 100, 255);  // Red
     track.name = "Current Orbit";
     track.visible = true;
     track.currentStep = 0;
-
-    bool hasLast = false;
-    float lastLon = 0.0f;
+    track.satellite = 0;
 
     // Estimate one orbit's worth of points — adjust based on timestep spacing
     constexpr size_t maxOrbitSteps = 90; // e.g., 90 time steps ≈ 1 orbit
@@ -321,31 +746,19 @@ void SatelliteMapWindow::updateSatelliteData(const PropagationResults& results)
 
     for (size_t i = startIdx; i < totalSteps; ++i) {
         const auto& step = satellite.timeSteps[i];
-        if (step.hasError) continue;
+        if (step.hasError()) continue;
 
+        // Normalize longitude to [-180, 180], the renderer splits segments at the antimeridian
         float lat = static_cast<float>(step.llh[0]);
-        float lon = static_cast<float>(step.llh[1]);
-
-        // Normalize longitude to [-180, 180]
-        while (lon < -180.0f) lon += 360.0f;
-        while (lon > 180.0f) lon -= 360.0f;
-
-        if (hasLast) {
-            float lonDiff = std::fabs(lon - lastLon);
-            if (lonDiff > 180.0f) {
-                // Insert break if path wraps
-                track.screenPoints.push_back(ImVec2(-10000, -10000));
-            }
-        }
-
-        lastLon = lon;
-        hasLast = true;
+        float lon = static_cast<float>(std::remainder(step.llh[1], 360.0));
 
-        ImVec2 screen = projection.projectToScreen(lat, lon);
-        track.screenPoints.push_back(screen);
+        track.pointTimes.push_back(step.ds50UTC);
+        track.geoPoints.push_back(ImVec2(lat, lon));
     }
 
     tracks.push_back(track);  // ✅ Only the latest orbit
+    rebuildTrackIndex();
+    tracksDirty = true;
 }
 
 
@@ -354,6 +767,8 @@ void SatelliteMapWindow::updateSatelliteData(const PropagationResults& results)
 
 void SatelliteMapWindow::clearTracks() {
     tracks.clear();
+    rebuildTrackIndex();
+    tracksDirty = true;
 }
 
 void SatelliteMapWindow::setTrackVisibility(int trackIndex, bool visible) {
@@ -370,7 +785,7 @@ void SatelliteMapWindow::setTrackColor(int trackIndex, ImU32 color) {
 
 void SatelliteMapWindow::playAnimation() {
     animateTracks = true;
-    // Animation logic would be called from your main loop
+    // the clock itself advances in render(), driven by the frame delta time
 }
 
 void SatelliteMapWindow::pauseAnimation() {
@@ -381,9 +796,34 @@ void SatelliteMapWindow::resetAnimation() {
     for (auto& track : tracks) {
         track.currentStep = 0;
     }
+    simTime = animator.startTime();
 }
 
 void SatelliteMapWindow::setAnimationSpeed(int speed) {
-    animationSpeed = std::max(1, std::min(10, speed));
+    animationSpeed = std::max(1, std::min(3600, speed));
+}
+
+void SatelliteMapWindow::setLiveMode(bool enabled) {
+    liveMode = enabled;
+}
+
+void SatelliteMapWindow::setProjection(int type) {
+    // only the view changes, every layer is re-projected on the GPU
+    projection.type = std::clamp(type, (int)MapRenderer::EQUIRECTANGULAR, (int)MapRenderer::POLAR_SOUTH);
+    panOffset = ImVec2(0, 0);
+    isRotating = false;
+}
+
+void SatelliteMapWindow::setSelectedSatellite(int index) {
+    selectedSatellite = index;
+    if (std::find(boxSelection.begin(), boxSelection.end(), index) == boxSelection.end()) {
+        boxSelection.clear();
+    }
+}
+
+bool SatelliteMapWindow::consumeSelectionChanged() {
+    bool changed = selectionChanged;
+    selectionChanged = false;
+    return changed;
 }
 
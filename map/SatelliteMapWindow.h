@@ -7,38 +7,52 @@
 #define SATELLITEMAPWINDOW_H
 
 #include "../PropResults.h"
+#include "CatalogAnimator.h"
+#include "EarthImagery.h"
+#include "MapRenderer.h"
+#include "SpatialGrid.h"
 #include <imgui.h>
+#include <cstdint>
 #include <vector>
 #include <string>
 
 struct MapProjection {
     float width;
     float height;
-    float centerLat;
+    float centerLat;   // View center (deg), used by the globe and polar views
     float centerLon;
+    int type;          // MapRenderer::Projection
 
-    // Convert lat/lon to screen coordinates (Equirectangular projection)
-    ImVec2 projectToScreen(double lat, double lon) const {
-        // Normalize longitude to [-180, 180]
-        while (lon > 180.0) lon -= 360.0;
-        while (lon < -180.0) lon += 360.0;
+    // Convert lat/lon to map coordinates, the CPU mirror of projectLatLon in the map shaders
+    ImVec2 projectToScreen(double lat, double lon) const;
 
-        // Convert to screen coordinates
-        float x = (float)((lon + 180.0) / 360.0 * width);
-        float y = (float)((90.0 - lat) / 180.0 * height);
+    // Same, but false on the far side of the globe or past the polar view limit
+    bool projectVisible(double lat, double lon, ImVec2* mapPos) const;
 
-        return ImVec2(x, y);
-    }
+    // Inverse projection, false when the map position is off the Earth
+    bool unproject(const ImVec2& mapPos, double* lat, double* lon) const;
+
+private:
+    ImVec2 project(double lat, double lon, double* facing) const;
 };
 
 struct SatelliteTrack {
-    std::vector<ImVec2> screenPoints;
+    std::vector<ImVec2> geoPoints;   // (lat, lon) deg, projected on the GPU
+    std::vector<double> pointTimes;  // ds50UTC of each point
+    int satellite;                   // Index of the satellite in the results
     ImU32 color;
     std::string name;
     bool visible;
     int currentStep;  // For animation
 };
 
+// What is under the cursor, live satellites win over track points
+struct MapPick {
+    int satellite = -1;
+    int track = -1;
+    int trackPoint = -1;
+};
+
 class SatelliteMapWindow {
 private:
     std::vector<SatelliteTrack> tracks;
@@ -46,33 +60,94 @@ private:
     ImVec2 mapSize;
     bool showGrid;
     bool animateTracks;
-    int animationSpeed;
+    int animationSpeed;   // Simulated seconds per wall clock second
+    bool liveMode;        // Show every catalog object at the simulated clock
+    double simTime;       // Simulated clock (ds50UTC)
+    double requestedTime; // Last time handed to the animator
     float zoomLevel;
     ImVec2 panOffset;
 
     // UI state
     bool isDragging;
+    bool isBoxSelecting;
+    bool isRotating;
     ImVec2 lastMousePos;
+    ImVec2 dragStart;
+
+    // Selection, index into the results like SGP4DataViewer
+    std::vector<std::string> satelliteNames;
+    int selectedSatellite;
+    std::vector<int> boxSelection;
+    bool selectionChanged;
+
+    // Picking indices in lat/lon space
+    SpatialGrid satelliteIndex;   // Current live positions, id = satellite index
+    SpatialGrid trackIndex;       // Track points, id = index into trackPointRefs
+    std::vector<std::pair<int, int>> trackPointRefs;
+    std::vector<int> indexedPoints; // Per track, how many leading points are in trackIndex
+
+    // Background imagery
+    EarthImagery imagery;
+    std::vector<ImageryTile> visibleTiles;
+
+    // Live catalog
+    CatalogAnimator animator;
+    uint64_t uploadedFrame;
+
+    // Every map layer is drawn through this, in the current projection
+    MapRenderer renderer;
+    bool tracksDirty;
 
     // Drawing helpers
-    void drawWorldMap(ImDrawList* drawList, const ImVec2& canvasPos);
+    void drawWorldMap(const ImVec2& canvasPos);
 
     void drawContinentOutlines(ImDrawList *drawList, const ImVec2 &canvasPos);
 
-    void drawGrid(ImDrawList* drawList, const ImVec2& canvasPos);
-    void drawSatelliteTracks(ImDrawList* drawList, const ImVec2& canvasPos);
+    void drawGrid();
+    void drawSatelliteTracks();
+    void drawLiveCatalog();
+    void drawSelection(ImDrawList* drawList, const ImVec2& canvasPos);
+    void drawHoverTooltip(const ImVec2& mousePos, const ImVec2& canvasPos);
     void drawControls();
+    void drawAnimationControls();
+
+    // Advances the simulated clock and queues the catalog evaluation for it
+    void advanceClock();
+
+    // Picks up the newest animator frame: GPU upload and picking index update
+    void syncLiveFrame();
+
+    // Picking
+    MapPick pickAt(const ImVec2& screenPos, const ImVec2& canvasPos) const;
+    void selectAt(const ImVec2& screenPos, const ImVec2& canvasPos);
+    void selectBox(const ImVec2& cornerA, const ImVec2& cornerB, const ImVec2& canvasPos);
+    void rebuildTrackIndex();
+    // Keeps only the drawn track points pickable: hidden tracks drop out, animated ones
+    // grow with their current step
+    void syncTrackIndex();
 
     // Coordinate conversion with zoom/pan
     ImVec2 worldToScreen(const ImVec2& worldPos, const ImVec2& canvasPos) const;
     ImVec2 screenToWorld(const ImVec2& screenPos, const ImVec2& canvasPos) const;
+    bool screenToLatLon(const ImVec2& screenPos, const ImVec2& canvasPos, double* lat, double* lon) const;
+    void pixelsPerDegree(double lat, double lon, double* pxPerDegLon, double* pxPerDegLat) const;
+
+    // Lat/lon box covering the visible part of a screen rectangle, false when it misses the Earth
+    bool visibleBounds(const ImVec2& rectMin, const ImVec2& rectMax, const ImVec2& canvasPos,
+                       double* latMin, double* latMax, double* lonMin, double* lonMax) const;
 
 public:
     SatelliteMapWindow();
 
     ~SatelliteMapWindow() = default;
 
-    static void loadEarthTexture(const std::string &filePath);
+    // Both return immediately, imagery shows up once decoded
+    void loadEarthTexture(const std::string &filePath);
+    bool loadEarthPyramid(const std::string &rootDir);
+    bool isLoadingImagery() const { return imagery.hasPendingWork(); }
+
+    // True while the map changes on its own and needs continuous redraws
+    bool isAnimating() const { return animateTracks || liveMode || imagery.hasPendingWork(); }
 
     void render();
     void updateSatelliteData(const PropagationResults& results);
@@ -85,6 +160,15 @@ public:
     void pauseAnimation();
     void resetAnimation();
     void setAnimationSpeed(int speed);
+    void setLiveMode(bool enabled);
+    void setProjection(int type);
+    double getSimTime() const { return simTime; }
+
+    // Selection, kept in sync with SGP4DataViewer by the app
+    int getSelectedSatellite() const { return selectedSatellite; }
+    void setSelectedSatellite(int index);
+    const std::vector<int>& getBoxSelection() const { return boxSelection; }
+    bool consumeSelectionChanged();
 };
 
 #endif //SATELLITEMAPWINDOW_H
\ No newline at end of file
@@ -0,0 +1,159 @@
+//
+// SpatialGrid.cpp
+// Uniform lat/lon grid for picking points on the map
+//
+
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cmath>
+
+SpatialGrid::SpatialGrid(float cellDegrees)
+    : m_cellDegrees(cellDegrees)
+    , m_cols((int)std::ceil(360.0f / cellDegrees))
+    , m_rows((int)std::ceil(180.0f / cellDegrees))
+{
+    m_cells.resize((size_t)m_cols * m_rows);
+}
+
+void SpatialGrid::clear() {
+    for (auto& cell : m_cells) {
+        cell.clear();
+    }
+    m_itemCell.clear();
+    m_itemSlot.clear();
+    m_lat.clear();
+    m_lon.clear();
+}
+
+int SpatialGrid::cellOf(float lat, float lon) const {
+    if (std::isnan(lat) || std::isnan(lon)) return -1;
+
+    // Normalize longitude to [-180, 180)
+    double l = std::fmod((double)lon + 180.0, 360.0);
+    if (l < 0) l += 360.0;
+
+    int col = std::min(m_cols - 1, (int)(l / m_cellDegrees));
+    int row = std::clamp((int)((lat + 90.0) / m_cellDegrees), 0, m_rows - 1);
+    return row * m_cols + col;
+}
+
+void SpatialGrid::insert(int id, int cell) {
+    m_itemCell[id] = cell;
+    if (cell < 0) return;
+    m_itemSlot[id] = (int)m_cells[cell].size();
+    m_cells[cell].push_back(id);
+}
+
+void SpatialGrid::remove(int id) {
+    int cell = m_itemCell[id];
+    if (cell < 0) return;
+
+    // swap-remove and patch the slot of the item that moved into our place
+    auto& bucket = m_cells[cell];
+    int slot = m_itemSlot[id];
+    int moved = bucket.back();
+    bucket[slot] = moved;
+    m_itemSlot[moved] = slot;
+    bucket.pop_back();
+    m_itemCell[id] = -1;
+}
+
+void SpatialGrid::rebuild(const std::vector<float>& lat, const std::vector<float>& lon) {
+    clear();
+
+    size_t count = std::min(lat.size(), lon.size());
+    m_lat.assign(lat.begin(), lat.begin() + count);
+    m_lon.assign(lon.begin(), lon.begin() + count);
+    m_itemCell.assign(count, -1);
+    m_itemSlot.assign(count, 0);
+
+    for (size_t i = 0; i < count; i++) {
+        insert((int)i, cellOf(m_lat[i], m_lon[i]));
+    }
+}
+
+void SpatialGrid::update(const std::vector<float>& lat, const std::vector<float>& lon) {
+    size_t count = std::min(lat.size(), lon.size());
+    if (count != m_lat.size()) {
+        rebuild(lat, lon);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        m_lat[i] = lat[i];
+        m_lon[i] = lon[i];
+        int cell = cellOf(lat[i], lon[i]);
+        if (cell != m_itemCell[i]) {
+            remove((int)i);
+            insert((int)i, cell);
+        }
+    }
+}
+
+int SpatialGrid::nearest(double lat, double lon, double pxPerDegLon, double pxPerDegLat, double radiusPx) const {
+    if (m_lat.empty() || pxPerDegLon <= 0 || pxPerDegLat <= 0) return -1;
+
+    double radiusLon = std::min(180.0, radiusPx / pxPerDegLon);
+    double radiusLat = std::min(90.0, radiusPx / pxPerDegLat);
+
+    std::vector<int> candidates;
+    double lonMin = lon - radiusLon;
+    double lonMax = lon + radiusLon;
+    queryBox(lat - radiusLat, lat + radiusLat, lonMin, lonMax, candidates);
+
+    int best = -1;
+    double bestDist = radiusPx * radiusPx;
+    for (int id : candidates) {
+        double dLon = std::remainder((double)m_lon[id] - lon, 360.0);
+        double dx = dLon * pxPerDegLon;
+        double dy = ((double)m_lat[id] - lat) * pxPerDegLat;
+        double dist = dx * dx + dy * dy;
+        if (dist <= bestDist) {
+            bestDist = dist;
+            best = id;
+        }
+    }
+    return best;
+}
+
+void SpatialGrid::queryBox(double latMin, double latMax, double lonMin, double lonMax, std::vector<int>& out) const {
+    if (latMin > latMax) std::swap(latMin, latMax);
+
+    int rowMin = std::clamp((int)std::floor((latMin + 90.0) / m_cellDegrees), 0, m_rows - 1);
+    int rowMax = std::clamp((int)std::floor((latMax + 90.0) / m_cellDegrees), 0, m_rows - 1);
+
+    // work in [0, 360) longitude so the column range can wrap around the antimeridian
+    double span = lonMax - lonMin;
+    if (span < 0) span += 360.0;
+    bool fullCircle = span >= 360.0;
+    double start = std::fmod(lonMin + 180.0, 360.0);
+    if (start < 0) start += 360.0;
+
+    int colStart = fullCircle ? 0 : std::min(m_cols - 1, (int)std::floor(start / m_cellDegrees));
+    int colCount = fullCircle ? m_cols : std::min(m_cols, (int)std::floor((start + span) / m_cellDegrees) - colStart + 1);
+
+    auto inside = [&](int id) {
+        double lat = m_lat[id];
+        if (lat < latMin || lat > latMax) return false;
+        if (fullCircle) return true;
+        double offset = std::fmod((double)m_lon[id] - lonMin, 360.0);
+        if (offset < 0) offset += 360.0;
+        return offset <= span;
+    };
+
+    for (int row = rowMin; row <= rowMax; row++) {
+        bool edgeRow = row == rowMin || row == rowMax;
+        for (int c = 0; c < colCount; c++) {
+            const auto& bucket = m_cells[(size_t)row * m_cols + (colStart + c) % m_cols];
+
+            // interior cells lie completely inside the box, only the border needs per-item tests
+            if (!edgeRow && (fullCircle || (c != 0 && c != colCount - 1))) {
+                out.insert(out.end(), bucket.begin(), bucket.end());
+                continue;
+            }
+            for (int id : bucket) {
+                if (inside(id)) out.push_back(id);
+            }
+        }
+    }
+}
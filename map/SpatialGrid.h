@@ -0,0 +1,54 @@
+//
+// SpatialGrid.h
+// Uniform lat/lon grid for picking points on the map
+//
+
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <cstddef>
+#include <vector>
+
+// The grid covers the whole equirectangular map world (lon -180..180, lat -90..90) with square
+// cells. Items are kept in per-cell buckets and remember their bucket slot, so moving an item
+// between frames is O(1) and only items that actually change cells are touched.
+class SpatialGrid {
+public:
+    explicit SpatialGrid(float cellDegrees = 1.0f);
+
+    void clear();
+
+    // Replaces the indexed set, item ids are the vector indices. NaN positions are not indexed
+    void rebuild(const std::vector<float>& lat, const std::vector<float>& lon);
+
+    // Moves items to new positions, only re-bucketing the ones that changed cell.
+    // Falls back to a rebuild when the item count changes
+    void update(const std::vector<float>& lat, const std::vector<float>& lon);
+
+    // Closest item to (lat, lon) within radiusPx, measured in screen pixels using the
+    // current map scale. Returns -1 when nothing is in range
+    int nearest(double lat, double lon, double pxPerDegLon, double pxPerDegLat, double radiusPx) const;
+
+    // All items inside the lat/lon box. lonMin > lonMax means the box wraps across 180 deg
+    void queryBox(double latMin, double latMax, double lonMin, double lonMax, std::vector<int>& out) const;
+
+    size_t size() const { return m_lat.size(); }
+    float latOf(int id) const { return m_lat[id]; }
+    float lonOf(int id) const { return m_lon[id]; }
+
+private:
+    int cellOf(float lat, float lon) const;
+    void insert(int id, int cell);
+    void remove(int id);
+
+    float m_cellDegrees;
+    int m_cols;
+    int m_rows;
+    std::vector<std::vector<int>> m_cells;
+    std::vector<int> m_itemCell;   // Bucket of each item, -1 when not indexed
+    std::vector<int> m_itemSlot;   // Position of each item inside its bucket
+    std::vector<float> m_lat;
+    std::vector<float> m_lon;
+};
+
+#endif //SPATIALGRID_H
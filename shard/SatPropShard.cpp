@@ -0,0 +1,322 @@
+//
+// SatPropShard.cpp
+// Sharded propagation over worker processes, local or on other hosts
+//
+// Usage: SatPropShard run --tle catalog.txt --start 0 --stop 1440 --step 1
+//                         [--local 4] [--workers host:port,host:port] [--shards 16]
+//                         [--threads 1] [--attempts 3] [--timeout 600] [--work-dir .]
+//                         [--out merged.sprs] [--archive merged.spea] [--verify]
+//                         [--token T] [--fail-worker N]
+//        SatPropShard worker [--port 0] [--bind 127.0.0.1] [--token T] [--work-dir .]
+//                            [--fail-after N]
+//
+// run starts --local workers by launching this executable in worker mode and also uses
+// every --workers endpoint, e.g. "SatPropShard worker --port 5050 --bind 0.0.0.0" started
+// on another host. A worker listens on loopback unless --bind says otherwise and serves only
+// connections that present its token, --token or else SATPROP_SHARD_TOKEN on both sides,
+// and won't start without one. The token is all that guards a worker and the traffic is
+// not encrypted, so only bind one past loopback on a trusted network.
+// --verify propagates the catalog again in this process and checks that the merged results
+// match it bit for bit. --fail-worker makes that local worker die in its second shard, to
+// see the shard reassigned.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "../AstroStdDlls.h"
+#include "../Propagator.h"
+#include "../PropResults.h"
+#include "../io/EphemerisArchive.h"
+#include "../io/ResultStream.h"
+#include "ShardCoordinator.h"
+#include "ShardProtocol.h"
+#include "ShardWorker.h"
+
+using namespace SGP_IMPL;
+
+struct RunOptions
+{
+    std::string tleFile;
+    double startTime = 0.0;
+    double stopTime = 1440.0;
+    double stepSize = 60.0;
+    std::string outFile;
+    std::string archiveFile;
+    bool verify = false;
+    ShardOptions shard;
+};
+
+static std::vector<std::string> Split(const char* list)
+{
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* c = list; ; c++)
+    {
+        if (*c == ',' || *c == 0)
+        {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*c == 0)
+                break;
+        }
+        else
+        {
+            item += *c;
+        }
+    }
+    return items;
+}
+
+static void PrintUsage()
+{
+    printf("Usage: SatPropShard run --tle catalog.txt --start 0 --stop 1440 --step 1\n"
+           "                        [--local 4] [--workers host:port,host:port] [--shards 16]\n"
+           "                        [--threads 1] [--attempts 3] [--timeout 600] [--work-dir .]\n"
+           "                        [--out merged.sprs] [--archive merged.spea] [--verify]\n"
+           "                        [--token T] [--fail-worker N]\n"
+           "       SatPropShard worker [--port 0] [--bind 127.0.0.1] [--token T] [--work-dir .]\n"
+           "                           [--fail-after N]\n"
+           "A worker needs a token and serves only connections with it, --token or else %s.\n",
+           SHARD_TOKEN_VARIABLE);
+}
+
+static bool ParseWorkerOptions(int argc, char** argv, ShardWorkerOptions& options)
+{
+    if (const char* token = getenv(SHARD_TOKEN_VARIABLE))
+        options.token = token;
+
+    for (int i = 2; i < argc; i += 2)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (strcmp(arg, "--port") == 0)
+            options.port = atoi(value);
+        else if (strcmp(arg, "--bind") == 0)
+            options.bindAddress = value;
+        else if (strcmp(arg, "--token") == 0)
+            options.token = value;
+        else if (strcmp(arg, "--work-dir") == 0)
+            options.workDir = value;
+        else if (strcmp(arg, "--fail-after") == 0)
+            options.failAfter = atoi(value);
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            PrintUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ParseRunOptions(int argc, char** argv, RunOptions& options)
+{
+    if (const char* token = getenv(SHARD_TOKEN_VARIABLE))
+        options.shard.token = token;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool takesValue = strcmp(arg, "--verify") != 0;
+        if (takesValue && !value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (strcmp(arg, "--verify") == 0)
+            options.verify = true;
+        else if (strcmp(arg, "--tle") == 0)
+            options.tleFile = value;
+        else if (strcmp(arg, "--start") == 0)
+            options.startTime = atof(value);
+        else if (strcmp(arg, "--stop") == 0)
+            options.stopTime = atof(value);
+        else if (strcmp(arg, "--step") == 0)
+            options.stepSize = atof(value);
+        else if (strcmp(arg, "--local") == 0)
+            options.shard.localWorkers = std::max(0, atoi(value));
+        else if (strcmp(arg, "--shards") == 0)
+            options.shard.shards = std::max(0, atoi(value));
+        else if (strcmp(arg, "--threads") == 0)
+            options.shard.threadsPerWorker = std::max(1, atoi(value));
+        else if (strcmp(arg, "--attempts") == 0)
+            options.shard.maxAttempts = std::max(1, atoi(value));
+        else if (strcmp(arg, "--timeout") == 0)
+            options.shard.timeoutSeconds = std::max(0, atoi(value));
+        else if (strcmp(arg, "--work-dir") == 0)
+            options.shard.workDir = value;
+        else if (strcmp(arg, "--out") == 0)
+            options.outFile = value;
+        else if (strcmp(arg, "--archive") == 0)
+            options.archiveFile = value;
+        else if (strcmp(arg, "--token") == 0)
+            options.shard.token = value;
+        else if (strcmp(arg, "--fail-worker") == 0)
+            options.shard.failLocalWorker = atoi(value);
+        else if (strcmp(arg, "--workers") == 0)
+        {
+            for (const auto& item : Split(value))
+            {
+                WorkerEndpoint endpoint;
+                if (!ShardCoordinator::ParseEndpoint(item, endpoint))
+                {
+                    fprintf(stderr, "Bad worker address: %s\n", item.c_str());
+                    return false;
+                }
+                options.shard.remoteWorkers.push_back(endpoint);
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            PrintUsage();
+            return false;
+        }
+
+        if (takesValue)
+            i++;
+    }
+
+    if (options.tleFile.empty())
+    {
+        fprintf(stderr, "--tle is required\n");
+        return false;
+    }
+    if (options.shard.localWorkers == 0 && options.shard.remoteWorkers.empty())
+        options.shard.localWorkers = 1;
+    return true;
+}
+
+// Bit for bit, including error records and their texts
+static bool SameResults(const PropagationResults& a, const PropagationResults& b)
+{
+    if (a.satellites.size() != b.satellites.size() || a.totalSatellites != b.totalSatellites)
+    {
+        printf("Satellite counts differ: %zu vs %zu\n", a.satellites.size(), b.satellites.size());
+        return false;
+    }
+
+    for (size_t i = 0; i < a.satellites.size(); i++)
+    {
+        const SatelliteData& x = a.satellites[i];
+        const SatelliteData& y = b.satellites[i];
+        bool same = x.satKey == y.satKey && x.line1 == y.line1 && x.line2 == y.line2 &&
+                    x.propagationSuccess == y.propagationSuccess && x.timeSteps.size() == y.timeSteps.size() &&
+                    x.errors.size() == y.errors.size();
+        for (size_t s = 0; same && s < x.timeSteps.size(); s++)
+        {
+            same = memcmp(&x.timeSteps[s], &y.timeSteps[s], offsetof(TimeStepData, meanMotion) + sizeof(double)) == 0 &&
+                   x.timeSteps[s].error == y.timeSteps[s].error;
+        }
+        for (size_t e = 0; same && e < x.errors.size(); e++)
+        {
+            same = x.errors[e].step == y.errors[e].step && x.errors[e].code == y.errors[e].code &&
+                   a.ErrorText(x.errors[e]) == b.ErrorText(y.errors[e]);
+        }
+        if (!same)
+        {
+            printf("Satellite %zu (%s) differs\n", i, x.line1.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static int RunCoordinator(const char* self, RunOptions& options)
+{
+    options.shard.workerCommand = std::string("\"") + self + "\" worker";
+
+    ShardStats stats;
+    PropagationResults results = ShardCoordinator::Run(options.tleFile, options.startTime, options.stopTime,
+                                                       options.stepSize, options.shard, &stats);
+
+    size_t steps = 0;
+    for (const auto& satellite : results.satellites)
+        steps += satellite.timeSteps.size();
+    printf("%d shards on %d workers in %.2f s: %zu satellites, %zu steps\n", stats.shards, stats.workers,
+           stats.seconds, results.satellites.size(), steps);
+    printf("%d workers lost, %d shards reassigned, %d shards failed\n", stats.workersLost, stats.reassigned,
+           stats.failedShards);
+    if (!results.overallSuccess)
+        fprintf(stderr, "%s\n", results.generalError.c_str());
+
+    int exitCode = results.overallSuccess ? 0 : 1;
+    if (!options.outFile.empty() && !ResultStream::WriteFile(options.outFile, results))
+    {
+        fprintf(stderr, "Failed to write %s\n", options.outFile.c_str());
+        exitCode = 1;
+    }
+    if (!options.archiveFile.empty() && !EphemerisArchive::Write(options.archiveFile, results))
+    {
+        fprintf(stderr, "Failed to write %s\n", options.archiveFile.c_str());
+        exitCode = 1;
+    }
+
+    if (options.verify)
+    {
+        LoadAstroStdDlls();
+        PropagationResults single = Propagator::RunOneSgp4Job((char*)options.tleFile.c_str(), options.startTime,
+                                                              options.stopTime, options.stepSize,
+                                                              options.shard.threadsPerWorker);
+        FreeAstroStdDlls();
+
+        bool same = SameResults(results, single);
+        printf("Verify against a single process run: %s\n", same ? "identical" : "DIFFERENT");
+        if (!same)
+            exitCode = 1;
+    }
+    return exitCode;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || strcmp(argv[1], "--help") == 0)
+    {
+        PrintUsage();
+        return argc < 2 ? 2 : 0;
+    }
+
+    if (strcmp(argv[1], "worker") == 0)
+    {
+        ShardWorkerOptions options;
+        if (!ParseWorkerOptions(argc, argv, options))
+            return 2;
+        if (options.token.empty())
+        {
+            fprintf(stderr, "A worker needs a token, give --token or set %s\n", SHARD_TOKEN_VARIABLE);
+            return 2;
+        }
+
+        LoadAstroStdDlls();
+        int exitCode = ShardWorker::Run(options);
+        FreeAstroStdDlls();
+        return exitCode;
+    }
+
+    if (strcmp(argv[1], "run") == 0)
+    {
+        RunOptions options;
+        if (!ParseRunOptions(argc, argv, options))
+            return 2;
+        return RunCoordinator(argv[0], options);
+    }
+
+    fprintf(stderr, "Unknown mode: %s\n", argv[1]);
+    PrintUsage();
+    return 2;
+}
@@ -0,0 +1,495 @@
+//
+// ShardCoordinator.cpp
+// Splits a catalog into shards, runs them on worker processes and merges the results
+//
+
+#include "ShardCoordinator.h"
+#include "ShardProtocol.h"
+#include "../TleUtil.h"
+#include "../WorkScheduler.h"
+#include "../io/ResultStream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        struct ShardResult
+        {
+            std::vector<SatelliteData> satellites;
+            ShardDone done;
+            bool complete = false;
+            int attempts = 0;
+            std::string error;          // of the last failed attempt
+        };
+
+        // Work queue and merge target shared by the per worker threads
+        struct ShardRun
+        {
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<int> pending;
+            int inFlight = 0;
+            std::vector<ShardResult> shards;
+            PropagationResults* merged = nullptr;   // messages are interned under the mutex
+            ShardStats stats;
+        };
+
+        // A worker started on this machine, its stdout is drained so it never blocks on the pipe
+        struct LocalWorker
+        {
+            FILE* pipe = nullptr;
+            int port = 0;
+            std::thread drain;
+        };
+
+        // For the local workers of one run, passed through the environment so that it never
+        // shows on a command line
+        std::string NewToken()
+        {
+            std::random_device random;
+            char token[33];
+            for (int i = 0; i < 4; i++)
+                snprintf(token + 8 * i, 9, "%08x", (unsigned)random());
+            return token;
+        }
+
+        void SetTokenVariable(const std::string& token)
+        {
+#ifdef _WIN32
+            _putenv_s(SHARD_TOKEN_VARIABLE, token.c_str());
+#else
+            setenv(SHARD_TOKEN_VARIABLE, token.c_str(), 1);
+#endif
+        }
+
+        bool Hello(TcpSocket& socket, const std::string& token)
+        {
+            ShardHello hello;
+            hello.token = token;
+            std::vector<uint8_t> payload;
+            hello.Encode(payload);
+            return SendFrame(socket, MSG_HELLO, payload);
+        }
+
+        bool StartLocalWorker(const ShardOptions& options, int index, LocalWorker& worker)
+        {
+            std::string command = options.workerCommand + " --port 0 --bind 127.0.0.1 --work-dir \"" +
+                                  options.workDir + "\"";
+            if (index == options.failLocalWorker)
+                command += " --fail-after 1";
+#ifdef _WIN32
+            // cmd.exe drops the outer quotes of the whole line
+            command = "\"" + command + "\"";
+#endif
+            worker.pipe = popen(command.c_str(), "r");
+            if (!worker.pipe)
+                return false;
+
+            char line[256];
+            while (fgets(line, sizeof(line), worker.pipe))
+            {
+                if (sscanf(line, "SATPROP_WORKER_PORT %d", &worker.port) == 1)
+                    break;
+            }
+            if (worker.port == 0)
+            {
+                pclose(worker.pipe);
+                worker.pipe = nullptr;
+                return false;
+            }
+
+            FILE* pipe = worker.pipe;
+            worker.drain = std::thread([pipe]()
+            {
+                char text[512];
+                while (fgets(text, sizeof(text), pipe)) {}
+            });
+            return true;
+        }
+
+        void StopLocalWorker(LocalWorker& worker, const std::string& token)
+        {
+            if (!worker.pipe)
+                return;
+
+            // a worker that already died refuses the connection, either way it ends
+            TcpSocket socket = TcpSocket::Connect("127.0.0.1", worker.port);
+            if (socket.IsValid() && Hello(socket, token))
+                SendFrame(socket, MSG_SHUTDOWN, std::vector<uint8_t>());
+            socket.Close();
+
+            if (worker.drain.joinable())
+                worker.drain.join();
+            pclose(worker.pipe);
+            worker.pipe = nullptr;
+        }
+
+        // Next shard for a worker, -1 once nothing is left. Waits while other workers still
+        // hold shards, since one of them may come back.
+        int TakeShard(ShardRun& run)
+        {
+            std::unique_lock<std::mutex> lock(run.mutex);
+            run.changed.wait(lock, [&]() { return !run.pending.empty() || run.inFlight == 0; });
+            if (run.pending.empty())
+                return -1;
+
+            int shard = run.pending.front();
+            run.pending.pop_front();
+            run.shards[shard].attempts++;
+            run.inFlight++;
+            return shard;
+        }
+
+        void FinishShard(ShardRun& run, int shard, std::vector<SatelliteData>& satellites, const ShardDone& done)
+        {
+            std::lock_guard<std::mutex> lock(run.mutex);
+            ShardResult& result = run.shards[shard];
+            result.satellites = std::move(satellites);
+            result.done = done;
+            result.complete = true;
+            run.inFlight--;
+            run.changed.notify_all();
+        }
+
+        void RetryShard(ShardRun& run, int shard, const std::string& error, int maxAttempts)
+        {
+            std::lock_guard<std::mutex> lock(run.mutex);
+            ShardResult& result = run.shards[shard];
+            result.error = error;
+            if (result.attempts < maxAttempts)
+            {
+                // to the front, it has waited longest
+                run.pending.push_front(shard);
+                run.stats.reassigned++;
+            }
+            else
+                run.stats.failedShards++;
+            run.inFlight--;
+            run.changed.notify_all();
+        }
+
+        enum AttemptResult
+        {
+            ATTEMPT_DONE,
+            ATTEMPT_JOB_FAILED,     // the worker is fine, the job wasn't
+            ATTEMPT_WORKER_LOST
+        };
+
+        AttemptResult RunShard(ShardRun& run, TcpSocket& socket, const ShardJob& job,
+                               std::vector<SatelliteData>& satellites, ShardDone& done, std::string& error)
+        {
+            std::vector<uint8_t> payload;
+            job.Encode(payload);
+            if (!SendFrame(socket, MSG_JOB, payload))
+            {
+                error = "Connection lost sending the job";
+                return ATTEMPT_WORKER_LOST;
+            }
+
+            std::vector<uint32_t> remap;
+            ShardMessage type;
+            while (ReceiveFrame(socket, type, payload))
+            {
+                ByteReader in(payload.data(), payload.size());
+                switch (type)
+                {
+                    case MSG_MESSAGES:
+                    {
+                        std::vector<std::string> messages;
+                        if (!ResultStream::ReadMessages(in, messages))
+                        {
+                            error = "Malformed message table";
+                            return ATTEMPT_WORKER_LOST;
+                        }
+                        std::lock_guard<std::mutex> lock(run.mutex);
+                        remap = ResultStream::RemapMessages(messages, run.merged->messages);
+                        break;
+                    }
+                    case MSG_SATELLITE:
+                    {
+                        SatelliteData& satellite = satellites.emplace_back(run.merged->arena.get());
+                        if (!ResultStream::ReadSatellite(in, satellite))
+                        {
+                            error = "Malformed satellite";
+                            return ATTEMPT_WORKER_LOST;
+                        }
+                        ResultStream::ApplyRemap(satellite, remap);
+                        break;
+                    }
+                    case MSG_DONE:
+                        if (!done.Decode(payload) || done.shard != job.shard)
+                        {
+                            error = "Malformed shard summary";
+                            return ATTEMPT_WORKER_LOST;
+                        }
+                        return ATTEMPT_DONE;
+                    case MSG_FAILED:
+                        error.assign(payload.begin(), payload.end());
+                        return ATTEMPT_JOB_FAILED;
+                    default:
+                        error = "Unexpected message";
+                        return ATTEMPT_WORKER_LOST;
+                }
+            }
+            error = "Connection lost or timed out";
+            return ATTEMPT_WORKER_LOST;
+        }
+
+        void ServeWorker(ShardRun& run, const WorkerEndpoint& endpoint, const std::vector<std::string>& shardTexts,
+                         ShardJob jobTemplate, const ShardOptions& options)
+        {
+            // a freshly started worker may still be getting to accept()
+            TcpSocket socket;
+            for (int attempt = 0; attempt < 5 && !socket.IsValid(); attempt++)
+            {
+                socket = TcpSocket::Connect(endpoint.host, endpoint.port);
+                if (!socket.IsValid())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+            if (!socket.IsValid())
+            {
+                fprintf(stderr, "Can't reach worker %s:%d\n", endpoint.host.c_str(), endpoint.port);
+                return;
+            }
+            if (!Hello(socket, endpoint.token))
+            {
+                fprintf(stderr, "Lost worker %s:%d before the first shard\n", endpoint.host.c_str(), endpoint.port);
+                return;
+            }
+            socket.SetReceiveTimeout(options.timeoutSeconds);
+            {
+                std::lock_guard<std::mutex> lock(run.mutex);
+                run.stats.workers++;
+            }
+
+            for (int shard = TakeShard(run); shard >= 0; shard = TakeShard(run))
+            {
+                ShardJob job = jobTemplate;
+                job.shard = (uint32_t)shard;
+                job.tleText = shardTexts[shard];
+
+                std::vector<SatelliteData> satellites;
+                ShardDone done;
+                std::string error;
+                AttemptResult result = RunShard(run, socket, job, satellites, done, error);
+                if (result == ATTEMPT_DONE)
+                {
+                    FinishShard(run, shard, satellites, done);
+                    continue;
+                }
+
+                // partial satellites stay in the arena until the results go, shards are small
+                fprintf(stderr, "Shard %d on %s:%d: %s\n", shard, endpoint.host.c_str(), endpoint.port, error.c_str());
+                RetryShard(run, shard, error, options.maxAttempts);
+                if (result == ATTEMPT_WORKER_LOST)
+                {
+                    std::lock_guard<std::mutex> lock(run.mutex);
+                    run.stats.workersLost++;
+                    return;
+                }
+            }
+        }
+
+    } // namespace
+
+    bool ShardCoordinator::SplitCatalog(const std::string& tleFile, int shards, double startTime, double stopTime,
+                                        double stepSize, std::vector<std::string>& shardTexts, std::string& error)
+    {
+        FILE* fp = fopen(tleFile.c_str(), "r");
+        if (!fp)
+        {
+            error = "Can't open " + tleFile;
+            return false;
+        }
+
+        std::vector<std::string> tles;
+        std::vector<double> costs;
+        std::string previous;
+        char line[512];
+        while (fgets(line, sizeof(line), fp))
+        {
+            std::string text(line);
+            while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+                text.pop_back();
+
+            if (text.size() > 1 && text[0] == '2' && text[1] == ' ' && previous.size() > 1 && previous[0] == '1' &&
+                previous[1] == ' ')
+            {
+                tles.push_back(previous + "\n" + text + "\n");
+
+                TleElements elements;
+                costs.push_back(ParseTle(previous, text, elements)
+                                ? CostModel::Estimate(elements, startTime, stopTime, stepSize).cost : 1.0);
+                previous.clear();
+            }
+            else
+                previous = text;
+        }
+        fclose(fp);
+
+        if (tles.empty())
+        {
+            error = "No TLEs were found in " + tleFile;
+            return false;
+        }
+
+        // contiguous, so merging stays a concatenation; a shard closes once the running cost
+        // passes its share of the total
+        shards = std::clamp(shards, 1, (int)tles.size());
+        double total = 0.0;
+        for (double cost : costs)
+            total += cost;
+
+        shardTexts.assign(1, std::string());
+        double sum = 0.0;
+        for (size_t i = 0; i < tles.size(); i++)
+        {
+            size_t left = tles.size() - i;
+            size_t shardsLeft = shards - shardTexts.size();
+            bool full = sum >= total * shardTexts.size() / shards;
+            if (!shardTexts.back().empty() && shardsLeft > 0 && (full || left <= shardsLeft))
+                shardTexts.emplace_back();
+            shardTexts.back() += tles[i];
+            sum += costs[i];
+        }
+        return true;
+    }
+
+    bool ShardCoordinator::ParseEndpoint(const std::string& text, WorkerEndpoint& endpoint)
+    {
+        size_t colon = text.rfind(':');
+        if (colon == std::string::npos || colon == 0)
+            return false;
+        endpoint.host = text.substr(0, colon);
+        endpoint.port = atoi(text.c_str() + colon + 1);
+        return endpoint.port > 0 && endpoint.port < 65536;
+    }
+
+    PropagationResults ShardCoordinator::Run(const std::string& tleFile, double startTime, double stopTime,
+                                             double stepSize, const ShardOptions& options, ShardStats* stats)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        PropagationResults results;
+        results.overallSuccess = false;
+        results.totalSatellites = 0;
+        results.arena = std::make_shared<ResultArena>(0);
+
+        int workerCount = options.localWorkers + (int)options.remoteWorkers.size();
+        if (workerCount == 0)
+        {
+            results.generalError = "No workers to run shards on";
+            return results;
+        }
+
+        std::vector<std::string> shardTexts;
+        int shards = options.shards > 0 ? options.shards : 4 * workerCount;
+        if (!SplitCatalog(tleFile, shards, startTime, stopTime, stepSize, shardTexts, results.generalError))
+            return results;
+
+        if (!TcpSocket::Startup())
+        {
+            results.generalError = "Socket startup failed";
+            return results;
+        }
+
+        std::vector<WorkerEndpoint> endpoints = options.remoteWorkers;
+        for (WorkerEndpoint& endpoint : endpoints)
+            endpoint.token = options.token;
+
+        std::string localToken = NewToken();
+        if (options.localWorkers > 0)
+            SetTokenVariable(localToken);
+        std::vector<LocalWorker> localWorkers(options.localWorkers);
+        for (int i = 0; i < options.localWorkers; i++)
+        {
+            if (StartLocalWorker(options, i, localWorkers[i]))
+                endpoints.push_back({"127.0.0.1", localWorkers[i].port, localToken});
+            else
+                fprintf(stderr, "Can't start local worker: %s\n", options.workerCommand.c_str());
+        }
+
+        ShardRun run;
+        run.merged = &results;
+        run.shards.resize(shardTexts.size());
+        run.stats.shards = (int)shardTexts.size();
+        for (int shard = 0; shard < (int)shardTexts.size(); shard++)
+            run.pending.push_back(shard);
+
+        ShardJob jobTemplate;
+        jobTemplate.startTime = startTime;
+        jobTemplate.stopTime = stopTime;
+        jobTemplate.stepSize = stepSize;
+        jobTemplate.threads = std::max(1, options.threadsPerWorker);
+
+        std::vector<std::thread> threads;
+        for (const WorkerEndpoint& endpoint : endpoints)
+        {
+            threads.emplace_back(ServeWorker, std::ref(run), std::cref(endpoint), std::cref(shardTexts), jobTemplate,
+                                 std::cref(options));
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        for (LocalWorker& worker : localWorkers)
+            StopLocalWorker(worker, localToken);
+        TcpSocket::Cleanup();
+
+        // catalog order, and any shard still queued had no worker left to run it
+        results.overallSuccess = true;
+        size_t satelliteCount = 0;
+        for (const ShardResult& shard : run.shards)
+            satelliteCount += shard.satellites.size();
+        results.satellites.reserve(satelliteCount);
+
+        for (int i = 0; i < (int)run.shards.size(); i++)
+        {
+            ShardResult& shard = run.shards[i];
+            if (!shard.complete)
+            {
+                if (shard.attempts < options.maxAttempts)
+                    run.stats.failedShards++;
+                results.overallSuccess = false;
+                if (results.generalError.empty())
+                {
+                    results.generalError = "Shard " + std::to_string(i) + " failed after " +
+                                           std::to_string(shard.attempts) + " attempt(s): " +
+                                           (shard.error.empty() ? std::string("no workers left") : shard.error);
+                }
+                continue;
+            }
+
+            results.totalSatellites += shard.done.totalSatellites;
+            if (!shard.done.overallSuccess)
+            {
+                results.overallSuccess = false;
+                if (results.generalError.empty())
+                    results.generalError = "Shard " + std::to_string(i) + ": " + shard.done.generalError;
+            }
+            for (SatelliteData& satellite : shard.satellites)
+                results.satellites.push_back(std::move(satellite));
+        }
+
+        run.stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (stats)
+            *stats = run.stats;
+        return results;
+    }
+
+} // SGP_IMPL
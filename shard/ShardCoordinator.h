@@ -0,0 +1,70 @@
+//
+// ShardCoordinator.h
+// Splits a catalog into shards, runs them on worker processes and merges the results
+//
+
+#ifndef SHARDCOORDINATOR_H
+#define SHARDCOORDINATOR_H
+
+#include <string>
+#include <vector>
+#include "../PropResults.h"
+
+namespace SGP_IMPL {
+
+    struct WorkerEndpoint
+    {
+        std::string host;
+        int port = 0;
+        std::string token;      // sent in MSG_HELLO
+    };
+
+    struct ShardOptions
+    {
+        int shards = 0;                             // 0 gives four per worker
+        int localWorkers = 0;                       // worker processes started on this machine
+        std::string workerCommand;                  // starts a worker, e.g. "SatPropShard worker"
+        std::vector<WorkerEndpoint> remoteWorkers;  // workers that are already listening
+        std::string token;                          // the remote workers', local ones get a fresh one
+        int threadsPerWorker = 1;                   // propagation threads inside each worker
+        int maxAttempts = 3;                        // per shard, before the shard counts as failed
+        int timeoutSeconds = 600;                   // longest wait for a worker's next message
+        std::string workDir = ".";                  // for the local workers' shard files
+        int failLocalWorker = -1;                   // testing: this local worker dies in its second shard
+    };
+
+    struct ShardStats
+    {
+        int shards = 0;
+        int workers = 0;            // that connected
+        int workersLost = 0;        // connection broke or timed out mid shard
+        int reassigned = 0;         // shard attempts that had to be repeated
+        int failedShards = 0;       // gave up after maxAttempts
+        double seconds = 0.0;
+    };
+
+    // AstroStd's process wide tables make one propagation job per process the unit of
+    // parallelism past a single backend. The coordinator cuts the catalog into shards of
+    // consecutive TLEs, hands them to whichever worker is free and streams each shard's
+    // satellites back in the exact ResultStream form. A worker that drops its connection
+    // or stays silent past the timeout is retired and its shard goes back in the queue.
+    // Shards are put back together in catalog order, so the merged results look like one
+    // RunOneSgp4Job over the whole file.
+    class ShardCoordinator
+    {
+    public:
+        static PropagationResults Run(const std::string& tleFile, double startTime, double stopTime, double stepSize,
+                                      const ShardOptions& options, ShardStats* stats = nullptr);
+
+        // Shard texts of up to shards parts of about the same estimated cost over the window
+        // (see CostModel). Only TLE line pairs are carried over.
+        static bool SplitCatalog(const std::string& tleFile, int shards, double startTime, double stopTime,
+                                 double stepSize, std::vector<std::string>& shardTexts, std::string& error);
+
+        // "host:port"
+        static bool ParseEndpoint(const std::string& text, WorkerEndpoint& endpoint);
+    };
+
+} // SGP_IMPL
+
+#endif //SHARDCOORDINATOR_H
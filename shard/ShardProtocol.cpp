@@ -0,0 +1,100 @@
+//
+// ShardProtocol.cpp
+// Messages between the shard coordinator and its workers
+//
+
+#include "ShardProtocol.h"
+#include "../io/ByteBuffer.h"
+
+namespace SGP_IMPL {
+
+    void ShardHello::Encode(std::vector<uint8_t>& payload) const
+    {
+        ByteWriter out;
+        out.Put(SHARD_PROTOCOL_VERSION);
+        out.PutString(token);
+        payload = std::move(out.data);
+    }
+
+    bool ShardHello::Decode(const std::vector<uint8_t>& payload)
+    {
+        ByteReader in(payload.data(), payload.size());
+        uint32_t version;
+        return in.Get(version) && version == SHARD_PROTOCOL_VERSION && in.GetString(token);
+    }
+
+    void ShardJob::Encode(std::vector<uint8_t>& payload) const
+    {
+        ByteWriter out;
+        out.Put(SHARD_PROTOCOL_VERSION);
+        out.Put(shard);
+        out.Put(startTime);
+        out.Put(stopTime);
+        out.Put(stepSize);
+        out.Put(threads);
+        out.PutBlob(tleText.data(), tleText.size());
+        payload = std::move(out.data);
+    }
+
+    bool ShardJob::Decode(const std::vector<uint8_t>& payload)
+    {
+        ByteReader in(payload.data(), payload.size());
+        uint32_t version;
+        return in.Get(version) && version == SHARD_PROTOCOL_VERSION && in.Get(shard) && in.Get(startTime) &&
+               in.Get(stopTime) && in.Get(stepSize) && in.Get(threads) && in.GetBlob(tleText);
+    }
+
+    void ShardDone::Encode(std::vector<uint8_t>& payload) const
+    {
+        ByteWriter out;
+        out.Put(shard);
+        out.Put(totalSatellites);
+        out.Put((uint8_t)overallSuccess);
+        out.PutString(generalError);
+        payload = std::move(out.data);
+    }
+
+    bool ShardDone::Decode(const std::vector<uint8_t>& payload)
+    {
+        ByteReader in(payload.data(), payload.size());
+        uint8_t success;
+        if (!in.Get(shard) || !in.Get(totalSatellites) || !in.Get(success) || !in.GetString(generalError))
+            return false;
+        overallSuccess = success != 0;
+        return true;
+    }
+
+    bool SendFrame(TcpSocket& socket, ShardMessage type, const std::vector<uint8_t>& payload)
+    {
+        uint8_t header[sizeof(uint32_t) + sizeof(uint64_t)];
+        uint32_t messageType = type;
+        uint64_t size = payload.size();
+        memcpy(header, &messageType, sizeof(messageType));
+        memcpy(header + sizeof(messageType), &size, sizeof(size));
+        return socket.SendAll(header, sizeof(header)) && (size == 0 || socket.SendAll(payload.data(), payload.size()));
+    }
+
+    bool SendFrame(TcpSocket& socket, ShardMessage type, const std::string& payload)
+    {
+        return SendFrame(socket, type, std::vector<uint8_t>(payload.begin(), payload.end()));
+    }
+
+    bool ReceiveFrame(TcpSocket& socket, ShardMessage& type, std::vector<uint8_t>& payload, uint64_t maxBytes)
+    {
+        uint8_t header[sizeof(uint32_t) + sizeof(uint64_t)];
+        if (!socket.RecvAll(header, sizeof(header)))
+            return false;
+
+        uint32_t messageType;
+        uint64_t size;
+        memcpy(&messageType, header, sizeof(messageType));
+        memcpy(&size, header + sizeof(messageType), sizeof(size));
+        if (messageType < MSG_JOB || messageType > MSG_HELLO || size > maxBytes)
+            return false;
+
+        type = (ShardMessage)messageType;
+        payload.resize((size_t)size);
+        return size == 0 || socket.RecvAll(payload.data(), payload.size());
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,86 @@
+//
+// ShardProtocol.h
+// Messages between the shard coordinator and its workers
+//
+
+#ifndef SHARDPROTOCOL_H
+#define SHARDPROTOCOL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TcpSocket.h"
+
+namespace SGP_IMPL {
+
+    // Every message is a frame: uint32 type, uint64 payload size, payload. A connection opens
+    // with MSG_HELLO from the coordinator, and a worker drops it without a reply unless the
+    // hello arrives within SHARD_HELLO_SECONDS, fits in SHARD_MAX_HELLO_BYTES and carries the
+    // worker's token. A job then runs as
+    //   coordinator -> worker   MSG_JOB
+    //   worker -> coordinator   MSG_MESSAGES, one MSG_SATELLITE per satellite, MSG_DONE
+    // or MSG_FAILED in place of the results when the job couldn't run at all. A worker takes
+    // jobs one at a time until the connection closes or it gets MSG_SHUTDOWN.
+    enum ShardMessage : uint32_t
+    {
+        MSG_JOB = 1,            // ShardJob
+        MSG_MESSAGES,           // ResultStream::WriteMessages of the job's results
+        MSG_SATELLITE,          // ResultStream::WriteSatellite
+        MSG_DONE,               // ShardDone
+        MSG_FAILED,             // error text
+        MSG_SHUTDOWN,           // no payload, the worker process exits
+        MSG_HELLO               // ShardHello
+    };
+
+    const uint32_t SHARD_PROTOCOL_VERSION = 2;
+
+    // Where both sides look for the shared token when it isn't given on the command line,
+    // which other users of the host could read
+    const char* const SHARD_TOKEN_VARIABLE = "SATPROP_SHARD_TOKEN";
+
+    const int SHARD_HELLO_SECONDS = 10;
+    const uint64_t SHARD_MAX_HELLO_BYTES = 4096;
+
+    // Largest frame either side accepts, a satellite of ~4.5 million steps
+    const uint64_t SHARD_MAX_FRAME_BYTES = 1ull << 30;
+
+    struct ShardHello
+    {
+        std::string token;
+
+        void Encode(std::vector<uint8_t>& payload) const;
+        bool Decode(const std::vector<uint8_t>& payload);
+    };
+
+    struct ShardJob
+    {
+        uint32_t shard = 0;
+        double startTime = 0.0;     // as Propagator::RunOneSgp4Job takes them
+        double stopTime = 0.0;
+        double stepSize = 0.0;
+        int32_t threads = 1;
+        std::string tleText;        // the shard's part of the input file
+
+        void Encode(std::vector<uint8_t>& payload) const;
+        bool Decode(const std::vector<uint8_t>& payload);
+    };
+
+    struct ShardDone
+    {
+        uint32_t shard = 0;
+        int32_t totalSatellites = 0;
+        bool overallSuccess = false;
+        std::string generalError;
+
+        void Encode(std::vector<uint8_t>& payload) const;
+        bool Decode(const std::vector<uint8_t>& payload);
+    };
+
+    bool SendFrame(TcpSocket& socket, ShardMessage type, const std::vector<uint8_t>& payload);
+    bool SendFrame(TcpSocket& socket, ShardMessage type, const std::string& payload);
+    bool ReceiveFrame(TcpSocket& socket, ShardMessage& type, std::vector<uint8_t>& payload,
+                      uint64_t maxBytes = SHARD_MAX_FRAME_BYTES);
+
+} // SGP_IMPL
+
+#endif //SHARDPROTOCOL_H
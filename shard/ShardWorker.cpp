@@ -0,0 +1,160 @@
+//
+// ShardWorker.cpp
+// Worker process of sharded propagation: takes jobs over TCP and streams the results back
+//
+
+#include "ShardWorker.h"
+#include "ShardProtocol.h"
+#include "../Propagator.h"
+#include "../io/ResultStream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+namespace SGP_IMPL {
+
+    namespace {
+
+        // Takes as long whatever the mismatch, so the token can't be guessed a byte at a time
+        bool SameToken(const std::string& a, const std::string& b)
+        {
+            unsigned char differ = a.size() != b.size();
+            for (size_t i = 0; i < a.size(); i++)
+                differ |= (unsigned char)(a[i] ^ b[i % std::max<size_t>(b.size(), 1)]);
+            return differ == 0;
+        }
+
+        // A stranger gets nothing back, and only a short while and a small frame to try
+        bool Authenticate(TcpSocket& client, const std::string& token)
+        {
+            ShardMessage type;
+            std::vector<uint8_t> payload;
+            ShardHello hello;
+            client.SetReceiveDeadline(SHARD_HELLO_SECONDS);
+            bool accepted = ReceiveFrame(client, type, payload, SHARD_MAX_HELLO_BYTES) && type == MSG_HELLO &&
+                            hello.Decode(payload) && SameToken(hello.token, token);
+            client.SetReceiveDeadline(0);
+            return accepted;
+        }
+
+        // Runs one job and sends its results, false when the connection broke
+        bool ServeJob(TcpSocket& client, const ShardJob& job, const ShardWorkerOptions& options, int port, bool failMidway)
+        {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/satprop_shard_%d_%u.tle", options.workDir.c_str(), port, job.shard);
+
+            FILE* fp = fopen(path, "wb");
+            if (!fp || fwrite(job.tleText.data(), 1, job.tleText.size(), fp) != job.tleText.size())
+            {
+                if (fp)
+                    fclose(fp);
+                remove(path);
+                return SendFrame(client, MSG_FAILED, std::string("Can't write shard file ") + path);
+            }
+            fclose(fp);
+
+            PropagationResults results = Propagator::RunOneSgp4Job(path, job.startTime, job.stopTime, job.stepSize,
+                                                                   job.threads);
+            remove(path);
+
+            ByteWriter out;
+            ResultStream::WriteMessages(out, results.messages);
+            if (!SendFrame(client, MSG_MESSAGES, out.data))
+                return false;
+
+            for (size_t i = 0; i < results.satellites.size(); i++)
+            {
+                if (failMidway && i == results.satellites.size() / 2)
+                {
+                    fprintf(stderr, "Worker on port %d failing on purpose in shard %u\n", port, job.shard);
+                    fflush(stderr);
+                    _Exit(3);
+                }
+                out.data.clear();
+                ResultStream::WriteSatellite(out, results.satellites[i]);
+                if (!SendFrame(client, MSG_SATELLITE, out.data))
+                    return false;
+            }
+
+            ShardDone done;
+            done.shard = job.shard;
+            done.totalSatellites = results.totalSatellites;
+            done.overallSuccess = results.overallSuccess;
+            done.generalError = results.generalError;
+            std::vector<uint8_t> payload;
+            done.Encode(payload);
+            return SendFrame(client, MSG_DONE, payload);
+        }
+
+    } // namespace
+
+    int ShardWorker::Run(const ShardWorkerOptions& options)
+    {
+        // an empty token would match an empty hello from anyone
+        if (options.token.empty())
+        {
+            fprintf(stderr, "Worker has no token\n");
+            return 2;
+        }
+
+        if (!TcpSocket::Startup())
+        {
+            fprintf(stderr, "Socket startup failed\n");
+            return 1;
+        }
+
+        TcpSocket listener = TcpSocket::Listen(options.port, options.bindAddress);
+        if (!listener.IsValid())
+        {
+            fprintf(stderr, "Can't listen on %s port %d\n", options.bindAddress.c_str(), options.port);
+            TcpSocket::Cleanup();
+            return 1;
+        }
+        int port = listener.LocalPort();
+        printf("SATPROP_WORKER_PORT %d\n", port);
+        fflush(stdout);
+
+        int jobsServed = 0;
+        bool shutdown = false;
+        while (!shutdown)
+        {
+            TcpSocket client = listener.Accept();
+            if (!client.IsValid())
+                continue;
+            if (!Authenticate(client, options.token))
+            {
+                fprintf(stderr, "Worker on port %d dropped a connection without a valid hello\n", port);
+                continue;
+            }
+
+            ShardMessage type;
+            std::vector<uint8_t> payload;
+            while (ReceiveFrame(client, type, payload))
+            {
+                if (type == MSG_SHUTDOWN)
+                {
+                    shutdown = true;
+                    break;
+                }
+
+                ShardJob job;
+                if (type != MSG_JOB || !job.Decode(payload))
+                {
+                    SendFrame(client, MSG_FAILED, std::string("Malformed job"));
+                    break;
+                }
+
+                bool failMidway = options.failAfter >= 0 && jobsServed == options.failAfter;
+                if (!ServeJob(client, job, options, port, failMidway))
+                    break;
+                jobsServed++;
+            }
+        }
+
+        listener.Close();
+        TcpSocket::Cleanup();
+        return 0;
+    }
+
+} // SGP_IMPL
@@ -0,0 +1,39 @@
+//
+// ShardWorker.h
+// Worker process of sharded propagation: takes jobs over TCP and streams the results back
+//
+
+#ifndef SHARDWORKER_H
+#define SHARDWORKER_H
+
+#include <string>
+
+namespace SGP_IMPL {
+
+    struct ShardWorkerOptions
+    {
+        int port = 0;                   // 0 picks a free port
+        std::string bindAddress = "127.0.0.1";  // "0.0.0.0" to take jobs from other hosts
+        std::string token;              // a coordinator's MSG_HELLO must carry the same, required
+        std::string workDir = ".";      // shard TLE files are written here while a job runs
+        int failAfter = -1;             // testing: exit without a word partway through job N + 1
+    };
+
+    // AstroStd keeps its satellites in process wide tables, so one worker process runs one
+    // job at a time and parallelism comes from running several processes. The worker prints
+    // "SATPROP_WORKER_PORT <port>" once it listens, which is how a coordinator that launched
+    // it finds the port. Connections are served one after another until MSG_SHUTDOWN.
+    //
+    // The token is the only check on who connects and the traffic is not encrypted, so a
+    // worker bound past loopback belongs on a trusted network with a token nobody else knows:
+    // whoever has it can run jobs on the host and shut the worker down.
+    class ShardWorker
+    {
+    public:
+        // The AstroStd DLLs must be loaded. Returns the process exit code.
+        static int Run(const ShardWorkerOptions& options);
+    };
+
+} // SGP_IMPL
+
+#endif //SHARDWORKER_H
@@ -0,0 +1,247 @@
+//
+// TcpSocket.cpp
+// Blocking TCP connections for the shard coordinator and its workers, Winsock or BSD sockets
+//
+
+#include "TcpSocket.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace SGP_IMPL {
+
+    namespace {
+
+#ifdef _WIN32
+        typedef SOCKET NativeSocket;
+        const NativeSocket NO_SOCKET = INVALID_SOCKET;
+
+        void CloseNative(NativeSocket s) { closesocket(s); }
+#else
+        typedef int NativeSocket;
+        const NativeSocket NO_SOCKET = -1;
+
+        void CloseNative(NativeSocket s) { close(s); }
+#endif
+
+        NativeSocket Native(intptr_t handle) { return (NativeSocket)handle; }
+
+        // frames are written header first, so don't let Nagle hold the header back
+        void SetNoDelay(NativeSocket s)
+        {
+            int on = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+        }
+
+    } // namespace
+
+    TcpSocket::~TcpSocket()
+    {
+        Close();
+    }
+
+    TcpSocket::TcpSocket(TcpSocket&& other) noexcept
+        : m_handle(other.m_handle), m_deadline(other.m_deadline), m_hasDeadline(other.m_hasDeadline)
+    {
+        other.m_handle = -1;
+    }
+
+    TcpSocket& TcpSocket::operator=(TcpSocket&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            m_handle = other.m_handle;
+            m_deadline = other.m_deadline;
+            m_hasDeadline = other.m_hasDeadline;
+            other.m_handle = -1;
+        }
+        return *this;
+    }
+
+    bool TcpSocket::Startup()
+    {
+#ifdef _WIN32
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+        // a worker that dies mid send must show up as a failed send, not kill the coordinator
+        signal(SIGPIPE, SIG_IGN);
+        return true;
+#endif
+    }
+
+    void TcpSocket::Cleanup()
+    {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    TcpSocket TcpSocket::Listen(int port, const std::string& address)
+    {
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_port = htons((uint16_t)port);
+        if (inet_pton(AF_INET, address.c_str(), &local.sin_addr) != 1)
+            return TcpSocket();
+
+        NativeSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == NO_SOCKET)
+            return TcpSocket();
+
+        int on = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+
+        if (bind(s, (sockaddr*)&local, sizeof(local)) != 0 || listen(s, 8) != 0)
+        {
+            CloseNative(s);
+            return TcpSocket();
+        }
+        return TcpSocket((intptr_t)s);
+    }
+
+    TcpSocket TcpSocket::Connect(const std::string& host, int port)
+    {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+
+        char service[16];
+        snprintf(service, sizeof(service), "%d", port);
+
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.c_str(), service, &hints, &found) != 0)
+            return TcpSocket();
+
+        NativeSocket s = NO_SOCKET;
+        for (addrinfo* candidate = found; candidate; candidate = candidate->ai_next)
+        {
+            s = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+            if (s == NO_SOCKET)
+                continue;
+            if (connect(s, candidate->ai_addr, (socklen_t)candidate->ai_addrlen) == 0)
+                break;
+            CloseNative(s);
+            s = NO_SOCKET;
+        }
+        freeaddrinfo(found);
+
+        if (s == NO_SOCKET)
+            return TcpSocket();
+        SetNoDelay(s);
+        return TcpSocket((intptr_t)s);
+    }
+
+    TcpSocket TcpSocket::Accept()
+    {
+        NativeSocket s = accept(Native(m_handle), nullptr, nullptr);
+        if (s == NO_SOCKET)
+            return TcpSocket();
+        SetNoDelay(s);
+        return TcpSocket((intptr_t)s);
+    }
+
+    bool TcpSocket::IsValid() const
+    {
+        return m_handle != -1 && Native(m_handle) != NO_SOCKET;
+    }
+
+    int TcpSocket::LocalPort() const
+    {
+        sockaddr_in address = {};
+        socklen_t length = sizeof(address);
+        if (getsockname(Native(m_handle), (sockaddr*)&address, &length) != 0)
+            return 0;
+        return ntohs(address.sin_port);
+    }
+
+    bool TcpSocket::SendAll(const void* data, size_t size)
+    {
+        const char* bytes = (const char*)data;
+        while (size > 0)
+        {
+            int chunk = (int)std::min<size_t>(size, 1 << 20);
+            int sent = (int)send(Native(m_handle), bytes, chunk, 0);
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    bool TcpSocket::RecvAll(void* data, size_t size)
+    {
+        char* bytes = (char*)data;
+        while (size > 0)
+        {
+            if (m_hasDeadline)
+            {
+                auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+                    m_deadline - std::chrono::steady_clock::now()).count();
+                if (left <= 0)
+                    return false;
+
+                fd_set readable;
+                FD_ZERO(&readable);
+                FD_SET(Native(m_handle), &readable);
+                timeval wait = {};
+                wait.tv_sec = (long)(left / 1000000);
+                wait.tv_usec = (long)(left % 1000000);
+                if (select((int)Native(m_handle) + 1, &readable, nullptr, nullptr, &wait) <= 0)
+                    return false;
+            }
+
+            int chunk = (int)std::min<size_t>(size, 1 << 20);
+            int received = (int)recv(Native(m_handle), bytes, chunk, 0);
+            if (received <= 0)
+                return false;
+            bytes += received;
+            size -= received;
+        }
+        return true;
+    }
+
+    void TcpSocket::SetReceiveTimeout(int seconds)
+    {
+#ifdef _WIN32
+        DWORD timeout = (DWORD)seconds * 1000;
+#else
+        timeval timeout = {};
+        timeout.tv_sec = seconds;
+#endif
+        setsockopt(Native(m_handle), SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    }
+
+    void TcpSocket::SetReceiveDeadline(int seconds)
+    {
+        m_hasDeadline = seconds > 0;
+        m_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    }
+
+    void TcpSocket::Close()
+    {
+        if (IsValid())
+            CloseNative(Native(m_handle));
+        m_handle = -1;
+    }
+
+} // SGP_IMPL
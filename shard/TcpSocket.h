@@ -0,0 +1,65 @@
+//
+// TcpSocket.h
+// Blocking TCP connections for the shard coordinator and its workers, Winsock or BSD sockets
+//
+
+#ifndef TCPSOCKET_H
+#define TCPSOCKET_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace SGP_IMPL {
+
+    class TcpSocket
+    {
+    public:
+        TcpSocket() = default;
+        ~TcpSocket();
+
+        TcpSocket(TcpSocket&& other) noexcept;
+        TcpSocket& operator=(TcpSocket&& other) noexcept;
+        TcpSocket(const TcpSocket&) = delete;
+        TcpSocket& operator=(const TcpSocket&) = delete;
+
+        // Once per process before any socket, Winsock needs it
+        static bool Startup();
+        static void Cleanup();
+
+        // Listening socket on the IPv4 address, "0.0.0.0" for all interfaces; port 0 picks a
+        // free one (see LocalPort)
+        static TcpSocket Listen(int port, const std::string& address = "127.0.0.1");
+        static TcpSocket Connect(const std::string& host, int port);
+
+        // Blocks until a client connects, invalid on error
+        TcpSocket Accept();
+
+        bool IsValid() const;
+        int LocalPort() const;
+
+        // Send and receive fail once the socket is closed, broken or times out
+        bool SendAll(const void* data, size_t size);
+        bool RecvAll(void* data, size_t size);
+
+        // Applies to every later receive, 0 waits forever
+        void SetReceiveTimeout(int seconds);
+
+        // Receives fail once this many seconds from now have passed, however the bytes
+        // trickle in; 0 lifts it
+        void SetReceiveDeadline(int seconds);
+
+        void Close();
+
+    private:
+        explicit TcpSocket(intptr_t handle) : m_handle(handle) {}
+
+        intptr_t m_handle = -1;
+        std::chrono::steady_clock::time_point m_deadline;
+        bool m_hasDeadline = false;
+    };
+
+} // SGP_IMPL
+
+#endif //TCPSOCKET_H